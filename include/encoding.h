@@ -24,5 +24,9 @@
 
 char *gg_encoding_convert(const char *src, gg_encoding_t src_encoding,
 	gg_encoding_t dst_encoding, int src_length, int dst_length);
+int gg_encoding_convert_buf(const char *src, gg_encoding_t src_encoding,
+	gg_encoding_t dst_encoding, int src_length, char *dst, size_t dst_size);
+size_t gg_encoding_convert_max(gg_encoding_t src_encoding,
+	gg_encoding_t dst_encoding, size_t src_length);
 
 #endif /* LIBGADU_SESSION_H */
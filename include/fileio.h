@@ -66,4 +66,41 @@
 #  define S_IWUSR S_IWRITE
 #endif
 
+#ifndef S_IRUSR
+#  define S_IRUSR S_IREAD
+#endif
+
+#ifndef O_BINARY
+#  define O_BINARY 0
+#endif
+
+/**
+ * \internal Domyślna maksymalna liczba bajtów przesyłanych jednym wywołaniem
+ * systemowym przez \c gg_file_send() i \c gg_file_recv().
+ */
+#define GG_FILE_CHUNK_SIZE 65536
+
+/**
+ * \internal Wynik przesyłania danych między plikiem a gniazdem.
+ */
+typedef enum {
+	GG_FILE_TRANSFER_OK = 0,	/**< Przesłano wszystko lub gniazdo nie jest gotowe */
+	GG_FILE_TRANSFER_ERROR_FILE,	/**< Błąd operacji na pliku */
+	GG_FILE_TRANSFER_ERROR_NET,	/**< Błąd operacji na gnieździe */
+	GG_FILE_TRANSFER_EOF		/**< Nieoczekiwany koniec pliku lub połączenia */
+} gg_file_transfer_t;
+
+/**
+ * \internal Potok używany przez \c gg_file_recv() do przenoszenia danych
+ * funkcją \c splice(), utrzymywany przez cały czas odbierania pliku.
+ */
+typedef struct gg_file_pipe gg_file_pipe_t;
+
+gg_file_transfer_t gg_file_send(int sock, int fd, int seek, off_t offset,
+	size_t count, size_t chunk, size_t *done);
+gg_file_transfer_t gg_file_recv(int sock, int fd, size_t count, size_t chunk,
+	size_t *done, gg_file_pipe_t **pipe_ptr);
+void gg_file_pipe_free(gg_file_pipe_t *fp);
+void gg_file_advise_sequential(int fd);
+
 #endif /* LIBGADU_FILEIO_H */
@@ -92,8 +92,61 @@
 	[(condition) ? 1 : -1]; static_assertion_failed_ ## message dummy; \
 	(void)dummy; }
 
+/* Początkowa i minimalna liczba niepotwierdzonych fragmentów obrazka */
 #define GG_IMGOUT_WAITING_MAX 4
 
+/* Maksymalna liczba niepotwierdzonych fragmentów obrazka */
+#define GG_IMGOUT_WINDOW_MAX 64
+
+/* Tolerancja czasu potwierdzenia fragmentu obrazka w milisekundach */
+#define GG_IMGOUT_LATENCY_SLACK 20
+
+/* Rozmiar treści pakietu z fragmentem obrazka, bez nagłówka wiadomości */
+#define GG_IMGOUT_CHUNK_SIZE 1910
+
+/* Maksymalna liczba struktur zdarzeń i elementów kolejki zdarzeń
+ * przechowywanych do ponownego użycia */
+#define GG_EVENT_POOL_SIZE 16
+
+/* Rozmiar bufora cyklicznego na odbierane pakiety */
+#define GG_RECV_RING_SIZE 16384
+
+/* Maksymalna liczba fragmentów pakietu wysyłanych bez sklejania */
+#define GG_SEND_IOV_MAX 16
+
+/* Rozmiar bufora na stosie, w którym są sklejane fragmenty pakietu dla TLS */
+#define GG_SEND_COALESCE_SIZE 4096
+
+/* Minimalny rozmiar fragmentu kolejki danych do wysłania */
+#define GG_SEND_CHUNK_SIZE 4096
+
+/* Maksymalna liczba wysłanych fragmentów zachowanych do ponownego użycia */
+#define GG_SEND_SPARE_MAX 4
+
+/* Liczba kubełków tablicy wiadomości oczekujących na potwierdzenie */
+#define GG_SENT_MESSAGES_BUCKETS 256
+
+/* Maksymalna liczba wiadomości oczekujących na potwierdzenie */
+#define GG_SENT_MESSAGES_MAX 4096
+
+/* Czas w milisekundach, po którym niepotwierdzona wiadomość jest zapominana */
+#define GG_SENT_MESSAGES_TIMEOUT (15 * 60 * 1000)
+
+/* Maksymalna liczba wpisów wiadomości zachowanych do ponownego użycia */
+#define GG_SENT_MESSAGES_POOL_SIZE 32
+
+/* Domyślny limit pamięci na odbierane obrazki */
+#define GG_IMAGE_QUEUE_LIMIT (16 * 1024 * 1024)
+
+/* Czas w milisekundach, po którym nieaktywny odbierany obrazek jest usuwany */
+#define GG_IMAGE_QUEUE_TIMEOUT (2 * 60 * 1000)
+
+/* Minimalny przyrost bufora odbieranego obrazka */
+#define GG_IMAGE_QUEUE_CHUNK 4096
+
+/* Domyślny limit pamięci na obrazki w pamięci podręcznej */
+#define GG_IMAGE_CACHE_LIMIT (16 * 1024 * 1024)
+
 struct gg_dcc7_relay {
 	uint32_t addr;
 	uint16_t port;
@@ -105,18 +158,23 @@ struct _gg_chat_list {
 	uint64_t id;
 	uint32_t version;
 	uint32_t participants_count;
-	uin_t *participants;
+	uint32_t participants_size;
+	uin_t *participants;	/* posortowana według numerów */
 
-	gg_chat_list_t *next;
+	gg_chat_list_t *next;	/* następna konferencja w kubełku */
 };
 
 typedef struct _gg_msg_list gg_msg_list_t;
 struct _gg_msg_list {
 	int seq;
+	uint64_t sent;		/* czas wysłania w milisekundach */
 	uin_t *recipients;
 	size_t recipients_count;
+	size_t recipients_size;
 
-	gg_msg_list_t *next;
+	gg_msg_list_t *next;	/* następna wiadomość w kubełku lub puli */
+	gg_msg_list_t *older;
+	gg_msg_list_t *newer;
 };
 
 typedef struct _gg_eventqueue gg_eventqueue_t;
@@ -126,27 +184,132 @@ struct _gg_eventqueue {
 	gg_eventqueue_t *next;
 };
 
+struct gg_image_buffer {
+	char *data;
+	uint32_t size;
+	uint32_t crc32;
+	int refcount;
+	void (*destroy)(char *data);
+};
+
+/* Obrazek do wysłania. Fragmenty są wysyłane wprost z bufora obrazka. */
 typedef struct _gg_imgout_queue_t gg_imgout_queue_t;
 struct _gg_imgout_queue_t {
 	struct gg_send_msg msg_hdr;
-	char buf[1910];
-	size_t buf_len;
+	struct gg_image_buffer *image;
+	char *filename;
+	uint32_t offset;	/* liczba wysłanych bajtów obrazka */
 
 	gg_imgout_queue_t *next;
 };
 
+/* Bufor cykliczny na dane odbierane od serwera. Pakiety mieszczące się
+ * w buforze w jednym kawałku są przekazywane bez kopiowania, pozostałe
+ * są składane w osobnym buforze pomocniczym. */
+typedef struct {
+	char *buf;		/* dane (size + 1 bajtów, miejsce na znak '\0') */
+	size_t size;		/* pojemność bufora */
+	size_t start;		/* początek niewczytanych danych */
+	size_t len;		/* liczba niewczytanych bajtów */
+
+	char *frame;		/* bufor pomocniczy na pakiet */
+	size_t frame_size;	/* rozmiar bufora pomocniczego */
+	size_t frame_total;	/* długość składanego pakietu z nagłówkiem */
+	size_t frame_done;	/* liczba bajtów złożonego pakietu */
+
+	int held;		/* flaga przekazania pakietu do obsługi */
+	size_t consume;		/* liczba bajtów do zwolnienia po obsłudze */
+	char *term;		/* położenie znaku '\0' za pakietem */
+	char term_saved;	/* bajt nadpisany przez znak '\0' */
+} gg_recv_ring_t;
+
+/* Fragment kolejki danych do wysłania. Dane są dopisywane na koniec
+ * ostatniego fragmentu, a wysyłane od początku pierwszego. */
+typedef struct _gg_send_chunk gg_send_chunk_t;
+struct _gg_send_chunk {
+	char *buf;		/* dane (zaraz za strukturą) */
+	size_t size;		/* pojemność fragmentu */
+	size_t start;		/* początek niewysłanych danych */
+	size_t end;		/* koniec zapisanych danych */
+
+	gg_send_chunk_t *next;
+};
+
+/* Lista statusów kontaktów, tablica z adresowaniem otwartym. Wolne pozycje
+ * mają numer 0. */
+typedef struct {
+	struct gg_roster_contact *entries;
+	unsigned int size;		/* liczba pozycji, potęga dwójki */
+	unsigned int count;		/* liczba zajętych pozycji */
+} gg_roster_t;
+
+/* Odbierany obrazek. Struktura publiczna musi być pierwszym polem, bo
+ * wskaźniki na nią są zwalniane przez gg_image_queue_remove(). */
+typedef struct gg_image_entry gg_image_entry_t;
+struct gg_image_entry {
+	struct gg_image_queue queue;	/* pole next wskazuje nowszy obrazek */
+	gg_image_entry_t *older;
+	gg_image_entry_t *hash_next;
+	uint32_t allocated;		/* rozmiar bufora queue.image */
+	uint64_t activity;		/* czas ostatniej aktywności w ms */
+};
+
+/* Indeks odbieranych obrazków. Lista sesji images zawiera je od
+ * najdawniej aktywnego. */
+typedef struct {
+	gg_image_entry_t **table;
+	unsigned int size;		/* liczba kubełków, potęga dwójki */
+	unsigned int count;
+	gg_image_entry_t *newest;
+	size_t memory;			/* suma rozmiarów buforów */
+	size_t limit;			/* 0 oznacza domyślny limit */
+	unsigned int completed;
+	unsigned int evicted;
+	unsigned int expired;
+} gg_image_index_t;
+
+/* Kontakt z listy wysłanej przez gg_notify_sync(). */
+typedef struct {
+	uin_t uin;
+	char type;
+} gg_notify_entry_t;
+
+/* Obiekt zarejestrowany w pętli zdarzeń gg_loop, zdefiniowany w loop.c. */
+struct gg_loop_item;
+
+/* Bufor budowanego pakietu, zdefiniowany w tvbuilder.c. */
+struct gg_tvbuilder;
+
 struct gg_session_private {
 	gg_compat_t compatibility;
 
-	gg_chat_list_t *chat_list;
-	gg_msg_list_t *sent_messages;
+	gg_chat_list_t **chat_table;
+	unsigned int chat_table_size;
+	unsigned int chat_count;
+	gg_msg_list_t **sent_messages;	/* kubełki według numeru sekwencyjnego */
+	gg_msg_list_t *sent_oldest;
+	gg_msg_list_t *sent_newest;
+	unsigned int sent_count;
+	gg_msg_list_t *sent_pool;
+	int sent_pool_count;
 
 	gg_eventqueue_t *event_queue;
+	gg_eventqueue_t *event_queue_tail;
+	gg_eventqueue_t *event_queue_pool;
+	int event_queue_pool_count;
+	struct gg_event *event_pool[GG_EVENT_POOL_SIZE];
+	int event_pool_count;
 	int check_after_queue;
 	int fd_after_queue;
+	int fd_is_dummy;
 
 	gg_imgout_queue_t *imgout_queue;
+	gg_imgout_queue_t *imgout_queue_tail;
 	int imgout_waiting_ack;
+	int imgout_window;		/* 0 oznacza GG_IMGOUT_WAITING_MAX */
+	int imgout_latency_min;		/* w ms, co najmniej 1, 0 jeśli nieznany */
+	uint64_t imgout_sent[GG_IMGOUT_WINDOW_MAX];	/* czasy wysłania */
+	int imgout_sent_first;
 
 	gg_socket_manager_type_t socket_manager_type;
 	gg_socket_manager_t socket_manager;
@@ -161,6 +324,32 @@ struct gg_session_private {
 	int dummyfds[2];
 
 	char **host_white_list;
+
+	gg_recv_ring_t recv_ring;
+	int recv_batch;
+
+	gg_send_chunk_t *send_head;
+	gg_send_chunk_t *send_tail;
+	gg_send_chunk_t *send_spare;
+	int send_spare_count;
+	gg_send_chunk_t *send_reserved;
+	int send_queue_limit;
+
+	struct gg_tvbuilder *tvbuilder_pool;
+	int tvbuilder_pool_count;
+
+	struct gg_loop_item *loop_item;
+
+	struct gg_protobuf_arena *protobuf_arena;
+
+	int roster_enabled;
+	gg_roster_t roster;
+
+	gg_image_index_t image_index;
+
+	gg_notify_entry_t *notify_list;	/* posortowana według numerów */
+	unsigned int notify_count;
+	int notify_list_valid;
 };
 
 typedef enum
@@ -188,10 +377,42 @@ int gg_login_hash_sha1_2(const char *password, uint32_t seed, uint8_t *result);
 int gg_chat_update(struct gg_session *sess, uint64_t id, uint32_t version,
 	const uin_t *participants, unsigned int participants_count);
 gg_chat_list_t *gg_chat_find(struct gg_session *sess, uint64_t id);
+int gg_chat_participant_add(gg_chat_list_t *chat, uin_t uin);
+int gg_chat_participant_remove(gg_chat_list_t *chat, uin_t uin);
+void gg_chat_free(struct gg_session *sess);
 
 uin_t gg_str_to_uin(const char *str, int len);
 
+int gg_roster_update(struct gg_session *gs, struct gg_event *ge,
+	struct gg_roster_contact *contact);
+void gg_roster_remove(struct gg_session *gs, uin_t uin);
+void gg_roster_free(struct gg_session *gs);
+
+struct gg_image_queue *gg_image_queue_add(struct gg_session *sess,
+	uin_t sender, uint32_t size, uint32_t crc32);
+struct gg_image_queue *gg_image_queue_find(struct gg_session *sess,
+	uin_t sender, uint32_t size, uint32_t crc32);
+int gg_image_queue_reserve(struct gg_session *sess, struct gg_image_queue *q,
+	uint32_t length);
+void gg_image_queue_unlink(struct gg_session *sess, struct gg_image_queue *q);
+void gg_image_queue_complete(struct gg_session *sess, struct gg_image_queue *q);
+size_t gg_image_queue_limit(struct gg_session *sess);
+void gg_image_queue_free(struct gg_session *sess);
+
+struct gg_image_buffer *gg_image_buffer_alloc(char *data, uint32_t size,
+	uint32_t crc32, void (*destroy)(char *data));
+int gg_image_cache_reply(struct gg_session *sess, uin_t recipient,
+	uint32_t size, uint32_t crc32);
+
 uint64_t gg_fix64(uint64_t x);
+
+uint32_t gg_crc32_sliced(uint32_t crc, const unsigned char *buf, size_t len);
+int gg_crc32_hw_available(void);
+uint32_t gg_crc32_hw(uint32_t crc, const unsigned char *buf, size_t len);
+
+void gg_loop_item_remove(struct gg_loop_item *item);
+void gg_loop_item_close_fd(struct gg_loop_item *item);
+
 void gg_connection_failure(struct gg_session *gs, struct gg_event *ge,
 	enum gg_failure_t failure);
 
@@ -200,11 +421,33 @@ time_t gg_server_time(struct gg_session *gs);
 int gg_session_init_ssl(struct gg_session *gs);
 void gg_close(struct gg_session *gs);
 
+int gg_send_queue_flush(struct gg_session *gs);
+void gg_send_queue_free(struct gg_session *gs);
+
+gg_send_chunk_t *gg_send_chunk_new(struct gg_session *gs, size_t size);
+gg_send_chunk_t *gg_send_chunk_resize(gg_send_chunk_t *chunk, size_t size);
+void gg_send_chunk_free(struct gg_session *gs, gg_send_chunk_t *chunk);
+
+void *gg_send_packet_reserve(struct gg_session *gs, size_t length);
+int gg_send_packet_commit(struct gg_session *gs, int type, size_t length);
+int gg_send_packet_chunk(struct gg_session *gs, int type,
+	gg_send_chunk_t *chunk, size_t length);
+
+const char *gg_recv_frame(struct gg_session *gs, uint32_t *type, uint32_t *length);
+void gg_recv_frame_release(struct gg_session *gs);
+int gg_recv_frame_pending(struct gg_session *gs);
+
 struct gg_event *gg_eventqueue_add(struct gg_session *sess);
+void gg_eventqueue_clear(struct gg_session *sess);
+struct gg_event *gg_event_new(struct gg_session *sess);
+void gg_event_pool_free(struct gg_session *sess);
+void gg_watch_fd_restore(struct gg_session *sess);
 
-void gg_compat_message_ack(struct gg_session *sess, int seq);
+int gg_sent_message_ack(struct gg_session *sess, int seq);
 
 void gg_image_sendout(struct gg_session *sess);
+void gg_image_sendout_ack(struct gg_session *sess);
+void gg_image_sendout_clear(struct gg_session *sess);
 
 void gg_strarr_free(char **strarr);
 char ** gg_strarr_dup(char **strarr);
@@ -75,6 +75,13 @@ int gg_win32_setsockopt(int sockfd, int level, int optname, const void *optval,
 int gg_win32_socket(int domain, int type, int protocol);
 int gg_win32_socketpair(int sv[2]);
 
+/* Win32 nie zna funkcji sendmsg(), ale struktura iovec służy też do opisu
+ * fragmentów pakietów, które są wtedy sklejane przed wysłaniem. */
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
 static inline void gg_win32_init_network(void)
 {
 	WSADATA wsaData;
@@ -89,6 +96,7 @@ static inline void gg_win32_init_network(void)
 #  include <sys/ioctl.h>
 #  include <sys/types.h>
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <netinet/in.h>
 #  include <arpa/inet.h>
 #  include <netdb.h>
@@ -0,0 +1,35 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+#ifndef LIBGADU_PROTOBUF_FAST_H
+#define LIBGADU_PROTOBUF_FAST_H
+
+#include "protobuf.h"
+#include "packets.pb-c.h"
+
+GG110RecvMessage *gg_protobuf_unpack_recv_message(ProtobufCAllocator *allocator,
+	size_t len, const uint8_t *data);
+GG110MessageAck *gg_protobuf_unpack_message_ack(ProtobufCAllocator *allocator,
+	size_t len, const uint8_t *data);
+GG110Pong *gg_protobuf_unpack_pong(ProtobufCAllocator *allocator,
+	size_t len, const uint8_t *data);
+
+size_t gg_protobuf_ack_size(const GG110Ack *msg);
+size_t gg_protobuf_ack_pack(const GG110Ack *msg, uint8_t *out);
+
+#endif /* LIBGADU_PROTOBUF_FAST_H */
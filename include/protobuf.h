@@ -45,6 +45,10 @@ typedef struct _gg_protobuf_uin_buff gg_protobuf_uin_buff_t;
 	gg_protobuf_valid_chkunknown(gs, name, &msg->base) && \
 	msg != NULL)
 
+/* Zwalnia wiadomość rozpakowaną z alokatorem gg_protobuf_arena(). */
+#define GG_PROTOBUF_FREE(gs, msg) \
+	gg_protobuf_free(gs, (ProtobufCMessage*) (msg))
+
 #define GG_PROTOBUF_SEND(gs, ge, packet_type, msg_type, msg) \
 	gg_protobuf_send_ex(gs, ge, packet_type, &msg, \
 		(gg_protobuf_size_cb_t) msg_type ## __get_packed_size, \
@@ -62,6 +66,11 @@ int gg_protobuf_send_ex(struct gg_session *gs, struct gg_event *ge, int type,
 	void *msg, gg_protobuf_size_cb_t size_cb,
 	gg_protobuf_pack_cb_t pack_cb);
 
+ProtobufCAllocator *gg_protobuf_arena(struct gg_session *gs);
+void gg_protobuf_arena_reset(struct gg_session *gs);
+void gg_protobuf_arena_destroy(struct gg_session *gs);
+void gg_protobuf_free(struct gg_session *gs, ProtobufCMessage *msg);
+
 void gg_protobuf_set_uin(ProtobufCBinaryData *dst, uin_t uin, gg_protobuf_uin_buff_t *buff);
 uin_t gg_protobuf_get_uin(ProtobufCBinaryData uin_data);
 
@@ -0,0 +1,97 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/**
+ * \file timer.h
+ *
+ * \brief Hierarchiczne koło liczników czasu
+ */
+
+#ifndef LIBGADU_TIMER_H
+#define LIBGADU_TIMER_H
+
+#include "libgadu.h"
+
+/**
+ * \internal Liczba bitów czasu obsługiwanych przez jeden poziom koła.
+ */
+#define GG_TIMER_BITS 6
+
+/**
+ * \internal Liczba pozycji na jednym poziomie koła.
+ */
+#define GG_TIMER_SLOTS (1 << GG_TIMER_BITS)
+
+/**
+ * \internal Liczba poziomów koła. Przy rozdzielczości jednej milisekundy
+ * koło obejmuje 2^30 ms, czyli ponad 12 dni. Liczniki ustawione na później
+ * są przenoszone na właściwą pozycję przy kolejnych obrotach koła.
+ */
+#define GG_TIMER_LEVELS 5
+
+/**
+ * \internal Brak zaplanowanych liczników.
+ */
+#define GG_TIMER_NEVER ((uint64_t) -1)
+
+typedef struct gg_timer gg_timer_t;
+
+/**
+ * \internal Funkcja wywoływana po upływie czasu licznika.
+ */
+typedef void (*gg_timer_handler_t)(gg_timer_t *timer, void *data);
+
+/**
+ * \internal Licznik czasu. Struktura jest zwykle częścią obiektu, którego
+ * dotyczy, więc ustawienie i odwołanie licznika nie przydziela pamięci.
+ */
+struct gg_timer {
+	gg_timer_t *next;		/**< Następny licznik na pozycji koła */
+	gg_timer_t *prev;		/**< Poprzedni licznik na pozycji koła */
+	uint64_t expires;		/**< Czas upływu w milisekundach */
+	int level;			/**< Poziom koła lub -1 jeśli nieaktywny */
+	int slot;			/**< Pozycja na poziomie koła */
+	gg_timer_handler_t handler;	/**< Funkcja obsługi */
+	void *data;			/**< Dane funkcji obsługi */
+};
+
+/**
+ * \internal Koło liczników czasu.
+ *
+ * Każda pozycja jest cykliczną listą dwukierunkową z wartownikiem, więc
+ * ustawienie i odwołanie licznika zajmuje stały czas. Mapa bitowa
+ * niepustych pozycji pozwala szybko wyznaczyć czas najbliższego licznika.
+ */
+typedef struct {
+	uint64_t now;			/**< Najbliższa nieobsłużona milisekunda */
+	unsigned int count;		/**< Liczba aktywnych liczników */
+	uint64_t bitmap[GG_TIMER_LEVELS];	/**< Mapy niepustych pozycji */
+	gg_timer_t slots[GG_TIMER_LEVELS][GG_TIMER_SLOTS];	/**< Wartownicy list */
+} gg_timer_wheel_t;
+
+uint64_t gg_timer_clock(void);
+
+void gg_timer_wheel_init(gg_timer_wheel_t *wheel, uint64_t now);
+void gg_timer_init(gg_timer_t *timer, gg_timer_handler_t handler, void *data);
+void gg_timer_arm(gg_timer_wheel_t *wheel, gg_timer_t *timer, uint64_t expires);
+void gg_timer_cancel(gg_timer_wheel_t *wheel, gg_timer_t *timer);
+int gg_timer_is_armed(const gg_timer_t *timer);
+void gg_timer_run(gg_timer_wheel_t *wheel, uint64_t now);
+uint64_t gg_timer_next(const gg_timer_wheel_t *wheel);
+
+#endif /* LIBGADU_TIMER_H */
@@ -50,6 +50,11 @@ void gg_tvbuff_read_str_dup(gg_tvbuff_t *tvb, char **dst);
 
 uin_t gg_tvbuff_read_uin(gg_tvbuff_t *tvb);
 
+void gg_tvbuff_read_uint32_array(gg_tvbuff_t *tvb, uint32_t *dst, size_t count);
+void gg_tvbuff_read_uint32_strided(gg_tvbuff_t *tvb, uint32_t *dst,
+	size_t count, size_t stride);
+void gg_tvbuff_read_uin_array(gg_tvbuff_t *tvb, uin_t *dst, size_t count);
+
 void gg_tvbuff_expected_uint8(gg_tvbuff_t *tvb, uint8_t value);
 void gg_tvbuff_expected_uint32(gg_tvbuff_t *tvb, uint32_t value);
 void gg_tvbuff_expected_eob(const gg_tvbuff_t *tvb);
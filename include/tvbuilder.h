@@ -27,6 +27,7 @@ gg_tvbuilder_t * gg_tvbuilder_new(struct gg_session *gs, struct gg_event *ge);
 void gg_tvbuilder_free(gg_tvbuilder_t *tvb);
 void gg_tvbuilder_fail(gg_tvbuilder_t *tvb, enum gg_failure_t failure);
 int gg_tvbuilder_send(gg_tvbuilder_t *tvb, int type);
+void gg_tvbuilder_pool_free(struct gg_session *gs);
 
 int gg_tvbuilder_is_valid(const gg_tvbuilder_t *tvb);
 
@@ -33,6 +33,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "debug.h"
 
@@ -554,6 +555,266 @@ int gg_dcc_voice_send(struct gg_dcc *d, char *buf, int length)
 	} \
 }
 
+/**
+ * \internal Uaktualnia liczniki przesyłania pliku.
+ *
+ * \param h Struktura połączenia
+ * \param len Liczba przesłanych bajtów
+ */
+static void gg_dcc_transfer_update(struct gg_dcc *h, size_t len)
+{
+	time_t elapsed;
+
+	h->transfer_bytes += len;
+
+	elapsed = time(NULL) - h->transfer_start;
+
+	h->transfer_rate = h->transfer_bytes / ((elapsed > 0) ? elapsed : 1);
+}
+
+/**
+ * \internal Zamienia wynik przesyłania pliku na kod błędu połączenia.
+ *
+ * \param res Wynik funkcji \c gg_file_send() lub \c gg_file_recv()
+ *
+ * \return Kod błędu zdarzenia \c GG_EVENT_DCC_ERROR
+ */
+static int gg_dcc_file_error(gg_file_transfer_t res)
+{
+	switch (res) {
+		case GG_FILE_TRANSFER_ERROR_FILE:
+			return GG_ERROR_DCC_FILE;
+		case GG_FILE_TRANSFER_EOF:
+			return GG_ERROR_DCC_EOF;
+		default:
+			return GG_ERROR_DCC_NET;
+	}
+}
+
+/**
+ * \internal Przygotowuje nagłówek kolejnego kawałka wysyłanego pliku.
+ *
+ * \param h Struktura połączenia
+ * \param p Pakiet do wypełnienia
+ */
+static void gg_dcc_file_header_fill(struct gg_dcc *h, struct gg_dcc_big_packet *p)
+{
+	h->chunk_offset = 0;
+
+	if ((h->chunk_size = h->file_info.size - h->offset) > 4096) {
+		h->chunk_size = 4096;
+		p->type = gg_fix32(0x0003);  /* XXX */
+	} else
+		p->type = gg_fix32(0x0002);  /* XXX */
+
+	p->dunno1 = gg_fix32(h->chunk_size);
+	p->dunno2 = 0;
+}
+
+/**
+ * \internal Analizuje nagłówek kolejnego kawałka odbieranego pliku.
+ *
+ * \param h Struktura połączenia
+ * \param p Odebrany pakiet
+ * \param e Struktura zdarzenia
+ *
+ * \return 0 jeśli można odbierać dane, -1 jeśli ustawiono zdarzenie
+ */
+static int gg_dcc_file_header_parse(struct gg_dcc *h, const struct gg_dcc_big_packet *p, struct gg_event *e)
+{
+	h->chunk_size = gg_fix32(p->dunno1);
+	h->chunk_offset = 0;
+
+	if (gg_fix32(p->type) == 0x0005)	{ /* XXX */
+		gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() transfer refused\n");
+		e->type = GG_EVENT_DCC_ERROR;
+		e->event.dcc_error = GG_ERROR_DCC_REFUSED;
+		return -1;
+	}
+
+	if (h->chunk_size == 0) {
+		gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() empty chunk, EOF\n");
+		e->type = GG_EVENT_DCC_DONE;
+		return -1;
+	}
+
+	h->state = GG_STATE_GETTING_FILE;
+	h->check = GG_CHECK_READ;
+	h->timeout = GG_DEFAULT_TIMEOUT;
+	h->established = 1;
+
+	return 0;
+}
+
+/**
+ * \internal Wysyła kolejne kawałki pliku wraz z nagłówkami, dopóki bufor
+ * gniazda nie zostanie zapełniony.
+ *
+ * \param h Struktura połączenia
+ * \param e Struktura zdarzenia
+ */
+static void gg_dcc_send_file_data(struct gg_dcc *h, struct gg_event *e)
+{
+	if (h->transfer_start == 0) {
+		h->transfer_start = time(NULL);
+		gg_file_advise_sequential(h->file_fd);
+	}
+
+	for (;;) {
+		struct gg_dcc_big_packet big_pkt;
+		gg_file_transfer_t res;
+		size_t count, done;
+		int tmp;
+
+		count = h->chunk_size - h->chunk_offset;
+
+		if (count > h->file_info.size - h->offset)
+			count = h->file_info.size - h->offset;
+
+		res = gg_file_send(h->fd, h->file_fd, 1, h->offset, count, 0, &done);
+
+		h->offset += done;
+		h->chunk_offset += done;
+		gg_dcc_transfer_update(h, done);
+
+		if (res != GG_FILE_TRANSFER_OK) {
+			gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() "
+				"gg_file_send() failed (res=%d, errno=%d, %s)\n",
+				res, errno, strerror(errno));
+			e->type = GG_EVENT_DCC_ERROR;
+			e->event.dcc_error = gg_dcc_file_error(res);
+			return;
+		}
+
+		if (h->offset >= h->file_info.size) {
+			e->type = GG_EVENT_DCC_DONE;
+			return;
+		}
+
+		if (done < count) {
+			h->state = GG_STATE_SENDING_FILE;
+			h->check = GG_CHECK_WRITE;
+			h->timeout = GG_DCC_TIMEOUT_SEND;
+			return;
+		}
+
+		gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() chunk finished\n");
+
+		gg_dcc_file_header_fill(h, &big_pkt);
+
+		tmp = send(h->fd, &big_pkt, sizeof(big_pkt), 0);
+
+		if (tmp == -1 && (errno == EAGAIN || errno == EINTR)) {
+			h->state = GG_STATE_SENDING_FILE_HEADER;
+			h->check = GG_CHECK_WRITE;
+			h->timeout = GG_DEFAULT_TIMEOUT;
+			return;
+		}
+
+		if (tmp != sizeof(big_pkt)) {
+			gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() send() "
+				"failed (res=%d, errno=%d, %s)\n", tmp, errno,
+				strerror(errno));
+			e->type = GG_EVENT_DCC_ERROR;
+			e->event.dcc_error = GG_ERROR_DCC_NET;
+			return;
+		}
+
+		gg_dcc_debug_data("write", h->fd, &big_pkt, sizeof(big_pkt));
+	}
+}
+
+/**
+ * \internal Odbiera kolejne kawałki pliku wraz z nagłówkami, dopóki są
+ * dostępne dane.
+ *
+ * \param h Struktura połączenia
+ * \param e Struktura zdarzenia
+ *
+ * \return 0 jeśli się powiodło, -1 jeśli zabrakło pamięci
+ */
+static int gg_dcc_get_file_data(struct gg_dcc *h, struct gg_event *e)
+{
+	if (h->transfer_start == 0) {
+		h->transfer_start = time(NULL);
+		gg_file_advise_sequential(h->file_fd);
+	}
+
+	for (;;) {
+		struct gg_dcc_big_packet big_pkt;
+		gg_file_transfer_t res;
+		size_t count, done;
+		int tmp;
+
+		count = h->chunk_size - h->chunk_offset;
+
+		/* Kawałki mają najwyżej 4096 bajtów, więc wystarczą zwykłe
+		 * recv() i write() bez potoku dla splice(). */
+		res = gg_file_recv(h->fd, h->file_fd, count, 0, &done, NULL);
+
+		gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() "
+			"ofs=%d, size=%d, received=%" GG_SIZE_FMT "\n",
+			h->offset, h->file_info.size, done);
+
+		h->offset += done;
+		h->chunk_offset += done;
+		gg_dcc_transfer_update(h, done);
+
+		if (res != GG_FILE_TRANSFER_OK) {
+			gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() "
+				"gg_file_recv() failed (res=%d, errno=%d, %s)\n",
+				res, errno, strerror(errno));
+			e->type = GG_EVENT_DCC_ERROR;
+			e->event.dcc_error = gg_dcc_file_error(res);
+			return 0;
+		}
+
+		if (h->offset >= h->file_info.size) {
+			e->type = GG_EVENT_DCC_DONE;
+			return 0;
+		}
+
+		if (done < count) {
+			h->state = GG_STATE_GETTING_FILE;
+			h->check = GG_CHECK_READ;
+			h->timeout = GG_DCC_TIMEOUT_GET;
+			return 0;
+		}
+
+		gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() chunk finished\n");
+
+		/* Nagłówek kolejnego kawałka odbieramy od razu tylko wtedy,
+		 * gdy jest dostępny w całości. W przeciwnym wypadku zajmie
+		 * się nim stan GG_STATE_READING_FILE_HEADER. */
+
+		tmp = recv(h->fd, (void*) &big_pkt, sizeof(big_pkt), MSG_PEEK);
+
+		if (tmp == sizeof(big_pkt))
+			tmp = recv(h->fd, (void*) &big_pkt, sizeof(big_pkt), 0);
+
+		if (tmp != sizeof(big_pkt)) {
+			h->state = GG_STATE_READING_FILE_HEADER;
+			h->check = GG_CHECK_READ;
+			h->timeout = GG_DEFAULT_TIMEOUT;
+			h->chunk_offset = 0;
+			h->chunk_size = sizeof(big_pkt);
+			h->chunk_buf = malloc(sizeof(big_pkt));
+
+			if (!h->chunk_buf) {
+				gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() out of memory\n");
+				return -1;
+			}
+
+			return 0;
+		}
+
+		gg_dcc_debug_data("read", h->fd, &big_pkt, sizeof(big_pkt));
+
+		if (gg_dcc_file_header_parse(h, &big_pkt, e) == -1)
+			return 0;
+	}
+}
+
 /**
  * Funkcja wywoływana po zaobserwowaniu zmian na deskryptorze połączenia.
  *
@@ -644,8 +905,7 @@ struct gg_event *gg_dcc_watch_fd(struct gg_dcc *h)
 		struct gg_dcc_tiny_packet tiny_pkt;
 		struct gg_dcc_small_packet small_pkt;
 		struct gg_dcc_big_packet big_pkt;
-		int size, tmp, res;
-		unsigned int utmp;
+		int tmp, res;
 		socklen_t res_size = sizeof(res);
 		char buf[1024], ack[] = "UDAG";
 		void *tmp_buf;
@@ -852,27 +1112,7 @@ struct gg_event *gg_dcc_watch_fd(struct gg_dcc *h)
 				free(h->chunk_buf);
 				h->chunk_buf = NULL;
 
-				big_pkt.type = gg_fix32(big_pkt.type);
-				h->chunk_size = gg_fix32(big_pkt.dunno1);
-				h->chunk_offset = 0;
-
-				if (big_pkt.type == 0x0005)	{ /* XXX */
-					gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() transfer refused\n");
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_REFUSED;
-					return e;
-				}
-
-				if (h->chunk_size == 0) {
-					gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() empty chunk, EOF\n");
-					e->type = GG_EVENT_DCC_DONE;
-					return e;
-				}
-
-				h->state = GG_STATE_GETTING_FILE;
-				h->check = GG_CHECK_READ;
-				h->timeout = GG_DEFAULT_TIMEOUT;
-				h->established = 1;
+				gg_dcc_file_header_parse(h, &big_pkt, e);
 
 				return e;
 
@@ -1135,16 +1375,7 @@ struct gg_event *gg_dcc_watch_fd(struct gg_dcc *h)
 			case GG_STATE_SENDING_FILE_HEADER:
 				gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() GG_STATE_SENDING_FILE_HEADER\n");
 
-				h->chunk_offset = 0;
-
-				if ((h->chunk_size = h->file_info.size - h->offset) > 4096) {
-					h->chunk_size = 4096;
-					big_pkt.type = gg_fix32(0x0003);  /* XXX */
-				} else
-					big_pkt.type = gg_fix32(0x0002);  /* XXX */
-
-				big_pkt.dunno1 = gg_fix32(h->chunk_size);
-				big_pkt.dunno2 = 0;
+				gg_dcc_file_header_fill(h, &big_pkt);
 
 				gg_dcc_write(h->fd, &big_pkt, sizeof(big_pkt));
 
@@ -1158,9 +1389,6 @@ struct gg_event *gg_dcc_watch_fd(struct gg_dcc *h)
 			case GG_STATE_SENDING_FILE:
 				gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() GG_STATE_SENDING_FILE\n");
 
-				if ((utmp = h->chunk_size - h->chunk_offset) > sizeof(buf))
-					utmp = sizeof(buf);
-
 				gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() "
 					"offset=%d, size=%d\n",
 					h->offset, h->file_info.size);
@@ -1181,185 +1409,24 @@ struct gg_event *gg_dcc_watch_fd(struct gg_dcc *h)
 					return e;
 				}
 
-				if (lseek(h->file_fd, h->offset, SEEK_SET) != (off_t)h->offset) {
-					gg_debug(GG_DEBUG_MISC,
-						"// gg_dcc_watch_fd() lseek() "
-						"failed. (errno=%d, %s)\n",
-						errno, strerror(errno));
-
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_FILE;
-
-					return e;
-				}
-
-				size = read(h->file_fd, buf, utmp);
-
-				/* błąd */
-				if (size == -1) {
-					gg_debug(GG_DEBUG_MISC,
-						"// gg_dcc_watch_fd() read() "
-						"failed. (errno=%d, %s)\n",
-						errno, strerror(errno));
-
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_FILE;
-
-					return e;
-				}
-
-				/* koniec pliku? */
-				if (size == 0) {
-					gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() read() reached eof\n");
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_EOF;
-
-					return e;
-				}
-
-				/* jeśli wczytaliśmy więcej, utnijmy. */
-				if (h->offset + size > h->file_info.size) {
-					gg_debug(GG_DEBUG_MISC,
-						"// gg_dcc_watch_fd() read() "
-						"too much (read=%d, ofs=%d, "
-						"size=%d)\n", size, h->offset,
-						h->file_info.size);
-					size = h->file_info.size - h->offset;
-
-					if (size < 1) {
-						gg_debug(GG_DEBUG_MISC,
-							"// gg_dcc_watch_fd() "
-							"reached EOF after cutting\n");
-						e->type = GG_EVENT_DCC_DONE;
-						return e;
-					}
-				}
-
-				tmp = send(h->fd, buf, size, 0);
-
-				if (tmp == -1) {
-					gg_debug(GG_DEBUG_MISC,
-						"// gg_dcc_watch_fd() send() "
-						"failed (%s)\n", strerror(errno));
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_NET;
-					return e;
-				}
-
-				if (tmp == 0) {
-					gg_debug(GG_DEBUG_MISC,
-						"// gg_dcc_watch_fd() send() "
-						"failed (connection reset)\n");
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_NET;
-					return e;
-				}
-
-				h->offset += tmp;
-
-				if (h->offset >= h->file_info.size) {
-					e->type = GG_EVENT_DCC_DONE;
-					return e;
-				}
-
-				h->chunk_offset += tmp;
-
-				if (h->chunk_offset >= h->chunk_size) {
-					gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() chunk finished\n");
-					h->state = GG_STATE_SENDING_FILE_HEADER;
-					h->timeout = GG_DEFAULT_TIMEOUT;
-				} else {
-					h->state = GG_STATE_SENDING_FILE;
-					h->timeout = GG_DCC_TIMEOUT_SEND;
-				}
-
-				h->check = GG_CHECK_WRITE;
+				gg_dcc_send_file_data(h, e);
 
 				return e;
 
 			case GG_STATE_GETTING_FILE:
 				gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() GG_STATE_GETTING_FILE\n");
 
-				if ((utmp = h->chunk_size - h->chunk_offset) > sizeof(buf))
-					utmp = sizeof(buf);
-
 				if (h->offset >= h->file_info.size) {
 					gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() offset >= size, finished\n");
 					e->type = GG_EVENT_DCC_DONE;
 					return e;
 				}
 
-				size = recv(h->fd, buf, utmp, 0);
-
-				gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() "
-					"ofs=%d, size=%d, recv()=%d\n",
-					h->offset, h->file_info.size, size);
-
-				/* błąd */
-				if (size == -1) {
-					gg_debug(GG_DEBUG_MISC,
-						"// gg_dcc_watch_fd() recv() "
-						"failed. (errno=%d, %s)\n",
-						errno, strerror(errno));
-
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_NET;
-
-					return e;
-				}
-
-				/* koniec? */
-				if (size == 0) {
-					gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() recv() reached eof\n");
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_EOF;
-
-					return e;
-				}
-
-				tmp = write(h->file_fd, buf, size);
-
-				if (tmp == -1 || tmp < size) {
-					gg_debug(GG_DEBUG_MISC,
-						"// gg_dcc_watch_fd() write() "
-						"failed (%d:fd=%d:res=%d:%s)\n",
-						tmp, h->file_fd, size,
-						strerror(errno));
-					e->type = GG_EVENT_DCC_ERROR;
-					e->event.dcc_error = GG_ERROR_DCC_NET;
-					return e;
-				}
-
-				h->offset += size;
-
-				if (h->offset >= h->file_info.size) {
-					e->type = GG_EVENT_DCC_DONE;
-					return e;
-				}
-
-				h->chunk_offset += size;
-
-				if (h->chunk_offset >= h->chunk_size) {
-					gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() chunk finished\n");
-					h->state = GG_STATE_READING_FILE_HEADER;
-					h->timeout = GG_DEFAULT_TIMEOUT;
-					h->chunk_offset = 0;
-					h->chunk_size = sizeof(big_pkt);
-					h->chunk_buf = NULL;
-					tmp_buf = malloc(sizeof(big_pkt));
-					if (!tmp_buf) {
-						gg_debug(GG_DEBUG_MISC, "// gg_dcc_watch_fd() out of memory\n");
-						free(e);
-						return NULL;
-					}
-					h->chunk_buf = tmp_buf;
-				} else {
-					h->state = GG_STATE_GETTING_FILE;
-					h->timeout = GG_DCC_TIMEOUT_GET;
+				if (gg_dcc_get_file_data(h, e) == -1) {
+					free(e);
+					return NULL;
 				}
 
-				h->check = GG_CHECK_READ;
-
 				return e;
 
 			default:
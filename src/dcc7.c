@@ -341,6 +341,7 @@ static int gg_dcc7_reverse_connect(struct gg_dcc7 *dcc)
 	}
 
 	gg_debug_dcc(dcc, GG_DEBUG_MISC, "// gg_dcc7_reverse_connect() timeout, trying reverse connection\n");
+	gg_loop_item_close_fd(dcc->loop_item);
 	close(dcc->fd);
 	dcc->fd = -1;
 	dcc->reverse = 1;
@@ -853,6 +854,7 @@ int gg_dcc7_handle_info(struct gg_session *sess, struct gg_event *e, const void
 #endif
 
 	if (dcc->state == GG_STATE_LISTENING) {
+		gg_loop_item_close_fd(dcc->loop_item);
 		close(dcc->fd);
 		dcc->fd = -1;
 		dcc->reverse = 1;
@@ -1052,6 +1054,25 @@ static int gg_dcc7_postauth_fixup(struct gg_dcc7 *dcc)
 	return -1;
 }
 
+/**
+ * \internal Zamienia wynik przesyłania pliku na kod błędu połączenia.
+ *
+ * \param res Wynik funkcji \c gg_file_send() lub \c gg_file_recv()
+ *
+ * \return Kod błędu zdarzenia \c GG_EVENT_DCC7_ERROR
+ */
+static int gg_dcc7_file_error(gg_file_transfer_t res)
+{
+	switch (res) {
+		case GG_FILE_TRANSFER_ERROR_FILE:
+			return GG_ERROR_DCC7_FILE;
+		case GG_FILE_TRANSFER_EOF:
+			return GG_ERROR_DCC7_EOF;
+		default:
+			return GG_ERROR_DCC7_NET;
+	}
+}
+
 /**
  * Funkcja wywoływana po zaobserwowaniu zmian na deskryptorze połączenia.
  *
@@ -1118,6 +1139,7 @@ struct gg_event *gg_dcc7_watch_fd(struct gg_dcc7 *dcc)
 				return e;
 			}
 
+			gg_loop_item_close_fd(dcc->loop_item);
 			close(dcc->fd);
 			dcc->fd = fd;
 
@@ -1311,9 +1333,8 @@ struct gg_event *gg_dcc7_watch_fd(struct gg_dcc7 *dcc)
 
 		case GG_STATE_SENDING_FILE:
 		{
-			char buf[1024];
-			size_t chunk;
-			int res;
+			gg_file_transfer_t res;
+			size_t done;
 
 			gg_debug_dcc(dcc, GG_DEBUG_MISC, "// gg_dcc7_watch_fd()"
 				" GG_STATE_SENDING_FILE (offset=%d, size=%d)\n",
@@ -1326,38 +1347,21 @@ struct gg_event *gg_dcc7_watch_fd(struct gg_dcc7 *dcc)
 				return e;
 			}
 
-			if (dcc->seek && lseek(dcc->file_fd, dcc->offset, SEEK_SET) == (off_t) -1) {
-				gg_debug_dcc(dcc, GG_DEBUG_MISC,
-					"// gg_dcc7_watch_fd() lseek() failed "
-					"(%s)\n", strerror(errno));
-				e->type = GG_EVENT_DCC7_ERROR;
-				e->event.dcc_error = GG_ERROR_DCC7_FILE;
-				return e;
-			}
+			res = gg_file_send(dcc->fd, dcc->file_fd, dcc->seek,
+				dcc->offset, dcc->size - dcc->offset,
+				dcc->chunk_size, &done);
 
-			if ((chunk = dcc->size - dcc->offset) > sizeof(buf))
-				chunk = sizeof(buf);
+			dcc->offset += done;
 
-			if ((res = read(dcc->file_fd, buf, chunk)) < 1) {
+			if (res != GG_FILE_TRANSFER_OK) {
 				gg_debug_dcc(dcc, GG_DEBUG_MISC,
-					"// gg_dcc7_watch_fd() read() failed "
+					"// gg_dcc7_watch_fd() gg_file_send() failed "
 					"(res=%d, %s)\n", res, strerror(errno));
 				e->type = GG_EVENT_DCC7_ERROR;
-				e->event.dcc_error = (res == -1) ? GG_ERROR_DCC7_FILE : GG_ERROR_DCC7_EOF;
-				return e;
-			}
-
-			if ((res = send(dcc->fd, buf, res, 0)) == -1) {
-				gg_debug_dcc(dcc, GG_DEBUG_MISC,
-					"// gg_dcc7_watch_fd() send() failed "
-					"(%s)\n", strerror(errno));
-				e->type = GG_EVENT_DCC7_ERROR;
-				e->event.dcc_error = GG_ERROR_DCC7_NET;
+				e->event.dcc_error = gg_dcc7_file_error(res);
 				return e;
 			}
 
-			dcc->offset += res;
-
 			if (dcc->offset >= dcc->size) {
 				gg_debug_dcc(dcc, GG_DEBUG_MISC, "// gg_dcc7_watch_fd() finished\n");
 				e->type = GG_EVENT_DCC7_DONE;
@@ -1374,8 +1378,9 @@ struct gg_event *gg_dcc7_watch_fd(struct gg_dcc7 *dcc)
 
 		case GG_STATE_GETTING_FILE:
 		{
-			char buf[1024];
-			int res, wres;
+			gg_file_pipe_t *recv_pipe;
+			gg_file_transfer_t res;
+			size_t done;
 
 			gg_debug_dcc(dcc, GG_DEBUG_MISC, "// gg_dcc7_watch_fd()"
 				" GG_STATE_GETTING_FILE (offset=%d, size=%d)\n",
@@ -1388,30 +1393,24 @@ struct gg_event *gg_dcc7_watch_fd(struct gg_dcc7 *dcc)
 				return e;
 			}
 
-			if ((res = recv(dcc->fd, buf, sizeof(buf), 0)) < 1) {
-				gg_debug_dcc(dcc, GG_DEBUG_MISC,
-					"// gg_dcc7_watch_fd() recv() failed "
-					"(fd=%d, res=%d, %s)\n", dcc->fd, res,
-					strerror(errno));
-				e->type = GG_EVENT_DCC7_ERROR;
-				e->event.dcc_error = (res == -1) ? GG_ERROR_DCC7_NET : GG_ERROR_DCC7_EOF;
-				return e;
-			}
+			recv_pipe = dcc->recv_pipe;
+			res = gg_file_recv(dcc->fd, dcc->file_fd,
+				dcc->size - dcc->offset, dcc->chunk_size, &done,
+				&recv_pipe);
+			dcc->recv_pipe = recv_pipe;
 
-			/* XXX zapisywać do skutku? */
+			dcc->offset += done;
 
-			if ((wres = write(dcc->file_fd, buf, res)) < res) {
+			if (res != GG_FILE_TRANSFER_OK) {
 				gg_debug_dcc(dcc, GG_DEBUG_MISC,
-					"// gg_dcc7_watch_fd() write() failed "
-					"(fd=%d, res=%d, %s)\n", dcc->file_fd,
-					wres, strerror(errno));
+					"// gg_dcc7_watch_fd() gg_file_recv() failed "
+					"(fd=%d, res=%d, %s)\n", dcc->fd, res,
+					strerror(errno));
 				e->type = GG_EVENT_DCC7_ERROR;
-				e->event.dcc_error = GG_ERROR_DCC7_FILE;
+				e->event.dcc_error = gg_dcc7_file_error(res);
 				return e;
 			}
 
-			dcc->offset += res;
-
 			if (dcc->offset >= dcc->size) {
 				gg_debug_dcc(dcc, GG_DEBUG_MISC, "// gg_dcc7_watch_fd() finished\n");
 				e->type = GG_EVENT_DCC7_DONE;
@@ -1443,6 +1442,7 @@ struct gg_event *gg_dcc7_watch_fd(struct gg_dcc7 *dcc)
 				int errno_save = errno;
 
 				gg_debug_dcc(dcc, GG_DEBUG_MISC, "// gg_dcc7_watch_fd() resolving failed\n");
+				gg_loop_item_close_fd(dcc->loop_item);
 				close(dcc->fd);
 				dcc->fd = -1;
 				errno = errno_save;
@@ -1646,12 +1646,16 @@ void gg_dcc7_free(struct gg_dcc7 *dcc)
 	if (!dcc)
 		return;
 
+	gg_loop_item_remove(dcc->loop_item);
+
 	if (dcc->fd != -1)
 		close(dcc->fd);
 
 	if (dcc->file_fd != -1)
 		gg_file_close(dcc->file_fd);
 
+	gg_file_pipe_free(dcc->recv_pipe);
+
 	if (dcc->sess)
 		gg_dcc7_session_remove(dcc->sess, dcc);
 
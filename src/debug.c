@@ -366,6 +366,7 @@ const char *gg_debug_event(enum gg_event_t event)
 	GG_DEBUG_EVENT(GG_EVENT_CHAT_INFO_UPDATE)
 	GG_DEBUG_EVENT(GG_EVENT_CHAT_CREATED)
 	GG_DEBUG_EVENT(GG_EVENT_CHAT_INVITE_ACK)
+	GG_DEBUG_EVENT(GG_EVENT_ROSTER_CHANGE)
 #undef GG_DEBUG_EVENT
 
 	/* Celowo nie ma default, żeby kompilator wyłapał brakujące zdarzenia */
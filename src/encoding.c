@@ -21,8 +21,15 @@
 
 #include "strman.h"
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#endif
+
 #include "encoding.h"
 
 /**
@@ -55,122 +62,238 @@ static const uint16_t table_cp1250[] =
 };
 
 /**
- * \internal Zamienia tekst kodowany CP1250 na UTF-8.
+ * \internal Tablica konwersji znaków Unikodu z zakresu U+00A0..U+017F na CP1250.
+ * Wartość 0 oznacza brak znaku w CP1250.
+ */
+static const unsigned char table_unicode_00a0[224] =
+{
+	0xa0, 0x00, 0x00, 0x00, 0xa4, 0x00, 0xa6, 0xa7,
+	0xa8, 0xa9, 0x00, 0xab, 0xac, 0xad, 0xae, 0x00,
+	0xb0, 0xb1, 0x00, 0x00, 0xb4, 0xb5, 0xb6, 0xb7,
+	0xb8, 0x00, 0x00, 0xbb, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0xc1, 0xc2, 0x00, 0xc4, 0x00, 0x00, 0xc7,
+	0x00, 0xc9, 0x00, 0xcb, 0x00, 0xcd, 0xce, 0x00,
+	0x00, 0x00, 0x00, 0xd3, 0xd4, 0x00, 0xd6, 0xd7,
+	0x00, 0x00, 0xda, 0x00, 0xdc, 0xdd, 0x00, 0xdf,
+	0x00, 0xe1, 0xe2, 0x00, 0xe4, 0x00, 0x00, 0xe7,
+	0x00, 0xe9, 0x00, 0xeb, 0x00, 0xed, 0xee, 0x00,
+	0x00, 0x00, 0x00, 0xf3, 0xf4, 0x00, 0xf6, 0xf7,
+	0x00, 0x00, 0xfa, 0x00, 0xfc, 0xfd, 0x00, 0x00,
+	0x00, 0x00, 0xc3, 0xe3, 0xa5, 0xb9, 0xc6, 0xe6,
+	0x00, 0x00, 0x00, 0x00, 0xc8, 0xe8, 0xcf, 0xef,
+	0xd0, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xca, 0xea, 0xcc, 0xec, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0xc5, 0xe5, 0x00, 0x00, 0xbc, 0xbe, 0x00,
+	0x00, 0xa3, 0xb3, 0xd1, 0xf1, 0x00, 0x00, 0xd2,
+	0xf2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xd5, 0xf5, 0x00, 0x00, 0xc0, 0xe0, 0x00, 0x00,
+	0xd8, 0xf8, 0x8c, 0x9c, 0x00, 0x00, 0xaa, 0xba,
+	0x8a, 0x9a, 0xde, 0xfe, 0x8d, 0x9d, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xd9, 0xf9,
+	0xdb, 0xfb, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x8f, 0x9f, 0xaf, 0xbf, 0x8e, 0x9e, 0x00,
+};
+
+/**
+ * \internal Tablica konwersji znaków Unikodu z zakresu U+02C0..U+02DF na CP1250.
+ */
+static const unsigned char table_unicode_02c0[32] =
+{
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa1,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xa2, 0xff, 0x00, 0xb2, 0x00, 0xbd, 0x00, 0x00,
+};
+
+/**
+ * \internal Tablica konwersji znaków Unikodu z zakresu U+2010..U+203F na CP1250.
+ */
+static const unsigned char table_unicode_2010[48] =
+{
+	0x00, 0x00, 0x00, 0x96, 0x97, 0x00, 0x00, 0x00,
+	0x91, 0x92, 0x82, 0x00, 0x93, 0x94, 0x84, 0x00,
+	0x86, 0x87, 0x95, 0x00, 0x00, 0x00, 0x85, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x89, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x8b, 0x9b, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/**
+ * \internal Zamienia znak Unikodu na znak CP1250.
  *
- * \param src Tekst źródłowy w CP1250.
- * \param src_length Długość ciągu źródłowego (nigdy ujemna).
- * \param dst_length Długość ciągu docelowego (jeśli -1, nieograniczona).
+ * \param uc Kod znaku (nie mniejszy niż 0x80)
  *
- * \return Zaalokowany bufor z tekstem w UTF-8.
+ * \return Znak w CP1250 lub 0, jeśli znak nie występuje w CP1250.
  */
-static char *gg_encoding_convert_cp1250_utf8(const char *src, int src_length, int dst_length)
+static inline unsigned char gg_encoding_unicode_to_cp1250(uint32_t uc)
 {
-	int i, j, len;
-	char *result = NULL;
+	if (uc >= 0x00a0 && uc < 0x0180)
+		return table_unicode_00a0[uc - 0x00a0];
 
-	for (i = 0, len = 0; (src[i] != 0) && (i < src_length); i++) {
-		uint16_t uc;
+	if (uc >= 0x02c0 && uc < 0x02e0)
+		return table_unicode_02c0[uc - 0x02c0];
 
-		if ((unsigned char) src[i] < 0x80)
-			uc = (unsigned char) src[i];
-		else
-			uc = table_cp1250[(unsigned char) src[i] - 128];
+	if (uc >= 0x2010 && uc < 0x2040)
+		return table_unicode_2010[uc - 0x2010];
 
-		if (uc < 0x80)
-			len += 1;
-		else if (uc < 0x800)
-			len += 2;
-		else
-			len += 3;
-	}
+	if (uc == 0x20ac)
+		return 0x80;
 
-	if ((dst_length != -1) && (len > dst_length))
-		len = dst_length;
+	if (uc == 0x2122)
+		return 0x99;
 
-	result = malloc(len + 1);
+	return 0;
+}
 
-	if (result == NULL)
-		return NULL;
+/**
+ * \internal Sprawdza, czy 16 kolejnych bajtów to znaki ASCII różne od zera.
+ *
+ * \param p Wskaźnik na dane (bez wymagań co do wyrównania)
+ *
+ * \return 1 jeśli tak, 0 jeśli nie.
+ */
+static inline int gg_encoding_is_ascii16(const char *p)
+{
+#if defined(__SSE2__)
+	__m128i v;
+
+	v = _mm_loadu_si128((const __m128i*) p);
+	v = _mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+
+	return _mm_movemask_epi8(v) == 0;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	uint8x16_t v;
+
+	v = vld1q_u8((const uint8_t*) p);
+
+	return vmaxvq_u8(v) < 0x80 && vminvq_u8(v) != 0;
+#else
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t highs = 0x8080808080808080ULL;
+	uint64_t a, b;
 
-	for (i = 0, j = 0; (src[i] != 0) && (i < src_length) && (j < len); i++) {
+	memcpy(&a, p, sizeof(a));
+	memcpy(&b, p + sizeof(a), sizeof(b));
+
+	if (((a | b) & highs) != 0)
+		return 0;
+
+	return (((a - ones) & ~a & highs) | ((b - ones) & ~b & highs)) == 0;
+#endif
+}
+
+/**
+ * \internal Zamienia tekst kodowany CP1250 na UTF-8.
+ *
+ * Znaki wielobajtowe, które nie mieszczą się w buforze, są pomijane
+ * w całości.
+ *
+ * \param src Tekst źródłowy w CP1250.
+ * \param src_length Długość ciągu źródłowego.
+ * \param dst Bufor docelowy.
+ * \param dst_length Maksymalna długość ciągu docelowego (bez znaku końca
+ *                   tekstu, który nie jest dopisywany).
+ *
+ * \return Długość tekstu w UTF-8.
+ */
+static size_t gg_encoding_convert_cp1250_utf8(const char *src, size_t src_length, char *dst, size_t dst_length)
+{
+	size_t i = 0, j = 0;
+
+	while (i < src_length && j < dst_length && src[i] != 0) {
 		uint16_t uc;
 
+		if (i + 16 <= src_length && j + 16 <= dst_length &&
+			gg_encoding_is_ascii16(src + i))
+		{
+			memcpy(dst + j, src + i, 16);
+			i += 16;
+			j += 16;
+			continue;
+		}
+
 		if ((unsigned char) src[i] < 0x80)
 			uc = (unsigned char) src[i];
 		else
 			uc = table_cp1250[(unsigned char) src[i] - 128];
 
+		i++;
+
 		if (uc < 0x80)
-			result[j++] = (char) uc;
+			dst[j++] = (char) uc;
 		else if (uc < 0x800) {
-			if (j + 1 > len)
+			if (j + 2 > dst_length)
 				break;
-			result[j++] = 0xc0 | ((uc >> 6) & 0x1f);
-			result[j++] = 0x80 | (uc & 0x3f);
+			dst[j++] = 0xc0 | ((uc >> 6) & 0x1f);
+			dst[j++] = 0x80 | (uc & 0x3f);
 		} else {
-			if (j + 2 > len)
+			if (j + 3 > dst_length)
 				break;
-			result[j++] = 0xe0 | ((uc >> 12) & 0x1f);
-			result[j++] = 0x80 | ((uc >> 6) & 0x3f);
-			result[j++] = 0x80 | (uc & 0x3f);
+			dst[j++] = 0xe0 | ((uc >> 12) & 0x1f);
+			dst[j++] = 0x80 | ((uc >> 6) & 0x3f);
+			dst[j++] = 0x80 | (uc & 0x3f);
 		}
 	}
 
-	result[j] = 0;
-
-	return result;
+	return j;
 }
 
 /**
  * \internal Zamienia tekst kodowany UTF-8 na CP1250.
  *
+ * Nieprawidłowe sekwencje i znaki spoza CP1250 są zamieniane na znak
+ * zapytania.
+ *
  * \param src Tekst źródłowy w UTF-8.
- * \param src_length Długość ciągu źródłowego (nigdy ujemna).
- * \param dst_length Długość ciągu docelowego (jeśli -1, nieograniczona).
+ * \param src_length Długość ciągu źródłowego.
+ * \param dst Bufor docelowy.
+ * \param dst_length Maksymalna długość ciągu docelowego (bez znaku końca
+ *                   tekstu, który nie jest dopisywany).
  *
- * \return Zaalokowany bufor z tekstem w CP1250.
+ * \return Długość tekstu w CP1250.
  */
-static char *gg_encoding_convert_utf8_cp1250(const char *src, int src_length, int dst_length)
+static size_t gg_encoding_convert_utf8_cp1250(const char *src, size_t src_length, char *dst, size_t dst_length)
 {
-	char *result;
-	int i, j, len, uc_left = 0;
+	size_t i, j;
+	int uc_left = 0;
 	uint32_t uc = 0, uc_min = 0;
 
-	for (i = 0, len = 0; (src[i] != 0) && (i < src_length); i++) {
-		if ((src[i] & 0xc0) != 0x80)
-			len++;
-	}
-
-	if ((dst_length != -1) && (len > dst_length))
-		len = dst_length;
+#define PUT(c) do { if (j < dst_length) dst[j++] = (c); } while (0)
 
-	result = malloc(len + 1);
-
-	if (result == NULL)
-		return NULL;
+	for (i = 0, j = 0; (i < src_length) && (src[i] != 0) && (j < dst_length); i++) {
+		if (uc_left == 0 && i + 16 <= src_length &&
+			j + 16 <= dst_length && gg_encoding_is_ascii16(src + i))
+		{
+			memcpy(dst + j, src + i, 16);
+			i += 15;
+			j += 16;
+			continue;
+		}
 
-	for (i = 0, j = 0; (src[i] != 0) && (i < src_length) && (j < len); i++) {
 		if ((unsigned char) src[i] >= 0xf5) {
 			if (uc_left != 0)
-				result[j++] = '?';
+				PUT('?');
 			/* Restricted sequences */
-			result[j++] = '?';
+			PUT('?');
 			uc_left = 0;
 		} else if ((src[i] & 0xf8) == 0xf0) {
 			if (uc_left != 0)
-				result[j++] = '?';
+				PUT('?');
 			uc = src[i] & 0x07;
 			uc_left = 3;
 			uc_min = 0x10000;
 		} else if ((src[i] & 0xf0) == 0xe0) {
 			if (uc_left != 0)
-				result[j++] = '?';
+				PUT('?');
 			uc = src[i] & 0x0f;
 			uc_left = 2;
 			uc_min = 0x800;
 		} else if ((src[i] & 0xe0) == 0xc0) {
 			if (uc_left != 0)
-				result[j++] = '?';
+				PUT('?');
 			uc = src[i] & 0x1f;
 			uc_left = 1;
 			uc_min = 0x80;
@@ -181,38 +304,106 @@ static char *gg_encoding_convert_utf8_cp1250(const char *src, int src_length, in
 				uc_left--;
 
 				if (uc_left == 0) {
-					int valid = 0;
-					int k;
-
-					if (uc >= uc_min) {
-						for (k = 0; k < 128; k++) {
-							if (uc == table_cp1250[k]) {
-								result[j++] = k + 128;
-								valid = 1;
-								break;
-							}
-						}
-					}
-
-					if (!valid && uc != 0xfeff)	/* Byte Order Mark */
-						result[j++] = '?';
+					unsigned char ch = 0;
+
+					if (uc >= uc_min)
+						ch = gg_encoding_unicode_to_cp1250(uc);
+
+					if (ch != 0)
+						PUT(ch);
+					else if (uc != 0xfeff)	/* Byte Order Mark */
+						PUT('?');
 				}
 			}
 		} else {
 			if (uc_left != 0) {
-				result[j++] = '?';
+				PUT('?');
 				uc_left = 0;
 			}
-			result[j++] = src[i];
+			PUT(src[i]);
 		}
 	}
 
 	if ((uc_left != 0) && (src[i] == 0))
-		result[j++] = '?';
+		PUT('?');
 
-	result[j] = 0;
+#undef PUT
 
-	return result;
+	return j;
+}
+
+/**
+ * \internal Zwraca maksymalną długość tekstu po zmianie kodowania.
+ *
+ * \param src_encoding Kodowanie tekstu źródłowego.
+ * \param dst_encoding Kodowanie tekstu docelowego.
+ * \param src_length Długość ciągu źródłowego w bajtach.
+ *
+ * \return Maksymalna długość ciągu docelowego w bajtach (bez znaku końca
+ *         tekstu).
+ */
+size_t gg_encoding_convert_max(gg_encoding_t src_encoding,
+	gg_encoding_t dst_encoding, size_t src_length)
+{
+	if (dst_encoding == GG_ENCODING_UTF8 && src_encoding == GG_ENCODING_CP1250)
+		return src_length * 3;
+
+	return src_length;
+}
+
+/**
+ * \internal Zamienia kodowanie tekstu, zapisując wynik do podanego bufora.
+ *
+ * Tekst, który nie mieści się w buforze, jest ucinany, ale nigdy w środku
+ * znaku wielobajtowego. Wystarczający rozmiar bufora można wyznaczyć
+ * funkcją \c gg_encoding_convert_max().
+ *
+ * \param src Tekst źródłowy.
+ * \param src_encoding Kodowanie tekstu źródłowego.
+ * \param dst_encoding Kodowanie tekstu docelowego.
+ * \param src_length Długość ciągu źródłowego w bajtach (jeśli -1, zostanie obliczona na podstawie zawartości \p src).
+ * \param dst Bufor docelowy.
+ * \param dst_size Rozmiar bufora docelowego w bajtach, łącznie ze znakiem końca tekstu.
+ *
+ * \return Długość tekstu w kodowaniu docelowym lub -1 w przypadku błędu.
+ */
+int gg_encoding_convert_buf(const char *src, gg_encoding_t src_encoding,
+	gg_encoding_t dst_encoding, int src_length, char *dst, size_t dst_size)
+{
+	size_t len;
+
+	if (src == NULL || dst == NULL || dst_size == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (src_length == -1)
+		src_length = strlen(src);
+
+	if (dst_encoding == src_encoding) {
+		const char *end;
+
+		len = src_length;
+
+		if ((end = memchr(src, 0, len)) != NULL)
+			len = end - src;
+
+		if (len > dst_size - 1)
+			len = dst_size - 1;
+
+		memcpy(dst, src, len);
+	} else if (dst_encoding == GG_ENCODING_CP1250 && src_encoding == GG_ENCODING_UTF8) {
+		len = gg_encoding_convert_utf8_cp1250(src, src_length, dst, dst_size - 1);
+	} else if (dst_encoding == GG_ENCODING_UTF8 && src_encoding == GG_ENCODING_CP1250) {
+		len = gg_encoding_convert_cp1250_utf8(src, src_length, dst, dst_size - 1);
+	} else {
+		errno = EINVAL;
+		return -1;
+	}
+
+	dst[len] = 0;
+
+	return len;
 }
 
 /**
@@ -229,7 +420,9 @@ static char *gg_encoding_convert_utf8_cp1250(const char *src, int src_length, in
 char *gg_encoding_convert(const char *src, gg_encoding_t src_encoding,
 	gg_encoding_t dst_encoding, int src_length, int dst_length)
 {
-	char *result;
+	char *result, *tmp;
+	size_t size;
+	int len;
 
 	if (src == NULL) {
 		errno = EINVAL;
@@ -243,31 +436,35 @@ char *gg_encoding_convert(const char *src, gg_encoding_t src_encoding,
 	if (src_length == -1)
 		src_length = strlen(src);
 
-	if (dst_encoding == src_encoding) {
-		int len;
+	if ((dst_encoding != src_encoding) &&
+		!(dst_encoding == GG_ENCODING_CP1250 && src_encoding == GG_ENCODING_UTF8) &&
+		!(dst_encoding == GG_ENCODING_UTF8 && src_encoding == GG_ENCODING_CP1250))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
 
-		if (dst_length == -1)
-			len = src_length;
-		else
-			len = (src_length < dst_length) ? src_length : dst_length;
+	size = gg_encoding_convert_max(src_encoding, dst_encoding, src_length);
 
-		result = malloc(len + 1);
+	if ((dst_length != -1) && (size > (size_t) dst_length))
+		size = dst_length;
 
-		if (result == NULL)
-			return NULL;
+	result = malloc(size + 1);
 
-		strncpy(result, src, len);
-		result[len] = 0;
+	if (result == NULL)
+		return NULL;
 
-		return result;
-	}
+	len = gg_encoding_convert_buf(src, src_encoding, dst_encoding,
+		src_length, result, size + 1);
 
-	if (dst_encoding == GG_ENCODING_CP1250 && src_encoding == GG_ENCODING_UTF8)
-		return gg_encoding_convert_utf8_cp1250(src, src_length, dst_length);
+	if (len == -1) {
+		free(result);
+		return NULL;
+	}
 
-	if (dst_encoding == GG_ENCODING_UTF8 && src_encoding == GG_ENCODING_CP1250)
-		return gg_encoding_convert_cp1250_utf8(src, src_length, dst_length);
+	/* Oddajemy nadmiar zaalokowanej pamięci */
+	if ((size_t) len < size && (tmp = realloc(result, len + 1)) != NULL)
+		result = tmp;
 
-	errno = EINVAL;
-	return NULL;
+	return result;
 }
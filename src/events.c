@@ -54,22 +54,12 @@
 #endif
 
 /**
- * Zwalnia pamięć zajmowaną przez informację o zdarzeniu.
- *
- * Funkcję należy wywoływać za każdym razem gdy funkcja biblioteki zwróci
- * strukturę \c gg_event.
+ * \internal Zwalnia dane dołączone do struktury zdarzenia.
  *
  * \param e Struktura zdarzenia
- *
- * \ingroup events
  */
-void gg_event_free(struct gg_event *e)
+static void gg_event_free_data(struct gg_event *e)
 {
-	gg_debug(GG_DEBUG_FUNCTION, "** gg_event_free(%p);\n", e);
-
-	if (!e)
-		return;
-
 	switch (e->type) {
 		case GG_EVENT_MSG:
 		case GG_EVENT_MULTILOGON_MSG:
@@ -99,6 +89,10 @@ void gg_event_free(struct gg_event *e)
 			free(e->event.status60.descr);
 			break;
 
+		case GG_EVENT_ROSTER_CHANGE:
+			free(e->event.roster_change.changes);
+			break;
+
 		case GG_EVENT_STATUS:
 			free(e->event.status.descr);
 			break;
@@ -178,10 +172,63 @@ void gg_event_free(struct gg_event *e)
 			free(e->event.chat_info.participants);
 			break;
 	}
+}
+
+/**
+ * Zwalnia pamięć zajmowaną przez informację o zdarzeniu.
+ *
+ * Funkcję należy wywoływać za każdym razem gdy funkcja biblioteki zwróci
+ * strukturę \c gg_event.
+ *
+ * \param e Struktura zdarzenia
+ *
+ * \ingroup events
+ */
+void gg_event_free(struct gg_event *e)
+{
+	gg_debug(GG_DEBUG_FUNCTION, "** gg_event_free(%p);\n", e);
+
+	if (!e)
+		return;
+
+	gg_event_free_data(e);
 
 	free(e);
 }
 
+/**
+ * Zwalnia informację o zdarzeniu, zachowując strukturę do ponownego użycia.
+ *
+ * Działa jak \c gg_event_free(), ale sama struktura trafia do puli sesji
+ * i zostanie zwrócona przez jedno z kolejnych wywołań \c gg_watch_fd() bez
+ * przydzielania pamięci. Jeśli pula jest pełna, struktura jest zwalniana.
+ *
+ * \param sess Struktura sesji
+ * \param e Struktura zdarzenia
+ *
+ * \ingroup events
+ */
+void gg_event_recycle(struct gg_session *sess, struct gg_event *e)
+{
+	struct gg_session_private *p;
+
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_event_recycle(%p, %p);\n", sess, e);
+
+	if (!e)
+		return;
+
+	gg_event_free_data(e);
+
+	p = (sess != NULL) ? sess->private_data : NULL;
+
+	if (p == NULL || p->event_pool_count == GG_EVENT_POOL_SIZE) {
+		free(e);
+		return;
+	}
+
+	p->event_pool[p->event_pool_count++] = e;
+}
+
 /** \cond internal */
 
 /**
@@ -200,18 +247,7 @@ int gg_image_queue_remove(struct gg_session *s, struct gg_image_queue *q, int fr
 		return -1;
 	}
 
-	if (s->images == q)
-		s->images = q->next;
-	else {
-		struct gg_image_queue *qq;
-
-		for (qq = s->images; qq; qq = qq->next) {
-			if (qq->next == q) {
-				qq->next = q->next;
-				break;
-			}
-		}
-	}
+	gg_image_queue_unlink(s, q);
 
 	if (freeq) {
 		free(q->image);
@@ -376,12 +412,12 @@ static int gg_send_queued_data(struct gg_session *sess)
 {
 	int res;
 
-	if (sess->send_buf == NULL || sess->send_left == 0)
+	if (sess->send_left == 0)
 		return 0;
 
 	gg_debug_session(sess, GG_DEBUG_MISC, "// gg_watch_fd() sending %d bytes of queued data\n", sess->send_left);
 
-	res = send(sess->fd, sess->send_buf, sess->send_left, 0);
+	res = gg_send_queue_flush(sess);
 
 	if (res == -1) {
 		if (errno == EAGAIN || errno == EINTR) {
@@ -398,18 +434,12 @@ static int gg_send_queued_data(struct gg_session *sess)
 		return -1;
 	}
 
-	if (res == sess->send_left) {
+	if (sess->send_left == 0) {
 		gg_debug_session(sess, GG_DEBUG_MISC, "// gg_watch_fd() sent all queued data\n");
-		free(sess->send_buf);
-		sess->send_buf = NULL;
-		sess->send_left = 0;
 	} else if (res > 0) {
 		gg_debug_session(sess, GG_DEBUG_MISC, "// gg_watch_fd() sent %d"
 			" bytes of queued data, %d bytes left\n",
-			res, sess->send_left - res);
-
-		memmove(sess->send_buf, sess->send_buf + res, sess->send_left - res);
-		sess->send_left -= res;
+			res, sess->send_left);
 	}
 
 	return 0;
@@ -1629,6 +1659,261 @@ static gg_action_t gg_handle_reading_proxy_gg(struct gg_session *sess,
 	return GG_ACTION_WAIT;
 }
 
+/**
+ * \internal Przydziela strukturę zdarzenia.
+ *
+ * W miarę możliwości wykorzystuje struktury zwrócone do puli sesji przez
+ * \c gg_event_recycle().
+ *
+ * \param sess Struktura sesji
+ *
+ * \return Wyzerowana struktura zdarzenia typu \c GG_EVENT_NONE lub \c NULL
+ *         w przypadku braku pamięci
+ */
+struct gg_event *gg_event_new(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+	struct gg_event *ge;
+
+	if (p->event_pool_count > 0) {
+		ge = p->event_pool[--p->event_pool_count];
+	} else {
+		ge = malloc(sizeof(struct gg_event));
+
+		if (ge == NULL)
+			return NULL;
+	}
+
+	memset(ge, 0, sizeof(struct gg_event));
+	ge->type = GG_EVENT_NONE;
+
+	return ge;
+}
+
+/**
+ * \internal Dołącza zdarzenie na koniec kolejki zdarzeń.
+ *
+ * \param sess Struktura sesji
+ * \param ge Struktura zdarzenia
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_eventqueue_push(struct gg_session *sess, struct gg_event *ge)
+{
+	struct gg_session_private *p = sess->private_data;
+	gg_eventqueue_t *queue_el;
+
+	if (p->event_queue_pool != NULL) {
+		queue_el = p->event_queue_pool;
+		p->event_queue_pool = queue_el->next;
+		p->event_queue_pool_count--;
+	} else {
+		queue_el = malloc(sizeof(gg_eventqueue_t));
+
+		if (queue_el == NULL)
+			return -1;
+	}
+
+	queue_el->event = ge;
+	queue_el->next = NULL;
+
+	if (p->event_queue_tail != NULL)
+		p->event_queue_tail->next = queue_el;
+	else
+		p->event_queue = queue_el;
+
+	p->event_queue_tail = queue_el;
+
+	return 0;
+}
+
+/**
+ * \internal Zdejmuje zdarzenie z początku kolejki zdarzeń.
+ *
+ * \param sess Struktura sesji
+ *
+ * \return Struktura zdarzenia lub \c NULL, jeśli kolejka jest pusta
+ */
+static struct gg_event *gg_eventqueue_pop(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+	gg_eventqueue_t *queue_el = p->event_queue;
+	struct gg_event *ge;
+
+	if (queue_el == NULL)
+		return NULL;
+
+	ge = queue_el->event;
+
+	p->event_queue = queue_el->next;
+
+	if (p->event_queue == NULL)
+		p->event_queue_tail = NULL;
+
+	if (p->event_queue_pool_count < GG_EVENT_POOL_SIZE) {
+		queue_el->next = p->event_queue_pool;
+		p->event_queue_pool = queue_el;
+		p->event_queue_pool_count++;
+	} else
+		free(queue_el);
+
+	return ge;
+}
+
+/**
+ * \internal Usuwa wszystkie zdarzenia z kolejki.
+ *
+ * \param sess Struktura sesji
+ */
+void gg_eventqueue_clear(struct gg_session *sess)
+{
+	struct gg_event *ge;
+
+	while ((ge = gg_eventqueue_pop(sess)) != NULL)
+		gg_event_recycle(sess, ge);
+}
+
+/**
+ * \internal Zwalnia pule struktur zdarzeń i elementów kolejki.
+ *
+ * \param sess Struktura sesji
+ */
+void gg_event_pool_free(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+
+	while (p->event_pool_count > 0)
+		free(p->event_pool[--p->event_pool_count]);
+
+	while (p->event_queue_pool != NULL) {
+		gg_eventqueue_t *next = p->event_queue_pool->next;
+
+		free(p->event_queue_pool);
+		p->event_queue_pool = next;
+	}
+
+	p->event_queue_pool_count = 0;
+}
+
+/**
+ * \internal Obsługuje kolejne zbuforowane pakiety w trybie wsadowym.
+ *
+ * Zdarzenie pierwszego pakietu jest zwracane bezpośrednio przez
+ * \c gg_watch_fd(), a zdarzenia kolejnych trafiają do kolejki zdarzeń. Liczbę
+ * pakietów obsługiwanych w jednym wywołaniu ogranicza pole \c recv_batch
+ * struktury \c gg_login_params.
+ *
+ * Jeśli obsługa któregoś z kolejnych pakietów się nie powiedzie, połączenie
+ * jest zamykane, a błąd jest zgłaszany w kolejce za zdarzeniami z poprzednich
+ * pakietów.
+ *
+ * \param sess Struktura sesji
+ * \param e Struktura zdarzenia zwracana przez \c gg_watch_fd()
+ *
+ * \return 0 jeśli się powiodło, 1 jeśli zgłoszono błąd w kolejce, -1 jeśli
+ *         należy zgłosić błąd w bieżącym zdarzeniu
+ */
+static int gg_handle_connected_batch(struct gg_session *sess, struct gg_event *e)
+{
+	struct gg_session_private *p = sess->private_data;
+	int i;
+
+	for (i = 1; i < p->recv_batch; i++) {
+		gg_eventqueue_t *queue, *queue_tail, *extra, *extra_tail;
+		struct gg_event *ge;
+		const char *payload;
+		uint32_t type, length;
+		int res;
+
+		if (sess->state != GG_STATE_CONNECTED || !gg_recv_frame_pending(sess))
+			break;
+
+		if (e->type == GG_EVENT_NONE) {
+			/* Nie mamy jeszcze zdarzenia, więc nie ma czego kolejkować */
+			payload = gg_recv_frame(sess, &type, &length);
+
+			if (payload == NULL ||
+				gg_session_handle_packet(sess, type, payload, length, e) == -1)
+			{
+				return -1;
+			}
+
+			gg_recv_frame_release(sess);
+			continue;
+		}
+
+		ge = gg_event_new(sess);
+
+		if (ge == NULL)
+			break;
+
+		/* Zdarzenia dodane do kolejki przez funkcję obsługi pakietu
+		 * muszą trafić za zdarzenie samego pakietu. Jeśli funkcja
+		 * zamknie połączenie, usunie tylko swoje zdarzenia. */
+		queue = p->event_queue;
+		queue_tail = p->event_queue_tail;
+		p->event_queue = NULL;
+		p->event_queue_tail = NULL;
+
+		payload = gg_recv_frame(sess, &type, &length);
+
+		if (payload != NULL)
+			res = gg_session_handle_packet(sess, type, payload, length, ge);
+		else
+			res = -1;
+
+		if (res == -1) {
+			gg_debug_session(sess, GG_DEBUG_MISC, "// gg_watch_fd() "
+				"batched packet failed, queueing failure\n");
+
+			if (ge->type != GG_EVENT_CONN_FAILED) {
+				ge->type = GG_EVENT_CONN_FAILED;
+				ge->event.failure = GG_FAILURE_INTERNAL;
+			}
+
+			gg_close(sess);
+			sess->state = GG_STATE_IDLE;
+			sess->check = 0;
+
+			p->event_queue = queue;
+			p->event_queue_tail = queue_tail;
+
+			if (gg_eventqueue_push(sess, ge) == -1)
+				gg_event_free(ge);
+
+			return 1;
+		}
+
+		gg_recv_frame_release(sess);
+
+		extra = p->event_queue;
+		extra_tail = p->event_queue_tail;
+		p->event_queue = queue;
+		p->event_queue_tail = queue_tail;
+
+		if (ge->type != GG_EVENT_NONE) {
+			if (gg_eventqueue_push(sess, ge) == -1) {
+				gg_debug_session(sess, GG_DEBUG_MISC | GG_DEBUG_ERROR,
+					"// gg_watch_fd() out of memory, event "
+					"lost\n");
+				gg_event_free(ge);
+			}
+		} else
+			gg_event_recycle(sess, ge);
+
+		if (extra != NULL) {
+			if (p->event_queue_tail != NULL)
+				p->event_queue_tail->next = extra;
+			else
+				p->event_queue = extra;
+
+			p->event_queue_tail = extra_tail;
+		}
+	}
+
+	return 0;
+}
+
 static gg_action_t gg_handle_connected(struct gg_session *sess,
 	struct gg_event *e, enum gg_state_t next_state,
 	enum gg_state_t alt_state, enum gg_state_t alt2_state)
@@ -1679,14 +1964,15 @@ static gg_action_t gg_handle_connected(struct gg_session *sess,
 
 	return GG_ACTION_WAIT;
 #else
-	struct gg_header *gh;
+	const char *payload;
+	uint32_t type, length;
 
 	if (gg_send_queued_data(sess) == -1)
 		return GG_ACTION_FAIL;
 
-	gh = gg_recv_packet(sess);
+	payload = gg_recv_frame(sess, &type, &length);
 
-	if (gh == NULL) {
+	if (payload == NULL) {
 		if (sess->state == GG_STATE_DISCONNECTING) {
 			gg_debug_session(sess, GG_DEBUG_MISC, "// gg_watch_fd() connection broken expectedly\n");
 			e->type = GG_EVENT_DISCONNECT_ACK;
@@ -1700,15 +1986,20 @@ static gg_action_t gg_handle_connected(struct gg_session *sess,
 			return GG_ACTION_FAIL;
 		}
 	} else {
-		if (gg_session_handle_packet(sess, gh->type,
-			(const char *) gh + sizeof(struct gg_header),
-			gh->length, e) == -1)
-		{
-			free(gh);
+		int res;
+
+		if (gg_session_handle_packet(sess, type, payload, length, e) == -1)
+			return GG_ACTION_FAIL;
+
+		gg_recv_frame_release(sess);
+
+		res = gg_handle_connected_batch(sess, e);
+
+		if (res == -1)
 			return GG_ACTION_FAIL;
-		}
 
-		free(gh);
+		if (res == 1)
+			return GG_ACTION_WAIT;
 	}
 
 	sess->check = GG_CHECK_READ;
@@ -1787,35 +2078,107 @@ static const gg_state_transition_t handlers[] =
 	/* style:maxlinelength:end-ignore */
 };
 
+/**
+ * \internal Rozmiar indeksu tablicy przejść między stanami.
+ */
+#define GG_HANDLERS_INDEX_SIZE 256
+
+/**
+ * \internal Indeks tablicy przejść według stanu sesji. Zawiera numer pozycji
+ * w tablicy \c handlers powiększony o 1 lub 0, jeśli stan nie jest obsługiwany.
+ */
+static unsigned char handlers_index[GG_HANDLERS_INDEX_SIZE];
+
+/**
+ * \internal Flaga zbudowania indeksu \c handlers_index.
+ */
+static int handlers_index_ready;
+
+/**
+ * \internal Buduje indeks tablicy przejść między stanami.
+ *
+ * Indeks jest za każdym razem budowany tak samo, więc jednoczesne wywołanie
+ * z kilku wątków niczego nie psuje.
+ */
+static void gg_watch_fd_handlers_index_init(void)
+{
+	unsigned int i;
+
+	GG_STATIC_ASSERT(sizeof(handlers) / sizeof(handlers[0]) < 255,
+		handlers_index_too_small);
+
+	for (i = sizeof(handlers) / sizeof(handlers[0]); i > 0; i--) {
+		unsigned int state = handlers[i - 1].state;
+
+		if (state < GG_HANDLERS_INDEX_SIZE)
+			handlers_index[state] = i;
+	}
+
+	handlers_index_ready = 1;
+}
+
 struct gg_event *gg_eventqueue_add(struct gg_session *sess)
 {
 	struct gg_event *ge;
-	gg_eventqueue_t *queue_el, *it;
 
-	queue_el = gg_new0(sizeof(gg_eventqueue_t));
-	ge = gg_new0(sizeof(struct gg_event));
+	ge = gg_event_new(sess);
 
-	if (queue_el == NULL || ge == NULL) {
-		free(queue_el);
-		free(ge);
+	if (ge == NULL)
 		return NULL;
-	}
-
-	ge->type = GG_EVENT_NONE;
 
-	queue_el->event = ge;
-	if (sess->private_data->event_queue == NULL)
-		sess->private_data->event_queue = queue_el;
-	else {
-		it = sess->private_data->event_queue;
-		while (it->next != NULL)
-			it = it->next;
-		it->next = queue_el;
+	if (gg_eventqueue_push(sess, ge) == -1) {
+		gg_event_recycle(sess, ge);
+		return NULL;
 	}
 
 	return ge;
 }
 
+/**
+ * \internal Wymusza ponowne wywołanie \c gg_watch_fd(), gdy w sesji czekają
+ * zdarzenia lub zbuforowane pakiety, a na deskryptorze nic się nie zmieni.
+ *
+ * \param sess Struktura sesji
+ */
+static void gg_watch_fd_force(struct gg_session *sess)
+{
+	struct gg_session_private *priv = sess->private_data;
+	int fd;
+
+	if (priv->fd_is_dummy)
+		return;
+
+	fd = gg_get_dummy_fd(sess);
+
+	if (fd < 0)
+		return;
+
+	priv->fd_after_queue = sess->fd;
+	priv->check_after_queue = sess->check;
+	priv->fd_is_dummy = 1;
+
+	sess->fd = fd;
+	sess->check = GG_CHECK_READ | GG_CHECK_WRITE;
+}
+
+/**
+ * \internal Przywraca deskryptor sesji podmieniony przez
+ * \c gg_watch_fd_force().
+ *
+ * \param sess Struktura sesji
+ */
+void gg_watch_fd_restore(struct gg_session *sess)
+{
+	struct gg_session_private *priv = sess->private_data;
+
+	if (!priv->fd_is_dummy)
+		return;
+
+	sess->fd = priv->fd_after_queue;
+	sess->check = priv->check_after_queue;
+	priv->fd_is_dummy = 0;
+}
+
 /**
  * Funkcja wywoływana po zaobserwowaniu zmian na deskryptorze sesji.
  *
@@ -1843,53 +2206,45 @@ struct gg_event *gg_watch_fd(struct gg_session *sess)
 
 	priv = sess->private_data;
 
-	if (priv->event_queue != NULL) {
-		gg_eventqueue_t *next;
-
-		ge = priv->event_queue->event;
-		next = priv->event_queue->next;
-		free(priv->event_queue);
-		priv->event_queue = next;
+	ge = gg_eventqueue_pop(sess);
 
-		if (next == NULL) {
-			sess->check = priv->check_after_queue;
-			sess->fd = priv->fd_after_queue;
-		}
+	if (ge != NULL) {
+		if (priv->event_queue == NULL && !gg_recv_frame_pending(sess))
+			gg_watch_fd_restore(sess);
 		return ge;
 	}
 
-	ge = malloc(sizeof(struct gg_event));
+	gg_watch_fd_restore(sess);
+
+	ge = gg_event_new(sess);
 
 	if (ge == NULL) {
 		gg_debug_session(sess, GG_DEBUG_MISC, "// gg_watch_fd() not enough memory for event data\n");
 		return NULL;
 	}
 
-	memset(ge, 0, sizeof(struct gg_event));
-
-	ge->type = GG_EVENT_NONE;
+	if (!handlers_index_ready)
+		gg_watch_fd_handlers_index_init();
 
 	for (;;) {
-		unsigned int i, found = 0;
+		const gg_state_transition_t *t = NULL;
 		gg_action_t res;
 
 		res = GG_ACTION_FAIL;
 
-		for (i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
-			if (handlers[i].state == (enum gg_state_t) sess->state) {
-				gg_debug_session(sess, GG_DEBUG_MISC,
-					"// gg_watch_fd() %s\n",
-					gg_debug_state(sess->state));
-				res = (*handlers[i].handler)(sess, ge,
-					handlers[i].next_state,
-					handlers[i].alt_state,
-					handlers[i].alt2_state);
-				found = 1;
-				break;
-			}
+		if ((unsigned int) sess->state < GG_HANDLERS_INDEX_SIZE &&
+			handlers_index[sess->state] != 0)
+		{
+			t = &handlers[handlers_index[sess->state] - 1];
 		}
 
-		if (!found) {
+		if (t != NULL) {
+			gg_debug_session(sess, GG_DEBUG_MISC,
+				"// gg_watch_fd() %s\n",
+				gg_debug_state(sess->state));
+			res = (*t->handler)(sess, ge, t->next_state,
+				t->alt_state, t->alt2_state);
+		} else {
 			gg_debug_session(sess, GG_DEBUG_MISC | GG_DEBUG_ERROR,
 				"// gg_watch_fd() invalid state %s\n",
 				gg_debug_state(sess->state));
@@ -1901,14 +2256,10 @@ struct gg_event *gg_watch_fd(struct gg_session *sess)
 
 		switch (res) {
 			case GG_ACTION_WAIT:
-				if (priv->event_queue != NULL) {
-					priv->fd_after_queue = sess->fd;
-					priv->check_after_queue = sess->check;
-					/* wymuszamy ponowne wywołanie gg_watch_fd */
-					sess->fd = gg_get_dummy_fd(sess);
-					if (sess->fd < 0)
-						sess->fd = priv->fd_after_queue;
-					sess->check = GG_CHECK_READ | GG_CHECK_WRITE;
+				if (priv->event_queue != NULL ||
+					gg_recv_frame_pending(sess))
+				{
+					gg_watch_fd_force(sess);
 				}
 				return ge;
 
@@ -1923,7 +2274,7 @@ struct gg_event *gg_watch_fd(struct gg_session *sess)
 				if (ge->event.failure != 0) {
 					ge->type = GG_EVENT_CONN_FAILED;
 				} else {
-					free(ge);
+					gg_event_recycle(sess, ge);
 					ge = NULL;
 				}
 
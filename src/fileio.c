@@ -0,0 +1,479 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/**
+ * \file fileio.c
+ *
+ * \brief Przesyłanie danych między plikami a gniazdami
+ */
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE /* splice() */
+#endif
+
+#include "internal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fileio.h"
+#include "network.h"
+
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+#  include <sys/sendfile.h>
+#  define GG_FILE_USE_SENDFILE
+#endif
+
+#if defined(HAVE_SPLICE) && defined(SPLICE_F_MOVE)
+#  define GG_FILE_USE_SPLICE
+#endif
+
+/**
+ * \internal Rozmiar bufora używanego, gdy nie można przesłać danych
+ * bezpośrednio między plikiem a gniazdem.
+ */
+#define GG_FILE_BUFFER_SIZE 16384
+
+/**
+ * \internal Zapisuje do pliku cały bufor.
+ *
+ * \param fd Deskryptor pliku
+ * \param buf Bufor z danymi
+ * \param len Długość bufora
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_file_write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		int res;
+
+		res = write(fd, buf, len);
+
+		if (res == -1 && errno == EINTR)
+			continue;
+
+		if (res < 1)
+			return -1;
+
+		buf += res;
+		len -= res;
+	}
+
+	return 0;
+}
+
+/**
+ * \internal Wysyła do gniazda fragment pliku.
+ *
+ * Jeśli system na to pozwala, dane są przesyłane funkcją \c sendfile() bez
+ * kopiowania do przestrzeni użytkownika. W przeciwnym wypadku są czytane
+ * do bufora i wysyłane funkcją \c send(). Przesyłanie trwa do wysłania
+ * wszystkich danych lub do zapełnienia bufora gniazda.
+ *
+ * \param sock Deskryptor gniazda (nieblokującego)
+ * \param fd Deskryptor pliku
+ * \param seek Flaga mówiąca, czy można zmieniać położenie w pliku. Jeśli
+ *             nie jest ustawiona, dane są czytane od bieżącego położenia,
+ *             a parametr \c offset jest ignorowany
+ * \param offset Położenie w pliku
+ * \param count Liczba bajtów do wysłania
+ * \param chunk Maksymalna liczba bajtów przesyłanych jednym wywołaniem
+ *              systemowym lub 0 dla wartości domyślnej
+ * \param done Wskaźnik na zmienną, do której zostanie zapisana liczba
+ *             wysłanych bajtów
+ *
+ * \return Wynik przesyłania
+ */
+gg_file_transfer_t gg_file_send(int sock, int fd, int seek, off_t offset,
+	size_t count, size_t chunk, size_t *done)
+{
+	char buf[GG_FILE_BUFFER_SIZE];
+
+	*done = 0;
+
+	if (chunk == 0)
+		chunk = GG_FILE_CHUNK_SIZE;
+
+#ifdef GG_FILE_USE_SENDFILE
+	while (*done < count) {
+		off_t pos = offset + *done;
+		size_t len = count - *done;
+		ssize_t res;
+
+		if (len > chunk)
+			len = chunk;
+
+		res = sendfile(sock, fd, seek ? &pos : NULL, len);
+
+		if (res > 0) {
+			*done += res;
+			continue;
+		}
+
+		if (res == 0)
+			return GG_FILE_TRANSFER_EOF;
+
+		if (errno == EINTR)
+			continue;
+
+		if (errno == EAGAIN)
+			return GG_FILE_TRANSFER_OK;
+
+		/* Plik lub gniazdo nie obsługuje sendfile(), więc
+		 * przechodzimy do zwykłego kopiowania */
+		if (errno == EINVAL || errno == ENOSYS)
+			break;
+
+		if (errno == EIO)
+			return GG_FILE_TRANSFER_ERROR_FILE;
+
+		return GG_FILE_TRANSFER_ERROR_NET;
+	}
+#endif
+
+	if (*done < count && seek &&
+		lseek(fd, offset + *done, SEEK_SET) == (off_t) -1)
+	{
+		return GG_FILE_TRANSFER_ERROR_FILE;
+	}
+
+	while (*done < count) {
+		size_t len = count - *done;
+		int res, sent = 0;
+
+		if (len > chunk)
+			len = chunk;
+
+		if (len > sizeof(buf))
+			len = sizeof(buf);
+
+		res = read(fd, buf, len);
+
+		if (res == -1 && errno == EINTR)
+			continue;
+
+		if (res == -1)
+			return GG_FILE_TRANSFER_ERROR_FILE;
+
+		if (res == 0)
+			return GG_FILE_TRANSFER_EOF;
+
+		while (sent < res) {
+			int tmp;
+
+			tmp = send(sock, buf + sent, res - sent, 0);
+
+			if (tmp == -1 && errno == EINTR)
+				continue;
+
+			if (tmp == -1 && errno == EAGAIN)
+				break;
+
+			if (tmp < 1)
+				return GG_FILE_TRANSFER_ERROR_NET;
+
+			sent += tmp;
+		}
+
+		*done += sent;
+
+		if (sent < res) {
+			/* Niewysłaną część trzeba będzie przeczytać jeszcze
+			 * raz. Przy ustawionej fladze seek zrobi to kolejne
+			 * wywołanie. */
+			if (!seek && lseek(fd, -(off_t) (res - sent), SEEK_CUR) == (off_t) -1)
+				return GG_FILE_TRANSFER_ERROR_FILE;
+
+			return GG_FILE_TRANSFER_OK;
+		}
+	}
+
+	return GG_FILE_TRANSFER_OK;
+}
+
+/**
+ * \internal Potok do przenoszenia danych funkcją \c splice().
+ */
+struct gg_file_pipe {
+	int fds[2];		/**< Deskryptory potoku lub -1 */
+	int splice_socket;	/**< Flaga obsługi \c splice() przez gniazdo */
+	int splice_file;	/**< Flaga obsługi \c splice() przez plik */
+};
+
+/**
+ * \internal Zamyka potok używany do odbierania pliku.
+ *
+ * \param fp Potok lub \c NULL
+ */
+void gg_file_pipe_free(gg_file_pipe_t *fp)
+{
+	if (fp == NULL)
+		return;
+
+	if (fp->fds[0] != -1)
+		close(fp->fds[0]);
+
+	if (fp->fds[1] != -1)
+		close(fp->fds[1]);
+
+	free(fp);
+}
+
+#ifdef GG_FILE_USE_SPLICE
+
+/**
+ * \internal Zwraca potok do odbierania pliku, tworząc go przy pierwszym
+ * użyciu.
+ *
+ * \param pipe_ptr Wskaźnik na potok
+ *
+ * \return Potok gotowy do użycia lub \c NULL, jeśli należy odebrać dane
+ *         bez \c splice()
+ */
+static gg_file_pipe_t *gg_file_pipe_get(gg_file_pipe_t **pipe_ptr)
+{
+	gg_file_pipe_t *fp = *pipe_ptr;
+
+	if (fp == NULL) {
+		fp = malloc(sizeof(gg_file_pipe_t));
+
+		if (fp == NULL)
+			return NULL;
+
+		fp->splice_socket = 1;
+		fp->splice_file = 1;
+
+		if (pipe(fp->fds) == -1) {
+			fp->fds[0] = -1;
+			fp->fds[1] = -1;
+			fp->splice_socket = 0;
+		}
+
+		*pipe_ptr = fp;
+	}
+
+	return fp->splice_socket ? fp : NULL;
+}
+
+/**
+ * \internal Przenosi dane z potoku do pliku.
+ *
+ * \param pipe_fd Deskryptor potoku do odczytu
+ * \param fd Deskryptor pliku
+ * \param len Liczba bajtów w potoku
+ * \param use_splice Wskaźnik na flagę użycia \c splice(), zerowaną, jeśli
+ *                   plik nie obsługuje tej funkcji
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_file_drain_pipe(int pipe_fd, int fd, size_t len, int *use_splice)
+{
+	char buf[GG_FILE_BUFFER_SIZE];
+
+	while (len > 0 && *use_splice) {
+		ssize_t res;
+
+		res = splice(pipe_fd, NULL, fd, NULL, len, SPLICE_F_MOVE);
+
+		if (res == -1 && errno == EINTR)
+			continue;
+
+		if (res == -1 && errno == EINVAL) {
+			*use_splice = 0;
+			break;
+		}
+
+		if (res < 1)
+			return -1;
+
+		len -= res;
+	}
+
+	while (len > 0) {
+		size_t chunk = (len > sizeof(buf)) ? sizeof(buf) : len;
+		int res;
+
+		res = read(pipe_fd, buf, chunk);
+
+		if (res == -1 && errno == EINTR)
+			continue;
+
+		if (res < 1 || gg_file_write_all(fd, buf, res) == -1)
+			return -1;
+
+		len -= res;
+	}
+
+	return 0;
+}
+
+/**
+ * \internal Odbiera z gniazda dane do pliku za pomocą \c splice().
+ *
+ * \param sock Deskryptor gniazda
+ * \param fd Deskryptor pliku
+ * \param count Liczba bajtów do odebrania
+ * \param chunk Maksymalna liczba bajtów przesyłanych jednym wywołaniem
+ * \param done Wskaźnik na liczbę odebranych bajtów
+ * \param fp Potok
+ *
+ * \return Wynik przesyłania
+ */
+static gg_file_transfer_t gg_file_recv_splice(int sock, int fd, size_t count,
+	size_t chunk, size_t *done, gg_file_pipe_t *fp)
+{
+	while (*done < count) {
+		size_t len = count - *done;
+		ssize_t res;
+
+		if (len > chunk)
+			len = chunk;
+
+		res = splice(sock, NULL, fp->fds[1], NULL, len,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+		if (res == -1 && errno == EINTR)
+			continue;
+
+		if (res == -1 && errno == EAGAIN)
+			break;
+
+		if (res == -1 && (errno == EINVAL || errno == ENOSYS)) {
+			/* Resztę danych odbierze zwykłe recv() */
+			fp->splice_socket = 0;
+			break;
+		}
+
+		if (res == -1)
+			return GG_FILE_TRANSFER_ERROR_NET;
+
+		if (res == 0)
+			return GG_FILE_TRANSFER_EOF;
+
+		if (gg_file_drain_pipe(fp->fds[0], fd, res, &fp->splice_file) == -1)
+			return GG_FILE_TRANSFER_ERROR_FILE;
+
+		*done += res;
+	}
+
+	return GG_FILE_TRANSFER_OK;
+}
+
+#endif /* GG_FILE_USE_SPLICE */
+
+/**
+ * \internal Odbiera z gniazda dane do pliku.
+ *
+ * Jeśli podano wskaźnik na potok i system na to pozwala, dane są
+ * przenoszone funkcją \c splice() bez kopiowania do przestrzeni
+ * użytkownika. Potok jest tworzony przy pierwszym wywołaniu i używany aż do
+ * zwolnienia funkcją \c gg_file_pipe_free() po zakończeniu transferu.
+ * W przeciwnym wypadku dane są odbierane do bufora i zapisywane funkcją
+ * \c write(). Przesyłanie trwa do odebrania wszystkich danych lub do
+ * opróżnienia bufora gniazda.
+ *
+ * \param sock Deskryptor gniazda (nieblokującego)
+ * \param fd Deskryptor pliku
+ * \param count Liczba bajtów do odebrania
+ * \param chunk Maksymalna liczba bajtów przesyłanych jednym wywołaniem
+ *              systemowym lub 0 dla wartości domyślnej
+ * \param done Wskaźnik na zmienną, do której zostanie zapisana liczba
+ *             odebranych bajtów
+ * \param pipe_ptr Wskaźnik na potok transferu (początkowo \c NULL) lub
+ *                 \c NULL, jeśli dane mają być odbierane bez \c splice()
+ *
+ * \return Wynik przesyłania
+ */
+gg_file_transfer_t gg_file_recv(int sock, int fd, size_t count, size_t chunk,
+	size_t *done, gg_file_pipe_t **pipe_ptr)
+{
+	char buf[GG_FILE_BUFFER_SIZE];
+
+	*done = 0;
+
+	if (chunk == 0)
+		chunk = GG_FILE_CHUNK_SIZE;
+
+#ifdef GG_FILE_USE_SPLICE
+	if (pipe_ptr != NULL) {
+		gg_file_pipe_t *fp = gg_file_pipe_get(pipe_ptr);
+		gg_file_transfer_t res;
+
+		if (fp != NULL) {
+			res = gg_file_recv_splice(sock, fd, count, chunk, done, fp);
+
+			if (res != GG_FILE_TRANSFER_OK || fp->splice_socket)
+				return res;
+		}
+	}
+#else
+	(void) pipe_ptr;
+#endif
+
+	while (*done < count) {
+		size_t len = count - *done;
+		int res;
+
+		if (len > chunk)
+			len = chunk;
+
+		if (len > sizeof(buf))
+			len = sizeof(buf);
+
+		res = recv(sock, buf, len, 0);
+
+		if (res == -1 && errno == EINTR)
+			continue;
+
+		if (res == -1 && errno == EAGAIN)
+			break;
+
+		if (res == -1)
+			return GG_FILE_TRANSFER_ERROR_NET;
+
+		if (res == 0)
+			return GG_FILE_TRANSFER_EOF;
+
+		if (gg_file_write_all(fd, buf, res) == -1)
+			return GG_FILE_TRANSFER_ERROR_FILE;
+
+		*done += res;
+	}
+
+	return GG_FILE_TRANSFER_OK;
+}
+
+/**
+ * \internal Informuje system, że plik będzie czytany lub zapisywany
+ * sekwencyjnie.
+ *
+ * Pozwala to systemowi zwiększyć wyprzedzające czytanie pliku. Jeśli
+ * system nie obsługuje \c posix_fadvise(), funkcja nic nie robi.
+ *
+ * \param fd Deskryptor pliku
+ */
+void gg_file_advise_sequential(int fd)
+{
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_SEQUENTIAL)
+	(void) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+	(void) fd;
+#endif
+}
@@ -41,6 +41,7 @@
 #include "deflate.h"
 #include "tvbuff.h"
 #include "protobuf.h"
+#include "protobuf-fast.h"
 #include "packets.pb-c.h"
 
 #include <errno.h>
@@ -73,8 +74,12 @@ static int gg_ack_110(struct gg_session *gs, GG110Ack__Type type, uint32_t seq,
 	msg.type = type;
 	msg.seq = seq;
 
-	if (!GG_PROTOBUF_SEND(gs, ge, GG_ACK110, gg110_ack, msg))
+	if (!gg_protobuf_send_ex(gs, ge, GG_ACK110, &msg,
+		(gg_protobuf_size_cb_t) gg_protobuf_ack_size,
+		(gg_protobuf_pack_cb_t) gg_protobuf_ack_pack))
+	{
 		return -1;
+	}
 	return 0;
 }
 
@@ -169,7 +174,7 @@ static int gg_session_handle_welcome_110(struct gg_session *gs, uint32_t seed,
 static int gg_session_handle_login110_ok(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110LoginOK *msg = gg110_login_ok__unpack(NULL, len, (uint8_t*)ptr);
+	GG110LoginOK *msg = gg110_login_ok__unpack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 
 	if (!GG_PROTOBUF_VALID(gs, "GG110LoginOK", msg))
 		return -1;
@@ -180,7 +185,7 @@ static int gg_session_handle_login110_ok(struct gg_session *gs, uint32_t type,
 	gg_debug_session(gs, GG_DEBUG_MISC, "// login110_ok: "
 		"uin=%u, dummyhash=%s\n", msg->uin, msg->dummyhash);
 
-	gg110_login_ok__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	ge->type = GG_EVENT_CONN_SUCCESS;
 	gs->state = GG_STATE_CONNECTED;
@@ -409,7 +414,6 @@ static int gg_session_handle_login_failed(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_send_msg_ack(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	struct gg_session_private *p = gs->private_data;
 	const struct gg_send_msg_ack *s = (const struct gg_send_msg_ack*) ptr;
 
 	gg_debug_session(gs, GG_DEBUG_MISC, "// gg_watch_fd_connected() received a message ack\n");
@@ -419,9 +423,10 @@ static int gg_session_handle_send_msg_ack(struct gg_session *gs, uint32_t type,
 	ge->event.ack.recipient = gg_fix32(s->recipient);
 	ge->event.ack.seq = gg_fix32(s->seq);
 
-	if (ge->event.ack.seq == 0 && p->imgout_waiting_ack > 0)
-		p->imgout_waiting_ack--;
-	gg_image_sendout(gs);
+	if (ge->event.ack.seq == 0)
+		gg_image_sendout_ack(gs);
+	else
+		gg_image_sendout(gs);
 
 	return 0;
 }
@@ -432,8 +437,7 @@ static int gg_session_handle_send_msg_ack(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_send_msg_ack_110(struct gg_session *gs,
 	uint32_t type, const char *ptr, size_t len, struct gg_event *ge)
 {
-	struct gg_session_private *p = gs->private_data;
-	GG110MessageAck *msg = gg110_message_ack__unpack(NULL, len, (uint8_t*)ptr);
+	GG110MessageAck *msg = gg_protobuf_unpack_message_ack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 	size_t i;
 
 	if (!GG_PROTOBUF_VALID(gs, "GG110MessageAck", msg))
@@ -471,14 +475,14 @@ static int gg_session_handle_send_msg_ack_110(struct gg_session *gs,
 	ge->event.ack110.msg_type = msg->msg_type;
 	ge->event.ack110.seq = msg->seq;
 	ge->event.ack110.time = msg->time;
+	ge->event.ack110.latency = gg_sent_message_ack(gs, msg->seq);
 
-	gg_compat_message_ack(gs, msg->seq);
-
-	gg110_message_ack__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
-	if (msg->seq == 0 && p->imgout_waiting_ack > 0)
-		p->imgout_waiting_ack--;
-	gg_image_sendout(gs);
+	if (msg->seq == 0)
+		gg_image_sendout_ack(gs);
+	else
+		gg_image_sendout(gs);
 
 	return 0;
 }
@@ -557,7 +561,7 @@ static int gg_session_handle_xml_event(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_event_110(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110Event *msg = gg110_event__unpack(NULL, len, (uint8_t*)ptr);
+	GG110Event *msg = gg110_event__unpack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 	int succ = 1;
 
 	if (!GG_PROTOBUF_VALID(gs, "GG110Event", msg))
@@ -587,7 +591,7 @@ static int gg_session_handle_event_110(struct gg_session *gs, uint32_t type,
 		succ = 0;
 	}
 
-	gg110_event__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	return succ ? 0 : -1;
 }
@@ -746,7 +750,7 @@ static void gg_image_queue_parse(struct gg_event *e, const char *p,
 	uint32_t type)
 {
 	const struct gg_msg_image_reply *i = (const void*) p;
-	struct gg_image_queue *q, *qq;
+	struct gg_image_queue *q;
 
 	gg_debug_session(sess, GG_DEBUG_VERBOSE,
 		"// gg_image_queue_parse(%p, %p, %d, %p, %u, %d)\n",
@@ -758,6 +762,12 @@ static void gg_image_queue_parse(struct gg_event *e, const char *p,
 	}
 
 	if (i->flag == GG_MSG_OPTION_IMAGE_REQUEST) {
+		if (gg_image_cache_reply(sess, sender, gg_fix32(i->size),
+			gg_fix32(i->crc32)) == 1)
+		{
+			return;
+		}
+
 		e->type = GG_EVENT_IMAGE_REQUEST;
 		e->event.image_request.sender = sender;
 		e->event.image_reply.size = i->size;
@@ -767,12 +777,7 @@ static void gg_image_queue_parse(struct gg_event *e, const char *p,
 
 	/* znajdź dany obrazek w kolejce danej sesji */
 
-	for (qq = sess->images, q = NULL; qq; qq = qq->next) {
-		if (sender == qq->sender && i->size == qq->size && i->crc32 == qq->crc32) {
-			q = qq;
-			break;
-		}
-	}
+	q = gg_image_queue_find(sess, sender, i->size, i->crc32);
 
 	if (!q) {
 		gg_debug_session(sess, GG_DEBUG_WARNING,
@@ -799,6 +804,8 @@ static void gg_image_queue_parse(struct gg_event *e, const char *p,
 			return;
 		}
 
+		free(q->filename);
+
 		if (!(q->filename = strdup(p))) {
 			gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_image_queue_parse() out of memory\n");
 			return;
@@ -819,7 +826,16 @@ static void gg_image_queue_parse(struct gg_event *e, const char *p,
 		len = q->size - q->done;
 	}
 
-	memcpy(q->image + q->done, p, len);
+	if (gg_image_queue_reserve(sess, q, q->done + len) == -1) {
+		gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_image_queue_parse() "
+			"no room for image from %d, dropping\n", sender);
+		gg_image_queue_remove(sess, q, 1);
+		sess->private_data->image_index.evicted++;
+		return;
+	}
+
+	if (len > 0)
+		memcpy(q->image + q->done, p, len);
 	q->done += len;
 
 	gg_debug_session(sess, GG_DEBUG_VERBOSE,
@@ -839,7 +855,7 @@ static void gg_image_queue_parse(struct gg_event *e, const char *p,
 		e->event.image_reply.filename = q->filename;
 		e->event.image_reply.image = q->image;
 
-		gg_image_queue_remove(sess, q, 0);
+		gg_image_queue_complete(sess, q);
 
 		free(q);
 	}
@@ -987,6 +1003,15 @@ static int gg_handle_recv_msg_options(struct gg_session *sess,
 					goto malformed;
 				}
 
+				/* obrazek z pamięci podręcznej wysyłamy sami,
+				 * a GG_RECV_MSG80 ustawił już GG_EVENT_MSG */
+				if (gg_image_cache_reply(sess, sender,
+					gg_fix32(i->size), gg_fix32(i->crc32)) == 1)
+				{
+					e->type = GG_EVENT_NONE;
+					goto handled;
+				}
+
 				e->event.image_request.sender = sender;
 				e->event.image_request.size = gg_fix32(i->size);
 				e->event.image_request.crc32 = gg_fix32(i->crc32);
@@ -1371,7 +1396,7 @@ malformed:
 static int gg_session_handle_recv_msg_110(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110RecvMessage *msg = gg110_recv_message__unpack(NULL, len, (uint8_t*)ptr);
+	GG110RecvMessage *msg = gg_protobuf_unpack_recv_message(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 	uint8_t ack_type;
 	uin_t sender = 0;
 	uint32_t seq;
@@ -1416,7 +1441,7 @@ static int gg_session_handle_recv_msg_110(struct gg_session *gs, uint32_t type,
 			gg_image_queue_parse(ge, (char *)msg->data.data,
 				msg->data.len, gs, sender, type);
 		}
-		gg110_recv_message__free_unpacked(msg, NULL);
+		GG_PROTOBUF_FREE(gs, msg);
 		return gg_ack_110(gs, GG110_ACK__TYPE__MSG, seq, ge);
 	}
 
@@ -1493,7 +1518,7 @@ static int gg_session_handle_recv_msg_110(struct gg_session *gs, uint32_t type,
 		}
 	}
 
-	gg110_recv_message__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	if (gg_ack_110(gs, ack_type, seq, ge) != 0)
 		succ = 0;
@@ -1677,6 +1702,51 @@ static int gg_session_handle_notify_reply(struct gg_session *gs, uint32_t type,
 	return 0;
 }
 
+/**
+ * \internal Odczytuje rekord pakietu GG_STATUS80 lub GG_NOTIFY_REPLY80 do
+ * struktury kontaktu listy prowadzonej przez bibliotekę.
+ *
+ * \param gs      Struktura sesji
+ * \param n       Rekord pakietu
+ * \param length  Liczba bajtów od początku rekordu do końca pakietu
+ * \param contact Struktura kontaktu
+ *
+ * \return Długość rekordu, 0 jeśli opis wykracza poza pakiet (kontakt jest
+ *         wtedy wypełniony bez opisu) lub -1 w przypadku błędu
+ */
+static int gg_session_read_status_80(struct gg_session *gs,
+	const struct gg_notify_reply80 *n, size_t length,
+	struct gg_roster_contact *contact)
+{
+	uint32_t descr_len;
+
+	contact->uin = gg_fix32(n->uin);
+	contact->status = gg_fix32(n->status);
+	contact->descr = NULL;
+	contact->image_size = n->image_size;
+	contact->flags = gg_fix32(n->flags);
+	contact->remote_ip = n->remote_ip;
+	contact->remote_port = gg_fix16(n->remote_port);
+
+	descr_len = gg_fix32(n->descr_len);
+
+	if (descr_len > length - sizeof(struct gg_notify_reply80))
+		return 0;
+
+	if (descr_len != 0) {
+		contact->descr = gg_encoding_convert(
+			(const char*) n + sizeof(struct gg_notify_reply80),
+			GG_ENCODING_UTF8, gs->encoding, descr_len, -1);
+
+		if (contact->descr == NULL) {
+			gg_debug_session(gs, GG_DEBUG_MISC, "// gg_watch_fd_connected() out of memory\n");
+			return -1;
+		}
+	}
+
+	return sizeof(struct gg_notify_reply80) + descr_len;
+}
+
 /**
  * \internal Obsługuje pakiet GG_STATUS80.
  *
@@ -1690,6 +1760,15 @@ static int gg_session_handle_status_80(struct gg_session *gs, uint32_t type,
 
 	gg_debug_session(gs, GG_DEBUG_MISC, "// gg_watch_fd_connected() received a status change\n");
 
+	if (gs->private_data->roster_enabled) {
+		struct gg_roster_contact contact;
+
+		if (gg_session_read_status_80(gs, n, len, &contact) == -1)
+			return -1;
+
+		return gg_roster_update(gs, ge, &contact);
+	}
+
 	ge->type = GG_EVENT_STATUS60;
 	ge->event.status60.uin = gg_fix32(n->uin);
 	ge->event.status60.status = gg_fix32(n->status);
@@ -1735,6 +1814,26 @@ static int gg_session_handle_notify_reply_80(struct gg_session *gs,
 
 	gg_debug_session(gs, GG_DEBUG_MISC, "// gg_watch_fd_connected() received a notify reply\n");
 
+	if (gs->private_data->roster_enabled) {
+		while (length >= sizeof(struct gg_notify_reply80)) {
+			struct gg_roster_contact contact;
+			int res;
+
+			res = gg_session_read_status_80(gs, n, length, &contact);
+
+			if (res == -1 || gg_roster_update(gs, ge, &contact) == -1)
+				return -1;
+
+			if (res == 0)
+				break;
+
+			length -= res;
+			n = (const void*) ((const char*) n + res);
+		}
+
+		return 0;
+	}
+
 	ge->type = GG_EVENT_NOTIFY60;
 	ge->event.notify60 = malloc(sizeof(*ge->event.notify60));
 
@@ -2345,7 +2444,7 @@ static int gg_session_handle_userlist_100_reply(struct gg_session *gs,
 static int gg_session_handle_imtoken(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110Imtoken *msg = gg110_imtoken__unpack(NULL, len, (uint8_t*)ptr);
+	GG110Imtoken *msg = gg110_imtoken__unpack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 	char *imtoken = NULL;
 	int succ = 1;
 
@@ -2360,7 +2459,7 @@ static int gg_session_handle_imtoken(struct gg_session *gs, uint32_t type,
 		succ = succ && (imtoken != NULL);
 	}
 
-	gg110_imtoken__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	ge->type = GG_EVENT_IMTOKEN;
 	ge->event.imtoken.imtoken = imtoken;
@@ -2371,7 +2470,7 @@ static int gg_session_handle_imtoken(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_pong_110(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110Pong *msg = gg110_pong__unpack(NULL, len, (uint8_t*)ptr);
+	GG110Pong *msg = gg_protobuf_unpack_pong(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 
 	if (!GG_PROTOBUF_VALID(gs, "GG110Pong", msg))
 		return -1;
@@ -2384,7 +2483,7 @@ static int gg_session_handle_pong_110(struct gg_session *gs, uint32_t type,
 
 	gg_sync_time(gs, msg->server_time);
 
-	gg110_pong__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	return 0;
 }
@@ -2441,10 +2540,8 @@ static int gg_session_handle_chat_info(struct gg_session *gs, uint32_t type,
 		}
 	}
 
-	for (i = 0; i < participants_count && gg_tvbuff_is_valid(tvb); i++) {
-		participants[i] = gg_tvbuff_read_uint32(tvb);
-		gg_tvbuff_read_uint32(tvb); /* 0x1e lub 0x18 */
-	}
+	/* Numer i nieznane pole (0x1e lub 0x18) */
+	gg_tvbuff_read_uint32_strided(tvb, participants, participants_count, 8);
 
 	if (!gg_tvbuff_close(tvb)) {
 		free(participants);
@@ -2475,9 +2572,10 @@ static int gg_session_handle_chat_info(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_chat_info_update(struct gg_session *gs,
 	uint32_t type, const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110ChatInfoUpdate *msg = gg110_chat_info_update__unpack(NULL, len, (uint8_t*)ptr);
+	GG110ChatInfoUpdate *msg = gg110_chat_info_update__unpack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 	gg_chat_list_t *chat;
 	uin_t participant;
+	int changed = 0;
 
 	if (!GG_PROTOBUF_VALID(gs, "GG110ChatInfoUpdate", msg))
 		return -1;
@@ -2494,49 +2592,34 @@ static int gg_session_handle_chat_info_update(struct gg_session *gs,
 	ge->event.chat_info_update.inviter = gg_protobuf_get_uin(msg->inviter);
 	ge->event.chat_info_update.version = msg->version;
 	ge->event.chat_info_update.time = msg->time;
+	ge->event.chat_info_update.participants_count = 0;
+	ge->event.chat_info_update.changed = 0;
 
 	chat = gg_chat_find(gs, msg->chat_id);
 	if (!chat) {
-		gg110_chat_info_update__free_unpacked(msg, NULL);
+		GG_PROTOBUF_FREE(gs, msg);
 		return 0;
 	}
 
 	chat->version = msg->version;
-	if (msg->update_type == GG_CHAT_INFO_UPDATE_ENTERED) {
-		uin_t *old_part = chat->participants;
-		chat->participants = realloc(chat->participants,
-			sizeof(uin_t) * (chat->participants_count + 1));
-		if (chat->participants == NULL) {
-			chat->participants = old_part;
-			gg_debug_session(gs, GG_DEBUG_ERROR,
-				"// gg_session_handle_chat_info_update() "
-				"out of memory (count=%u)\n",
-				chat->participants_count);
-			gg110_chat_info_update__free_unpacked(msg, NULL);
-			return -1;
-		}
-		chat->participants_count++;
-		chat->participants[chat->participants_count - 1] = participant;
-	} else if (msg->update_type == GG_CHAT_INFO_UPDATE_EXITED) {
-		uint32_t idx;
-		for (idx = 0; idx < chat->participants_count; idx++)
-			if (chat->participants[idx] == participant)
-				break;
-		if (idx < chat->participants_count) {
-			chat->participants_count--;
-			if (chat->participants_count == 0) {
-				free(chat->participants);
-				chat->participants = NULL;
-			} else {
-				chat->participants[idx] =
-					chat->participants[chat->participants_count];
-				chat->participants = realloc(chat->participants,
-					sizeof(uin_t)*chat->participants_count);
-			}
-		}
+	if (msg->update_type == GG_CHAT_INFO_UPDATE_ENTERED)
+		changed = gg_chat_participant_add(chat, participant);
+	else if (msg->update_type == GG_CHAT_INFO_UPDATE_EXITED)
+		changed = gg_chat_participant_remove(chat, participant);
+
+	if (changed == -1) {
+		gg_debug_session(gs, GG_DEBUG_ERROR,
+			"// gg_session_handle_chat_info_update() "
+			"out of memory (count=%u)\n",
+			chat->participants_count);
+		GG_PROTOBUF_FREE(gs, msg);
+		return -1;
 	}
 
-	gg110_chat_info_update__free_unpacked(msg, NULL);
+	ge->event.chat_info_update.participants_count = chat->participants_count;
+	ge->event.chat_info_update.changed = changed;
+
+	GG_PROTOBUF_FREE(gs, msg);
 	return 0;
 }
 
@@ -2581,6 +2664,8 @@ static int gg_session_handle_chat_left(struct gg_session *gs, uint32_t type,
 	ge->event.chat_info_update.inviter = gg_fix32(p->uin);
 	ge->event.chat_info_update.version = 0;
 	ge->event.chat_info_update.time = time(NULL);
+	ge->event.chat_info_update.participants_count = 0;
+	ge->event.chat_info_update.changed = 0;
 
 	return 0;
 }
@@ -2588,7 +2673,7 @@ static int gg_session_handle_chat_left(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_options(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110Options *msg = gg110_options__unpack(NULL, len, (uint8_t*)ptr);
+	GG110Options *msg = gg110_options__unpack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 	size_t i;
 
 	if (!GG_PROTOBUF_VALID(gs, "GG110Options", msg))
@@ -2605,7 +2690,7 @@ static int gg_session_handle_options(struct gg_session *gs, uint32_t type,
 			kvp->key, kvp->value);
 	}
 
-	gg110_options__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	return 0;
 }
@@ -2613,7 +2698,7 @@ static int gg_session_handle_options(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_access_info(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110AccessInfo *msg = gg110_access_info__unpack(NULL, len, (uint8_t*)ptr);
+	GG110AccessInfo *msg = gg110_access_info__unpack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 
 	if (!GG_PROTOBUF_VALID(gs, "GG110AccessInfo", msg))
 		return -1;
@@ -2624,7 +2709,7 @@ static int gg_session_handle_access_info(struct gg_session *gs, uint32_t type,
 		msg->dummy1, msg->dummy2, msg->last_message,
 		msg->last_file_transfer, msg->last_conference_ch);
 
-	gg110_access_info__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	return 0;
 }
@@ -2667,7 +2752,7 @@ static int gg_session_handle_uin_info(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_transfer_info(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG112TransferInfo *msg = gg112_transfer_info__unpack(NULL, len, (uint8_t*)ptr);
+	GG112TransferInfo *msg = gg112_transfer_info__unpack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 	int succ = 1;
 	size_t i;
 	uin_t peer = 0, sender = 0;
@@ -2722,7 +2807,7 @@ static int gg_session_handle_transfer_info(struct gg_session *gs, uint32_t type,
 	succ = (gg_ack_110(gs, GG110_ACK__TYPE__TRANSFER_INFO,
 		msg->seq, ge) == 0);
 
-	gg112_transfer_info__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	return succ ? 0 : -1;
 }
@@ -2730,7 +2815,7 @@ static int gg_session_handle_transfer_info(struct gg_session *gs, uint32_t type,
 static int gg_session_handle_magic_notification(struct gg_session *gs, uint32_t type,
 	const char *ptr, size_t len, struct gg_event *ge)
 {
-	GG110MagicNotification *msg = gg110_magic_notification__unpack(NULL, len, (uint8_t*)ptr);
+	GG110MagicNotification *msg = gg110_magic_notification__unpack(gg_protobuf_arena(gs), len, (uint8_t*)ptr);
 	int succ = 1;
 
 	if (!GG_PROTOBUF_VALID(gs, "GG110MagicNotification", msg))
@@ -2745,7 +2830,7 @@ static int gg_session_handle_magic_notification(struct gg_session *gs, uint32_t
 
 	succ = (gg_ack_110(gs, GG110_ACK__TYPE__MAGIC_NOTIFICATION, msg->seq, ge) == 0);
 
-	gg110_magic_notification__free_unpacked(msg, NULL);
+	GG_PROTOBUF_FREE(gs, msg);
 
 	return succ ? 0 : -1;
 }
@@ -2815,6 +2900,48 @@ static const gg_packet_handler_t handlers[] =
 	/* style:maxlinelength:end-ignore */
 };
 
+/**
+ * \internal Rozmiar indeksu tablicy obsługiwanych pakietów. Typy pakietów
+ * spoza tego zakresu nie są obsługiwane.
+ */
+#define GG_HANDLERS_INDEX_SIZE 256
+
+/**
+ * \internal Indeks tablicy obsługiwanych pakietów według ich typu. Zawiera
+ * numer pozycji w tablicy \c handlers powiększony o 1 lub 0, jeśli pakiet
+ * nie jest obsługiwany.
+ */
+static unsigned char handlers_index[GG_HANDLERS_INDEX_SIZE];
+
+/**
+ * \internal Flaga zbudowania indeksu \c handlers_index.
+ */
+static int handlers_index_ready;
+
+/**
+ * \internal Buduje indeks tablicy obsługiwanych pakietów.
+ *
+ * Jeśli typ pakietu występuje w tablicy wielokrotnie, obowiązuje pierwsze
+ * wystąpienie. Indeks jest za każdym razem budowany tak samo, więc
+ * jednoczesne wywołanie z kilku wątków niczego nie psuje.
+ */
+static void gg_session_handlers_index_init(void)
+{
+	unsigned int i;
+
+	GG_STATIC_ASSERT(sizeof(handlers) / sizeof(handlers[0]) < 255,
+		handlers_index_too_small);
+
+	for (i = sizeof(handlers) / sizeof(handlers[0]); i > 0; i--) {
+		uint32_t type = handlers[i - 1].type;
+
+		if (type < GG_HANDLERS_INDEX_SIZE)
+			handlers_index[type] = i;
+	}
+
+	handlers_index_ready = 1;
+}
+
 /**
  * \internal Obsługuje przychodzący pakiet danych.
  *
@@ -2828,7 +2955,7 @@ static const gg_packet_handler_t handlers[] =
  */
 int gg_session_handle_packet(struct gg_session *gs, uint32_t type, const char *ptr, size_t len, struct gg_event *ge)
 {
-	unsigned int i;
+	const gg_packet_handler_t *handler = NULL;
 
 	gg_debug_session(gs, GG_DEBUG_FUNCTION,
 		"// gg_session_handle_packet(%d, %p, %" GG_SIZE_FMT ")\n",
@@ -2860,26 +2987,33 @@ int gg_session_handle_packet(struct gg_session *gs, uint32_t type, const char *p
 	}
 #endif
 
-	for (i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
-		if (handlers[i].type != 0 && handlers[i].type != type)
-			continue;
+	if (!handlers_index_ready)
+		gg_session_handlers_index_init();
+
+	if (type < GG_HANDLERS_INDEX_SIZE && handlers_index[type] != 0)
+		handler = &handlers[handlers_index[type] - 1];
 
-		if (handlers[i].state != 0 && handlers[i].state != (enum gg_state_t) gs->state) {
+	if (handler != NULL) {
+		if (handler->state != 0 && handler->state != (enum gg_state_t) gs->state) {
 			gg_debug_session(gs, GG_DEBUG_WARNING,
 				"// gg_session_handle_packet() packet 0x%02x "
 				"unexpected in state %d\n", type, gs->state);
-			continue;
-		}
-
-		if (len < handlers[i].min_length) {
+		} else if (len < handler->min_length) {
 			gg_debug_session(gs, GG_DEBUG_ERROR,
 				"// gg_session_handle_packet() packet 0x%02x "
 				"too short (%" GG_SIZE_FMT " bytes)\n",
 				type, len);
-			continue;
-		}
+		} else {
+			int res;
 
-		return (*handlers[i].handler)(gs, type, ptr, len, ge);
+			res = (*handler->handler)(gs, type, ptr, len, ge);
+
+			/* Wiadomości protobuf rozpakowane przez funkcję
+			 * obsługi nie są już potrzebne. */
+			gg_protobuf_arena_reset(gs);
+
+			return res;
+		}
 	}
 
 	gg_debug_session(gs, GG_DEBUG_WARNING, "// gg_session_handle_packet() "
@@ -168,6 +168,7 @@ struct gg_http *gg_http_connect(const char *hostname, int port, int async,
 #ifndef DOXYGEN
 
 #define gg_http_error(x) \
+	gg_loop_item_close_fd(h->loop_item); \
 	if (h->fd > -1) \
 		close(h->fd); \
 	h->fd = -1; \
@@ -219,6 +220,7 @@ int gg_http_watch_fd(struct gg_http *h)
 			gg_http_error(GG_ERROR_RESOLVING);
 		}
 
+		gg_loop_item_close_fd(h->loop_item);
 		close(h->fd);
 		h->fd = -1;
 
@@ -246,6 +248,7 @@ int gg_http_watch_fd(struct gg_http *h)
 			gg_debug(GG_DEBUG_MISC, "=> http, async connection "
 				"failed (errno=%d, %s)\n", (res) ? res : errno,
 				strerror((res) ? res : errno));
+			gg_loop_item_close_fd(h->loop_item);
 			close(h->fd);
 			h->fd = -1;
 			h->state = GG_STATE_ERROR;
@@ -463,6 +466,7 @@ int gg_http_watch_fd(struct gg_http *h)
 			if (h->body_done >= h->body_size) {
 				gg_debug(GG_DEBUG_MISC, "=> http, we're done, closing socket\n");
 				h->state = GG_STATE_PARSING;
+				gg_loop_item_close_fd(h->loop_item);
 				close(h->fd);
 				h->fd = -1;
 			} else {
@@ -511,6 +515,8 @@ int gg_http_watch_fd(struct gg_http *h)
 		return 0;
 	}
 
+	gg_loop_item_close_fd(h->loop_item);
+
 	if (h->fd != -1)
 		close(h->fd);
 
@@ -541,6 +547,7 @@ void gg_http_stop(struct gg_http *h)
 	h->resolver_cleanup(&h->resolver, 1);
 
 	if (h->fd != -1) {
+		gg_loop_item_close_fd(h->loop_item);
 		close(h->fd);
 		h->fd = -1;
 	}
@@ -582,6 +589,8 @@ void gg_http_free(struct gg_http *h)
 	if (h == NULL)
 		return;
 
+	gg_loop_item_remove(h->loop_item);
+
 	gg_http_stop(h);
 	gg_http_free_fields(h);
 	free(h);
@@ -0,0 +1,952 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/**
+ * \file imgcache.c
+ *
+ * \brief Pamięć podręczna wysyłanych obrazków
+ *
+ * Obrazki są wspólne dla wszystkich sesji i wyszukiwane według rozmiaru
+ * i sumy kontrolnej, dzięki czemu sesja odpowiada na prośby o obrazki bez
+ * udziału aplikacji. Gdy obrazki przekraczają limit pamięci, najdawniej
+ * używane są zapisywane do katalogu wymiany albo usuwane.
+ */
+
+#include "internal.h"
+#include "fileio.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <process.h>
+#  define getpid _getpid
+#endif
+
+#ifdef GG_CONFIG_HAVE_PTHREAD
+#  include <pthread.h>
+#endif
+
+/**
+ * \internal Początkowa liczba kubełków tablicy obrazków.
+ */
+#define GG_IMAGE_CACHE_INITIAL_SIZE 64
+
+/**
+ * \internal Stany obrazka w pamięci podręcznej.
+ */
+enum {
+	GG_IMAGE_CACHE_IDLE = 0,	/**< Obrazek nie jest używany przez żaden wątek */
+	GG_IMAGE_CACHE_LOADING,		/**< Obrazek jest wczytywany z katalogu wymiany */
+	GG_IMAGE_CACHE_SPILLING		/**< Obrazek jest zapisywany do katalogu wymiany */
+};
+
+typedef struct gg_image_cache_entry gg_image_cache_entry_t;
+
+/**
+ * \internal Obrazek w pamięci podręcznej.
+ *
+ * Obrazek wczytywany lub zapisywany nie jest zwalniany przez inne wątki.
+ * Usunięcie go z pamięci podręcznej jedynie ustawia flagę \c removed,
+ * a zwolnieniem zajmuje się wątek wykonujący operację na pliku.
+ */
+struct gg_image_cache_entry {
+	uint32_t size;			/**< Rozmiar obrazka */
+	uint32_t crc32;			/**< Suma kontrolna obrazka */
+	char *filename;			/**< Nazwa pliku */
+	struct gg_image_buffer *image;	/**< Bufor obrazka lub \c NULL, jeśli obrazek jest tylko w katalogu wymiany */
+	char *path;			/**< Ścieżka pliku w katalogu wymiany */
+	int spilled;			/**< Flaga zapisania obrazka w katalogu wymiany */
+	int state;			/**< Stan obrazka */
+	int removed;			/**< Flaga usunięcia obrazka w trakcie operacji na pliku */
+
+	gg_image_cache_entry_t *next;	/**< Następny obrazek w kubełku lub na liście do zwolnienia */
+	gg_image_cache_entry_t *older;	/**< Poprzedni obrazek w pamięci */
+	gg_image_cache_entry_t *newer;	/**< Następny obrazek w pamięci */
+	gg_image_cache_entry_t *work;	/**< Następny obrazek do zapisania */
+};
+
+/**
+ * \internal Stan pamięci podręcznej obrazków.
+ */
+static struct {
+	gg_image_cache_entry_t **table;
+	unsigned int size;
+	unsigned int count;
+	gg_image_cache_entry_t *oldest;	/* obrazki w pamięci, od najdawniej używanego */
+	gg_image_cache_entry_t *newest;
+	size_t memory;
+	size_t limit;
+	char *spill_dir;
+	unsigned int sequence;		/* numer kolejnego pliku w katalogu wymiany */
+	unsigned int spilled;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evicted;
+} gg_image_cache;
+
+#ifdef GG_CONFIG_HAVE_PTHREAD
+static pthread_mutex_t gg_image_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gg_image_cache_cond = PTHREAD_COND_INITIALIZER;
+#  define gg_image_cache_lock() pthread_mutex_lock(&gg_image_cache_mutex)
+#  define gg_image_cache_unlock() pthread_mutex_unlock(&gg_image_cache_mutex)
+#  define gg_image_cache_wait() pthread_cond_wait(&gg_image_cache_cond, &gg_image_cache_mutex)
+#  define gg_image_cache_broadcast() pthread_cond_broadcast(&gg_image_cache_cond)
+#else
+#  define gg_image_cache_lock() do { } while (0)
+#  define gg_image_cache_unlock() do { } while (0)
+#  define gg_image_cache_broadcast() do { } while (0)
+#endif
+
+/**
+ * \internal Wyznacza kubełek obrazka.
+ */
+static inline unsigned int gg_image_cache_slot(unsigned int size,
+	uint32_t length, uint32_t crc32)
+{
+	uint32_t hash = (crc32 ^ (length << 16 | length >> 16)) *
+		(uint32_t) 2654435761U;
+
+	return (hash ^ (hash >> 16)) & (size - 1);
+}
+
+/**
+ * \internal Powiększa tablicę obrazków dwukrotnie.
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_image_cache_grow(void)
+{
+	gg_image_cache_entry_t **table;
+	unsigned int size, i;
+
+	size = (gg_image_cache.size != 0) ? gg_image_cache.size * 2 :
+		GG_IMAGE_CACHE_INITIAL_SIZE;
+
+	if (size < gg_image_cache.size ||
+		size > ~(unsigned int)0 / sizeof(gg_image_cache_entry_t *))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+
+	table = calloc(size, sizeof(gg_image_cache_entry_t *));
+
+	if (table == NULL)
+		return -1;
+
+	for (i = 0; i < gg_image_cache.size; i++) {
+		gg_image_cache_entry_t *e = gg_image_cache.table[i];
+
+		while (e != NULL) {
+			gg_image_cache_entry_t *next = e->next;
+			unsigned int slot;
+
+			slot = gg_image_cache_slot(size, e->size, e->crc32);
+			e->next = table[slot];
+			table[slot] = e;
+			e = next;
+		}
+	}
+
+	free(gg_image_cache.table);
+	gg_image_cache.table = table;
+	gg_image_cache.size = size;
+
+	return 0;
+}
+
+/**
+ * \internal Szuka obrazka w tablicy.
+ *
+ * \return Wskaźnik na wskaźnik obrazka w kubełku lub \c NULL
+ */
+static gg_image_cache_entry_t **gg_image_cache_lookup(uint32_t size,
+	uint32_t crc32)
+{
+	gg_image_cache_entry_t **it;
+
+	if (gg_image_cache.table == NULL)
+		return NULL;
+
+	it = &gg_image_cache.table[gg_image_cache_slot(gg_image_cache.size,
+		size, crc32)];
+
+	for (; *it != NULL; it = &(*it)->next) {
+		if ((*it)->size == size && (*it)->crc32 == crc32)
+			return it;
+	}
+
+	return NULL;
+}
+
+/**
+ * \internal Szuka obrazka, czekając na zakończenie jego wczytywania przez
+ * inny wątek.
+ *
+ * \return Obrazek lub \c NULL
+ */
+static gg_image_cache_entry_t *gg_image_cache_find(uint32_t size,
+	uint32_t crc32)
+{
+	gg_image_cache_entry_t **it;
+
+	for (;;) {
+		it = gg_image_cache_lookup(size, crc32);
+
+		if (it == NULL)
+			return NULL;
+
+		if ((*it)->state != GG_IMAGE_CACHE_LOADING)
+			return *it;
+
+#ifdef GG_CONFIG_HAVE_PTHREAD
+		gg_image_cache_wait();
+#else
+		return NULL;
+#endif
+	}
+}
+
+/**
+ * \internal Dopisuje obrazek na koniec listy obrazków w pamięci.
+ */
+static void gg_image_cache_link_newest(gg_image_cache_entry_t *e)
+{
+	e->older = gg_image_cache.newest;
+	e->newer = NULL;
+
+	if (gg_image_cache.newest != NULL)
+		gg_image_cache.newest->newer = e;
+	else
+		gg_image_cache.oldest = e;
+
+	gg_image_cache.newest = e;
+}
+
+/**
+ * \internal Wypina obrazek z listy obrazków w pamięci.
+ */
+static void gg_image_cache_unlink_list(gg_image_cache_entry_t *e)
+{
+	if (e->older != NULL)
+		e->older->newer = e->newer;
+	else
+		gg_image_cache.oldest = e->newer;
+
+	if (e->newer != NULL)
+		e->newer->older = e->older;
+	else
+		gg_image_cache.newest = e->older;
+
+	e->older = NULL;
+	e->newer = NULL;
+}
+
+/**
+ * \internal Zwraca nową ścieżkę pliku obrazka w katalogu wymiany.
+ *
+ * Nazwa zawiera identyfikator procesu i kolejny numer, a plik jest tworzony
+ * z flagą \c O_EXCL, więc procesy dzielące katalog wymiany nie nadpisują
+ * ani nie usuwają swoich plików.
+ *
+ * \return Zaalokowana ścieżka lub \c NULL w przypadku błędu
+ */
+static char *gg_image_cache_path(const gg_image_cache_entry_t *e)
+{
+	return gg_saprintf("%s/%.8x-%u-%d-%u.img", gg_image_cache.spill_dir,
+		e->crc32, e->size, (int) getpid(), gg_image_cache.sequence++);
+}
+
+/**
+ * \internal Zapisuje obrazek do katalogu wymiany.
+ *
+ * Wywoływana bez blokady pamięci podręcznej.
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_image_cache_spill(const gg_image_cache_entry_t *e)
+{
+	const char *data = e->image->data;
+	size_t left = e->size;
+	int fd, res = 0;
+
+	fd = open(e->path, O_WRONLY | O_CREAT | O_EXCL | O_BINARY,
+		S_IRUSR | S_IWUSR);
+
+	if (fd == -1) {
+		gg_debug(GG_DEBUG_MISC, "// gg_image_cache_spill() can't create "
+			"%s (%s)\n", e->path, strerror(errno));
+		return -1;
+	}
+
+	while (left > 0) {
+		int len;
+
+		len = write(fd, data, left);
+
+		if (len <= 0) {
+			res = -1;
+			break;
+		}
+
+		data += len;
+		left -= len;
+	}
+
+	gg_file_close(fd);
+
+	if (res == -1)
+		remove(e->path);
+
+	return res;
+}
+
+/**
+ * \internal Wczytuje obrazek z katalogu wymiany.
+ *
+ * Wywoływana bez blokady pamięci podręcznej. Sumy kontrolnej nie trzeba
+ * liczyć ponownie, bo plik o unikalnej nazwie utworzyła ta pamięć podręczna,
+ * a jego rozmiar jest sprawdzany.
+ *
+ * \return Bufor obrazka lub \c NULL w przypadku błędu
+ */
+static struct gg_image_buffer *gg_image_cache_load(const gg_image_cache_entry_t *e)
+{
+	struct gg_image_buffer *buf = NULL;
+	struct stat st;
+	char *data;
+	size_t done = 0;
+	int fd;
+
+	fd = open(e->path, O_RDONLY | O_BINARY);
+
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) == -1 || st.st_size != (off_t) e->size) {
+		gg_file_close(fd);
+		return NULL;
+	}
+
+	data = malloc(e->size);
+
+	if (data == NULL) {
+		gg_file_close(fd);
+		return NULL;
+	}
+
+	while (done < e->size) {
+		int len;
+
+		len = read(fd, data + done, e->size - done);
+
+		if (len <= 0)
+			break;
+
+		done += len;
+	}
+
+	gg_file_close(fd);
+
+	if (done == e->size)
+		buf = gg_image_buffer_alloc(data, e->size, e->crc32, NULL);
+
+	if (buf == NULL)
+		free(data);
+
+	return buf;
+}
+
+/**
+ * \internal Zwalnia obrazki usunięte z pamięci podręcznej.
+ *
+ * Wywoływana bez blokady pamięci podręcznej, bo zwolnienie bufora może
+ * wywołać funkcję \c destroy aplikacji, a usunięcie pliku czeka na dysk.
+ *
+ * \param garbage Lista obrazków do zwolnienia
+ */
+static void gg_image_cache_release(gg_image_cache_entry_t *garbage)
+{
+	while (garbage != NULL) {
+		gg_image_cache_entry_t *e = garbage;
+
+		garbage = e->next;
+
+		if (e->spilled && e->path != NULL)
+			remove(e->path);
+
+		gg_image_buffer_unref(e->image);
+		free(e->path);
+		free(e->filename);
+		free(e);
+	}
+}
+
+/**
+ * \internal Usuwa obrazek z pamięci podręcznej.
+ *
+ * Obrazek trafia na listę do zwolnienia po zdjęciu blokady. Obrazek, na
+ * którym inny wątek wykonuje operację na pliku, jest tylko oznaczany jako
+ * usunięty.
+ *
+ * \param it      Wskaźnik na wskaźnik obrazka w kubełku
+ * \param garbage Lista obrazków do zwolnienia
+ */
+static void gg_image_cache_drop(gg_image_cache_entry_t **it,
+	gg_image_cache_entry_t **garbage)
+{
+	gg_image_cache_entry_t *e = *it;
+
+	*it = e->next;
+	gg_image_cache.count--;
+
+	if (e->spilled)
+		gg_image_cache.spilled--;
+
+	if (e->state != GG_IMAGE_CACHE_IDLE) {
+		e->removed = 1;
+		return;
+	}
+
+	if (e->image != NULL) {
+		gg_image_cache_unlink_list(e);
+		gg_image_cache.memory -= e->size;
+	}
+
+	e->next = *garbage;
+	*garbage = e;
+}
+
+/**
+ * \internal Przekazuje bufor lub plik do zwolnienia po zdjęciu blokady.
+ *
+ * \param image   Bufor obrazka lub \c NULL
+ * \param path    Ścieżka pliku do usunięcia lub \c NULL
+ * \param garbage Lista obrazków do zwolnienia
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_image_cache_discard(struct gg_image_buffer *image, char *path,
+	gg_image_cache_entry_t **garbage)
+{
+	gg_image_cache_entry_t *g;
+
+	g = calloc(1, sizeof(gg_image_cache_entry_t));
+
+	if (g == NULL)
+		return -1;
+
+	g->image = image;
+	g->path = path;
+	g->spilled = (path != NULL);
+	g->next = *garbage;
+	*garbage = g;
+
+	return 0;
+}
+
+/**
+ * \internal Zwalnia pamięć najdawniej używanych obrazków do osiągnięcia
+ * limitu.
+ *
+ * Obrazki już zapisane w katalogu wymiany są zwalniane z pamięci. Pozostałe
+ * trafiają na listę do zapisania po zdjęciu blokady, a jeśli katalog wymiany
+ * nie jest ustawiony, są usuwane.
+ *
+ * \param keep    Obrazek, który musi zostać w pamięci, lub \c NULL
+ * \param work    Lista obrazków do zapisania
+ * \param garbage Lista obrazków do zwolnienia
+ */
+static void gg_image_cache_shrink(gg_image_cache_entry_t *keep,
+	gg_image_cache_entry_t **work, gg_image_cache_entry_t **garbage)
+{
+	while (gg_image_cache.memory > gg_image_cache.limit) {
+		gg_image_cache_entry_t *e = gg_image_cache.oldest;
+
+		if (e == keep)
+			e = e->newer;
+
+		if (e == NULL)
+			break;
+
+		if (e->spilled &&
+			gg_image_cache_discard(e->image, NULL, garbage) == 0)
+		{
+			gg_image_cache_unlink_list(e);
+			gg_image_cache.memory -= e->size;
+			e->image = NULL;
+			continue;
+		}
+
+		if (!e->spilled && gg_image_cache.spill_dir != NULL) {
+			free(e->path);
+			e->path = gg_image_cache_path(e);
+
+			if (e->path != NULL) {
+				gg_image_cache_unlink_list(e);
+				gg_image_cache.memory -= e->size;
+				e->state = GG_IMAGE_CACHE_SPILLING;
+				e->work = *work;
+				*work = e;
+				continue;
+			}
+		}
+
+		gg_image_cache_drop(gg_image_cache_lookup(e->size, e->crc32),
+			garbage);
+		gg_image_cache.evicted++;
+	}
+}
+
+/**
+ * \internal Kończy zapisywanie obrazka do katalogu wymiany.
+ *
+ * \param e       Obrazek
+ * \param res     Wynik zapisu
+ * \param garbage Lista obrazków do zwolnienia
+ */
+static void gg_image_cache_spilled(gg_image_cache_entry_t *e, int res,
+	gg_image_cache_entry_t **garbage)
+{
+	gg_image_cache_entry_t **it;
+
+	e->state = GG_IMAGE_CACHE_IDLE;
+
+	if (e->removed) {
+		e->spilled = (res == 0);
+		e->next = *garbage;
+		*garbage = e;
+		return;
+	}
+
+	if (res == 0) {
+		e->spilled = 1;
+		gg_image_cache.spilled++;
+
+		if (gg_image_cache_discard(e->image, NULL, garbage) == 0) {
+			e->image = NULL;
+		} else {
+			gg_image_cache_link_newest(e);
+			gg_image_cache.memory += e->size;
+		}
+
+		return;
+	}
+
+	it = gg_image_cache_lookup(e->size, e->crc32);
+	*it = e->next;
+	gg_image_cache.count--;
+	gg_image_cache.evicted++;
+
+	e->next = *garbage;
+	*garbage = e;
+}
+
+/**
+ * \internal Zapisuje obrazki do katalogu wymiany i zwalnia usunięte obrazki.
+ *
+ * Wywoływana bez blokady pamięci podręcznej. Na czas zapisu obrazki są
+ * w stanie \c GG_IMAGE_CACHE_SPILLING, a sesje dalej wysyłają je z pamięci.
+ *
+ * \param work    Lista obrazków do zapisania
+ * \param garbage Lista obrazków do zwolnienia
+ */
+static void gg_image_cache_finish(gg_image_cache_entry_t *work,
+	gg_image_cache_entry_t *garbage)
+{
+	while (work != NULL) {
+		gg_image_cache_entry_t *e = work;
+		int res;
+
+		work = e->work;
+
+		res = gg_image_cache_spill(e);
+
+		gg_image_cache_lock();
+		gg_image_cache_spilled(e, res, &garbage);
+		gg_image_cache_unlock();
+	}
+
+	gg_image_cache_release(garbage);
+}
+
+/**
+ * \internal Usuwa pliki z katalogu wymiany i obrazki, które były tylko tam.
+ *
+ * \param garbage Lista obrazków do zwolnienia
+ */
+static void gg_image_cache_drop_spilled(gg_image_cache_entry_t **garbage)
+{
+	unsigned int i;
+
+	for (i = 0; i < gg_image_cache.size; i++) {
+		gg_image_cache_entry_t **it = &gg_image_cache.table[i];
+
+		while (*it != NULL) {
+			gg_image_cache_entry_t *e = *it;
+
+			if (e->image == NULL || e->state != GG_IMAGE_CACHE_IDLE) {
+				gg_image_cache_drop(it, garbage);
+				continue;
+			}
+
+			if (e->spilled) {
+				if (gg_image_cache_discard(NULL, e->path, garbage) == -1) {
+					gg_image_cache_drop(it, garbage);
+					continue;
+				}
+
+				e->path = NULL;
+				e->spilled = 0;
+				gg_image_cache.spilled--;
+			}
+
+			it = &e->next;
+		}
+	}
+}
+
+/**
+ * Ustawia limit pamięci i katalog wymiany pamięci podręcznej obrazków.
+ *
+ * Obrazki ponad limit są zapisywane do katalogu wymiany i wczytywane
+ * z powrotem, gdy ktoś o nie poprosi. Bez katalogu wymiany najdawniej
+ * używane obrazki są usuwane. Zmiana katalogu usuwa obrazki zapisane
+ * w poprzednim. Nazwy plików są unikalne dla procesu, więc katalog może
+ * być wspólny dla kilku procesów.
+ *
+ * \param limit     Limit pamięci w bajtach lub 0 dla wartości domyślnej
+ * \param spill_dir Katalog wymiany lub \c NULL
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup messages
+ */
+int gg_image_cache_setup(size_t limit, const char *spill_dir)
+{
+	gg_image_cache_entry_t *work = NULL, *garbage = NULL;
+	char *dir = NULL;
+
+	if (spill_dir != NULL) {
+		dir = strdup(spill_dir);
+
+		if (dir == NULL)
+			return -1;
+	}
+
+	gg_image_cache_lock();
+
+	gg_image_cache_drop_spilled(&garbage);
+
+	free(gg_image_cache.spill_dir);
+	gg_image_cache.spill_dir = dir;
+	gg_image_cache.limit = (limit != 0) ? limit : GG_IMAGE_CACHE_LIMIT;
+
+	gg_image_cache_shrink(NULL, &work, &garbage);
+
+	gg_image_cache_unlock();
+
+	gg_image_cache_finish(work, garbage);
+
+	return 0;
+}
+
+/**
+ * Dodaje obrazek do pamięci podręcznej.
+ *
+ * Sesje odpowiadają obrazkiem na prośby o obrazek o tym samym rozmiarze
+ * i sumie kontrolnej bez zgłaszania zdarzenia \c GG_EVENT_IMAGE_REQUEST.
+ * Pamięć podręczna trzyma własne odwołanie do bufora. Obrazek o tym samym
+ * rozmiarze i sumie kontrolnej jest zastępowany.
+ *
+ * \param filename Nazwa pliku
+ * \param image    Bufor obrazka
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup messages
+ */
+int gg_image_cache_add(const char *filename, struct gg_image_buffer *image)
+{
+	gg_image_cache_entry_t *e = NULL, **it, *work = NULL, *garbage = NULL;
+	char *name;
+	int res = -1, errsv = 0;
+
+	if (filename == NULL || image == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (image->size == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	name = strdup(filename);
+
+	if (name == NULL)
+		return -1;
+
+	gg_image_cache_lock();
+
+	if (gg_image_cache.limit == 0)
+		gg_image_cache.limit = GG_IMAGE_CACHE_LIMIT;
+
+	if (gg_image_cache.spill_dir == NULL &&
+		image->size > gg_image_cache.limit)
+	{
+		errno = ENOBUFS;
+		goto out;
+	}
+
+	it = gg_image_cache_lookup(image->size, image->crc32);
+
+	if (it != NULL)
+		gg_image_cache_drop(it, &garbage);
+
+	if (gg_image_cache.count >= gg_image_cache.size &&
+		gg_image_cache_grow() == -1)
+		goto out;
+
+	e = calloc(1, sizeof(gg_image_cache_entry_t));
+
+	if (e == NULL)
+		goto out;
+
+	e->size = image->size;
+	e->crc32 = image->crc32;
+	e->filename = name;
+	e->image = gg_image_buffer_ref(image);
+
+	it = &gg_image_cache.table[gg_image_cache_slot(gg_image_cache.size,
+		e->size, e->crc32)];
+	e->next = *it;
+	*it = e;
+	gg_image_cache.count++;
+
+	gg_image_cache_link_newest(e);
+	gg_image_cache.memory += e->size;
+
+	gg_image_cache_shrink(NULL, &work, &garbage);
+
+	res = 0;
+
+out:
+	if (res == -1)
+		errsv = errno;
+
+	gg_image_cache_unlock();
+
+	if (e == NULL)
+		free(name);
+
+	gg_image_cache_finish(work, garbage);
+
+	if (res == -1)
+		errno = errsv;
+
+	return res;
+}
+
+/**
+ * Usuwa obrazek z pamięci podręcznej.
+ *
+ * \param size  Rozmiar obrazka
+ * \param crc32 Suma kontrolna obrazka
+ *
+ * \return 0 jeśli się powiodło, -1 jeśli obrazka nie znaleziono
+ *
+ * \ingroup messages
+ */
+int gg_image_cache_remove(uint32_t size, uint32_t crc32)
+{
+	gg_image_cache_entry_t **it, *garbage = NULL;
+
+	gg_image_cache_lock();
+
+	it = gg_image_cache_lookup(size, crc32);
+
+	if (it != NULL)
+		gg_image_cache_drop(it, &garbage);
+
+	gg_image_cache_unlock();
+
+	gg_image_cache_release(garbage);
+
+	if (it == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Usuwa wszystkie obrazki z pamięci podręcznej.
+ *
+ * \ingroup messages
+ */
+void gg_image_cache_clear(void)
+{
+	gg_image_cache_entry_t *garbage = NULL;
+	unsigned int i;
+
+	gg_image_cache_lock();
+
+	for (i = 0; i < gg_image_cache.size; i++) {
+		while (gg_image_cache.table[i] != NULL)
+			gg_image_cache_drop(&gg_image_cache.table[i], &garbage);
+	}
+
+	free(gg_image_cache.table);
+	gg_image_cache.table = NULL;
+	gg_image_cache.size = 0;
+
+	gg_image_cache_unlock();
+
+	gg_image_cache_release(garbage);
+}
+
+/**
+ * Zwraca statystyki pamięci podręcznej obrazków.
+ *
+ * \param stats Struktura statystyk
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup messages
+ */
+int gg_image_cache_get_stats(struct gg_image_cache_stats *stats)
+{
+	if (stats == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	gg_image_cache_lock();
+
+	stats->count = gg_image_cache.count;
+	stats->memory = gg_image_cache.memory;
+	stats->limit = (gg_image_cache.limit != 0) ? gg_image_cache.limit :
+		GG_IMAGE_CACHE_LIMIT;
+	stats->spilled = gg_image_cache.spilled;
+	stats->hits = gg_image_cache.hits;
+	stats->misses = gg_image_cache.misses;
+	stats->evicted = gg_image_cache.evicted;
+
+	gg_image_cache_unlock();
+
+	return 0;
+}
+
+/**
+ * \internal Odpowiada na prośbę o obrazek z pamięci podręcznej.
+ *
+ * Obrazek z katalogu wymiany jest wczytywany bez blokady pamięci
+ * podręcznej. Inne sesje proszące w tym czasie o ten sam obrazek czekają na
+ * koniec wczytywania, a prośby o pozostałe obrazki są obsługiwane od razu.
+ *
+ * \param sess      Struktura sesji
+ * \param recipient Numer proszącego o obrazek
+ * \param size      Rozmiar obrazka
+ * \param crc32     Suma kontrolna obrazka
+ *
+ * \return 1 jeśli wysłano obrazek, 0 jeśli go nie ma, -1 w przypadku błędu
+ */
+int gg_image_cache_reply(struct gg_session *sess, uin_t recipient,
+	uint32_t size, uint32_t crc32)
+{
+	gg_image_cache_entry_t *e, *work = NULL, *garbage = NULL;
+	struct gg_image_buffer *image = NULL;
+	char *filename = NULL;
+	int res;
+
+	gg_image_cache_lock();
+
+	if (gg_image_cache.count == 0) {
+		gg_image_cache.misses++;
+		gg_image_cache_unlock();
+		return 0;
+	}
+
+	e = gg_image_cache_find(size, crc32);
+
+	if (e != NULL && e->image == NULL) {
+		struct gg_image_buffer *buf;
+
+		e->state = GG_IMAGE_CACHE_LOADING;
+		gg_image_cache_unlock();
+
+		buf = gg_image_cache_load(e);
+
+		gg_image_cache_lock();
+		e->state = GG_IMAGE_CACHE_IDLE;
+		gg_image_cache_broadcast();
+
+		if (e->removed) {
+			e->image = buf;
+			e->next = garbage;
+			garbage = e;
+			e = NULL;
+		} else if (buf != NULL) {
+			e->image = buf;
+			gg_image_cache_link_newest(e);
+			gg_image_cache.memory += e->size;
+			gg_image_cache_shrink(e, &work, &garbage);
+		} else {
+			gg_debug_session(sess, GG_DEBUG_WARNING,
+				"// gg_image_cache_reply() can't load image "
+				"(size=%u, crc32=%.8x)\n", size, crc32);
+			gg_image_cache_drop(gg_image_cache_lookup(size, crc32),
+				&garbage);
+			e = NULL;
+		}
+	} else if (e != NULL && e->state == GG_IMAGE_CACHE_IDLE) {
+		gg_image_cache_unlink_list(e);
+		gg_image_cache_link_newest(e);
+	}
+
+	if (e != NULL) {
+		filename = strdup(e->filename);
+
+		if (filename != NULL)
+			image = gg_image_buffer_ref(e->image);
+	}
+
+	if (image != NULL)
+		gg_image_cache.hits++;
+	else
+		gg_image_cache.misses++;
+
+	gg_image_cache_unlock();
+
+	gg_image_cache_finish(work, garbage);
+
+	if (image == NULL)
+		return (e != NULL) ? -1 : 0;
+
+	res = gg_image_reply_buffer(sess, recipient, filename, image);
+
+	gg_image_buffer_unref(image);
+	free(filename);
+
+	return (res == 0) ? 1 : -1;
+}
@@ -0,0 +1,478 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/**
+ * \file imgqueue.c
+ *
+ * \brief Kolejka odbieranych obrazków
+ *
+ * Obrazki są wyszukiwane w tablicy z kubełkami według nadawcy, rozmiaru
+ * i sumy kontrolnej. Lista \c images sesji jest uporządkowana od najdawniej
+ * aktywnego obrazka, dzięki czemu łatwo usunąć obrazki, których transfer
+ * stanął. Bufory obrazków rosną w miarę odbierania danych, a ich łączny
+ * rozmiar jest ograniczony.
+ */
+
+#include "internal.h"
+#include "timer.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \internal Początkowa liczba kubełków tablicy obrazków.
+ */
+#define GG_IMAGE_QUEUE_INITIAL_SIZE 16
+
+/**
+ * \internal Wyznacza kubełek obrazka.
+ *
+ * \param size   Liczba kubełków (potęga dwójki)
+ * \param sender Numer nadawcy
+ * \param length Rozmiar obrazka
+ * \param crc32  Suma kontrolna obrazka
+ *
+ * \return Numer kubełka
+ */
+static inline unsigned int gg_image_queue_slot(unsigned int size, uin_t sender,
+	uint32_t length, uint32_t crc32)
+{
+	uint32_t hash = (sender ^ crc32 ^ (length << 16 | length >> 16)) *
+		(uint32_t) 2654435761U;
+
+	return (hash ^ (hash >> 16)) & (size - 1);
+}
+
+/**
+ * \internal Powiększa tablicę obrazków dwukrotnie.
+ *
+ * \param idx Indeks obrazków
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_image_queue_grow(gg_image_index_t *idx)
+{
+	gg_image_entry_t **table;
+	unsigned int size, i;
+
+	size = (idx->size != 0) ? idx->size * 2 : GG_IMAGE_QUEUE_INITIAL_SIZE;
+
+	if (size < idx->size || size > ~(unsigned int)0 / sizeof(gg_image_entry_t *)) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	table = calloc(size, sizeof(gg_image_entry_t *));
+
+	if (table == NULL)
+		return -1;
+
+	for (i = 0; i < idx->size; i++) {
+		gg_image_entry_t *e = idx->table[i];
+
+		while (e != NULL) {
+			gg_image_entry_t *next = e->hash_next;
+			unsigned int slot;
+
+			slot = gg_image_queue_slot(size, e->queue.sender,
+				e->queue.size, e->queue.crc32);
+			e->hash_next = table[slot];
+			table[slot] = e;
+			e = next;
+		}
+	}
+
+	free(idx->table);
+	idx->table = table;
+	idx->size = size;
+
+	return 0;
+}
+
+/**
+ * \internal Dopisuje obrazek na koniec listy jako najnowszy.
+ */
+static void gg_image_queue_link_newest(struct gg_session *sess,
+	gg_image_entry_t *e)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+
+	e->older = idx->newest;
+	e->queue.next = NULL;
+
+	if (idx->newest != NULL)
+		idx->newest->queue.next = &e->queue;
+	else
+		sess->images = &e->queue;
+
+	idx->newest = e;
+}
+
+/**
+ * \internal Wypina obrazek z listy sesji.
+ */
+static void gg_image_queue_unlink_list(struct gg_session *sess,
+	gg_image_entry_t *e)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+	gg_image_entry_t *newer = (gg_image_entry_t *) e->queue.next;
+
+	if (e->older != NULL)
+		e->older->queue.next = e->queue.next;
+	else
+		sess->images = e->queue.next;
+
+	if (newer != NULL)
+		newer->older = e->older;
+	else
+		idx->newest = e->older;
+
+	e->older = NULL;
+	e->queue.next = NULL;
+}
+
+/**
+ * \internal Usuwa obrazek i zwalnia jego pamięć.
+ */
+static void gg_image_queue_drop(struct gg_session *sess, gg_image_entry_t *e)
+{
+	gg_image_queue_unlink(sess, &e->queue);
+
+	free(e->queue.image);
+	free(e->queue.filename);
+	free(e);
+}
+
+/**
+ * \internal Usuwa obrazki, których transfer stanął.
+ *
+ * \param sess Struktura sesji
+ * \param now  Bieżący czas w milisekundach
+ */
+static void gg_image_queue_expire(struct gg_session *sess, uint64_t now)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+
+	while (sess->images != NULL) {
+		gg_image_entry_t *e = (gg_image_entry_t *) sess->images;
+
+		if (now - e->activity <= GG_IMAGE_QUEUE_TIMEOUT)
+			break;
+
+		gg_debug_session(sess, GG_DEBUG_MISC, "// gg_image_queue_expire() "
+			"image from %u (size=%u, crc32=%.8x) timed out\n",
+			e->queue.sender, e->queue.size, e->queue.crc32);
+
+		gg_image_queue_drop(sess, e);
+		idx->expired++;
+	}
+}
+
+/**
+ * \internal Szuka obrazka w tablicy.
+ */
+static gg_image_entry_t *gg_image_queue_lookup(gg_image_index_t *idx,
+	uin_t sender, uint32_t size, uint32_t crc32)
+{
+	gg_image_entry_t *e;
+
+	if (idx->table == NULL)
+		return NULL;
+
+	e = idx->table[gg_image_queue_slot(idx->size, sender, size, crc32)];
+
+	for (; e != NULL; e = e->hash_next) {
+		if (e->queue.sender == sender && e->queue.size == size &&
+			e->queue.crc32 == crc32)
+		{
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * \internal Zwraca limit pamięci na odbierane obrazki.
+ *
+ * \param sess Struktura sesji
+ *
+ * \return Limit w bajtach
+ */
+size_t gg_image_queue_limit(struct gg_session *sess)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+
+	return (idx->limit != 0) ? idx->limit : GG_IMAGE_QUEUE_LIMIT;
+}
+
+/**
+ * \internal Dodaje obrazek do kolejki odbieranych.
+ *
+ * Jeśli obrazek jest już w kolejce, zwracany jest istniejący wpis. Bufor
+ * na dane nie jest jeszcze przydzielany.
+ *
+ * \param sess   Struktura sesji
+ * \param sender Numer nadawcy
+ * \param size   Rozmiar obrazka
+ * \param crc32  Suma kontrolna obrazka
+ *
+ * \return Wpis obrazka lub \c NULL w przypadku błędu
+ */
+struct gg_image_queue *gg_image_queue_add(struct gg_session *sess,
+	uin_t sender, uint32_t size, uint32_t crc32)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+	gg_image_entry_t *e;
+	unsigned int slot;
+
+	e = (gg_image_entry_t *) gg_image_queue_find(sess, sender, size, crc32);
+
+	if (e != NULL)
+		return &e->queue;
+
+	if (idx->count >= idx->size && gg_image_queue_grow(idx) == -1)
+		return NULL;
+
+	e = gg_new0(sizeof(gg_image_entry_t));
+
+	if (e == NULL)
+		return NULL;
+
+	e->queue.sender = sender;
+	e->queue.size = size;
+	e->queue.crc32 = crc32;
+	e->activity = gg_timer_clock();
+
+	slot = gg_image_queue_slot(idx->size, sender, size, crc32);
+	e->hash_next = idx->table[slot];
+	idx->table[slot] = e;
+	idx->count++;
+
+	gg_image_queue_link_newest(sess, e);
+
+	return &e->queue;
+}
+
+/**
+ * \internal Szuka obrazka w kolejce odbieranych.
+ *
+ * Znaleziony obrazek jest oznaczany jako aktywny. Przy okazji usuwane są
+ * obrazki, których transfer stanął.
+ *
+ * \param sess   Struktura sesji
+ * \param sender Numer nadawcy
+ * \param size   Rozmiar obrazka
+ * \param crc32  Suma kontrolna obrazka
+ *
+ * \return Wpis obrazka lub \c NULL, jeśli go nie ma
+ */
+struct gg_image_queue *gg_image_queue_find(struct gg_session *sess,
+	uin_t sender, uint32_t size, uint32_t crc32)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+	gg_image_entry_t *e;
+	uint64_t now;
+
+	now = gg_timer_clock();
+
+	gg_image_queue_expire(sess, now);
+
+	e = gg_image_queue_lookup(idx, sender, size, crc32);
+
+	if (e == NULL)
+		return NULL;
+
+	e->activity = now;
+
+	if (e != idx->newest) {
+		gg_image_queue_unlink_list(sess, e);
+		gg_image_queue_link_newest(sess, e);
+	}
+
+	return &e->queue;
+}
+
+/**
+ * \internal Zapewnia miejsce na podaną liczbę bajtów obrazka.
+ *
+ * Bufor rośnie co najmniej dwukrotnie, ale nie ponad rozmiar obrazka.
+ * Jeśli brakuje miejsca w limicie pamięci, usuwane są obrazki najdawniej
+ * aktywne, z pominięciem zamówionych obrazków bez danych.
+ *
+ * \param sess   Struktura sesji
+ * \param q      Wpis obrazka
+ * \param length Wymagany rozmiar bufora, nie większy niż rozmiar obrazka
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+int gg_image_queue_reserve(struct gg_session *sess, struct gg_image_queue *q,
+	uint32_t length)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+	gg_image_entry_t *e = (gg_image_entry_t *) q;
+	size_t limit = gg_image_queue_limit(sess);
+	uint32_t allocated;
+	char *image;
+
+	if (length <= e->allocated)
+		return 0;
+
+	allocated = e->allocated;
+
+	if (allocated < GG_IMAGE_QUEUE_CHUNK / 2)
+		allocated = GG_IMAGE_QUEUE_CHUNK / 2;
+
+	allocated = (allocated <= q->size / 2) ? allocated * 2 : q->size;
+
+	if (allocated < length)
+		allocated = length;
+
+	while (idx->memory - e->allocated + allocated > limit) {
+		gg_image_entry_t *oldest = (gg_image_entry_t *) sess->images;
+
+		/* Zamówione obrazki bez danych nie zajmują pamięci */
+		while (oldest != NULL && (oldest == e || oldest->allocated == 0))
+			oldest = (gg_image_entry_t *) oldest->queue.next;
+
+		if (oldest == NULL) {
+			errno = ENOBUFS;
+			return -1;
+		}
+
+		gg_debug_session(sess, GG_DEBUG_MISC, "// gg_image_queue_reserve() "
+			"evicting image from %u (size=%u, done=%u)\n",
+			oldest->queue.sender, oldest->queue.size,
+			oldest->queue.done);
+
+		gg_image_queue_drop(sess, oldest);
+		idx->evicted++;
+	}
+
+	image = realloc(q->image, allocated);
+
+	if (image == NULL)
+		return -1;
+
+	idx->memory += allocated - e->allocated;
+	q->image = image;
+	e->allocated = allocated;
+
+	return 0;
+}
+
+/**
+ * \internal Wypina obrazek z kolejki bez zwalniania jego pamięci.
+ *
+ * \param sess Struktura sesji
+ * \param q    Wpis obrazka
+ */
+void gg_image_queue_unlink(struct gg_session *sess, struct gg_image_queue *q)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+	gg_image_entry_t *e = (gg_image_entry_t *) q, **it;
+
+	if (idx->table == NULL)
+		return;
+
+	it = &idx->table[gg_image_queue_slot(idx->size, q->sender, q->size, q->crc32)];
+
+	for (; *it != NULL; it = &(*it)->hash_next) {
+		if (*it == e) {
+			*it = e->hash_next;
+			break;
+		}
+	}
+
+	gg_image_queue_unlink_list(sess, e);
+
+	idx->memory -= e->allocated;
+	idx->count--;
+	e->hash_next = NULL;
+	e->allocated = 0;
+}
+
+/**
+ * \internal Wypina odebrany w całości obrazek z kolejki.
+ *
+ * Bufor i nazwa pliku przechodzą na własność zdarzenia.
+ *
+ * \param sess Struktura sesji
+ * \param q    Wpis obrazka
+ */
+void gg_image_queue_complete(struct gg_session *sess, struct gg_image_queue *q)
+{
+	gg_image_queue_unlink(sess, q);
+
+	sess->private_data->image_index.completed++;
+}
+
+/**
+ * \internal Zwalnia wszystkie odbierane obrazki.
+ *
+ * \param sess Struktura sesji
+ */
+void gg_image_queue_free(struct gg_session *sess)
+{
+	gg_image_index_t *idx = &sess->private_data->image_index;
+
+	while (sess->images != NULL)
+		gg_image_queue_drop(sess, (gg_image_entry_t *) sess->images);
+
+	free(idx->table);
+	idx->table = NULL;
+	idx->size = 0;
+}
+
+/**
+ * Pobiera statystyki kolejki odbieranych obrazków.
+ *
+ * Przed pobraniem statystyk usuwane są obrazki, których transfer stanął.
+ *
+ * \param sess  Struktura sesji
+ * \param stats Struktura, do której zostaną zapisane statystyki
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup messages
+ */
+int gg_image_queue_get_stats(struct gg_session *sess,
+	struct gg_image_queue_stats *stats)
+{
+	gg_image_index_t *idx;
+
+	if (sess == NULL || sess->private_data == NULL || stats == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	idx = &sess->private_data->image_index;
+
+	gg_image_queue_expire(sess, gg_timer_clock());
+
+	memset(stats, 0, sizeof(struct gg_image_queue_stats));
+	stats->pending = idx->count;
+	stats->memory = idx->memory;
+	stats->limit = gg_image_queue_limit(sess);
+	stats->completed = idx->completed;
+	stats->evicted = idx->evicted;
+	stats->expired = idx->expired;
+
+	return 0;
+}
@@ -40,10 +40,12 @@
 #include "message.h"
 #include "deflate.h"
 #include "tvbuilder.h"
+#include "timer.h"
 #include "protobuf.h"
 #include "packets.pb-c.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -55,6 +57,9 @@
 #  include <openssl/err.h>
 #  include <openssl/rand.h>
 #endif
+#ifdef GG_CONFIG_HAVE_PTHREAD
+#  include <pthread.h>
+#endif
 
 /**
  * Port gniazda nasłuchującego dla połączeń bezpośrednich.
@@ -121,6 +126,8 @@ char *gg_proxy_password = NULL;
 
 static void gg_compat_message_sent(struct gg_session *sess, int seq, size_t recipients_count, uin_t *recipients);
 static void gg_compat_message_cleanup(struct gg_session *sess);
+static gg_msg_list_t *gg_sent_message_add(struct gg_session *sess, int seq);
+static void gg_recv_ring_free(struct gg_session *sess);
 
 #ifdef GG_CONFIG_IS_GPL_COMPLIANT
 /**
@@ -436,370 +443,1288 @@ static int gg_write_common(struct gg_session *sess, const char *buf, int length)
 }
 
 /**
- * \internal Wysyła do serwera dane binarne.
+ * \internal Wysyła do serwera dane binarne złożone z kilku fragmentów.
  *
- * Funkcja wysyła dane do serwera zajmując się TLS w razie konieczności.
+ * Przy zwykłym połączeniu fragmenty są przekazywane jednym wywołaniem
+ * \c sendmsg(). W przypadku TLS i zewnętrznego gniazda są sklejane, żeby
+ * trafiły do jednego rekordu lub jednego wywołania funkcji zwrotnej.
  *
  * \param sess Struktura sesji
- * \param buf Bufor z danymi
- * \param length Długość bufora
+ * \param iov Tablica fragmentów
+ * \param iovcnt Liczba fragmentów
+ * \param length Łączna długość fragmentów
  *
  * \return To samo co funkcja systemowa \c write
  */
-int gg_write(struct gg_session *sess, const char *buf, int length)
+static int gg_writev_common(struct gg_session *sess, const struct iovec *iov,
+	int iovcnt, size_t length)
 {
-	int res = 0;
+	char stack_buf[GG_SEND_COALESCE_SIZE];
+	char *buf;
+	size_t offset;
+	int i, res;
 
-	if (!sess->async) {
-		int written = 0;
+	if (iovcnt < 2)
+		return gg_write_common(sess, iov[0].iov_base, iov[0].iov_len);
 
-		while (written < length) {
-			res = gg_write_common(sess, buf + written, length - written);
+#ifndef _WIN32
+	if (sess->ssl == NULL && sess->private_data->socket_handle == NULL) {
+		struct msghdr msg;
 
-			if (res == -1)
-				return -1;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = (struct iovec*) iov;
+		msg.msg_iovlen = iovcnt;
 
-			written += res;
-			res = written;
-		}
-	} else {
-		if (sess->send_buf == NULL) {
-			res = gg_write_common(sess, buf, length);
+		for (;;) {
+			res = sendmsg(sess->fd, &msg, 0);
 
-			if (res == -1 && errno == EAGAIN)
-				res = 0;
-			if (res == -1)
-				return -1;
+			if (res == -1 && errno == EINTR)
+				continue;
+
+			return res;
 		}
+	}
+#endif
 
-		if (res < length) {
-			char *tmp;
+	if (length <= sizeof(stack_buf)) {
+		buf = stack_buf;
+	} else {
+		buf = malloc(length);
 
-			if (!(tmp = realloc(sess->send_buf, sess->send_left + length - res))) {
-				errno = ENOMEM;
-				return -1;
-			}
+		if (buf == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+	}
 
-			sess->send_buf = tmp;
+	for (i = 0, offset = 0; i < iovcnt; i++) {
+		memcpy(buf + offset, iov[i].iov_base, iov[i].iov_len);
+		offset += iov[i].iov_len;
+	}
 
-			memcpy(sess->send_buf + sess->send_left, buf + res, length - res);
+	res = gg_write_common(sess, buf, length);
 
-			sess->send_left += length - res;
-		}
-	}
+	if (buf != stack_buf)
+		free(buf);
 
 	return res;
 }
 
-void gg_close(struct gg_session *sess)
+/**
+ * \internal Pomija początkowe bajty tablicy fragmentów.
+ *
+ * \param iov Wskaźnik na tablicę fragmentów
+ * \param iovcnt Wskaźnik na liczbę fragmentów
+ * \param skip Liczba bajtów do pominięcia
+ */
+static void gg_iov_skip(struct iovec **iov, int *iovcnt, size_t skip)
 {
-	struct gg_session_private *p = sess->private_data;
-	int errno_copy;
-
-	errno_copy = errno;
-
-	if (!p->socket_is_external) {
-		if (sess->fd != -1)
-			close(sess->fd);
-	} else {
-		assert(p->socket_manager_type !=
-			GG_SOCKET_MANAGER_TYPE_INTERNAL);
-		if (p->socket_handle != NULL) {
-			p->socket_manager.close_cb(p->socket_manager.cb_data,
-				p->socket_handle);
-		}
-		p->socket_is_external = 0;
-	}
-	sess->fd = -1;
-	p->socket_handle = NULL;
-
-	while (p->event_queue) {
-		gg_eventqueue_t *next = p->event_queue->next;
-		gg_event_free(p->event_queue->event);
-		free(p->event_queue);
-		p->event_queue = next;
+	while (*iovcnt > 0 && skip >= (*iov)->iov_len) {
+		skip -= (*iov)->iov_len;
+		(*iov)++;
+		(*iovcnt)--;
 	}
 
-	while (p->imgout_queue) {
-		gg_imgout_queue_t *next = p->imgout_queue->next;
-		free(p->imgout_queue);
-		p->imgout_queue = next;
+	if (*iovcnt > 0 && skip > 0) {
+		(*iov)->iov_base = (char*) (*iov)->iov_base + skip;
+		(*iov)->iov_len -= skip;
 	}
+}
 
-	if (p->dummyfds_created) {
-		close(p->dummyfds[0]);
-		close(p->dummyfds[1]);
-		p->dummyfds_created = 0;
-	}
+/**
+ * \internal Uaktualnia pola \c send_buf i \c send_left struktury sesji.
+ *
+ * Pole \c send_buf wskazuje na niewysłane dane z pierwszego fragmentu
+ * kolejki, a \c send_left zawiera łączną liczbę bajtów w kolejce.
+ *
+ * \param sess Struktura sesji
+ * \param left Łączna liczba bajtów w kolejce
+ */
+static void gg_send_queue_update(struct gg_session *sess, size_t left)
+{
+	gg_send_chunk_t *head = sess->private_data->send_head;
 
-	gg_compat_message_cleanup(sess);
+	sess->send_left = left;
 
-	errno = errno_copy;
+	if (head != NULL)
+		sess->send_buf = head->buf + head->start;
+	else
+		sess->send_buf = NULL;
 }
 
 /**
- * \internal Odbiera pakiet od serwera.
- *
- * Funkcja odczytuje nagłówek pakietu, a następnie jego zawartość i zwraca
- * w zaalokowanym buforze.
+ * \internal Dopisuje dane na koniec kolejki danych do wysłania.
  *
- * Przy połączeniach asynchronicznych, funkcja może nie być w stanie
- * skompletować całego pakietu -- w takim przypadku zwróci \c NULL, a kodem błędu
- * będzie \c EAGAIN.
+ * Dane są kopiowane do wolnego miejsca w ostatnim fragmencie kolejki,
+ * a reszta do nowego fragmentu. Wcześniej zakolejkowane dane nie są
+ * przenoszone.
  *
  * \param sess Struktura sesji
+ * \param iov Tablica fragmentów
+ * \param iovcnt Liczba fragmentów
+ * \param length Łączna długość fragmentów
  *
- * \return Wskaźnik do zaalokowanego bufora
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
  */
-void *gg_recv_packet(struct gg_session *sess)
+static int gg_send_queue_append(struct gg_session *sess,
+	const struct iovec *iov, int iovcnt, size_t length)
 {
-	struct gg_header *gh;
-	char *packet;
-	int res;
-	size_t len;
-	uint32_t ghlen = 0;
-
-	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_recv_packet(%p);\n", sess);
-
-	if (sess == NULL) {
-		errno = EFAULT;
-		return NULL;
-	}
+	struct gg_session_private *p = sess->private_data;
+	gg_send_chunk_t *tail = p->send_tail;
+	gg_send_chunk_t *chunk = NULL;
+	size_t space = 0;
+	int i;
 
-	for (;;) {
-		if (sess->recv_buf == NULL && sess->recv_done == 0) {
-			sess->recv_buf = malloc(sizeof(struct gg_header) + 1);
+	if (tail != NULL)
+		space = tail->size - tail->end;
 
-			if (sess->recv_buf == NULL) {
-				gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_recv_packet() out of memory\n");
-				return NULL;
-			}
-		}
+	/* Nowy fragment przydzielamy przed kopiowaniem, żeby w razie braku
+	 * pamięci nie zostawić w kolejce połowy pakietu */
+	if (length > space) {
+		chunk = gg_send_chunk_new(sess, length - space);
 
-		gh = (struct gg_header*) sess->recv_buf;
+		if (chunk == NULL)
+			return -1;
+	}
 
-		if ((size_t) sess->recv_done < sizeof(struct gg_header)) {
-			len = sizeof(struct gg_header) - sess->recv_done;
-			gg_debug_session(sess, GG_DEBUG_NET,
-				"// gg_recv_packet() header: %d done, "
-				"%" GG_SIZE_FMT " to go\n",
-				sess->recv_done, len);
-		} else {
-			ghlen = gh ? gg_fix32(gh->length) : 0;
+	for (i = 0; i < iovcnt; i++) {
+		const char *buf = iov[i].iov_base;
+		size_t len = iov[i].iov_len;
 
-			if (ghlen > 65535) {
-				gg_debug_session(sess, GG_DEBUG_ERROR,
-					"// gg_recv_packet() invalid packet "
-					"length (%d)\n", ghlen);
-				errno = ERANGE;
-				goto fail;
-			}
+		while (len > 0) {
+			size_t n;
 
-			if ((size_t) sess->recv_done >= sizeof(struct gg_header) + ghlen) {
-				gg_debug_session(sess, GG_DEBUG_NET, "// gg_recv_packet() and that's it\n");
-				break;
+			if (tail == NULL || tail->end == tail->size) {
+				if (tail != NULL)
+					tail->next = chunk;
+				else
+					p->send_head = chunk;
+				tail = chunk;
+				p->send_tail = chunk;
 			}
 
-			len = sizeof(struct gg_header) + ghlen - sess->recv_done;
-
-			gg_debug_session(sess, GG_DEBUG_NET,
-				"// gg_recv_packet() payload: %d done, "
-				"%u length, %" GG_SIZE_FMT " to go\n",
-				sess->recv_done, ghlen, len);
-		}
+			n = tail->size - tail->end;
 
-		res = gg_read(sess, sess->recv_buf + sess->recv_done, len);
+			if (n > len)
+				n = len;
 
-		if (res == 0) {
-			errno = ECONNRESET;
-			gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_recv_packet() connection broken\n");
-			goto fail;
+			memcpy(tail->buf + tail->end, buf, n);
+			tail->end += n;
+			buf += n;
+			len -= n;
 		}
+	}
 
-		if (res == -1 && errno == EAGAIN) {
-			gg_debug_session(sess, GG_DEBUG_NET, "// gg_recv_packet() resource temporarily unavailable\n");
-			goto eagain;
-		}
+	gg_send_queue_update(sess, sess->send_left + length);
 
-		if (res == -1) {
-			gg_debug_session(sess, GG_DEBUG_ERROR,
-				"// gg_recv_packet() read failed: errno=%d, "
-				"%s\n", errno, strerror(errno));
-			goto fail;
-		}
+	return 0;
+}
 
-		gg_debug_session(sess, GG_DEBUG_NET, "// gg_recv_packet() read %d bytes\n", res);
+/**
+ * \internal Usuwa z początku kolejki wysłane dane.
+ *
+ * \param sess Struktura sesji
+ * \param length Liczba wysłanych bajtów
+ */
+static void gg_send_queue_consume(struct gg_session *sess, size_t length)
+{
+	struct gg_session_private *p = sess->private_data;
+	size_t left = sess->send_left - length;
 
-		if (sess->recv_done + res == sizeof(struct gg_header)) {
-			char *tmp;
-			ghlen = gh ? gg_fix32(gh->length) : 0;
+	while (length > 0 && p->send_head != NULL) {
+		gg_send_chunk_t *head = p->send_head;
+		size_t n = head->end - head->start;
 
-			gg_debug_session(sess, GG_DEBUG_NET,
-				"// gg_recv_packet() header complete, "
-				"payload %d bytes\n", ghlen);
+		if (n > length) {
+			head->start += length;
+			break;
+		}
 
-			if (ghlen == 0)
-				break;
+		length -= n;
+		p->send_head = head->next;
+		gg_send_chunk_free(sess, head);
+	}
 
-			if (ghlen > 65535) {
-				gg_debug_session(sess, GG_DEBUG_ERROR,
-					"// gg_recv_packet() invalid packet "
-					"length (%d)\n", ghlen);
-				errno = ERANGE;
-				goto fail;
-			}
+	if (p->send_head == NULL)
+		p->send_tail = NULL;
 
-			tmp = realloc(sess->recv_buf, sizeof(struct gg_header) + ghlen + 1);
+	gg_send_queue_update(sess, left);
+}
 
-			if (tmp == NULL) {
-				gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_recv_packet() out of memory\n");
-				goto fail;
-			}
+/**
+ * \internal Wysyła zakolejkowane dane.
+ *
+ * Przy zwykłym połączeniu wysyła jednym wywołaniem \c sendmsg() tyle
+ * fragmentów kolejki, ile zmieści się w tablicy \c iovec. Przy TLS
+ * i zewnętrznym gnieździe wysyła pierwszy fragment kolejki.
+ *
+ * \param sess Struktura sesji
+ *
+ * \return To samo co funkcja systemowa \c write
+ */
+int gg_send_queue_flush(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+	struct iovec iov[GG_SEND_IOV_MAX];
+	gg_send_chunk_t *chunk;
+	size_t length = 0;
+	int iovcnt = 0, res;
+
+	for (chunk = p->send_head; chunk != NULL && iovcnt < GG_SEND_IOV_MAX; chunk = chunk->next) {
+		iov[iovcnt].iov_base = chunk->buf + chunk->start;
+		iov[iovcnt].iov_len = chunk->end - chunk->start;
+		length += iov[iovcnt].iov_len;
+		iovcnt++;
+
+		/* Nie sklejamy fragmentów, zostaną wysłane kolejno */
+		if (sess->ssl != NULL || p->socket_handle != NULL)
+			break;
+	}
 
-			sess->recv_buf = tmp;
-		}
+	if (iovcnt == 0)
+		return 0;
 
-		sess->recv_done += res;
-	}
+	res = gg_writev_common(sess, iov, iovcnt, length);
 
-	packet = sess->recv_buf;
-	sess->recv_buf = NULL;
-	sess->recv_done = 0;
+	if (res > 0)
+		gg_send_queue_consume(sess, res);
 
-	if (gh == NULL)
-		goto fail;
+	return res;
+}
 
-	/* Czasami zakładamy, że teksty w pakietach są zakończone zerem */
-	packet[sizeof(struct gg_header) + ghlen] = 0;
+/**
+ * \internal Zwalnia kolejkę danych do wysłania.
+ *
+ * \param sess Struktura sesji
+ */
+void gg_send_queue_free(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
 
-	gg_debug_session(sess, GG_DEBUG_MISC, "// gg_recv_packet(type=0x%.2x, "
-		"length=%d)\n", gg_fix32(gh->type), ghlen);
-	gg_debug_dump(sess, GG_DEBUG_DUMP, packet, sizeof(struct gg_header) + ghlen);
+	while (p->send_head != NULL) {
+		gg_send_chunk_t *next = p->send_head->next;
 
-	gh->type = gg_fix32(gh->type);
-	gh->length = ghlen;
+		free(p->send_head);
+		p->send_head = next;
+	}
 
-	return packet;
+	while (p->send_spare != NULL) {
+		gg_send_chunk_t *next = p->send_spare->next;
 
-fail:
-	free(sess->recv_buf);
-	sess->recv_buf = NULL;
-	sess->recv_done = 0;
+		free(p->send_spare);
+		p->send_spare = next;
+	}
 
-eagain:
-	return NULL;
+	free(p->send_reserved);
+	p->send_reserved = NULL;
+	p->send_spare_count = 0;
+	p->send_tail = NULL;
+	sess->send_buf = NULL;
+	sess->send_left = 0;
 }
 
 /**
- * \internal Wysyła pakiet do serwera.
+ * \internal Wysyła do serwera dane binarne złożone z kilku fragmentów.
  *
- * Funkcja konstruuje pakiet do wysłania z dowolnej liczby fragmentów. Jeśli
- * rozmiar pakietu jest za duży, by móc go wysłać za jednym razem, pozostała
- * część zostanie zakolejkowana i wysłana, gdy będzie to możliwe.
+ * W trybie asynchronicznym do kolejki trafia jedynie niewysłana część danych.
+ * Jeśli kolejka nie jest pusta, a dopisanie danych przekroczyłoby limit
+ * ustalony polem \c send_queue_limit struktury \c gg_login_params, dane nie
+ * są wysyłane, a funkcja zwraca błąd \c ENOBUFS.
+ * Tablica fragmentów może zostać zmodyfikowana.
  *
  * \param sess Struktura sesji
- * \param type Rodzaj pakietu
- * \param ... Lista kolejnych części pakietu (wskaźnik na bufor i długość
- *            typu \c int) zakończona \c NULL
+ * \param iov Tablica fragmentów
+ * \param iovcnt Liczba fragmentów
  *
- * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ * \return To samo co funkcja systemowa \c write
  */
-int gg_send_packet(struct gg_session *sess, int type, ...)
+static int gg_writev(struct gg_session *sess, struct iovec *iov, int iovcnt)
 {
-	struct gg_header *h;
-	char *tmp;
-	unsigned int tmp_length;
-	void *payload;
-	unsigned int payload_length;
-	va_list ap;
-	int res;
-
-	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_send_packet(%p, 0x%.2x, ...);\n", sess, type);
-
-	tmp_length = sizeof(struct gg_header);
-
-	if (!(tmp = malloc(tmp_length))) {
-		gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_send_packet() not enough memory for packet header\n");
-		return -1;
-	}
+	size_t length = 0;
+	int res = 0, i;
 
-	va_start(ap, type);
+	for (i = 0; i < iovcnt; i++)
+		length += iov[i].iov_len;
 
-	payload = va_arg(ap, void *);
+	if (!sess->async) {
+		size_t written = 0;
 
-	while (payload) {
-		char *tmp2;
+		while (written < length) {
+			res = gg_writev_common(sess, iov, iovcnt, length - written);
 
-		payload_length = va_arg(ap, unsigned int);
+			if (res == -1)
+				return -1;
 
-		if (!(tmp2 = realloc(tmp, tmp_length + payload_length))) {
-			gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_send_packet() not enough memory for payload\n");
-			free(tmp);
-			va_end(ap);
-			return -1;
+			written += res;
+			gg_iov_skip(&iov, &iovcnt, res);
 		}
 
-		tmp = tmp2;
-
-		memcpy(tmp + tmp_length, payload, payload_length);
-		tmp_length += payload_length;
-
-		payload = va_arg(ap, void *);
+		return written;
 	}
 
-	va_end(ap);
-
-	h = (struct gg_header*) tmp;
-	h->type = gg_fix32(type);
-	h->length = gg_fix32(tmp_length - sizeof(struct gg_header));
-
-	gg_debug_session(sess, GG_DEBUG_MISC, "// gg_send_packet(type=0x%.2x, "
-		"length=%d)\n", gg_fix32(h->type), gg_fix32(h->length));
-	gg_debug_dump(sess, GG_DEBUG_DUMP, tmp, tmp_length);
-
-	res = gg_write(sess, tmp, tmp_length);
-
-	free(tmp);
+	if (sess->private_data->send_head == NULL) {
+		res = gg_writev_common(sess, iov, iovcnt, length);
 
-	if (res == -1) {
-		gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_send_packet() "
-			"write() failed. res = %d, errno = %d (%s)\n",
-			res, errno, strerror(errno));
+		if (res == -1 && errno == EAGAIN)
+			res = 0;
+		if (res == -1)
+			return -1;
+	} else if (sess->private_data->send_queue_limit > 0 &&
+		(size_t) sess->send_left + length >
+		(size_t) sess->private_data->send_queue_limit)
+	{
+		errno = ENOBUFS;
 		return -1;
 	}
 
-	if (sess->async) {
-		gg_debug_session(sess, GG_DEBUG_NET, "// gg_send_packet() "
-			"partial write(), %d sent, %d left, %d total left\n",
-			res, tmp_length - res, sess->send_left);
-	}
+	if ((size_t) res < length) {
+		gg_iov_skip(&iov, &iovcnt, res);
 
-	if (sess->send_buf)
-		sess->check |= GG_CHECK_WRITE;
+		if (gg_send_queue_append(sess, iov, iovcnt, length - res) == -1)
+			return -1;
+	}
 
-	return 0;
+	return res;
 }
 
 /**
- * \internal Funkcja zwrotna sesji.
- *
- * Pole \c callback struktury \c gg_session zawiera wskaźnik do tej funkcji.
- * Wywołuje ona \c gg_watch_fd i zachowuje wynik w polu \c event.
+ * \internal Wysyła do serwera dane binarne.
  *
- * \note Korzystanie z tej funkcjonalności nie jest już zalecane.
+ * Funkcja wysyła dane do serwera zajmując się TLS w razie konieczności.
  *
  * \param sess Struktura sesji
+ * \param buf Bufor z danymi
+ * \param length Długość bufora
  *
- * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ * \return To samo co funkcja systemowa \c write
  */
-static int gg_session_callback(struct gg_session *sess)
+int gg_write(struct gg_session *sess, const char *buf, int length)
 {
-	if (!sess) {
-		errno = EFAULT;
-		return -1;
-	}
+	struct iovec iov;
 
-	return ((sess->event = gg_watch_fd(sess)) != NULL) ? 0 : -1;
+	iov.iov_base = (char*) buf;
+	iov.iov_len = length;
+
+	return gg_writev(sess, &iov, 1);
+}
+
+void gg_close(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+	int errno_copy;
+
+	errno_copy = errno;
+
+	gg_watch_fd_restore(sess);
+
+	gg_loop_item_close_fd(p->loop_item);
+
+	if (!p->socket_is_external) {
+		if (sess->fd != -1)
+			close(sess->fd);
+	} else {
+		assert(p->socket_manager_type !=
+			GG_SOCKET_MANAGER_TYPE_INTERNAL);
+		if (p->socket_handle != NULL) {
+			p->socket_manager.close_cb(p->socket_manager.cb_data,
+				p->socket_handle);
+		}
+		p->socket_is_external = 0;
+	}
+	sess->fd = -1;
+	p->socket_handle = NULL;
+
+	gg_eventqueue_clear(sess);
+
+	gg_image_sendout_clear(sess);
+
+	gg_recv_ring_free(sess);
+
+	if (p->dummyfds_created) {
+		close(p->dummyfds[0]);
+		close(p->dummyfds[1]);
+		p->dummyfds_created = 0;
+	}
+
+	gg_compat_message_cleanup(sess);
+
+	errno = errno_copy;
+}
+
+/**
+ * \internal Kopiuje początek danych z bufora cyklicznego.
+ *
+ * \param r Bufor cykliczny
+ * \param dst Bufor docelowy
+ * \param len Liczba bajtów do skopiowania
+ */
+static void gg_recv_ring_copy(const gg_recv_ring_t *r, char *dst, size_t len)
+{
+	size_t first;
+
+	first = r->size - r->start;
+	if (first > len)
+		first = len;
+
+	memcpy(dst, r->buf + r->start, first);
+	memcpy(dst + first, r->buf, len - first);
+}
+
+/**
+ * \internal Zapewnia odpowiedni rozmiar bufora pomocniczego.
+ *
+ * \param r Bufor cykliczny
+ * \param len Wymagana długość pakietu (bez znaku '\\0')
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_recv_ring_frame_alloc(gg_recv_ring_t *r, size_t len)
+{
+	char *tmp;
+
+	if (r->frame_size > len)
+		return 0;
+
+	tmp = realloc(r->frame, len + 1);
+
+	if (tmp == NULL)
+		return -1;
+
+	r->frame = tmp;
+	r->frame_size = len + 1;
+
+	return 0;
+}
+
+/**
+ * \internal Zwalnia bufory odbiorcze sesji.
+ *
+ * \param sess Struktura sesji
+ */
+static void gg_recv_ring_free(struct gg_session *sess)
+{
+	gg_recv_ring_t *r = &sess->private_data->recv_ring;
+
+	free(r->buf);
+	free(r->frame);
+	memset(r, 0, sizeof(gg_recv_ring_t));
+}
+
+/**
+ * \internal Zwalnia pakiet zwrócony przez \c gg_recv_frame().
+ *
+ * Po wywołaniu funkcji wskaźnik do danych pakietu przestaje być ważny.
+ *
+ * \param sess Struktura sesji
+ */
+void gg_recv_frame_release(struct gg_session *sess)
+{
+	gg_recv_ring_t *r = &sess->private_data->recv_ring;
+
+	if (!r->held)
+		return;
+
+	if (r->term != NULL) {
+		*r->term = r->term_saved;
+		r->term = NULL;
+	}
+
+	r->start = (r->start + r->consume) % r->size;
+	r->len -= r->consume;
+	r->consume = 0;
+
+	if (r->len == 0)
+		r->start = 0;
+
+	r->frame_total = 0;
+	r->frame_done = 0;
+	r->held = 0;
+}
+
+/**
+ * \internal Sprawdza, czy w buforze cyklicznym czeka kompletny pakiet.
+ *
+ * \param sess Struktura sesji
+ *
+ * \return 1 jeśli pakiet czeka na obsługę, 0 w przeciwnym wypadku
+ */
+int gg_recv_frame_pending(struct gg_session *sess)
+{
+	gg_recv_ring_t *r = &sess->private_data->recv_ring;
+	struct gg_header gh;
+	uint32_t ghlen;
+
+	if (r->buf == NULL || r->held || r->len < sizeof(gh))
+		return 0;
+
+	gg_recv_ring_copy(r, (char*) &gh, sizeof(gh));
+	ghlen = gg_fix32(gh.length);
+
+	/* Błędną długość też trzeba obsłużyć */
+	if (ghlen > 65535)
+		return 1;
+
+	return (r->len >= sizeof(gh) + ghlen);
+}
+
+/**
+ * \internal Przenosi do bufora cyklicznego dane odebrane przed zestawieniem
+ * połączenia (np. nadmiarowo wczytane przy łączeniu przez serwer
+ * pośredniczący).
+ *
+ * \param sess Struktura sesji
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_recv_ring_init(struct gg_session *sess)
+{
+	gg_recv_ring_t *r = &sess->private_data->recv_ring;
+	size_t pending = 0;
+
+	if (sess->recv_buf != NULL && sess->recv_done > 0)
+		pending = sess->recv_done;
+
+	if (r->buf == NULL) {
+		r->size = GG_RECV_RING_SIZE;
+		if (r->size < pending)
+			r->size = pending;
+
+		r->buf = malloc(r->size + 1);
+
+		if (r->buf == NULL) {
+			r->size = 0;
+			return -1;
+		}
+
+		r->start = 0;
+		r->len = 0;
+	}
+
+	if (pending > 0) {
+		if (r->len + pending > r->size) {
+			errno = ERANGE;
+			return -1;
+		}
+
+		memcpy(r->buf + r->len, sess->recv_buf, pending);
+		r->len += pending;
+	}
+
+	free(sess->recv_buf);
+	sess->recv_buf = NULL;
+	sess->recv_done = 0;
+
+	return 0;
+}
+
+/**
+ * \internal Odbiera pakiet od serwera bez kopiowania.
+ *
+ * Funkcja wczytuje do bufora cyklicznego sesji tyle danych, ile jest
+ * dostępnych, i zwraca wskaźnik do danych pierwszego kompletnego pakietu.
+ * Jeśli pakiet nie mieści się w buforze w jednym kawałku, jest składany
+ * w buforze pomocniczym. Dane pakietu są zakończone znakiem '\\0'.
+ *
+ * Zwrócony wskaźnik jest ważny do wywołania \c gg_recv_frame_release(),
+ * kolejnego wywołania \c gg_recv_frame() lub zamknięcia połączenia.
+ *
+ * Przy połączeniach asynchronicznych, funkcja może nie być w stanie
+ * skompletować całego pakietu -- w takim przypadku zwróci \c NULL, a kodem
+ * błędu będzie \c EAGAIN.
+ *
+ * \param sess Struktura sesji
+ * \param type Wskaźnik na rodzaj pakietu
+ * \param length Wskaźnik na długość danych pakietu
+ *
+ * \return Wskaźnik do danych pakietu lub \c NULL
+ */
+const char *gg_recv_frame(struct gg_session *sess, uint32_t *type, uint32_t *length)
+{
+	gg_recv_ring_t *r = &sess->private_data->recv_ring;
+	struct gg_header gh;
+	const char *packet;
+	uint32_t ghlen;
+	size_t total, tail, len;
+	int res;
+
+	gg_recv_frame_release(sess);
+
+	if ((r->buf == NULL || sess->recv_buf != NULL) &&
+		gg_recv_ring_init(sess) == -1)
+	{
+		gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_recv_packet() out of memory\n");
+		goto fail;
+	}
+
+	for (;;) {
+		if (r->frame_total != 0) {
+			/* Składamy pakiet większy niż bufor cykliczny */
+
+			total = r->frame_total;
+
+			if (r->frame_done == total) {
+				packet = r->frame;
+				r->frame[total] = 0;
+				break;
+			}
+
+			len = total - r->frame_done;
+
+			gg_debug_session(sess, GG_DEBUG_NET,
+				"// gg_recv_packet() payload: %" GG_SIZE_FMT
+				" done, %" GG_SIZE_FMT " length, %"
+				GG_SIZE_FMT " to go\n", r->frame_done,
+				total - sizeof(struct gg_header), len);
+
+			res = gg_read(sess, r->frame + r->frame_done, len);
+		} else {
+			if (r->len >= sizeof(struct gg_header)) {
+				gg_recv_ring_copy(r, (char*) &gh, sizeof(gh));
+				ghlen = gg_fix32(gh.length);
+
+				if (ghlen > 65535) {
+					gg_debug_session(sess, GG_DEBUG_ERROR,
+						"// gg_recv_packet() invalid packet "
+						"length (%d)\n", ghlen);
+					errno = ERANGE;
+					goto fail;
+				}
+
+				total = sizeof(struct gg_header) + ghlen;
+
+				if (total > r->size) {
+					if (gg_recv_ring_frame_alloc(r, total) == -1) {
+						gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_recv_packet() out of memory\n");
+						goto fail;
+					}
+
+					gg_recv_ring_copy(r, r->frame, r->len);
+					r->frame_total = total;
+					r->frame_done = r->len;
+					r->start = 0;
+					r->len = 0;
+					continue;
+				}
+
+				if (r->len >= total) {
+					if (r->start + total <= r->size) {
+						/* Pakiet w jednym kawałku */
+						packet = r->buf + r->start;
+						r->term = r->buf + r->start + total;
+						r->term_saved = *r->term;
+						*r->term = 0;
+					} else {
+						/* Pakiet zawinięty */
+						if (gg_recv_ring_frame_alloc(r, total) == -1) {
+							gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_recv_packet() out of memory\n");
+							goto fail;
+						}
+
+						gg_recv_ring_copy(r, r->frame, total);
+						r->frame[total] = 0;
+						packet = r->frame;
+					}
+
+					r->consume = total;
+					break;
+				}
+
+				gg_debug_session(sess, GG_DEBUG_NET,
+					"// gg_recv_packet() payload: %"
+					GG_SIZE_FMT " done, %u length, %"
+					GG_SIZE_FMT " to go\n", r->len, ghlen,
+					total - r->len);
+			} else {
+				gg_debug_session(sess, GG_DEBUG_NET,
+					"// gg_recv_packet() header: %"
+					GG_SIZE_FMT " done, %" GG_SIZE_FMT
+					" to go\n", r->len,
+					sizeof(struct gg_header) - r->len);
+			}
+
+			/* Wczytujemy wszystko, co zmieści się w buforze */
+
+			if (r->len == 0)
+				r->start = 0;
+
+			tail = (r->start + r->len) % r->size;
+
+			if (tail >= r->start && r->len < r->size)
+				len = r->size - tail;
+			else
+				len = r->start - tail;
+
+			res = gg_read(sess, r->buf + tail, len);
+		}
+
+		if (res == 0) {
+			errno = ECONNRESET;
+			gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_recv_packet() connection broken\n");
+			goto fail;
+		}
+
+		if (res == -1 && errno == EAGAIN) {
+			gg_debug_session(sess, GG_DEBUG_NET, "// gg_recv_packet() resource temporarily unavailable\n");
+			return NULL;
+		}
+
+		if (res == -1) {
+			gg_debug_session(sess, GG_DEBUG_ERROR,
+				"// gg_recv_packet() read failed: errno=%d, "
+				"%s\n", errno, strerror(errno));
+			goto fail;
+		}
+
+		gg_debug_session(sess, GG_DEBUG_NET, "// gg_recv_packet() read %d bytes\n", res);
+
+		if (r->frame_total != 0)
+			r->frame_done += res;
+		else
+			r->len += res;
+	}
+
+	r->held = 1;
+
+	memcpy(&gh, packet, sizeof(gh));
+	*type = gg_fix32(gh.type);
+	*length = gg_fix32(gh.length);
+
+	gg_debug_session(sess, GG_DEBUG_MISC, "// gg_recv_packet(type=0x%.2x, "
+		"length=%d)\n", *type, *length);
+	gg_debug_dump(sess, GG_DEBUG_DUMP, packet, sizeof(struct gg_header) + *length);
+
+	return packet + sizeof(struct gg_header);
+
+fail:
+	gg_recv_ring_free(sess);
+
+	return NULL;
+}
+
+/**
+ * \internal Odbiera pakiet od serwera.
+ *
+ * Funkcja odczytuje nagłówek pakietu, a następnie jego zawartość i zwraca
+ * w zaalokowanym buforze.
+ *
+ * Przy połączeniach asynchronicznych, funkcja może nie być w stanie
+ * skompletować całego pakietu -- w takim przypadku zwróci \c NULL, a kodem błędu
+ * będzie \c EAGAIN.
+ *
+ * \note Biblioteka korzysta wewnętrznie z \c gg_recv_frame(), która nie
+ * kopiuje danych pakietu.
+ *
+ * \param sess Struktura sesji
+ *
+ * \return Wskaźnik do zaalokowanego bufora
+ */
+void *gg_recv_packet(struct gg_session *sess)
+{
+	struct gg_header *gh;
+	const char *payload;
+	uint32_t type, length;
+	char *packet;
+
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_recv_packet(%p);\n", sess);
+
+	if (sess == NULL) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	payload = gg_recv_frame(sess, &type, &length);
+
+	if (payload == NULL)
+		return NULL;
+
+	packet = malloc(sizeof(struct gg_header) + length + 1);
+
+	if (packet == NULL) {
+		gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_recv_packet() out of memory\n");
+		gg_recv_frame_release(sess);
+		return NULL;
+	}
+
+	gh = (struct gg_header*) packet;
+	gh->type = type;
+	gh->length = length;
+
+	/* Czasami zakładamy, że teksty w pakietach są zakończone zerem */
+	memcpy(packet + sizeof(struct gg_header), payload, length + 1);
+
+	gg_recv_frame_release(sess);
+
+	return packet;
+}
+
+/**
+ * \internal Wysyła pakiet do serwera.
+ *
+ * Funkcja wysyła pakiet złożony z dowolnej liczby fragmentów bez kopiowania
+ * ich do wspólnego bufora. Jeśli rozmiar pakietu jest za duży, by móc go
+ * wysłać za jednym razem, pozostała część zostanie zakolejkowana i wysłana,
+ * gdy będzie to możliwe.
+ *
+ * \param sess Struktura sesji
+ * \param type Rodzaj pakietu
+ * \param ... Lista kolejnych części pakietu (wskaźnik na bufor i długość
+ *            typu \c int) zakończona \c NULL
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+int gg_send_packet(struct gg_session *sess, int type, ...)
+{
+	struct gg_header h;
+	struct iovec iov[GG_SEND_IOV_MAX];
+	int iovcnt, i;
+	char *tmp = NULL;
+	unsigned int tmp_length;
+	void *payload;
+	unsigned int payload_length;
+	va_list ap;
+	int res;
+
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_send_packet(%p, 0x%.2x, ...);\n", sess, type);
+
+	iov[0].iov_base = &h;
+	iov[0].iov_len = sizeof(h);
+	iovcnt = 1;
+
+	tmp_length = sizeof(struct gg_header);
+
+	va_start(ap, type);
+
+	payload = va_arg(ap, void *);
+
+	while (payload) {
+		payload_length = va_arg(ap, unsigned int);
+
+		if (payload_length > 0 && iovcnt <= GG_SEND_IOV_MAX) {
+			if (iovcnt < GG_SEND_IOV_MAX) {
+				iov[iovcnt].iov_base = payload;
+				iov[iovcnt].iov_len = payload_length;
+			}
+			iovcnt++;
+		}
+
+		tmp_length += payload_length;
+
+		payload = va_arg(ap, void *);
+	}
+
+	va_end(ap);
+
+	/* Zbyt wiele fragmentów, więc sklejamy treść pakietu */
+	if (iovcnt > GG_SEND_IOV_MAX) {
+		unsigned int offset = 0;
+
+		if (!(tmp = malloc(tmp_length - sizeof(struct gg_header)))) {
+			gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_send_packet() not enough memory for payload\n");
+			return -1;
+		}
+
+		va_start(ap, type);
+
+		payload = va_arg(ap, void *);
+
+		while (payload) {
+			payload_length = va_arg(ap, unsigned int);
+			memcpy(tmp + offset, payload, payload_length);
+			offset += payload_length;
+			payload = va_arg(ap, void *);
+		}
+
+		va_end(ap);
+
+		iov[1].iov_base = tmp;
+		iov[1].iov_len = offset;
+		iovcnt = 2;
+	}
+
+	h.type = gg_fix32(type);
+	h.length = gg_fix32(tmp_length - sizeof(struct gg_header));
+
+	gg_debug_session(sess, GG_DEBUG_MISC, "// gg_send_packet(type=0x%.2x, "
+		"length=%d)\n", gg_fix32(h.type), gg_fix32(h.length));
+	for (i = 0; i < iovcnt; i++)
+		gg_debug_dump(sess, GG_DEBUG_DUMP, iov[i].iov_base, iov[i].iov_len);
+
+	res = gg_writev(sess, iov, iovcnt);
+
+	free(tmp);
+
+	if (res == -1) {
+		gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_send_packet() "
+			"write() failed. res = %d, errno = %d (%s)\n",
+			res, errno, strerror(errno));
+		return -1;
+	}
+
+	if (sess->async) {
+		gg_debug_session(sess, GG_DEBUG_NET, "// gg_send_packet() "
+			"partial write(), %d sent, %d left, %d total left\n",
+			res, tmp_length - res, sess->send_left);
+	}
+
+	if (sess->send_buf)
+		sess->check |= GG_CHECK_WRITE;
+
+	return 0;
+}
+
+/**
+ * \internal Dołącza do kolejki dane zapisane już za jej końcem i próbuje
+ * je wysłać.
+ *
+ * Jeśli kolejka była pusta, dane są od razu wysyłane. W trybie
+ * synchronicznym wysyłana jest cała kolejka.
+ *
+ * \param sess Struktura sesji
+ * \param left Liczba bajtów w kolejce przed dołączeniem danych
+ * \param length Liczba dołączanych bajtów
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_send_queue_commit(struct gg_session *sess, size_t left,
+	size_t length)
+{
+	int res;
+
+	gg_send_queue_update(sess, left + length);
+
+	if (!sess->async) {
+		while (sess->private_data->send_head != NULL) {
+			if (gg_send_queue_flush(sess) == -1) {
+				gg_send_queue_free(sess);
+				return -1;
+			}
+		}
+
+		return 0;
+	}
+
+	if (left == 0) {
+		res = gg_send_queue_flush(sess);
+
+		if (res == -1 && errno != EAGAIN) {
+			gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_send_packet() "
+				"write() failed. res = %d, errno = %d (%s)\n",
+				res, errno, strerror(errno));
+			gg_send_queue_free(sess);
+			return -1;
+		}
+	}
+
+	if (sess->send_buf)
+		sess->check |= GG_CHECK_WRITE;
+
+	return 0;
+}
+
+/**
+ * \internal Dołącza fragment na koniec kolejki danych do wysłania.
+ *
+ * \param sess Struktura sesji
+ * \param chunk Fragment
+ */
+static void gg_send_queue_link(struct gg_session *sess, gg_send_chunk_t *chunk)
+{
+	struct gg_session_private *p = sess->private_data;
+
+	chunk->next = NULL;
+
+	if (p->send_tail != NULL)
+		p->send_tail->next = chunk;
+	else
+		p->send_head = chunk;
+	p->send_tail = chunk;
+}
+
+/**
+ * \internal Sprawdza, czy dopisanie danych nie przekroczy limitu kolejki.
+ *
+ * \param sess Struktura sesji
+ * \param length Liczba dopisywanych bajtów
+ *
+ * \return 0 jeśli dane się zmieszczą, -1 w przeciwnym wypadku
+ */
+static int gg_send_queue_check_limit(struct gg_session *sess, size_t length)
+{
+	struct gg_session_private *p = sess->private_data;
+
+	if (p->send_head != NULL && p->send_queue_limit > 0 &&
+		(size_t) sess->send_left + length > (size_t) p->send_queue_limit)
+	{
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * \internal Przydziela fragment kolejki danych do wysłania.
+ *
+ * Jeśli to możliwe, wykorzystywany jest fragment, którego zawartość została
+ * już wysłana.
+ *
+ * \param sess Struktura sesji
+ * \param size Minimalna pojemność fragmentu
+ *
+ * \return Pusty fragment lub \c NULL w przypadku błędu
+ */
+gg_send_chunk_t *gg_send_chunk_new(struct gg_session *sess, size_t size)
+{
+	struct gg_session_private *p = sess->private_data;
+	gg_send_chunk_t *chunk = p->send_spare;
+
+	if (chunk != NULL && chunk->size >= size) {
+		p->send_spare = chunk->next;
+		p->send_spare_count--;
+	} else {
+		if (size < GG_SEND_CHUNK_SIZE)
+			size = GG_SEND_CHUNK_SIZE;
+
+		chunk = malloc(sizeof(gg_send_chunk_t) + size);
+
+		if (chunk == NULL) {
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		chunk->buf = (char*) (chunk + 1);
+		chunk->size = size;
+	}
+
+	chunk->start = 0;
+	chunk->end = 0;
+	chunk->next = NULL;
+
+	return chunk;
+}
+
+/**
+ * \internal Zmienia pojemność fragmentu, zachowując jego zawartość.
+ *
+ * \param chunk Fragment spoza kolejki
+ * \param size Nowa pojemność fragmentu
+ *
+ * \return Fragment lub \c NULL w przypadku błędu (wtedy pierwotny fragment
+ *         nie jest zwalniany)
+ */
+gg_send_chunk_t *gg_send_chunk_resize(gg_send_chunk_t *chunk, size_t size)
+{
+	gg_send_chunk_t *res;
+
+	res = realloc(chunk, sizeof(gg_send_chunk_t) + size);
+
+	if (res == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	res->buf = (char*) (res + 1);
+	res->size = size;
+
+	return res;
+}
+
+/**
+ * \internal Zwalnia fragment kolejki lub zachowuje go do ponownego użycia.
+ *
+ * \param sess Struktura sesji
+ * \param chunk Fragment spoza kolejki
+ */
+void gg_send_chunk_free(struct gg_session *sess, gg_send_chunk_t *chunk)
+{
+	struct gg_session_private *p = sess->private_data;
+
+	if (chunk == NULL)
+		return;
+
+	/* Zachowujemy tylko fragmenty podstawowego rozmiaru, żeby pula
+	 * nie trzymała pamięci po pojedynczych dużych pakietach */
+	if (p->send_spare_count < GG_SEND_SPARE_MAX &&
+		chunk->size == GG_SEND_CHUNK_SIZE)
+	{
+		chunk->next = p->send_spare;
+		p->send_spare = chunk;
+		p->send_spare_count++;
+		return;
+	}
+
+	free(chunk);
+}
+
+/**
+ * \internal Rezerwuje w kolejce danych do wysłania miejsce na pakiet.
+ *
+ * Pozwala zbudować treść pakietu bezpośrednio w kolejce, bez tymczasowego
+ * bufora. Miejsce na nagłówek i treść jest ciągłe i znajduje się w ostatnim
+ * fragmencie kolejki lub w nowym fragmencie, który zostanie do niej
+ * dołączony przez gg_send_packet_commit(). Do czasu wywołania tej funkcji
+ * nie można wysyłać innych pakietów.
+ *
+ * \param sess Struktura sesji
+ * \param length Długość treści pakietu
+ *
+ * \return Wskaźnik na miejsce na treść pakietu lub \c NULL w przypadku błędu
+ */
+void *gg_send_packet_reserve(struct gg_session *sess, size_t length)
+{
+	struct gg_session_private *p = sess->private_data;
+	gg_send_chunk_t *tail = p->send_tail;
+	size_t total = sizeof(struct gg_header) + length;
+
+	if (gg_send_queue_check_limit(sess, total) == -1)
+		return NULL;
+
+	if (tail != NULL && tail->size - tail->end >= total)
+		return tail->buf + tail->end + sizeof(struct gg_header);
+
+	if (p->send_reserved != NULL && p->send_reserved->size < total) {
+		gg_send_chunk_free(sess, p->send_reserved);
+		p->send_reserved = NULL;
+	}
+
+	if (p->send_reserved == NULL) {
+		p->send_reserved = gg_send_chunk_new(sess, total);
+
+		if (p->send_reserved == NULL)
+			return NULL;
+	}
+
+	return p->send_reserved->buf + sizeof(struct gg_header);
+}
+
+/**
+ * \internal Wysyła pakiet zbudowany w miejscu zarezerwowanym przez
+ * gg_send_packet_reserve().
+ *
+ * Funkcja uzupełnia nagłówek pakietu i dołącza go do kolejki. Jeśli kolejka
+ * była pusta, od razu próbuje go wysłać. W trybie synchronicznym wysyła
+ * całą kolejkę.
+ *
+ * \param sess Struktura sesji
+ * \param type Rodzaj pakietu
+ * \param length Długość treści pakietu, taka sama jak przy rezerwacji
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+int gg_send_packet_commit(struct gg_session *sess, int type, size_t length)
+{
+	struct gg_session_private *p = sess->private_data;
+	gg_send_chunk_t *tail = p->send_tail;
+	size_t total = sizeof(struct gg_header) + length;
+	size_t left = sess->send_left;
+	struct gg_header h;
+	char *packet;
+
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_send_packet_commit(%p, 0x%.2x, %" GG_SIZE_FMT ");\n", sess, type, length);
+
+	if (tail == NULL || tail->size - tail->end < total) {
+		tail = p->send_reserved;
+		p->send_reserved = NULL;
+		gg_send_queue_link(sess, tail);
+	}
+
+	packet = tail->buf + tail->end;
+
+	h.type = gg_fix32(type);
+	h.length = gg_fix32(length);
+	memcpy(packet, &h, sizeof(h));
+
+	gg_debug_session(sess, GG_DEBUG_MISC, "// gg_send_packet(type=0x%.2x, "
+		"length=%" GG_SIZE_FMT ")\n", type, length);
+	gg_debug_dump(sess, GG_DEBUG_DUMP, packet, total);
+
+	tail->end += total;
+
+	return gg_send_queue_commit(sess, left, total);
+}
+
+/**
+ * \internal Dołącza do kolejki fragment z gotowymi pakietami i próbuje
+ * go wysłać.
+ *
+ * Fragment przechodzi na własność kolejki również w przypadku błędu.
+ *
+ * \param sess Struktura sesji
+ * \param chunk Fragment przydzielony przez gg_send_chunk_new()
+ * \param length Długość danych od początku fragmentu
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_send_queue_chunk(struct gg_session *sess,
+	gg_send_chunk_t *chunk, size_t length)
+{
+	size_t left = sess->send_left;
+
+	if (gg_send_queue_check_limit(sess, length) == -1) {
+		gg_send_chunk_free(sess, chunk);
+		return -1;
+	}
+
+	gg_debug_dump(sess, GG_DEBUG_DUMP, chunk->buf, length);
+
+	chunk->start = 0;
+	chunk->end = length;
+	gg_send_queue_link(sess, chunk);
+
+	return gg_send_queue_commit(sess, left, length);
+}
+
+/**
+ * \internal Wysyła pakiet zbudowany we własnym fragmencie kolejki.
+ *
+ * Treść pakietu musi znajdować się w fragmencie zaraz za miejscem na
+ * nagłówek. Fragment jest dołączany do kolejki bez kopiowania danych
+ * i przechodzi na własność kolejki również w przypadku błędu.
+ *
+ * \param sess Struktura sesji
+ * \param type Rodzaj pakietu
+ * \param chunk Fragment przydzielony przez gg_send_chunk_new()
+ * \param length Długość treści pakietu
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+int gg_send_packet_chunk(struct gg_session *sess, int type,
+	gg_send_chunk_t *chunk, size_t length)
+{
+	struct gg_header h;
+
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_send_packet_chunk(%p, 0x%.2x, %" GG_SIZE_FMT ");\n", sess, type, length);
+
+	h.type = gg_fix32(type);
+	h.length = gg_fix32(length);
+	memcpy(chunk->buf, &h, sizeof(h));
+
+	gg_debug_session(sess, GG_DEBUG_MISC, "// gg_send_packet(type=0x%.2x, "
+		"length=%" GG_SIZE_FMT ")\n", type, length);
+
+	return gg_send_queue_chunk(sess, chunk, sizeof(struct gg_header) + length);
+}
+
+/**
+ * \internal Funkcja zwrotna sesji.
+ *
+ * Pole \c callback struktury \c gg_session zawiera wskaźnik do tej funkcji.
+ * Wywołuje ona \c gg_watch_fd i zachowuje wynik w polu \c event.
+ *
+ * \note Korzystanie z tej funkcjonalności nie jest już zalecane.
+ *
+ * \param sess Struktura sesji
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_session_callback(struct gg_session *sess)
+{
+	if (!sess) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	return ((sess->event = gg_watch_fd(sess)) != NULL) ? 0 : -1;
 }
 
 /**
@@ -954,6 +1879,26 @@ struct gg_session *gg_login(const struct gg_login_params *p)
 			goto fail;
 	}
 
+	if (GG_LOGIN_PARAMS_HAS_FIELD(p, recv_batch) && p->recv_batch > 1)
+		sess_private->recv_batch = p->recv_batch;
+	else
+		sess_private->recv_batch = 1;
+
+	if (GG_LOGIN_PARAMS_HAS_FIELD(p, send_queue_limit) &&
+		p->send_queue_limit > 0)
+	{
+		sess_private->send_queue_limit = p->send_queue_limit;
+	}
+
+	if (GG_LOGIN_PARAMS_HAS_FIELD(p, image_queue_limit) &&
+		p->image_queue_limit > 0)
+	{
+		sess_private->image_index.limit = p->image_queue_limit;
+	}
+
+	if (GG_LOGIN_PARAMS_HAS_FIELD(p, roster))
+		sess_private->roster_enabled = (p->roster != 0);
+
 	if (p->protocol_features == 0) {
 		sess->protocol_features = GG_FEATURE_MSG80 |
 			GG_FEATURE_STATUS80 | GG_FEATURE_DND_FFC |
@@ -1191,11 +2136,7 @@ void gg_logoff(struct gg_session *sess)
 
 	gg_close(sess);
 
-	if (sess->send_buf) {
-		free(sess->send_buf);
-		sess->send_buf = NULL;
-		sess->send_left = 0;
-	}
+	gg_send_queue_free(sess);
 }
 
 /**
@@ -1210,7 +2151,6 @@ void gg_logoff(struct gg_session *sess)
 void gg_free_session(struct gg_session *sess)
 {
 	struct gg_dcc7 *dcc;
-	gg_chat_list_t *chat;
 
 	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_free_session(%p);\n", sess);
 
@@ -1219,6 +2159,8 @@ void gg_free_session(struct gg_session *sess)
 
 	/* XXX dopisać zwalnianie i zamykanie wszystkiego, co mogło zostać */
 
+	gg_loop_item_remove(sess->private_data->loop_item);
+
 	free(sess->resolver_result);
 	free(sess->connect_host);
 	free(sess->password);
@@ -1255,30 +2197,27 @@ void gg_free_session(struct gg_session *sess)
 
 	gg_close(sess);
 
-	while (sess->images) {
-		struct gg_image_queue *next = sess->images->next;
+	gg_image_queue_free(sess);
 
-		gg_image_queue_remove(sess, sess->images, 1);
-
-		/* a fix for false-positive NULL-dereference */
-		sess->images = next;
-	}
-
-	free(sess->send_buf);
+	gg_send_queue_free(sess);
 
 	for (dcc = sess->dcc7_list; dcc; dcc = dcc->next)
 		dcc->sess = NULL;
 
-	chat = sess->private_data->chat_list;
-	while (chat != NULL) {
-		gg_chat_list_t *next = chat->next;
-		free(chat->participants);
-		free(chat);
-		chat = next;
-	}
+	gg_chat_free(sess);
 
 	gg_strarr_free(sess->private_data->host_white_list);
 
+	gg_roster_free(sess);
+
+	free(sess->private_data->notify_list);
+
+	gg_event_pool_free(sess);
+
+	gg_tvbuilder_pool_free(sess);
+
+	gg_protobuf_arena_destroy(sess);
+
 	free(sess->private_data);
 
 	free(sess);
@@ -1503,6 +2442,11 @@ static int gg_send_message_110(struct gg_session *sess,
 
 	if (!GG_PROTOBUF_SEND(sess, NULL, packet_type, gg110_send_message, msg))
 		succ = 0;
+	else if (gg_sent_message_add(sess, seq) == NULL) {
+		gg_debug_session(sess, GG_DEBUG_MISC | GG_DEBUG_WARNING,
+			"// gg_send_message_110() unable to track message %d\n",
+			seq);
+	}
 
 	free(html_message_gen);
 	free(plain_message_gen);
@@ -1912,127 +2856,401 @@ int gg_send_message_confer(struct gg_session *sess, int msgclass,
  * Zwraca losowy numer sekwencyjny, który można zignorować albo wykorzystać
  * do potwierdzenia.
  *
- * \param sess Struktura sesji
- * \param msgclass Klasa wiadomości
- * \param recipients_count Liczba adresatów
- * \param recipients Wskaźnik do tablicy z numerami adresatów
- * \param message Treść wiadomości
- * \param format Informacje o formatowaniu
- * \param formatlen Długość informacji o formatowaniu
+ * \param sess Struktura sesji
+ * \param msgclass Klasa wiadomości
+ * \param recipients_count Liczba adresatów
+ * \param recipients Wskaźnik do tablicy z numerami adresatów
+ * \param message Treść wiadomości
+ * \param format Informacje o formatowaniu
+ * \param formatlen Długość informacji o formatowaniu
+ *
+ * \return Numer sekwencyjny wiadomości lub -1 w przypadku błędu.
+ *
+ * \ingroup messages
+ */
+int gg_send_message_confer_richtext(struct gg_session *sess, int msgclass,
+	int recipients_count, uin_t *recipients, const unsigned char *message,
+	const unsigned char *format, int formatlen)
+{
+	gg_debug_session(sess, GG_DEBUG_FUNCTION,
+		"** gg_send_message_confer_richtext(%p, %d, %d, %p, %p, %p, "
+		"%d);\n", sess, msgclass, recipients_count, recipients, message,
+		format, formatlen);
+
+	return gg_send_message_common(sess, msgclass, recipients_count, recipients, message, format, formatlen, NULL);
+}
+
+/**
+ * Wysyła formatowaną wiadomość HTML w ramach konferencji.
+ *
+ * Zwraca losowy numer sekwencyjny, który można zignorować albo wykorzystać
+ * do potwierdzenia.
+ *
+ * \param sess Struktura sesji
+ * \param msgclass Klasa wiadomości
+ * \param recipients_count Liczba adresatów
+ * \param recipients Wskaźnik do tablicy z numerami adresatów
+ * \param html_message Treść wiadomości HTML
+ *
+ * \return Numer sekwencyjny wiadomości lub -1 w przypadku błędu.
+ *
+ * \ingroup messages
+ */
+int gg_send_message_confer_html(struct gg_session *sess, int msgclass,
+	int recipients_count, uin_t *recipients,
+	const unsigned char *html_message)
+{
+	gg_debug_session(sess, GG_DEBUG_FUNCTION,
+		"** gg_send_message_confer_html(%p, %d, %d, %p, %p);\n", sess,
+		msgclass, recipients_count, recipients, html_message);
+
+	return gg_send_message_common(sess, msgclass, recipients_count, recipients, NULL, NULL, 0, html_message);
+}
+
+/**
+ * Wysyła wiadomość binarną przeznaczoną dla klienta.
+ *
+ * Wiadomości między klientami przesyła się np. w celu wywołania zwrotnego
+ * połączenia bezpośredniego. Funkcja zwraca losowy numer sekwencyjny,
+ * który można zignorować albo wykorzystać do potwierdzenia.
+ *
+ * \param sess Struktura sesji
+ * \param msgclass Klasa wiadomości
+ * \param recipient Numer adresata
+ * \param message Treść wiadomości
+ * \param message_len Długość wiadomości
+ *
+ * \return Numer sekwencyjny wiadomości lub -1 w przypadku błędu.
+ *
+ * \ingroup messages
+ */
+int gg_send_message_ctcp(struct gg_session *sess, int msgclass, uin_t recipient,
+	const unsigned char *message, int message_len)
+{
+	struct gg_send_msg s;
+
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_send_message_ctcp(%p, "
+		"%d, %u, ...);\n", sess, msgclass, recipient);
+
+	if (!sess) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (sess->state != GG_STATE_CONNECTED) {
+		errno = ENOTCONN;
+		return -1;
+	}
+
+	s.recipient = gg_fix32(recipient);
+	s.seq = gg_fix32(0);
+	s.msgclass = gg_fix32(msgclass);
+
+	return gg_send_packet(sess, GG_SEND_MSG, &s, sizeof(s), message, message_len, NULL);
+}
+
+/**
+ * Wysyła żądanie obrazka o podanych parametrach.
+ *
+ * Wiadomości obrazkowe nie zawierają samych obrazków, a tylko ich rozmiary
+ * i sumy kontrolne. Odbiorca najpierw szuka obrazków w swojej pamięci
+ * podręcznej i dopiero gdy ich nie znajdzie, wysyła żądanie do nadawcy.
+ * Wynik zostanie przekazany zdarzeniem \c GG_EVENT_IMAGE_REPLY.
+ *
+ * \param sess Struktura sesji
+ * \param recipient Numer adresata
+ * \param size Rozmiar obrazka w bajtach
+ * \param crc32 Suma kontrola obrazka
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup messages
+ */
+int gg_image_request(struct gg_session *sess, uin_t recipient, int size, uint32_t crc32)
+{
+	struct gg_send_msg s;
+	struct gg_msg_image_request r;
+	char dummy = 0;
+	int res;
+
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_image_request(%p, %d, "
+		"%u, 0x%.4x);\n", sess, recipient, size, crc32);
+
+	if (!sess) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (sess->state != GG_STATE_CONNECTED) {
+		errno = ENOTCONN;
+		return -1;
+	}
+
+	if (size < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((size_t) size > gg_image_queue_limit(sess)) {
+		gg_debug_session(sess, GG_DEBUG_MISC, "// gg_image_request() "
+			"image exceeds image queue limit\n");
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	s.recipient = gg_fix32(recipient);
+	s.seq = gg_fix32(0);
+	s.msgclass = gg_fix32(GG_CLASS_MSG);
+
+	r.flag = GG_MSG_OPTION_IMAGE_REQUEST;
+	r.size = gg_fix32(size);
+	r.crc32 = gg_fix32(crc32);
+
+	res = gg_send_packet(sess, GG_SEND_MSG, &s, sizeof(s), &dummy, 1, &r, sizeof(r), NULL);
+
+	if (!res && gg_image_queue_add(sess, recipient, size, crc32) == NULL) {
+		gg_debug_session(sess, GG_DEBUG_MISC,
+			"// gg_image_request() not enough memory for "
+			"image queue\n");
+		return -1;
+	}
+
+	return res;
+}
+
+/**
+ * Tworzy bufor obrazka ze zliczaniem odwołań.
+ *
+ * Bufor przejmuje dane obrazka, więc można go wysyłać do wielu odbiorców
+ * funkcją \c gg_image_reply_buffer() bez kopiowania treści. Dane są
+ * zwalniane po zwolnieniu ostatniego odwołania.
+ *
+ * \param data    Dane obrazka
+ * \param size    Rozmiar obrazka
+ * \param destroy Funkcja zwalniająca dane lub \c NULL, jeśli należy użyć
+ *                \c free()
+ *
+ * \return Bufor obrazka z jednym odwołaniem lub \c NULL w przypadku błędu
+ *         (dane nie są wtedy zwalniane)
+ *
+ * \ingroup messages
+ */
+struct gg_image_buffer *gg_image_buffer_new(char *data, size_t size,
+	void (*destroy)(char *data))
+{
+	if (data == NULL && size > 0) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if (size > 0xffffffffU || size > INT_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return gg_image_buffer_alloc(data, size,
+		gg_crc32(0, (const unsigned char*) data, size), destroy);
+}
+
+/**
+ * \internal Tworzy bufor obrazka o znanej sumie kontrolnej.
+ *
+ * \param data    Dane obrazka
+ * \param size    Rozmiar obrazka
+ * \param crc32   Suma kontrolna obrazka
+ * \param destroy Funkcja zwalniająca dane lub \c NULL
+ *
+ * \return Bufor obrazka z jednym odwołaniem lub \c NULL w przypadku błędu
+ */
+struct gg_image_buffer *gg_image_buffer_alloc(char *data, uint32_t size,
+	uint32_t crc32, void (*destroy)(char *data))
+{
+	struct gg_image_buffer *buf;
+
+	buf = malloc(sizeof(struct gg_image_buffer));
+
+	if (buf == NULL)
+		return NULL;
+
+	buf->data = data;
+	buf->size = size;
+	buf->crc32 = crc32;
+	buf->refcount = 1;
+	buf->destroy = destroy;
+
+	return buf;
+}
+
+#ifdef GG_CONFIG_HAVE_PTHREAD
+/* Bufory z pamięci podręcznej obrazków są współdzielone przez sesje
+ * obsługiwane w różnych wątkach. */
+static pthread_mutex_t gg_image_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/**
+ * Dodaje odwołanie do bufora obrazka.
+ *
+ * \param buf Bufor obrazka
  *
- * \return Numer sekwencyjny wiadomości lub -1 w przypadku błędu.
+ * \return Bufor obrazka
  *
  * \ingroup messages
  */
-int gg_send_message_confer_richtext(struct gg_session *sess, int msgclass,
-	int recipients_count, uin_t *recipients, const unsigned char *message,
-	const unsigned char *format, int formatlen)
+struct gg_image_buffer *gg_image_buffer_ref(struct gg_image_buffer *buf)
 {
-	gg_debug_session(sess, GG_DEBUG_FUNCTION,
-		"** gg_send_message_confer_richtext(%p, %d, %d, %p, %p, %p, "
-		"%d);\n", sess, msgclass, recipients_count, recipients, message,
-		format, formatlen);
+	if (buf == NULL)
+		return NULL;
 
-	return gg_send_message_common(sess, msgclass, recipients_count, recipients, message, format, formatlen, NULL);
+#ifdef GG_CONFIG_HAVE_PTHREAD
+	pthread_mutex_lock(&gg_image_buffer_mutex);
+#endif
+	buf->refcount++;
+#ifdef GG_CONFIG_HAVE_PTHREAD
+	pthread_mutex_unlock(&gg_image_buffer_mutex);
+#endif
+
+	return buf;
 }
 
 /**
- * Wysyła formatowaną wiadomość HTML w ramach konferencji.
- *
- * Zwraca losowy numer sekwencyjny, który można zignorować albo wykorzystać
- * do potwierdzenia.
+ * Zwalnia odwołanie do bufora obrazka.
  *
- * \param sess Struktura sesji
- * \param msgclass Klasa wiadomości
- * \param recipients_count Liczba adresatów
- * \param recipients Wskaźnik do tablicy z numerami adresatów
- * \param html_message Treść wiadomości HTML
+ * Po zwolnieniu ostatniego odwołania zwalniane są dane obrazka.
  *
- * \return Numer sekwencyjny wiadomości lub -1 w przypadku błędu.
+ * \param buf Bufor obrazka
  *
  * \ingroup messages
  */
-int gg_send_message_confer_html(struct gg_session *sess, int msgclass,
-	int recipients_count, uin_t *recipients,
-	const unsigned char *html_message)
+void gg_image_buffer_unref(struct gg_image_buffer *buf)
 {
-	gg_debug_session(sess, GG_DEBUG_FUNCTION,
-		"** gg_send_message_confer_html(%p, %d, %d, %p, %p);\n", sess,
-		msgclass, recipients_count, recipients, html_message);
+	int refcount;
 
-	return gg_send_message_common(sess, msgclass, recipients_count, recipients, NULL, NULL, 0, html_message);
+	if (buf == NULL)
+		return;
+
+#ifdef GG_CONFIG_HAVE_PTHREAD
+	pthread_mutex_lock(&gg_image_buffer_mutex);
+#endif
+	refcount = --buf->refcount;
+#ifdef GG_CONFIG_HAVE_PTHREAD
+	pthread_mutex_unlock(&gg_image_buffer_mutex);
+#endif
+
+	if (refcount > 0)
+		return;
+
+	if (buf->destroy != NULL)
+		buf->destroy(buf->data);
+	else
+		free(buf->data);
+
+	free(buf);
 }
 
 /**
- * Wysyła wiadomość binarną przeznaczoną dla klienta.
+ * Wysyła żądany obrazek z bufora ze zliczaniem odwołań.
  *
- * Wiadomości między klientami przesyła się np. w celu wywołania zwrotnego
- * połączenia bezpośredniego. Funkcja zwraca losowy numer sekwencyjny,
- * który można zignorować albo wykorzystać do potwierdzenia.
+ * Fragmenty obrazka są wysyłane wprost z bufora, do którego kolejka
+ * wysyłania trzyma własne odwołanie.
  *
  * \param sess Struktura sesji
- * \param msgclass Klasa wiadomości
  * \param recipient Numer adresata
- * \param message Treść wiadomości
- * \param message_len Długość wiadomości
+ * \param filename Nazwa pliku
+ * \param image Bufor obrazka
  *
- * \return Numer sekwencyjny wiadomości lub -1 w przypadku błędu.
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
  *
  * \ingroup messages
  */
-int gg_send_message_ctcp(struct gg_session *sess, int msgclass, uin_t recipient,
-	const unsigned char *message, int message_len)
+int gg_image_reply_buffer(struct gg_session *sess, uin_t recipient,
+	const char *filename, struct gg_image_buffer *image)
 {
-	struct gg_send_msg s;
+	struct gg_session_private *p;
+	gg_imgout_queue_t *it;
+	const char *tmp;
 
-	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_send_message_ctcp(%p, "
-		"%d, %u, ...);\n", sess, msgclass, recipient);
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_image_reply_buffer(%p, "
+		"%d, \"%s\", %p);\n", sess, recipient, filename, image);
 
-	if (!sess) {
+	if (!sess || !filename || !image) {
 		errno = EFAULT;
 		return -1;
 	}
 
+	p = sess->private_data;
+
 	if (sess->state != GG_STATE_CONNECTED) {
 		errno = ENOTCONN;
 		return -1;
 	}
 
-	s.recipient = gg_fix32(recipient);
-	s.seq = gg_fix32(0);
-	s.msgclass = gg_fix32(msgclass);
+	/* wytnij ścieżki, zostaw tylko nazwę pliku */
+	while ((tmp = strrchr(filename, '/')) || (tmp = strrchr(filename, '\\')))
+		filename = tmp + 1;
 
-	return gg_send_packet(sess, GG_SEND_MSG, &s, sizeof(s), message, message_len, NULL);
+	if (strlen(filename) < 1 || strlen(filename) > 1024) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (image->size == 0)
+		return 0;
+
+	it = gg_new0(sizeof(gg_imgout_queue_t));
+
+	if (it == NULL)
+		return -1;
+
+	it->filename = strdup(filename);
+
+	if (it->filename == NULL) {
+		free(it);
+		return -1;
+	}
+
+	it->msg_hdr.recipient = gg_fix32(recipient);
+	it->msg_hdr.seq = gg_fix32(0);
+	it->msg_hdr.msgclass = gg_fix32(GG_CLASS_MSG);
+	it->image = gg_image_buffer_ref(image);
+
+	if (p->imgout_queue_tail != NULL)
+		p->imgout_queue_tail->next = it;
+	else
+		p->imgout_queue = it;
+	p->imgout_queue_tail = it;
+
+	gg_image_sendout(sess);
+
+	return 0;
 }
 
 /**
- * Wysyła żądanie obrazka o podanych parametrach.
+ * Wysyła żądany obrazek.
  *
- * Wiadomości obrazkowe nie zawierają samych obrazków, a tylko ich rozmiary
- * i sumy kontrolne. Odbiorca najpierw szuka obrazków w swojej pamięci
- * podręcznej i dopiero gdy ich nie znajdzie, wysyła żądanie do nadawcy.
- * Wynik zostanie przekazany zdarzeniem \c GG_EVENT_IMAGE_REPLY.
+ * Treść obrazka jest kopiowana, więc po powrocie z funkcji bufor można
+ * zwolnić. Aby wysłać obrazek bez kopiowania, należy użyć
+ * \c gg_image_reply_buffer().
  *
  * \param sess Struktura sesji
  * \param recipient Numer adresata
- * \param size Rozmiar obrazka w bajtach
- * \param crc32 Suma kontrola obrazka
+ * \param filename Nazwa pliku
+ * \param image Bufor z obrazkiem
+ * \param size Rozmiar obrazka
  *
  * \return 0 jeśli się powiodło, -1 w przypadku błędu
  *
  * \ingroup messages
  */
-int gg_image_request(struct gg_session *sess, uin_t recipient, int size, uint32_t crc32)
+int gg_image_reply(struct gg_session *sess, uin_t recipient, const char *filename, const char *image, int size)
 {
-	struct gg_send_msg s;
-	struct gg_msg_image_request r;
-	char dummy = 0;
+	struct gg_image_buffer *buf;
+	char *data = NULL;
 	int res;
 
-	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_image_request(%p, %d, "
-		"%u, 0x%.4x);\n", sess, recipient, size, crc32);
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_image_reply(%p, %d, "
+		"\"%s\", %p, %d);\n", sess, recipient, filename, image, size);
 
-	if (!sess) {
+	if (!sess || !filename || !image) {
 		errno = EFAULT;
 		return -1;
 	}
@@ -2047,187 +3265,356 @@ int gg_image_request(struct gg_session *sess, uin_t recipient, int size, uint32_
 		return -1;
 	}
 
-	s.recipient = gg_fix32(recipient);
-	s.seq = gg_fix32(0);
-	s.msgclass = gg_fix32(GG_CLASS_MSG);
+	if (size > 0) {
+		data = malloc(size);
 
-	r.flag = GG_MSG_OPTION_IMAGE_REQUEST;
-	r.size = gg_fix32(size);
-	r.crc32 = gg_fix32(crc32);
+		if (data == NULL)
+			return -1;
 
-	res = gg_send_packet(sess, GG_SEND_MSG, &s, sizeof(s), &dummy, 1, &r, sizeof(r), NULL);
+		memcpy(data, image, size);
+	}
 
-	if (!res) {
-		struct gg_image_queue *q = malloc(sizeof(*q));
-		char *buf;
+	buf = gg_image_buffer_new(data, size, NULL);
 
-		if (!q) {
-			gg_debug_session(sess, GG_DEBUG_MISC,
-				"// gg_image_request() not enough memory for "
-				"image queue\n");
-			return -1;
-		}
+	if (buf == NULL) {
+		free(data);
+		return -1;
+	}
 
-		buf = malloc(size);
-		if (size && !buf) {
-			gg_debug_session(sess, GG_DEBUG_MISC, "// gg_image_request() not enough memory for image\n");
-			free(q);
-			return -1;
+	res = gg_image_reply_buffer(sess, recipient, filename, buf);
+
+	gg_image_buffer_unref(buf);
+
+	return res;
+}
+
+/**
+ * \internal Zwraca liczbę fragmentów obrazków, które można wysłać bez
+ * czekania na potwierdzenie.
+ */
+static int gg_image_sendout_window(struct gg_session_private *p)
+{
+	return (p->imgout_window != 0) ? p->imgout_window : GG_IMGOUT_WAITING_MAX;
+}
+
+/**
+ * \internal Wysyła kolejne fragmenty obrazków z kolejki.
+ *
+ * Liczba niepotwierdzonych fragmentów jest ograniczona oknem, które rośnie,
+ * dopóki potwierdzenia przychodzą niewiele wolniej niż najszybsze
+ * zaobserwowane, i maleje, gdy zaczynają się opóźniać.
+ *
+ * \param sess Struktura sesji
+ */
+void gg_image_sendout(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+
+	while (p->imgout_waiting_ack < gg_image_sendout_window(p) && p->imgout_queue) {
+		gg_imgout_queue_t *it = p->imgout_queue;
+		struct gg_msg_image_reply r;
+		unsigned int name_len = 0, chunk_len;
+		char dummy = 0;
+		int res;
+
+		r.flag = (it->offset == 0) ? GG_MSG_OPTION_IMAGE_REPLY :
+			GG_MSG_OPTION_IMAGE_REPLY_MORE;
+		r.size = gg_fix32(it->image->size);
+		r.crc32 = gg_fix32(it->image->crc32);
+
+		/* w pierwszym kawałku jest nazwa pliku */
+		if (it->offset == 0)
+			name_len = strlen(it->filename) + 1;
+
+		chunk_len = GG_IMGOUT_CHUNK_SIZE - 1 - sizeof(r) - name_len;
+
+		if (chunk_len > it->image->size - it->offset)
+			chunk_len = it->image->size - it->offset;
+
+		res = gg_send_packet(sess, GG_SEND_MSG,
+			&it->msg_hdr, sizeof(it->msg_hdr),
+			&dummy, 1,
+			&r, sizeof(r),
+			it->filename, name_len,
+			it->image->data + it->offset, chunk_len,
+			NULL);
+
+		if (res == -1)
+			break;
+
+		p->imgout_sent[(p->imgout_sent_first + p->imgout_waiting_ack) %
+			GG_IMGOUT_WINDOW_MAX] = gg_timer_clock();
+		p->imgout_waiting_ack++;
+
+		it->offset += chunk_len;
+
+		if (it->offset == it->image->size) {
+			p->imgout_queue = it->next;
+			if (p->imgout_queue == NULL)
+				p->imgout_queue_tail = NULL;
+
+			gg_image_buffer_unref(it->image);
+			free(it->filename);
+			free(it);
 		}
+	}
+}
+
+/**
+ * \internal Obsługuje potwierdzenie fragmentu obrazka.
+ *
+ * Dostosowuje okno do czasu potwierdzenia najstarszego niepotwierdzonego
+ * fragmentu i wysyła kolejne fragmenty.
+ *
+ * \param sess Struktura sesji
+ */
+void gg_image_sendout_ack(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
 
-		memset(q, 0, sizeof(*q));
+	if (p->imgout_waiting_ack > 0) {
+		uint64_t latency;
+		int window, min;
 
-		q->sender = recipient;
-		q->size = size;
-		q->crc32 = crc32;
-		q->image = buf;
+		latency = gg_timer_clock() - p->imgout_sent[p->imgout_sent_first];
 
-		if (!sess->images)
-			sess->images = q;
-		else {
-			struct gg_image_queue *qq;
+		p->imgout_sent_first = (p->imgout_sent_first + 1) % GG_IMGOUT_WINDOW_MAX;
+		p->imgout_waiting_ack--;
+
+		if (latency > INT_MAX / 4)
+			latency = INT_MAX / 4;
+		if (latency < 1)
+			latency = 1;
 
-			for (qq = sess->images; qq->next; qq = qq->next);
+		if (p->imgout_latency_min == 0 || (int) latency < p->imgout_latency_min)
+			p->imgout_latency_min = latency;
 
-			qq->next = q;
+		min = p->imgout_latency_min;
+		window = gg_image_sendout_window(p);
+
+		if ((int) latency <= min + min / 2 + GG_IMGOUT_LATENCY_SLACK) {
+			if (window < GG_IMGOUT_WINDOW_MAX)
+				window++;
+		} else if ((int) latency > 2 * min + GG_IMGOUT_LATENCY_SLACK) {
+			if (window > GG_IMGOUT_WAITING_MAX)
+				window--;
 		}
+
+		p->imgout_window = window;
 	}
 
-	return res;
+	gg_image_sendout(sess);
 }
 
 /**
- * Wysyła żądany obrazek.
+ * \internal Usuwa wszystkie obrazki z kolejki do wysłania.
  *
  * \param sess Struktura sesji
- * \param recipient Numer adresata
- * \param filename Nazwa pliku
- * \param image Bufor z obrazkiem
- * \param size Rozmiar obrazka
+ */
+void gg_image_sendout_clear(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+
+	while (p->imgout_queue) {
+		gg_imgout_queue_t *next = p->imgout_queue->next;
+
+		gg_image_buffer_unref(p->imgout_queue->image);
+		free(p->imgout_queue->filename);
+		free(p->imgout_queue);
+		p->imgout_queue = next;
+	}
+
+	p->imgout_queue_tail = NULL;
+	p->imgout_waiting_ack = 0;
+	p->imgout_sent_first = 0;
+}
+
+/**
+ * \internal Maksymalna długość pakietu dodania lub usunięcia kontaktu.
+ */
+#define GG_NOTIFY_SYNC_PACKET_MAX (sizeof(struct gg_header) + 16)
+
+/**
+ * \internal Zwalnia listę kontaktów zapamiętaną przez gg_notify_sync().
  *
- * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ * \param sess Struktura sesji
+ */
+static void gg_notify_list_free(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+
+	free(p->notify_list);
+	p->notify_list = NULL;
+	p->notify_count = 0;
+	p->notify_list_valid = 0;
+}
+
+/**
+ * \internal Szuka kontaktu na liście zapamiętanej przez gg_notify_sync().
  *
- * \ingroup messages
+ * \param p Prywatne dane sesji
+ * \param uin Numer kontaktu
+ *
+ * \return Indeks kontaktu lub indeks, pod którym należy go wstawić
  */
-int gg_image_reply(struct gg_session *sess, uin_t recipient, const char *filename, const char *image, int size)
+static unsigned int gg_notify_list_search(const struct gg_session_private *p,
+	uin_t uin)
 {
-	struct gg_session_private *p;
-	struct gg_msg_image_reply *r;
-	struct gg_send_msg s;
-	const char *tmp;
-	char buf[1910];
-	gg_imgout_queue_t *queue = NULL, *queue_end = NULL;
+	unsigned int lo = 0, hi = p->notify_count;
 
-	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_image_reply(%p, %d, "
-		"\"%s\", %p, %d);\n", sess, recipient, filename, image, size);
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
 
-	if (!sess || !filename || !image) {
-		errno = EFAULT;
-		return -1;
+		if (p->notify_list[mid].uin < uin)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	p = sess->private_data;
+	return lo;
+}
 
-	if (sess->state != GG_STATE_CONNECTED) {
-		errno = ENOTCONN;
-		return -1;
-	}
+/**
+ * \internal Uaktualnia listę zapamiętaną przez gg_notify_sync() po
+ * dodaniu lub usunięciu pojedynczego kontaktu.
+ *
+ * Serwer operuje na maskach bitowych rodzajów kontaktów, więc lista również.
+ * Jeśli zabraknie pamięci, lista przestaje być aktualna i następne wywołanie
+ * gg_notify_sync() wyśle całą listę.
+ *
+ * \param sess Struktura sesji
+ * \param uin Numer kontaktu
+ * \param type Rodzaj kontaktu
+ * \param add Flaga dodania kontaktu
+ */
+static void gg_notify_list_update(struct gg_session *sess, uin_t uin,
+	char type, int add)
+{
+	struct gg_session_private *p = sess->private_data;
+	gg_notify_entry_t *tmp;
+	unsigned int i;
 
-	if (size < 0) {
-		errno = EINVAL;
-		return -1;
-	}
+	if (!p->notify_list_valid)
+		return;
 
-	/* wytnij ścieżki, zostaw tylko nazwę pliku */
-	while ((tmp = strrchr(filename, '/')) || (tmp = strrchr(filename, '\\')))
-		filename = tmp + 1;
+	i = gg_notify_list_search(p, uin);
 
-	if (strlen(filename) < 1 || strlen(filename) > 1024) {
-		errno = EINVAL;
-		return -1;
+	if (i < p->notify_count && p->notify_list[i].uin == uin) {
+		if (add)
+			p->notify_list[i].type |= type;
+		else
+			p->notify_list[i].type &= ~type;
+
+		if (p->notify_list[i].type == 0) {
+			memmove(&p->notify_list[i], &p->notify_list[i + 1],
+				(p->notify_count - i - 1) * sizeof(gg_notify_entry_t));
+			p->notify_count--;
+		}
+
+		return;
 	}
 
-	s.recipient = gg_fix32(recipient);
-	s.seq = gg_fix32(0);
-	s.msgclass = gg_fix32(GG_CLASS_MSG);
+	if (!add)
+		return;
 
-	buf[0] = 0;
-	r = (void*) &buf[1];
+	tmp = realloc(p->notify_list, (p->notify_count + 1) * sizeof(gg_notify_entry_t));
 
-	r->flag = GG_MSG_OPTION_IMAGE_REPLY;
-	r->size = gg_fix32(size);
-	r->crc32 = gg_fix32(gg_crc32(0, (const unsigned char*) image, size));
+	if (tmp == NULL) {
+		gg_notify_list_free(sess);
+		return;
+	}
 
-	while (size > 0) {
-		gg_imgout_queue_t *it;
-		size_t buflen, chunklen;
+	memmove(&tmp[i + 1], &tmp[i], (p->notify_count - i) * sizeof(gg_notify_entry_t));
+	tmp[i].uin = uin;
+	tmp[i].type = type;
 
-		/* \0 + struct gg_msg_image_reply */
-		buflen = sizeof(struct gg_msg_image_reply) + 1;
+	p->notify_list = tmp;
+	p->notify_count++;
+}
 
-		/* w pierwszym kawałku jest nazwa pliku */
-		if (r->flag == GG_MSG_OPTION_IMAGE_REPLY) {
-			strcpy(buf + buflen, filename);
-			buflen += strlen(filename) + 1;
-		}
+/**
+ * \internal Porównuje numery kontaktów dla qsort().
+ */
+static int gg_notify_entry_cmp(const void *a, const void *b)
+{
+	uin_t uin_a = ((const gg_notify_entry_t*) a)->uin;
+	uin_t uin_b = ((const gg_notify_entry_t*) b)->uin;
 
-		chunklen = ((size_t) size >= sizeof(buf) - buflen) ? (sizeof(buf) - buflen) : (size_t) size;
+	return (uin_a > uin_b) - (uin_a < uin_b);
+}
 
-		memcpy(buf + buflen, image, chunklen);
-		size -= chunklen;
-		image += chunklen;
+/**
+ * \internal Dopisuje pakiet dodania lub usunięcia kontaktu do fragmentu
+ * kolejki danych do wysłania.
+ *
+ * Pełny fragment jest dołączany do kolejki, a kolejne pakiety trafiają do
+ * nowego, więc zmiany listy wysyłane są kilkoma dużymi zapisami zamiast
+ * osobnego zapisu dla każdego kontaktu.
+ *
+ * \param sess Struktura sesji
+ * \param chunk Wskaźnik na bieżący fragment
+ * \param add Flaga dodania kontaktu
+ * \param uin Numer kontaktu
+ * \param type Rodzaj kontaktu
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_notify_sync_packet(struct gg_session *sess,
+	gg_send_chunk_t **chunk, int add, uin_t uin, char type)
+{
+	struct gg_header h;
+	char *buf;
+	uint32_t length;
 
-		it = gg_new0(sizeof(gg_imgout_queue_t));
-		if (!it)
-			break;
-		if (queue_end) {
-			queue_end->next = it;
-			queue_end = it;
-		} else {
-			queue = queue_end = it;
-		}
+	if (*chunk != NULL && (*chunk)->end + GG_NOTIFY_SYNC_PACKET_MAX > (*chunk)->size) {
+		gg_send_chunk_t *full = *chunk;
 
-		memcpy(&it->msg_hdr, &s, sizeof(s));
-		memcpy(it->buf, buf, buflen + chunklen);
-		it->buf_len = buflen + chunklen;
+		*chunk = NULL;
 
-		r->flag = GG_MSG_OPTION_IMAGE_REPLY_MORE;
+		if (gg_send_queue_chunk(sess, full, full->end) == -1)
+			return -1;
 	}
 
-	if (p->imgout_queue) {
-		queue_end = p->imgout_queue;
-		while (queue_end->next)
-			queue_end = queue_end->next;
-		queue_end->next = queue;
-	} else {
-		p->imgout_queue = queue;
+	if (*chunk == NULL) {
+		*chunk = gg_send_chunk_new(sess, GG_SEND_CHUNK_SIZE);
+
+		if (*chunk == NULL)
+			return -1;
 	}
-	gg_image_sendout(sess);
 
-	return 0;
-}
+	buf = (*chunk)->buf + (*chunk)->end + sizeof(h);
 
-void gg_image_sendout(struct gg_session *sess)
-{
-	struct gg_session_private *p = sess->private_data;
+	if (sess->protocol_version >= GG_PROTOCOL_VERSION_110) {
+		char uin_str[16];
+		int uin_len;
 
-	while (p->imgout_waiting_ack < GG_IMGOUT_WAITING_MAX && p->imgout_queue) {
-		gg_imgout_queue_t *it = p->imgout_queue;
-		int res;
+		/* Tak jak gg_tvbuilder_write_uin() */
+		uin_len = snprintf(uin_str, sizeof(uin_str), "%u", uin);
 
-		p->imgout_queue = p->imgout_queue->next;
-		p->imgout_waiting_ack++;
+		buf[0] = 0x00;
+		buf[1] = uin_len;
+		memcpy(buf + 2, uin_str, uin_len);
+		buf[2 + uin_len] = type;
 
-		res = gg_send_packet(sess, GG_SEND_MSG,
-			&it->msg_hdr, sizeof(it->msg_hdr),
-			it->buf, it->buf_len,
-			NULL);
+		length = uin_len + 3;
+		h.type = gg_fix32(add ? GG_ADD_NOTIFY105 : GG_REMOVE_NOTIFY105);
+	} else {
+		struct gg_add_remove a;
 
-		free(it);
+		a.uin = gg_fix32(uin);
+		a.dunno1 = type;
 
-		if (res == -1)
-			break;
+		memcpy(buf, &a, sizeof(a));
+
+		length = sizeof(a);
+		h.type = gg_fix32(add ? GG_ADD_NOTIFY : GG_REMOVE_NOTIFY);
 	}
+
+	h.length = gg_fix32(length);
+	memcpy((*chunk)->buf + (*chunk)->end, &h, sizeof(h));
+	(*chunk)->end += sizeof(h) + length;
+
+	return 0;
 }
 
 static int gg_notify105_ex(struct gg_session *sess, uin_t *userlist, char *types, int count)
@@ -2304,6 +3691,10 @@ int gg_notify_ex(struct gg_session *sess, uin_t *userlist, char *types, int coun
 		return -1;
 	}
 
+	/* Po wysłaniu całej listy poprzednia lista gg_notify_sync() jest
+	 * nieaktualna */
+	gg_notify_list_free(sess);
+
 	if (sess->protocol_version >= GG_PROTOCOL_VERSION_110)
 		return gg_notify105_ex(sess, userlist, types, count);
 
@@ -2368,6 +3759,154 @@ int gg_notify(struct gg_session *sess, uin_t *userlist, int count)
 	return gg_notify_ex(sess, userlist, NULL, count);
 }
 
+/**
+ * Synchronizuje listę kontaktów z serwerem.
+ *
+ * Przy pierwszym wywołaniu w sesji funkcja wysyła całą listę, tak jak
+ * \c gg_notify_ex(), i zapamiętuje ją. Kolejne wywołania wysyłają jedynie
+ * różnice względem poprzedniej listy: pakiety dodania nowych kontaktów,
+ * usunięcia brakujących, a dla zmienionych usunięcia i dodania tylko tych
+ * bitów rodzaju, które się zmieniły. Pakiety są
+ * sklejane, więc nawet duże zmiany wysyłane są kilkoma zapisami.
+ *
+ * Zmiany dokonane za pomocą \c gg_add_notify_ex() i \c gg_remove_notify_ex()
+ * są uwzględniane, a wywołanie \c gg_notify_ex() powoduje, że następne
+ * wywołanie funkcji ponownie wyśle całą listę. Powtórzone numery traktowane
+ * są jak jeden kontakt o sumie rodzajów.
+ *
+ * \param sess Struktura sesji
+ * \param userlist Wskaźnik do tablicy numerów kontaktów
+ * \param types Wskaźnik do tablicy rodzajów kontaktów. Jeżeli NULL, wszystkie kontakty są typu GG_USER_NORMAL.
+ * \param count Liczba kontaktów
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup contacts
+ */
+int gg_notify_sync(struct gg_session *sess, const uin_t *userlist, const char *types, int count)
+{
+	struct gg_session_private *p;
+	gg_notify_entry_t *list = NULL;
+	gg_send_chunk_t *chunk = NULL;
+	unsigned int list_count = 0, i, j;
+	int k;
+
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_notify_sync(%p, %p, %p, %d);\n", sess, userlist, types, count);
+
+	if (!sess) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (sess->state != GG_STATE_CONNECTED) {
+		errno = ENOTCONN;
+		return -1;
+	}
+
+	if (count < 0 || (count > 0 && userlist == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	p = sess->private_data;
+
+	if (count > 0) {
+		list = malloc(sizeof(gg_notify_entry_t) * count);
+
+		if (list == NULL) {
+			gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_notify_sync() out of memory\n");
+			return -1;
+		}
+
+		for (k = 0; k < count; k++) {
+			list[k].uin = userlist[k];
+			list[k].type = (types == NULL) ? GG_USER_NORMAL : types[k];
+		}
+
+		qsort(list, count, sizeof(gg_notify_entry_t), gg_notify_entry_cmp);
+
+		for (k = 0; k < count; k++) {
+			if (list_count > 0 && list[list_count - 1].uin == list[k].uin)
+				list[list_count - 1].type |= list[k].type;
+			else
+				list[list_count++] = list[k];
+		}
+	}
+
+	/* Pierwsza lista w sesji musi zostać wysłana w całości */
+	if (!p->notify_list_valid) {
+		if (gg_notify_ex(sess, (uin_t*) userlist, (char*) types, count) == -1) {
+			free(list);
+			return -1;
+		}
+
+		p->notify_list = list;
+		p->notify_count = list_count;
+		p->notify_list_valid = 1;
+
+		return 0;
+	}
+
+	i = 0;
+	j = 0;
+
+	while (i < p->notify_count || j < list_count) {
+		const gg_notify_entry_t *o = (i < p->notify_count) ? &p->notify_list[i] : NULL;
+		const gg_notify_entry_t *n = (j < list_count) ? &list[j] : NULL;
+		int res = 0;
+
+		if (n == NULL || (o != NULL && o->uin < n->uin)) {
+			res = gg_notify_sync_packet(sess, &chunk, 0, o->uin, o->type);
+			gg_roster_remove(sess, o->uin);
+			i++;
+		} else if (o == NULL || n->uin < o->uin) {
+			res = gg_notify_sync_packet(sess, &chunk, 1, n->uin, n->type);
+			j++;
+		} else {
+			/* Serwer operuje na maskach bitowych, więc wystarczy
+			 * usunąć i dodać tylko zmienione bity */
+			char removed = o->type & ~n->type;
+			char added = n->type & ~o->type;
+
+			if (removed != 0)
+				res = gg_notify_sync_packet(sess, &chunk, 0, o->uin, removed);
+			if (res == 0 && added != 0)
+				res = gg_notify_sync_packet(sess, &chunk, 1, n->uin, added);
+			i++;
+			j++;
+		}
+
+		if (res == -1)
+			goto fail;
+	}
+
+	if (chunk != NULL) {
+		gg_send_chunk_t *last = chunk;
+
+		chunk = NULL;
+
+		if (gg_send_queue_chunk(sess, last, last->end) == -1)
+			goto fail;
+	}
+
+	free(p->notify_list);
+	p->notify_list = list;
+	p->notify_count = list_count;
+
+	return 0;
+
+fail:
+	gg_debug_session(sess, GG_DEBUG_ERROR, "// gg_notify_sync() sending failed (errno=%d, %s)\n", errno, strerror(errno));
+
+	if (chunk != NULL)
+		gg_send_chunk_free(sess, chunk);
+
+	free(list);
+	gg_notify_list_free(sess);
+
+	return -1;
+}
+
 /**
  * Dodaje kontakt.
  *
@@ -2406,15 +3945,19 @@ int gg_add_notify_ex(struct gg_session *sess, uin_t uin, char type)
 
 		if (!gg_tvbuilder_send(tvb, GG_ADD_NOTIFY105))
 			return -1;
-		return 0;
 	} else {
 		struct gg_add_remove a;
 
 		a.uin = gg_fix32(uin);
 		a.dunno1 = type;
 
-		return gg_send_packet(sess, GG_ADD_NOTIFY, &a, sizeof(a), NULL);
+		if (gg_send_packet(sess, GG_ADD_NOTIFY, &a, sizeof(a), NULL) == -1)
+			return -1;
 	}
+
+	gg_notify_list_update(sess, uin, type, 1);
+
+	return 0;
 }
 
 /**
@@ -2471,15 +4014,23 @@ int gg_remove_notify_ex(struct gg_session *sess, uin_t uin, char type)
 
 		if (!gg_tvbuilder_send(tvb, GG_REMOVE_NOTIFY105))
 			return -1;
-		return 0;
 	} else {
 		struct gg_add_remove a;
 
 		a.uin = gg_fix32(uin);
 		a.dunno1 = type;
 
-		return gg_send_packet(sess, GG_REMOVE_NOTIFY, &a, sizeof(a), NULL);
+		if (gg_send_packet(sess, GG_REMOVE_NOTIFY, &a, sizeof(a), NULL) == -1)
+			return -1;
 	}
+
+	gg_notify_list_update(sess, uin, type, 0);
+
+	/* Kontakt usunięty z listy przestaje być śledzony */
+	if ((type & GG_USER_NORMAL) == GG_USER_NORMAL)
+		gg_roster_remove(sess, uin);
+
+	return 0;
 }
 
 /**
@@ -2898,79 +4449,198 @@ int gg_compat_feature_is_enabled(struct gg_session *sess, gg_compat_feature_t fe
 	return 0;
 }
 
-static gg_msg_list_t * gg_compat_find_sent_message(struct gg_session *sess, int seq, int remove)
+/**
+ * \internal Szuka wiadomości oczekującej na potwierdzenie.
+ *
+ * \param sess Struktura sesji
+ * \param seq  Numer sekwencyjny wiadomości
+ * \param prev Wskaźnik na miejsce wskaźnika na znaleziony wpis w kubełku
+ *             lub \c NULL
+ *
+ * \return Wpis wiadomości lub \c NULL, jeśli jej nie ma
+ */
+static gg_msg_list_t *gg_sent_message_find(struct gg_session *sess, int seq,
+	gg_msg_list_t ***prev)
 {
 	struct gg_session_private *p = sess->private_data;
-	gg_msg_list_t *it, *previous = NULL;
+	gg_msg_list_t **it;
 
-	for (it = p->sent_messages; it; it = it->next) {
-		if (it->seq == seq)
-			break;
-		else
-			previous = it;
-	}
+	if (p->sent_messages == NULL)
+		return NULL;
 
-	if (remove && it) {
-		if (previous == NULL)
-			p->sent_messages = it->next;
-		else
-			previous->next = it->next;
+	/* Numery sekwencyjne są kolejnymi liczbami, więc same
+	 * wyznaczają kubełek. */
+	it = &p->sent_messages[(unsigned int) seq % GG_SENT_MESSAGES_BUCKETS];
+
+	for (; *it != NULL; it = &(*it)->next) {
+		if ((*it)->seq == seq) {
+			if (prev != NULL)
+				*prev = it;
+			return *it;
+		}
 	}
 
-	return it;
+	return NULL;
 }
 
-static void gg_compat_message_cleanup(struct gg_session *sess)
+/**
+ * \internal Usuwa wiadomość z tablicy i oddaje wpis do puli.
+ *
+ * \param sess Struktura sesji
+ * \param sm   Wpis wiadomości
+ * \param prev Miejsce wskaźnika na wpis w kubełku
+ */
+static void gg_sent_message_remove(struct gg_session *sess, gg_msg_list_t *sm,
+	gg_msg_list_t **prev)
 {
 	struct gg_session_private *p = sess->private_data;
 
-	while (p->sent_messages) {
-		gg_msg_list_t *next = p->sent_messages->next;
-		free(p->sent_messages->recipients);
-		free(p->sent_messages);
-		p->sent_messages = next;
+	*prev = sm->next;
+
+	if (sm->older != NULL)
+		sm->older->newer = sm->newer;
+	else
+		p->sent_oldest = sm->newer;
+
+	if (sm->newer != NULL)
+		sm->newer->older = sm->older;
+	else
+		p->sent_newest = sm->older;
+
+	p->sent_count--;
+
+	if (p->sent_pool_count < GG_SENT_MESSAGES_POOL_SIZE) {
+		sm->next = p->sent_pool;
+		p->sent_pool = sm;
+		p->sent_pool_count++;
+	} else {
+		free(sm->recipients);
+		free(sm);
 	}
 }
 
-static void gg_compat_message_sent(struct gg_session *sess, int seq, size_t recipients_count, uin_t *recipients)
+/**
+ * \internal Zapomina najstarsze wiadomości, jeśli jest ich za dużo lub
+ * zbyt długo czekają na potwierdzenie.
+ *
+ * \param sess Struktura sesji
+ * \param now  Bieżący czas w milisekundach
+ */
+static void gg_sent_message_expire(struct gg_session *sess, uint64_t now)
 {
 	struct gg_session_private *p = sess->private_data;
-	gg_msg_list_t *sm;
-	uin_t *new_recipients;
-	size_t old_count, i;
 
-	if (sess->protocol_version < GG_PROTOCOL_VERSION_110)
-		return;
+	while (p->sent_oldest != NULL && (p->sent_count >= GG_SENT_MESSAGES_MAX ||
+		now - p->sent_oldest->sent > GG_SENT_MESSAGES_TIMEOUT))
+	{
+		gg_msg_list_t *sm = p->sent_oldest, **prev = NULL;
 
-	if (!gg_compat_feature_is_enabled(sess, GG_COMPAT_FEATURE_ACK_EVENT))
-		return;
+		gg_debug_session(sess, GG_DEBUG_MISC, "// gg_sent_message_expire() "
+			"forgetting unacknowledged message %d\n", sm->seq);
+
+		gg_sent_message_find(sess, sm->seq, &prev);
+		gg_sent_message_remove(sess, sm, prev);
+	}
+}
 
-	sm = gg_compat_find_sent_message(sess, seq, 0);
-	if (!sm) {
+/**
+ * \internal Zapamiętuje czas wysłania wiadomości.
+ *
+ * Jeśli wiadomość o danym numerze sekwencyjnym jest już zapamiętana,
+ * zwracany jest istniejący wpis.
+ *
+ * \param sess Struktura sesji
+ * \param seq  Numer sekwencyjny wiadomości
+ *
+ * \return Wpis wiadomości lub \c NULL w przypadku braku pamięci
+ */
+static gg_msg_list_t *gg_sent_message_add(struct gg_session *sess, int seq)
+{
+	struct gg_session_private *p = sess->private_data;
+	gg_msg_list_t *sm, **bucket;
+	uint64_t now;
+
+	sm = gg_sent_message_find(sess, seq, NULL);
+
+	if (sm != NULL)
+		return sm;
+
+	if (p->sent_messages == NULL) {
+		p->sent_messages = calloc(GG_SENT_MESSAGES_BUCKETS,
+			sizeof(gg_msg_list_t *));
+
+		if (p->sent_messages == NULL)
+			return NULL;
+	}
+
+	now = gg_timer_clock();
+
+	gg_sent_message_expire(sess, now);
+
+	if (p->sent_pool != NULL) {
+		sm = p->sent_pool;
+		p->sent_pool = sm->next;
+		p->sent_pool_count--;
+	} else {
 		sm = gg_new0(sizeof(gg_msg_list_t));
-		if (!sm)
-			return;
-		sm->next = p->sent_messages;
-		p->sent_messages = sm;
+
+		if (sm == NULL)
+			return NULL;
 	}
 
 	sm->seq = seq;
-	old_count = sm->recipients_count;
-	sm->recipients_count += recipients_count;
+	sm->sent = now;
+	sm->recipients_count = 0;
 
-	new_recipients = realloc(sm->recipients, sizeof(uin_t) * sm->recipients_count);
-	if (new_recipients == NULL) {
-		gg_debug_session(sess, GG_DEBUG_MISC | GG_DEBUG_ERROR,
-			"// gg_compat_message_sent() not enough memory\n");
-		return;
+	bucket = &p->sent_messages[(unsigned int) seq % GG_SENT_MESSAGES_BUCKETS];
+	sm->next = *bucket;
+	*bucket = sm;
+
+	sm->older = p->sent_newest;
+	sm->newer = NULL;
+
+	if (p->sent_newest != NULL)
+		p->sent_newest->newer = sm;
+	else
+		p->sent_oldest = sm;
+
+	p->sent_newest = sm;
+	p->sent_count++;
+
+	return sm;
+}
+
+static void gg_compat_message_cleanup(struct gg_session *sess)
+{
+	struct gg_session_private *p = sess->private_data;
+	gg_msg_list_t *sm;
+
+	sm = p->sent_oldest;
+	while (sm != NULL) {
+		gg_msg_list_t *next = sm->newer;
+		free(sm->recipients);
+		free(sm);
+		sm = next;
 	}
-	sm->recipients = new_recipients;
 
-	for (i = 0; i < recipients_count; i++)
-		sm->recipients[old_count + i] = recipients[i];
+	sm = p->sent_pool;
+	while (sm != NULL) {
+		gg_msg_list_t *next = sm->next;
+		free(sm->recipients);
+		free(sm);
+		sm = next;
+	}
+
+	free(p->sent_messages);
+	p->sent_messages = NULL;
+	p->sent_oldest = NULL;
+	p->sent_newest = NULL;
+	p->sent_count = 0;
+	p->sent_pool = NULL;
+	p->sent_pool_count = 0;
 }
 
-void gg_compat_message_ack(struct gg_session *sess, int seq)
+static void gg_compat_message_sent(struct gg_session *sess, int seq, size_t recipients_count, uin_t *recipients)
 {
 	gg_msg_list_t *sm;
 	size_t i;
@@ -2981,23 +4651,73 @@ void gg_compat_message_ack(struct gg_session *sess, int seq)
 	if (!gg_compat_feature_is_enabled(sess, GG_COMPAT_FEATURE_ACK_EVENT))
 		return;
 
-	sm = gg_compat_find_sent_message(sess, seq, 1);
+	sm = gg_sent_message_add(sess, seq);
 	if (!sm)
 		return;
 
-	for (i = 0; i < sm->recipients_count; i++) {
-		struct gg_event *qev;
+	if (sm->recipients_count + recipients_count > sm->recipients_size) {
+		uin_t *new_recipients;
+		size_t new_size;
+
+		new_size = sm->recipients_count + recipients_count;
+
+		new_recipients = realloc(sm->recipients, sizeof(uin_t) * new_size);
+		if (new_recipients == NULL) {
+			gg_debug_session(sess, GG_DEBUG_MISC | GG_DEBUG_ERROR,
+				"// gg_compat_message_sent() not enough memory\n");
+			return;
+		}
+		sm->recipients = new_recipients;
+		sm->recipients_size = new_size;
+	}
+
+	for (i = 0; i < recipients_count; i++)
+		sm->recipients[sm->recipients_count + i] = recipients[i];
+	sm->recipients_count += recipients_count;
+}
+
+/**
+ * \internal Obsługuje potwierdzenie wiadomości wysłanej protokołem 11.0.
+ *
+ * Usuwa wiadomość z tablicy oczekujących na potwierdzenie, a w trybie
+ * zgodności ze starym API kolejkuje zdarzenia \c GG_EVENT_ACK dla
+ * wszystkich odbiorców.
+ *
+ * \param sess Struktura sesji
+ * \param seq  Numer sekwencyjny wiadomości
+ *
+ * \return Czas od wysłania wiadomości w milisekundach lub -1, jeśli
+ *         wiadomość nie jest znana
+ */
+int gg_sent_message_ack(struct gg_session *sess, int seq)
+{
+	gg_msg_list_t *sm, **prev = NULL;
+	uint64_t latency;
+	size_t i;
+
+	sm = gg_sent_message_find(sess, seq, &prev);
+	if (!sm)
+		return -1;
+
+	latency = gg_timer_clock() - sm->sent;
+
+	if (gg_compat_feature_is_enabled(sess, GG_COMPAT_FEATURE_ACK_EVENT)) {
+		for (i = 0; i < sm->recipients_count; i++) {
+			struct gg_event *qev;
 
-		qev = gg_eventqueue_add(sess);
+			qev = gg_eventqueue_add(sess);
 
-		qev->type = GG_EVENT_ACK;
-		qev->event.ack.status = GG_ACK_DELIVERED;
-		qev->event.ack.recipient = sm->recipients[i];
-		qev->event.ack.seq = seq;
+			qev->type = GG_EVENT_ACK;
+			qev->event.ack.status = GG_ACK_DELIVERED;
+			qev->event.ack.recipient = sm->recipients[i];
+			qev->event.ack.seq = seq;
+		}
 	}
 
-	free(sm->recipients);
-	free(sm);
+	gg_sent_message_remove(sess, sm, prev);
+
+	return (latency < GG_SENT_MESSAGES_TIMEOUT) ? (int) latency :
+		GG_SENT_MESSAGES_TIMEOUT;
 }
 
 /**
@@ -0,0 +1,929 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/**
+ * \file loop.c
+ *
+ * \brief Wbudowana pętla zdarzeń obsługująca wiele połączeń
+ */
+
+#include "internal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "network.h"
+#include "timer.h"
+
+#if defined(HAVE_SYS_EPOLL_H)
+#  include <sys/epoll.h>
+#  define GG_LOOP_USE_EPOLL
+#elif defined(HAVE_POLL_H)
+#  include <poll.h>
+#  define GG_LOOP_USE_POLL
+#endif
+
+/**
+ * \internal Maksymalna liczba zdarzeń odbieranych jednym wywołaniem
+ * \c epoll_wait().
+ */
+#define GG_LOOP_MAX_EVENTS 64
+
+/**
+ * \internal Odstęp między automatycznie wysyłanymi pakietami \c GG_PING
+ * w sekundach.
+ */
+#define GG_LOOP_PING_INTERVAL 60
+
+/**
+ * \internal Rodzaj obiektu zarejestrowanego w pętli.
+ */
+typedef enum {
+	GG_LOOP_ITEM_SESSION,
+	GG_LOOP_ITEM_DCC7,
+	GG_LOOP_ITEM_HTTP
+} gg_loop_item_type_t;
+
+/**
+ * \internal Obiekt zarejestrowany w pętli zdarzeń.
+ *
+ * Po usunięciu z pętli pole \c object jest zerowane, a struktura trafia na
+ * listę do zwolnienia po zakończeniu bieżącego obiegu pętli, ponieważ
+ * mogą na nią jeszcze wskazywać zdarzenia zwrócone przez system.
+ */
+struct gg_loop_item {
+	struct gg_loop *loop;		/**< Pętla zdarzeń */
+	gg_loop_item_type_t type;	/**< Rodzaj obiektu */
+	void *object;			/**< Obiekt lub \c NULL po usunięciu */
+	gg_loop_callback_t callback;	/**< Funkcja zwrotna */
+	void *priv_data;		/**< Dane prywatne funkcji zwrotnej */
+
+	int fd;				/**< Zarejestrowany deskryptor lub -1 */
+	int check;			/**< Zarejestrowana maska \c gg_check_t */
+	int state;			/**< Stan obiektu przy rejestracji */
+	int timeout;			/**< Ostatnio widziana wartość pola \c timeout */
+
+	gg_timer_t timeout_timer;	/**< Licznik czasu operacji */
+	gg_timer_t ping_timer;		/**< Licznik wysyłania \c GG_PING */
+
+	unsigned int index;		/**< Indeks w tablicy obiektów */
+	struct gg_loop_item *next;	/**< Następny element listy do zwolnienia */
+};
+
+/**
+ * \internal Pętla zdarzeń.
+ */
+struct gg_loop {
+	int epoll_fd;			/**< Deskryptor \c epoll lub -1 */
+
+	struct gg_loop_item **items;	/**< Tablica zarejestrowanych obiektów */
+	unsigned int count;		/**< Liczba zarejestrowanych obiektów */
+	unsigned int size;		/**< Rozmiar tablicy obiektów */
+
+	struct gg_loop_item *removed;	/**< Usunięte obiekty do zwolnienia */
+
+	gg_timer_wheel_t timers;	/**< Koło liczników czasu */
+	uint64_t now;			/**< Bieżący czas w milisekundach */
+	int stop;			/**< Flaga przerwania \c gg_loop_run() */
+};
+
+/**
+ * \internal Zwraca wskaźnik na pole obiektu wskazujące na element pętli.
+ *
+ * \param type Rodzaj obiektu
+ * \param object Obiekt
+ *
+ * \return Wskaźnik na pole lub \c NULL
+ */
+static struct gg_loop_item **gg_loop_item_slot(gg_loop_item_type_t type, void *object)
+{
+	switch (type) {
+		case GG_LOOP_ITEM_SESSION:
+		{
+			struct gg_session *sess = object;
+
+			if (sess->private_data == NULL)
+				return NULL;
+
+			return &sess->private_data->loop_item;
+		}
+
+		case GG_LOOP_ITEM_DCC7:
+			return (struct gg_loop_item**) &((struct gg_dcc7*) object)->loop_item;
+
+		case GG_LOOP_ITEM_HTTP:
+			return (struct gg_loop_item**) &((struct gg_http*) object)->loop_item;
+	}
+
+	return NULL;
+}
+
+/**
+ * \internal Uaktualnia liczniki czasu obiektu.
+ *
+ * Licznik czasu operacji jest ustawiany ponownie tylko wtedy, gdy zmienił
+ * się stan obiektu lub biblioteka zapisała nową wartość pola \c timeout.
+ * Sesje w stanie \c GG_STATE_CONNECTED mają dodatkowo licznik wysyłania
+ * pakietów \c GG_PING.
+ *
+ * \param item Element pętli
+ */
+static void gg_loop_item_update_timers(struct gg_loop_item *item)
+{
+	struct gg_loop *loop = item->loop;
+	struct gg_common *c = item->object;
+
+	if (c->state != item->state || c->timeout != item->timeout) {
+		if (c->timeout < 0)
+			gg_timer_cancel(&loop->timers, &item->timeout_timer);
+		else
+			gg_timer_arm(&loop->timers, &item->timeout_timer, loop->now + (uint64_t) c->timeout * 1000);
+
+		item->timeout = c->timeout;
+	}
+
+	if (item->type != GG_LOOP_ITEM_SESSION)
+		return;
+
+	if (c->state != GG_STATE_CONNECTED)
+		gg_timer_cancel(&loop->timers, &item->ping_timer);
+	else if (!gg_timer_is_armed(&item->ping_timer))
+		gg_timer_arm(&loop->timers, &item->ping_timer, loop->now + GG_LOOP_PING_INTERVAL * 1000);
+}
+
+/**
+ * \internal Zapisuje w polu \c timeout obiektu pozostały czas operacji.
+ *
+ * Pętla nie zmniejsza pola \c timeout co sekundę, więc przed wywołaniem
+ * funkcji obsługi zapisuje w nim czas pozostały do upływu licznika. Dzięki
+ * temu biblioteka widzi tę samą wartość, co przy odliczaniu przez
+ * aplikację, a jej zmianę można wykryć po powrocie z funkcji obsługi.
+ *
+ * \param item Element pętli
+ */
+static void gg_loop_item_sync_timeout(struct gg_loop_item *item)
+{
+	struct gg_common *c = item->object;
+	uint64_t expires, now;
+	int remaining = 1;
+
+	if (!gg_timer_is_armed(&item->timeout_timer))
+		return;
+
+	expires = item->timeout_timer.expires;
+	now = item->loop->now;
+
+	/* Wartość 0 oznacza przekroczenie czasu, które zgłasza licznik. */
+	if (expires > now + 1000)
+		remaining = (int) ((expires - now + 999) / 1000);
+
+	c->timeout = remaining;
+	item->timeout = remaining;
+}
+
+/**
+ * \internal Uaktualnia obserwowany deskryptor i liczniki czasu obiektu.
+ *
+ * Obserwowany deskryptor jest zmieniany tylko wtedy, gdy zmieniło się pole
+ * \c fd, \c check lub \c state obiektu, więc w typowej sytuacji obsługa
+ * zdarzenia nie wymaga żadnego wywołania systemowego. Zamknięcie połączenia
+ * jest zgłaszane przez \c gg_loop_item_close_fd(), więc nowe połączenie
+ * z tym samym numerem deskryptora zostanie zarejestrowane ponownie.
+ *
+ * \param item Element pętli
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_loop_item_update(struct gg_loop_item *item)
+{
+	struct gg_common *c = item->object;
+	int fd, check;
+
+	gg_loop_item_update_timers(item);
+
+	check = c->check & (GG_CHECK_READ | GG_CHECK_WRITE);
+	fd = (check != 0) ? c->fd : -1;
+
+	if (fd == item->fd && check == item->check && c->state == item->state)
+		return 0;
+
+#ifdef GG_LOOP_USE_EPOLL
+	if (item->fd != -1 && item->fd != fd) {
+		struct epoll_event ev;
+
+		/* Starsze jądra wymagają niepustego wskaźnika */
+		memset(&ev, 0, sizeof(ev));
+		(void) epoll_ctl(item->loop->epoll_fd, EPOLL_CTL_DEL, item->fd, &ev);
+		item->fd = -1;
+	}
+
+	if (fd != -1) {
+		struct epoll_event ev;
+		int op, res;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.data.ptr = item;
+
+		if (check & GG_CHECK_READ)
+			ev.events |= EPOLLIN;
+		if (check & GG_CHECK_WRITE)
+			ev.events |= EPOLLOUT;
+
+		op = (item->fd == fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+		res = epoll_ctl(item->loop->epoll_fd, op, fd, &ev);
+
+		/* Deskryptor mógł zostać zamknięty i otwarty ponownie
+		 * z tym samym numerem, co usuwa go z epoll. */
+		if (res == -1 && op == EPOLL_CTL_MOD && errno == ENOENT)
+			res = epoll_ctl(item->loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+		if (res == -1 && op == EPOLL_CTL_ADD && errno == EEXIST)
+			res = epoll_ctl(item->loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+
+		if (res == -1) {
+			gg_debug(GG_DEBUG_MISC, "// gg_loop_item_update() epoll_ctl() failed (errno=%d, %s)\n", errno, strerror(errno));
+			return -1;
+		}
+	}
+#endif
+
+	item->fd = fd;
+	item->check = check;
+	item->state = c->state;
+
+	return 0;
+}
+
+/**
+ * \internal Przestaje obserwować deskryptor obiektu przed jego zamknięciem.
+ *
+ * Biblioteka wywołuje tę funkcję przed zamknięciem gniazda, ponieważ
+ * kolejne połączenie może dostać ten sam numer deskryptora, a \c epoll
+ * zapomina o zamkniętym gnieździe.
+ *
+ * \param item Element pętli lub \c NULL
+ */
+void gg_loop_item_close_fd(struct gg_loop_item *item)
+{
+	if (item == NULL || item->object == NULL || item->fd == -1)
+		return;
+
+#ifdef GG_LOOP_USE_EPOLL
+	{
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		(void) epoll_ctl(item->loop->epoll_fd, EPOLL_CTL_DEL, item->fd, &ev);
+	}
+#endif
+
+	item->fd = -1;
+}
+
+/**
+ * Usuwa obiekt z pętli zdarzeń.
+ *
+ * \internal Funkcja jest wywoływana również przy zwalnianiu obiektu.
+ *
+ * \param item Element pętli
+ */
+void gg_loop_item_remove(struct gg_loop_item *item)
+{
+	struct gg_loop *loop;
+	struct gg_loop_item **slot;
+
+	if (item == NULL || item->object == NULL)
+		return;
+
+	loop = item->loop;
+
+#ifdef GG_LOOP_USE_EPOLL
+	if (item->fd != -1) {
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		(void) epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, item->fd, &ev);
+	}
+#endif
+
+	item->fd = -1;
+
+	gg_timer_cancel(&loop->timers, &item->timeout_timer);
+	gg_timer_cancel(&loop->timers, &item->ping_timer);
+
+	slot = gg_loop_item_slot(item->type, item->object);
+
+	if (slot != NULL && *slot == item)
+		*slot = NULL;
+
+	loop->count--;
+
+	if (item->index != loop->count) {
+		loop->items[item->index] = loop->items[loop->count];
+		loop->items[item->index]->index = item->index;
+	}
+
+	item->object = NULL;
+	item->next = loop->removed;
+	loop->removed = item;
+}
+
+/**
+ * \internal Zwalnia elementy usunięte z pętli.
+ *
+ * \param loop Pętla zdarzeń
+ */
+static void gg_loop_collect(struct gg_loop *loop)
+{
+	while (loop->removed != NULL) {
+		struct gg_loop_item *next = loop->removed->next;
+
+		free(loop->removed);
+		loop->removed = next;
+	}
+}
+
+/**
+ * \internal Obsługuje zmianę na deskryptorze obiektu.
+ *
+ * Wywołuje funkcję obsługi odpowiednią dla rodzaju obiektu i przekazuje
+ * wynik do funkcji zwrotnej. W przypadku błędu lub zakończenia połączenia
+ * HTTP obiekt jest usuwany z pętli przed wywołaniem funkcji zwrotnej, więc
+ * można go w niej zwolnić.
+ *
+ * \param item Element pętli
+ */
+static void gg_loop_dispatch(struct gg_loop_item *item)
+{
+	struct gg_loop *loop = item->loop;
+	void *object = item->object;
+	gg_loop_status_t status = GG_LOOP_EVENT;
+	struct gg_event *e = NULL;
+
+	gg_loop_item_sync_timeout(item);
+
+	switch (item->type) {
+		case GG_LOOP_ITEM_SESSION:
+			e = gg_watch_fd(object);
+			if (e == NULL)
+				status = GG_LOOP_ERROR;
+			break;
+
+		case GG_LOOP_ITEM_DCC7:
+			e = gg_dcc7_watch_fd(object);
+			if (e == NULL)
+				status = GG_LOOP_ERROR;
+			break;
+
+		case GG_LOOP_ITEM_HTTP:
+		{
+			struct gg_http *h = object;
+
+			if (h->callback(h) == -1 || h->state == GG_STATE_ERROR)
+				status = GG_LOOP_ERROR;
+			else if (h->state == GG_STATE_DONE)
+				status = GG_LOOP_DONE;
+			break;
+		}
+	}
+
+	if (status != GG_LOOP_EVENT)
+		gg_loop_item_remove(item);
+
+	if (status != GG_LOOP_EVENT || (e != NULL && e->type != GG_EVENT_NONE))
+		item->callback(loop, object, status, e, item->priv_data);
+
+	/* Funkcja zwrotna mogła usunąć lub zwolnić obiekt. */
+
+	if (e != NULL) {
+		if (item->type == GG_LOOP_ITEM_SESSION && item->object != NULL)
+			gg_event_recycle(object, e);
+		else
+			gg_event_free(e);
+	}
+
+	if (item->object != NULL && gg_loop_item_update(item) == -1) {
+		gg_loop_item_remove(item);
+		item->callback(loop, object, GG_LOOP_ERROR, NULL, item->priv_data);
+	}
+}
+
+/**
+ * \internal Obsługuje przekroczenie czasu operacji.
+ *
+ * Zgodnie z opisem pola \c timeout, obiekty z ustawioną flagą
+ * \c soft_timeout są obsługiwane jak po zmianie na deskryptorze z polem
+ * \c timeout równym 0, a pozostałe są usuwane z pętli.
+ *
+ * \param timer Licznik
+ * \param data Element pętli
+ */
+static void gg_loop_timeout_handler(gg_timer_t *timer, void *data)
+{
+	struct gg_loop_item *item = data;
+	struct gg_common *c = item->object;
+	int soft_timeout = 0;
+
+	if (item->type == GG_LOOP_ITEM_SESSION)
+		soft_timeout = ((struct gg_session*) c)->soft_timeout;
+	else if (item->type == GG_LOOP_ITEM_DCC7)
+		soft_timeout = ((struct gg_dcc7*) c)->soft_timeout;
+
+	if (soft_timeout) {
+		c->timeout = 0;
+		item->timeout = 0;
+		gg_loop_dispatch(item);
+	} else {
+		gg_loop_item_remove(item);
+		item->callback(item->loop, c, GG_LOOP_TIMEOUT, NULL, item->priv_data);
+	}
+}
+
+/**
+ * \internal Wysyła pakiet \c GG_PING w imieniu aplikacji.
+ *
+ * \param timer Licznik
+ * \param data Element pętli
+ */
+static void gg_loop_ping_handler(gg_timer_t *timer, void *data)
+{
+	struct gg_loop_item *item = data;
+	struct gg_loop *loop = item->loop;
+	void *object = item->object;
+
+	gg_timer_arm(&loop->timers, timer, loop->now + GG_LOOP_PING_INTERVAL * 1000);
+
+	/* Wysłanie pakietu mogło dopisać dane do kolejki i zmienić
+	 * obserwowane zdarzenia. */
+
+	if (gg_ping(object) == -1 || gg_loop_item_update(item) == -1) {
+		gg_loop_item_remove(item);
+		item->callback(loop, object, GG_LOOP_ERROR, NULL, item->priv_data);
+	}
+}
+
+/**
+ * \internal Dodaje obiekt do pętli zdarzeń.
+ *
+ * \param loop Pętla zdarzeń
+ * \param type Rodzaj obiektu
+ * \param object Obiekt
+ * \param callback Funkcja zwrotna
+ * \param priv_data Dane prywatne funkcji zwrotnej
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_loop_add(struct gg_loop *loop, gg_loop_item_type_t type,
+	void *object, gg_loop_callback_t callback, void *priv_data)
+{
+	struct gg_loop_item *item, **slot;
+
+	if (loop == NULL || object == NULL || callback == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	slot = gg_loop_item_slot(type, object);
+
+	if (slot == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (*slot != NULL) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	if (loop->count == loop->size) {
+		struct gg_loop_item **tmp;
+		unsigned int size;
+
+		size = (loop->size != 0) ? loop->size * 2 : 16;
+
+		tmp = realloc(loop->items, size * sizeof(struct gg_loop_item*));
+
+		if (tmp == NULL)
+			return -1;
+
+		loop->items = tmp;
+		loop->size = size;
+	}
+
+	item = gg_new0(sizeof(struct gg_loop_item));
+
+	if (item == NULL)
+		return -1;
+
+	item->loop = loop;
+	item->type = type;
+	item->object = object;
+	item->callback = callback;
+	item->priv_data = priv_data;
+	item->fd = -1;
+	item->state = -1;
+	item->timeout = -1;
+	item->index = loop->count;
+
+	gg_timer_init(&item->timeout_timer, gg_loop_timeout_handler, item);
+	gg_timer_init(&item->ping_timer, gg_loop_ping_handler, item);
+
+	loop->items[loop->count++] = item;
+	*slot = item;
+
+	loop->now = gg_timer_clock();
+
+	if (gg_loop_item_update(item) == -1) {
+		int errsv = errno;
+
+		gg_loop_item_remove(item);
+		gg_loop_collect(loop);
+		errno = errsv;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Tworzy pętlę zdarzeń.
+ *
+ * Pętla obserwuje deskryptory dodanych sesji, połączeń bezpośrednich
+ * i połączeń HTTP (za pomocą \c epoll, jeśli system go obsługuje), wywołuje
+ * dla nich odpowiednie funkcje obsługi i odlicza czas operacji. Wyniki są
+ * przekazywane do funkcji zwrotnych podanych przy dodawaniu obiektów.
+ *
+ * \return Pętla zdarzeń lub \c NULL w przypadku błędu
+ *
+ * \ingroup events
+ */
+struct gg_loop *gg_loop_new(void)
+{
+	struct gg_loop *loop;
+
+	gg_debug(GG_DEBUG_FUNCTION, "** gg_loop_new();\n");
+
+#if !defined(GG_LOOP_USE_EPOLL) && !defined(GG_LOOP_USE_POLL)
+	errno = ENOSYS;
+	return NULL;
+#else
+	loop = gg_new0(sizeof(struct gg_loop));
+
+	if (loop == NULL)
+		return NULL;
+
+	loop->epoll_fd = -1;
+	loop->now = gg_timer_clock();
+
+	gg_timer_wheel_init(&loop->timers, loop->now);
+
+#ifdef GG_LOOP_USE_EPOLL
+	loop->epoll_fd = epoll_create(GG_LOOP_MAX_EVENTS);
+
+	if (loop->epoll_fd == -1) {
+		int errsv = errno;
+
+		gg_debug(GG_DEBUG_MISC, "// gg_loop_new() epoll_create() failed (errno=%d, %s)\n", errno, strerror(errno));
+		free(loop);
+		errno = errsv;
+		return NULL;
+	}
+#endif
+
+	return loop;
+#endif
+}
+
+/**
+ * Zwalnia pętlę zdarzeń.
+ *
+ * Zarejestrowane obiekty są usuwane z pętli, ale nie są zwalniane. Funkcji
+ * nie można wywołać z wnętrza funkcji zwrotnej.
+ *
+ * \param loop Pętla zdarzeń
+ *
+ * \ingroup events
+ */
+void gg_loop_free(struct gg_loop *loop)
+{
+	gg_debug(GG_DEBUG_FUNCTION, "** gg_loop_free(%p);\n", loop);
+
+	if (loop == NULL)
+		return;
+
+	while (loop->count > 0)
+		gg_loop_item_remove(loop->items[loop->count - 1]);
+
+	gg_loop_collect(loop);
+
+	if (loop->epoll_fd != -1)
+		close(loop->epoll_fd);
+
+	free(loop->items);
+	free(loop);
+}
+
+/**
+ * Dodaje sesję do pętli zdarzeń.
+ *
+ * Zdarzenia inne niż \c GG_EVENT_NONE są przekazywane do funkcji zwrotnej
+ * i zwalniane po jej powrocie. Po połączeniu z serwerem pętla co minutę
+ * wysyła pakiet \c GG_PING, więc nie trzeba wywoływać \c gg_ping().
+ * Obiekt może należeć tylko do jednej pętli.
+ * Zwolnienie sesji funkcją \c gg_free_session() usuwa ją z pętli.
+ *
+ * \param loop Pętla zdarzeń
+ * \param sess Struktura sesji
+ * \param callback Funkcja zwrotna
+ * \param priv_data Dane prywatne funkcji zwrotnej
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup events
+ */
+int gg_loop_add_session(struct gg_loop *loop, struct gg_session *sess,
+	gg_loop_callback_t callback, void *priv_data)
+{
+	gg_debug_session(sess, GG_DEBUG_FUNCTION, "** gg_loop_add_session(%p, %p, %p, %p);\n", loop, sess, callback, priv_data);
+
+	return gg_loop_add(loop, GG_LOOP_ITEM_SESSION, sess, callback, priv_data);
+}
+
+/**
+ * Dodaje połączenie bezpośrednie do pętli zdarzeń.
+ *
+ * Zwolnienie połączenia funkcją \c gg_dcc7_free() usuwa je z pętli.
+ *
+ * \param loop Pętla zdarzeń
+ * \param dcc Struktura połączenia
+ * \param callback Funkcja zwrotna
+ * \param priv_data Dane prywatne funkcji zwrotnej
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup events
+ */
+int gg_loop_add_dcc7(struct gg_loop *loop, struct gg_dcc7 *dcc,
+	gg_loop_callback_t callback, void *priv_data)
+{
+	gg_debug(GG_DEBUG_FUNCTION, "** gg_loop_add_dcc7(%p, %p, %p, %p);\n", loop, dcc, callback, priv_data);
+
+	return gg_loop_add(loop, GG_LOOP_ITEM_DCC7, dcc, callback, priv_data);
+}
+
+/**
+ * Dodaje asynchroniczne połączenie HTTP do pętli zdarzeń.
+ *
+ * Po zakończeniu lub przerwaniu połączenia jest ono usuwane z pętli,
+ * a funkcja zwrotna otrzymuje \c GG_LOOP_DONE lub \c GG_LOOP_ERROR.
+ * Zwolnienie połączenia funkcją \c gg_http_free() usuwa je z pętli.
+ *
+ * \param loop Pętla zdarzeń
+ * \param h Struktura połączenia
+ * \param callback Funkcja zwrotna
+ * \param priv_data Dane prywatne funkcji zwrotnej
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup events
+ */
+int gg_loop_add_http(struct gg_loop *loop, struct gg_http *h,
+	gg_loop_callback_t callback, void *priv_data)
+{
+	gg_debug(GG_DEBUG_FUNCTION, "** gg_loop_add_http(%p, %p, %p, %p);\n", loop, h, callback, priv_data);
+
+	if (h != NULL && h->callback == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return gg_loop_add(loop, GG_LOOP_ITEM_HTTP, h, callback, priv_data);
+}
+
+/**
+ * Usuwa obiekt z pętli zdarzeń.
+ *
+ * Obiekt nie jest zwalniany. Funkcję można wywołać z wnętrza funkcji
+ * zwrotnej.
+ *
+ * \param loop Pętla zdarzeń
+ * \param object Obiekt (\c gg_session, \c gg_dcc7 lub \c gg_http)
+ *
+ * \return 0 jeśli się powiodło, -1 jeśli obiektu nie ma w pętli
+ *
+ * \ingroup events
+ */
+int gg_loop_remove(struct gg_loop *loop, void *object)
+{
+	unsigned int i;
+
+	gg_debug(GG_DEBUG_FUNCTION, "** gg_loop_remove(%p, %p);\n", loop, object);
+
+	if (loop == NULL || object == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Rodzaj obiektu nie jest znany, więc nie można sięgnąć do
+	 * jego pól przed odnalezieniem go w tablicy. */
+
+	for (i = 0; i < loop->count; i++) {
+		if (loop->items[i]->object == object) {
+			gg_loop_item_remove(loop->items[i]);
+			return 0;
+		}
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+/**
+ * Wykonuje jeden obieg pętli zdarzeń.
+ *
+ * Czeka na zmiany na obserwowanych deskryptorach, obsługuje je, a następnie
+ * obsługuje liczniki czasu operacji i wysyłania pakietów \c GG_PING.
+ * Oczekiwanie kończy się najpóźniej w chwili upływu najbliższego licznika.
+ *
+ * \param loop Pętla zdarzeń
+ * \param timeout_ms Maksymalny czas oczekiwania w milisekundach lub -1
+ *
+ * \return Liczba obsłużonych deskryptorów lub -1 w przypadku błędu
+ *
+ * \ingroup events
+ */
+int gg_loop_run_once(struct gg_loop *loop, int timeout_ms)
+{
+	unsigned int i;
+	uint64_t next;
+	int res = 0;
+
+	if (loop == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	next = gg_timer_next(&loop->timers);
+
+	if (next != GG_TIMER_NEVER) {
+		uint64_t now = gg_timer_clock();
+		uint64_t wait = (next > now) ? next - now : 0;
+
+		if (timeout_ms < 0 || wait < (uint64_t) timeout_ms)
+			timeout_ms = (int) wait;
+	}
+
+#ifdef GG_LOOP_USE_EPOLL
+	{
+		struct epoll_event events[GG_LOOP_MAX_EVENTS];
+		int n;
+
+		n = epoll_wait(loop->epoll_fd, events, GG_LOOP_MAX_EVENTS, timeout_ms);
+
+		if (n == -1 && errno != EINTR) {
+			gg_debug(GG_DEBUG_MISC, "// gg_loop_run_once() epoll_wait() failed (errno=%d, %s)\n", errno, strerror(errno));
+			return -1;
+		}
+
+		loop->now = gg_timer_clock();
+
+		for (i = 0; (int) i < n; i++) {
+			struct gg_loop_item *item = events[i].data.ptr;
+
+			/* Obiekt mógł zostać usunięty podczas obsługi
+			 * poprzedniego zdarzenia. */
+			if (item->object == NULL)
+				continue;
+
+			gg_loop_dispatch(item);
+			res++;
+		}
+	}
+#endif
+
+#ifdef GG_LOOP_USE_POLL
+	{
+		struct pollfd *fds;
+		struct gg_loop_item **items;
+		unsigned int count = 0;
+		int n;
+
+		fds = malloc((loop->count + 1) * sizeof(struct pollfd));
+		items = malloc((loop->count + 1) * sizeof(struct gg_loop_item*));
+
+		if (fds == NULL || items == NULL) {
+			free(fds);
+			free(items);
+			return -1;
+		}
+
+		for (i = 0; i < loop->count; i++) {
+			struct gg_loop_item *item = loop->items[i];
+
+			if (item->fd == -1)
+				continue;
+
+			fds[count].fd = item->fd;
+			fds[count].events = 0;
+			fds[count].revents = 0;
+
+			if (item->check & GG_CHECK_READ)
+				fds[count].events |= POLLIN;
+			if (item->check & GG_CHECK_WRITE)
+				fds[count].events |= POLLOUT;
+
+			items[count++] = item;
+		}
+
+		n = poll(fds, count, timeout_ms);
+
+		if (n == -1 && errno != EINTR) {
+			gg_debug(GG_DEBUG_MISC, "// gg_loop_run_once() poll() failed (errno=%d, %s)\n", errno, strerror(errno));
+			free(fds);
+			free(items);
+			return -1;
+		}
+
+		loop->now = gg_timer_clock();
+
+		/* Zwalnianie elementów jest odkładane do końca obiegu,
+		 * więc wskaźniki w tablicy items pozostają ważne. */
+
+		for (i = 0; n > 0 && i < count; i++) {
+			if (fds[i].revents == 0 || items[i]->object == NULL)
+				continue;
+
+			gg_loop_dispatch(items[i]);
+			res++;
+		}
+
+		free(fds);
+		free(items);
+	}
+#endif
+
+	gg_timer_run(&loop->timers, loop->now);
+
+	gg_loop_collect(loop);
+
+	return res;
+}
+
+/**
+ * Obsługuje zdarzenia do momentu wywołania \c gg_loop_stop() lub usunięcia
+ * z pętli wszystkich obiektów.
+ *
+ * \param loop Pętla zdarzeń
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \ingroup events
+ */
+int gg_loop_run(struct gg_loop *loop)
+{
+	gg_debug(GG_DEBUG_FUNCTION, "** gg_loop_run(%p);\n", loop);
+
+	if (loop == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	loop->stop = 0;
+
+	while (!loop->stop && loop->count > 0) {
+		if (gg_loop_run_once(loop, -1) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Przerywa działanie \c gg_loop_run() po zakończeniu bieżącego obiegu.
+ *
+ * \param loop Pętla zdarzeń
+ *
+ * \ingroup events
+ */
+void gg_loop_stop(struct gg_loop *loop)
+{
+	if (loop != NULL)
+		loop->stop = 1;
+}
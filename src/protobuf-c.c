@@ -167,7 +167,8 @@ do_alloc(ProtobufCAllocator *allocator, size_t size)
 static inline void
 do_free(ProtobufCAllocator *allocator, void *data)
 {
-	if (data != NULL)
+	/* An allocator without free() is an arena owned by the caller */
+	if (data != NULL && allocator->free != NULL)
 		allocator->free(allocator->allocator_data, data);
 }
 
@@ -2432,7 +2433,11 @@ parse_required_member(ScannedMember *scanned_member,
 		{
 			do_free(allocator, bd->data);
 		}
-		if (len - pref_len > 0) {
+		if (len - pref_len > 0 && allocator->free == NULL) {
+			/* Arena allocations live no longer than the packed
+			 * buffer, so bytes fields may point into it. */
+			bd->data = (uint8_t *) data + pref_len;
+		} else if (len - pref_len > 0) {
 			bd->data = do_alloc(allocator, len - pref_len);
 			if (bd->data == NULL)
 				return FALSE;
@@ -0,0 +1,702 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/**
+ * \file protobuf-fast.c
+ *
+ * \brief Wyspecjalizowane kodowanie najczęstszych wiadomości protokołu 11.0
+ *
+ * Ogólny dekoder protobuf-c dla każdego pola przegląda opisy wiadomości.
+ * Funkcje z tego pliku rozpoznają pola najczęściej odbieranych wiadomości
+ * bezpośrednio po bajcie klucza. Wynik jest taki sam, jak w przypadku
+ * funkcji \c *__unpack() z \c packets.pb-c.c i może być zwolniony przez
+ * \c protobuf_c_message_free_unpacked() z tym samym alokatorem.
+ *
+ * Dane, których nie da się obsłużyć prostą ścieżką (nieznane pola, błędy
+ * kodowania, brak wymaganych pól), są przekazywane ogólnemu dekoderowi,
+ * więc zachowanie w przypadkach brzegowych się nie zmienia.
+ */
+
+#include "internal.h"
+
+#include "protobuf-fast.h"
+
+/** \internal Bajt klucza pola o numerze mniejszym od 16. */
+#define GG_PROTOBUF_KEY(tag, wire_type) (((tag) << 3) | (wire_type))
+
+#define GG_PROTOBUF_KEY_VARINT(tag) GG_PROTOBUF_KEY(tag, PROTOBUF_C_WIRE_TYPE_VARINT)
+#define GG_PROTOBUF_KEY_64BIT(tag) GG_PROTOBUF_KEY(tag, PROTOBUF_C_WIRE_TYPE_64BIT)
+#define GG_PROTOBUF_KEY_BYTES(tag) GG_PROTOBUF_KEY(tag, PROTOBUF_C_WIRE_TYPE_LENGTH_PREFIXED)
+#define GG_PROTOBUF_KEY_32BIT(tag) GG_PROTOBUF_KEY(tag, PROTOBUF_C_WIRE_TYPE_32BIT)
+
+/* Fragment rozpakowywanych danych, wskazujący treść pola typu string
+ * lub bytes. Pole nieobecne w wiadomości ma data == NULL. */
+typedef struct {
+	const uint8_t *data;
+	size_t len;
+} gg_protobuf_slice_t;
+
+static void *gg_protobuf_system_alloc(void *allocator_data, size_t size)
+{
+	return malloc(size);
+}
+
+static void gg_protobuf_system_free(void *allocator_data, void *ptr)
+{
+	free(ptr);
+}
+
+/* Alokator używany, gdy wywołujący nie podał własnego, zgodny z domyślnym
+ * alokatorem protobuf-c. */
+static ProtobufCAllocator gg_protobuf_system_allocator = {
+	gg_protobuf_system_alloc,
+	gg_protobuf_system_free,
+	NULL
+};
+
+/**
+ * \internal Odczytuje liczbę zapisaną w formacie varint.
+ *
+ * \param ptr Wskaźnik na bieżące położenie w danych, przesuwany za liczbę
+ * \param end Koniec danych
+ * \param value Wskaźnik na wynik
+ * \param max Maksymalna liczba bajtów liczby
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static inline int gg_protobuf_read_varint(const uint8_t **ptr,
+	const uint8_t *end, uint64_t *value, int max)
+{
+	const uint8_t *p = *ptr;
+	uint64_t result = 0;
+	int shift = 0;
+
+	while (p < end && max-- > 0) {
+		uint8_t b = *p++;
+
+		result |= (uint64_t) (b & 0x7f) << shift;
+		shift += 7;
+
+		if ((b & 0x80) == 0) {
+			*ptr = p;
+			*value = result;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * \internal Odczytuje pole typu uint32.
+ *
+ * \param ptr Wskaźnik na bieżące położenie w danych
+ * \param end Koniec danych
+ * \param value Wskaźnik na wynik
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static inline int gg_protobuf_read_uint32(const uint8_t **ptr,
+	const uint8_t *end, uint32_t *value)
+{
+	uint64_t tmp;
+
+	/* Najczęstszy przypadek, liczba mniejsza od 128 */
+	if (*ptr < end && **ptr < 0x80) {
+		*value = *(*ptr)++;
+		return 0;
+	}
+
+	/* Tak jak protobuf-c, przyjmujemy najmłodsze 32 bity */
+	if (gg_protobuf_read_varint(ptr, end, &tmp, 10) == -1)
+		return -1;
+
+	*value = (uint32_t) tmp;
+
+	return 0;
+}
+
+/**
+ * \internal Odczytuje pole typu fixed32.
+ *
+ * \param ptr Wskaźnik na bieżące położenie w danych
+ * \param end Koniec danych
+ * \param value Wskaźnik na wynik
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static inline int gg_protobuf_read_fixed32(const uint8_t **ptr,
+	const uint8_t *end, uint32_t *value)
+{
+	const uint8_t *p = *ptr;
+
+	if (end - p < 4)
+		return -1;
+
+	*value = (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+		((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+	*ptr = p + 4;
+
+	return 0;
+}
+
+/**
+ * \internal Odczytuje pole typu fixed64.
+ *
+ * \param ptr Wskaźnik na bieżące położenie w danych
+ * \param end Koniec danych
+ * \param value Wskaźnik na wynik
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static inline int gg_protobuf_read_fixed64(const uint8_t **ptr,
+	const uint8_t *end, uint64_t *value)
+{
+	const uint8_t *p = *ptr;
+	uint64_t res = 0;
+	int i;
+
+	if (end - p < 8)
+		return -1;
+
+	for (i = 7; i >= 0; i--)
+		res = (res << 8) | p[i];
+
+	*value = res;
+	*ptr = p + 8;
+
+	return 0;
+}
+
+/**
+ * \internal Odczytuje pole o długości zapisanej przed treścią.
+ *
+ * \param ptr Wskaźnik na bieżące położenie w danych
+ * \param end Koniec danych
+ * \param slice Wskaźnik na fragment z treścią pola
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static inline int gg_protobuf_read_slice(const uint8_t **ptr,
+	const uint8_t *end, gg_protobuf_slice_t *slice)
+{
+	uint64_t len;
+
+	/* Długość jest liczbą 32-bitową, tak jak w protobuf-c */
+	if (gg_protobuf_read_varint(ptr, end, &len, 5) == -1)
+		return -1;
+
+	len = (uint32_t) len;
+
+	if (len > (uint64_t) (end - *ptr))
+		return -1;
+
+	slice->data = *ptr;
+	slice->len = len;
+	*ptr += len;
+
+	return 0;
+}
+
+/**
+ * \internal Pomija pole wiadomości, którego klucz został już odczytany.
+ *
+ * \param ptr Wskaźnik na bieżące położenie w danych
+ * \param end Koniec danych
+ * \param key Bajt klucza
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_protobuf_skip(const uint8_t **ptr, const uint8_t *end,
+	uint8_t key)
+{
+	gg_protobuf_slice_t slice;
+	uint64_t value;
+
+	switch (key & 7) {
+		case PROTOBUF_C_WIRE_TYPE_VARINT:
+			return gg_protobuf_read_varint(ptr, end, &value, 10);
+		case PROTOBUF_C_WIRE_TYPE_64BIT:
+			return gg_protobuf_read_fixed64(ptr, end, &value);
+		case PROTOBUF_C_WIRE_TYPE_LENGTH_PREFIXED:
+			return gg_protobuf_read_slice(ptr, end, &slice);
+		case PROTOBUF_C_WIRE_TYPE_32BIT:
+			if (end - *ptr < 4)
+				return -1;
+			*ptr += 4;
+			return 0;
+	}
+
+	return -1;
+}
+
+/**
+ * \internal Kopiuje treść pola typu string.
+ *
+ * \param allocator Alokator
+ * \param dst Wskaźnik na wynik
+ * \param src Treść pola
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_protobuf_copy_string(ProtobufCAllocator *allocator, char **dst,
+	const gg_protobuf_slice_t *src)
+{
+	char *str;
+
+	str = allocator->alloc(allocator->allocator_data, src->len + 1);
+
+	if (str == NULL)
+		return -1;
+
+	memcpy(str, src->data, src->len);
+	str[src->len] = 0;
+	*dst = str;
+
+	return 0;
+}
+
+/**
+ * \internal Kopiuje treść pola typu bytes.
+ *
+ * Jeśli alokator nie zwalnia pamięci (arena sesji), wynik wskazuje na
+ * rozpakowywane dane, tak jak w protobuf-c.
+ *
+ * \param allocator Alokator
+ * \param dst Wskaźnik na wynik
+ * \param src Treść pola
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_protobuf_copy_bytes(ProtobufCAllocator *allocator,
+	ProtobufCBinaryData *dst, const gg_protobuf_slice_t *src)
+{
+	dst->len = src->len;
+
+	if (src->len == 0) {
+		dst->data = NULL;
+		return 0;
+	}
+
+	if (allocator->free == NULL) {
+		dst->data = (uint8_t*) src->data;
+		return 0;
+	}
+
+	dst->data = allocator->alloc(allocator->allocator_data, src->len);
+
+	if (dst->data == NULL)
+		return -1;
+
+	memcpy(dst->data, src->data, src->len);
+
+	return 0;
+}
+
+/**
+ * \internal Rozpakowuje wiadomość GG110RecvMessage.
+ *
+ * \param allocator Alokator lub \c NULL
+ * \param len Długość danych
+ * \param data Dane
+ *
+ * \return Wiadomość lub \c NULL w przypadku błędu
+ */
+GG110RecvMessage *gg_protobuf_unpack_recv_message(ProtobufCAllocator *allocator,
+	size_t len, const uint8_t *data)
+{
+	GG110RecvMessage tmp = GG110_RECV_MESSAGE__INIT, *msg;
+	gg_protobuf_slice_t sender = { NULL, 0 }, msg_plain = { NULL, 0 };
+	gg_protobuf_slice_t msg_xhtml = { NULL, 0 }, msg_data = { NULL, 0 };
+	const uint8_t *p = data, *end = data + len;
+	unsigned int required = 0;
+
+	if (allocator == NULL)
+		allocator = &gg_protobuf_system_allocator;
+
+	while (p < end) {
+		switch (*p++) {
+			case GG_PROTOBUF_KEY_BYTES(1):
+				if (gg_protobuf_read_slice(&p, end, &sender) == -1)
+					goto fallback;
+				tmp.has_sender = 1;
+				break;
+			case GG_PROTOBUF_KEY_VARINT(2):
+				if (gg_protobuf_read_uint32(&p, end, &tmp.flags) == -1)
+					goto fallback;
+				required |= 1;
+				break;
+			case GG_PROTOBUF_KEY_VARINT(3):
+				if (gg_protobuf_read_uint32(&p, end, &tmp.seq) == -1)
+					goto fallback;
+				required |= 2;
+				break;
+			case GG_PROTOBUF_KEY_32BIT(4):
+				if (gg_protobuf_read_fixed32(&p, end, &tmp.time) == -1)
+					goto fallback;
+				required |= 4;
+				break;
+			case GG_PROTOBUF_KEY_BYTES(5):
+				if (gg_protobuf_read_slice(&p, end, &msg_plain) == -1)
+					goto fallback;
+				break;
+			case GG_PROTOBUF_KEY_BYTES(6):
+				if (gg_protobuf_read_slice(&p, end, &msg_xhtml) == -1)
+					goto fallback;
+				break;
+			case GG_PROTOBUF_KEY_BYTES(7):
+				if (gg_protobuf_read_slice(&p, end, &msg_data) == -1)
+					goto fallback;
+				tmp.has_data = 1;
+				break;
+			case GG_PROTOBUF_KEY_64BIT(9):
+				if (gg_protobuf_read_fixed64(&p, end, &tmp.msg_id) == -1)
+					goto fallback;
+				tmp.has_msg_id = 1;
+				break;
+			case GG_PROTOBUF_KEY_64BIT(10):
+				if (gg_protobuf_read_fixed64(&p, end, &tmp.chat_id) == -1)
+					goto fallback;
+				tmp.has_chat_id = 1;
+				break;
+			case GG_PROTOBUF_KEY_64BIT(11):
+				if (gg_protobuf_read_fixed64(&p, end, &tmp.conv_id) == -1)
+					goto fallback;
+				tmp.has_conv_id = 1;
+				break;
+			default:
+				goto fallback;
+		}
+	}
+
+	/* flags, seq i time; msg_plain ma wartość domyślną */
+	if (required != 7)
+		goto fallback;
+
+	msg = allocator->alloc(allocator->allocator_data, sizeof(GG110RecvMessage));
+
+	if (msg == NULL)
+		return NULL;
+
+	*msg = tmp;
+
+	if ((sender.data != NULL && gg_protobuf_copy_bytes(allocator, &msg->sender, &sender) == -1) ||
+		(msg_plain.data != NULL && gg_protobuf_copy_string(allocator, &msg->msg_plain, &msg_plain) == -1) ||
+		(msg_xhtml.data != NULL && gg_protobuf_copy_string(allocator, &msg->msg_xhtml, &msg_xhtml) == -1) ||
+		(msg_data.data != NULL && gg_protobuf_copy_bytes(allocator, &msg->data, &msg_data) == -1))
+	{
+		protobuf_c_message_free_unpacked(&msg->base, allocator);
+		return NULL;
+	}
+
+	return msg;
+
+fallback:
+	return gg110_recv_message__unpack(allocator, len, data);
+}
+
+/**
+ * \internal Odczytuje zagnieżdżoną wiadomość GG110MessageAckLink.
+ *
+ * \param src Treść pola
+ * \param id Wskaźnik na identyfikator odnośnika
+ * \param url Wskaźnik na adres odnośnika
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu lub nieobsługiwanych
+ *         danych
+ */
+static int gg_protobuf_read_link(const gg_protobuf_slice_t *src, uint64_t *id,
+	gg_protobuf_slice_t *url)
+{
+	const uint8_t *p = src->data, *end = src->data + src->len;
+	unsigned int required = 0;
+
+	while (p < end) {
+		switch (*p++) {
+			case GG_PROTOBUF_KEY_64BIT(1):
+				if (gg_protobuf_read_fixed64(&p, end, id) == -1)
+					return -1;
+				required |= 1;
+				break;
+			case GG_PROTOBUF_KEY_BYTES(2):
+				if (gg_protobuf_read_slice(&p, end, url) == -1)
+					return -1;
+				required |= 2;
+				break;
+			default:
+				return -1;
+		}
+	}
+
+	return (required == 3) ? 0 : -1;
+}
+
+/**
+ * \internal Rozpakowuje wiadomość GG110MessageAck.
+ *
+ * \param allocator Alokator lub \c NULL
+ * \param len Długość danych
+ * \param data Dane
+ *
+ * \return Wiadomość lub \c NULL w przypadku błędu
+ */
+GG110MessageAck *gg_protobuf_unpack_message_ack(ProtobufCAllocator *allocator,
+	size_t len, const uint8_t *data)
+{
+	GG110MessageAck tmp = GG110_MESSAGE_ACK__INIT, *msg;
+	const uint8_t *p = data, *end = data + len, *links = NULL;
+	gg_protobuf_slice_t slice = { NULL, 0 }, url = { NULL, 0 };
+	unsigned int required = 0;
+	size_t n_links = 0;
+	uint64_t id;
+
+	if (allocator == NULL)
+		allocator = &gg_protobuf_system_allocator;
+
+	while (p < end) {
+		const uint8_t *key = p;
+
+		switch (*p++) {
+			case GG_PROTOBUF_KEY_VARINT(1):
+				if (gg_protobuf_read_uint32(&p, end, &tmp.msg_type) == -1)
+					goto fallback;
+				required |= 1;
+				break;
+			case GG_PROTOBUF_KEY_VARINT(2):
+				if (gg_protobuf_read_uint32(&p, end, &tmp.seq) == -1)
+					goto fallback;
+				required |= 2;
+				break;
+			case GG_PROTOBUF_KEY_32BIT(3):
+				if (gg_protobuf_read_fixed32(&p, end, &tmp.time) == -1)
+					goto fallback;
+				required |= 4;
+				break;
+			case GG_PROTOBUF_KEY_64BIT(4):
+				if (gg_protobuf_read_fixed64(&p, end, &tmp.msg_id) == -1)
+					goto fallback;
+				tmp.has_msg_id = 1;
+				break;
+			case GG_PROTOBUF_KEY_64BIT(5):
+				if (gg_protobuf_read_fixed64(&p, end, &tmp.conv_id) == -1)
+					goto fallback;
+				tmp.has_conv_id = 1;
+				break;
+			case GG_PROTOBUF_KEY_BYTES(6):
+				if (gg_protobuf_read_slice(&p, end, &slice) == -1 ||
+					gg_protobuf_read_link(&slice, &id, &url) == -1)
+					goto fallback;
+				if (links == NULL)
+					links = key;
+				n_links++;
+				break;
+			case GG_PROTOBUF_KEY_VARINT(7):
+				if (gg_protobuf_read_uint32(&p, end, &tmp.dummy1) == -1)
+					goto fallback;
+				break;
+			default:
+				goto fallback;
+		}
+	}
+
+	/* msg_type, seq i time; dummy1 ma wartość domyślną */
+	if (required != 7)
+		goto fallback;
+
+	msg = allocator->alloc(allocator->allocator_data, sizeof(GG110MessageAck));
+
+	if (msg == NULL)
+		return NULL;
+
+	*msg = tmp;
+
+	if (n_links == 0)
+		return msg;
+
+	msg->links = allocator->alloc(allocator->allocator_data,
+		n_links * sizeof(GG110MessageAckLink*));
+
+	if (msg->links == NULL)
+		goto fail;
+
+	/* Dane zostały już sprawdzone, więc drugi przebieg jedynie
+	 * przepisuje kolejne odnośniki. */
+
+	for (p = links; p < end; ) {
+		uint8_t key = *p++;
+		GG110MessageAckLink *link;
+		GG110MessageAckLink link_init = GG110_MESSAGE_ACK_LINK__INIT;
+
+		if (key != GG_PROTOBUF_KEY_BYTES(6)) {
+			gg_protobuf_skip(&p, end, key);
+			continue;
+		}
+
+		gg_protobuf_read_slice(&p, end, &slice);
+		gg_protobuf_read_link(&slice, &id, &url);
+
+		link = allocator->alloc(allocator->allocator_data, sizeof(GG110MessageAckLink));
+
+		if (link == NULL)
+			goto fail;
+
+		*link = link_init;
+		link->id = id;
+		msg->links[msg->n_links++] = link;
+
+		if (gg_protobuf_copy_string(allocator, &link->url, &url) == -1)
+			goto fail;
+	}
+
+	return msg;
+
+fail:
+	protobuf_c_message_free_unpacked(&msg->base, allocator);
+	return NULL;
+
+fallback:
+	return gg110_message_ack__unpack(allocator, len, data);
+}
+
+/**
+ * \internal Rozpakowuje wiadomość GG110Pong.
+ *
+ * \param allocator Alokator lub \c NULL
+ * \param len Długość danych
+ * \param data Dane
+ *
+ * \return Wiadomość lub \c NULL w przypadku błędu
+ */
+GG110Pong *gg_protobuf_unpack_pong(ProtobufCAllocator *allocator,
+	size_t len, const uint8_t *data)
+{
+	GG110Pong tmp = GG110_PONG__INIT, *msg;
+	const uint8_t *p = data, *end = data + len;
+	unsigned int required = 0;
+
+	if (allocator == NULL)
+		allocator = &gg_protobuf_system_allocator;
+
+	while (p < end) {
+		switch (*p++) {
+			case GG_PROTOBUF_KEY_32BIT(1):
+				if (gg_protobuf_read_fixed32(&p, end, &tmp.server_time) == -1)
+					goto fallback;
+				required |= 1;
+				break;
+			default:
+				goto fallback;
+		}
+	}
+
+	if (required != 1)
+		goto fallback;
+
+	msg = allocator->alloc(allocator->allocator_data, sizeof(GG110Pong));
+
+	if (msg == NULL)
+		return NULL;
+
+	*msg = tmp;
+
+	return msg;
+
+fallback:
+	return gg110_pong__unpack(allocator, len, data);
+}
+
+/**
+ * \internal Zwraca liczbę bajtów potrzebnych do zapisania liczby w formacie
+ * varint.
+ *
+ * \param value Liczba
+ *
+ * \return Liczba bajtów
+ */
+static inline size_t gg_protobuf_varint_size(uint64_t value)
+{
+	size_t res = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		res++;
+	}
+
+	return res;
+}
+
+/**
+ * \internal Zapisuje liczbę w formacie varint.
+ *
+ * \param out Bufor wyjściowy
+ * \param value Liczba
+ *
+ * \return Wskaźnik za zapisaną liczbą
+ */
+static inline uint8_t *gg_protobuf_write_varint(uint8_t *out, uint64_t value)
+{
+	while (value >= 0x80) {
+		*out++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+
+	*out++ = value;
+
+	return out;
+}
+
+/**
+ * \internal Zwraca rozmiar zakodowanej wiadomości GG110Ack.
+ *
+ * Wiadomość nie może zawierać nieznanych pól, co w przypadku wiadomości
+ * wysyłanych przez bibliotekę jest zawsze spełnione.
+ *
+ * \param msg Wiadomość
+ *
+ * \return Rozmiar w bajtach
+ */
+size_t gg_protobuf_ack_size(const GG110Ack *msg)
+{
+	/* Pole typu enum jest kodowane jak int32, więc wartość ujemna
+	 * zajmuje 10 bajtów. */
+	return 3 + gg_protobuf_varint_size((uint64_t) (int64_t) (int32_t) msg->type) +
+		gg_protobuf_varint_size(msg->seq) +
+		gg_protobuf_varint_size(msg->dummy1);
+}
+
+/**
+ * \internal Koduje wiadomość GG110Ack.
+ *
+ * \param msg Wiadomość
+ * \param out Bufor o rozmiarze zwróconym przez gg_protobuf_ack_size()
+ *
+ * \return Liczba zapisanych bajtów
+ */
+size_t gg_protobuf_ack_pack(const GG110Ack *msg, uint8_t *out)
+{
+	uint8_t *p = out;
+
+	*p++ = GG_PROTOBUF_KEY_VARINT(1);
+	p = gg_protobuf_write_varint(p, (uint64_t) (int64_t) (int32_t) msg->type);
+	*p++ = GG_PROTOBUF_KEY_VARINT(2);
+	p = gg_protobuf_write_varint(p, msg->seq);
+	*p++ = GG_PROTOBUF_KEY_VARINT(3);
+	p = gg_protobuf_write_varint(p, msg->dummy1);
+
+	return p - out;
+}
@@ -32,6 +32,41 @@ struct _gg_protobuf_uin_buff
 	char data[GG_PROTOBUFF_UIN_MAXLEN + 1 + 2];
 };
 
+/** \internal Rozmiar pierwszego bloku areny */
+#define GG_PROTOBUF_ARENA_SIZE 4096
+
+/** \internal Rozmiar bloku, powyżej którego blok jest zwalniany po obsłudze pakietu */
+#define GG_PROTOBUF_ARENA_MAX 262144
+
+/** \internal Wyrównanie przydzielanej pamięci */
+#define GG_PROTOBUF_ARENA_ALIGN 16
+
+typedef struct gg_protobuf_arena_block gg_protobuf_arena_block_t;
+
+/* Blok pamięci areny. Dane znajdują się zaraz za nagłówkiem. */
+struct gg_protobuf_arena_block
+{
+	gg_protobuf_arena_block_t *next;	/* poprzednio przydzielony blok */
+	size_t size;				/* pojemność bloku */
+	size_t used;				/* liczba zajętych bajtów */
+};
+
+/* Rozmiar nagłówka bloku zaokrąglony do wyrównania danych. */
+#define GG_PROTOBUF_ARENA_HEADER \
+	((sizeof(gg_protobuf_arena_block_t) + GG_PROTOBUF_ARENA_ALIGN - 1) & \
+	~(size_t) (GG_PROTOBUF_ARENA_ALIGN - 1))
+
+/* Arena, z której protobuf-c przydziela pamięć na rozpakowywane
+ * wiadomości. Pamięć nie jest zwalniana pojedynczo, tylko w całości po
+ * obsłudze pakietu. Bloki nie są zwalniane, dopóki nie urosną ponad
+ * GG_PROTOBUF_ARENA_MAX, więc typowy pakiet nie wymaga przydzielania
+ * pamięci. */
+struct gg_protobuf_arena
+{
+	ProtobufCAllocator allocator;
+	gg_protobuf_arena_block_t *head;	/* bieżący blok */
+};
+
 void gg_protobuf_expected(struct gg_session *gs, const char *field_name,
 	uint32_t value, uint32_t expected)
 {
@@ -73,19 +108,19 @@ int gg_protobuf_send_ex(struct gg_session *gs, struct gg_event *ge, int type,
 	int succ = 1;
 	enum gg_failure_t failure;
 
+	/* Wiadomość jest pakowana od razu do kolejki danych do wysłania */
 	len = size_cb(msg);
-	buffer = malloc(len);
+	buffer = gg_send_packet_reserve(gs, len);
 	if (buffer == NULL) {
-		gg_debug_session(gs, GG_DEBUG_ERROR, "// gg_protobuf_send: out "
-			"of memory - tried to allocate %" GG_SIZE_FMT
-			" bytes for %#x packet\n", len, type);
+		gg_debug_session(gs, GG_DEBUG_ERROR, "// gg_protobuf_send: "
+			"can't reserve %" GG_SIZE_FMT " bytes for %#x packet "
+			"(errno=%d, %s)\n", len, type, errno, strerror(errno));
 		succ = 0;
-		failure = GG_FAILURE_INTERNAL;
+		failure = (errno == ENOMEM) ? GG_FAILURE_INTERNAL :
+			GG_FAILURE_WRITING;
 	} else {
 		pack_cb(msg, buffer);
-		succ = (-1 != gg_send_packet(gs, type, buffer, len, NULL));
-		free(buffer);
-		buffer = NULL;
+		succ = (-1 != gg_send_packet_commit(gs, type, len));
 		if (!succ) {
 			failure = GG_FAILURE_WRITING;
 			gg_debug_session(gs, GG_DEBUG_ERROR,
@@ -102,6 +137,173 @@ int gg_protobuf_send_ex(struct gg_session *gs, struct gg_event *ge, int type,
 	return succ;
 }
 
+static void *gg_protobuf_arena_alloc(void *allocator_data, size_t size)
+{
+	struct gg_protobuf_arena *arena = allocator_data;
+	gg_protobuf_arena_block_t *blk = arena->head;
+	void *ptr;
+
+	size = (size + GG_PROTOBUF_ARENA_ALIGN - 1) &
+		~(size_t) (GG_PROTOBUF_ARENA_ALIGN - 1);
+
+	if (blk == NULL || blk->size - blk->used < size) {
+		size_t blk_size = GG_PROTOBUF_ARENA_SIZE;
+
+		if (blk != NULL)
+			blk_size = blk->size * 2;
+
+		if (blk_size < size)
+			blk_size = size;
+
+		blk = malloc(GG_PROTOBUF_ARENA_HEADER + blk_size);
+
+		if (blk == NULL)
+			return NULL;
+
+		blk->next = arena->head;
+		blk->size = blk_size;
+		blk->used = 0;
+		arena->head = blk;
+	}
+
+	ptr = (char*) blk + GG_PROTOBUF_ARENA_HEADER + blk->used;
+	blk->used += size;
+
+	return ptr;
+}
+
+#ifdef GG_CONFIG_HAVE_PROTOBUF_C
+static void gg_protobuf_arena_free(void *allocator_data, void *ptr)
+{
+}
+#endif
+
+/**
+ * \internal Zwraca alokator areny sesji do rozpakowywania wiadomości.
+ *
+ * Wiadomości rozpakowane z tym alokatorem należy zwalniać makrem
+ * \c GG_PROTOBUF_FREE, a pamięć jest odzyskiwana po obsłudze pakietu przez
+ * \c gg_protobuf_arena_reset(). Dołączona do biblioteki wersja protobuf-c
+ * nie kopiuje przy tym pól typu \c bytes, tylko wskazuje nimi bufor
+ * odebranego pakietu.
+ *
+ * \param gs Struktura sesji
+ *
+ * \return Alokator lub \c NULL (domyślny alokator) jeśli zabrakło pamięci
+ */
+ProtobufCAllocator *gg_protobuf_arena(struct gg_session *gs)
+{
+	struct gg_session_private *p = gs->private_data;
+	struct gg_protobuf_arena *arena = p->protobuf_arena;
+
+	if (arena == NULL) {
+		arena = malloc(sizeof(struct gg_protobuf_arena));
+
+		if (arena == NULL)
+			return NULL;
+
+		arena->allocator.alloc = gg_protobuf_arena_alloc;
+#ifdef GG_CONFIG_HAVE_PROTOBUF_C
+		arena->allocator.free = gg_protobuf_arena_free;
+#else
+		/* Dołączona wersja protobuf-c uznaje alokator bez
+		 * funkcji zwalniania za arenę. */
+		arena->allocator.free = NULL;
+#endif
+		arena->allocator.allocator_data = arena;
+		arena->head = NULL;
+
+		p->protobuf_arena = arena;
+	}
+
+	return &arena->allocator;
+}
+
+/**
+ * \internal Zwalnia pamięć wszystkich wiadomości rozpakowanych z areny.
+ *
+ * Zostaje jedynie największy blok, chyba że przekracza on
+ * \c GG_PROTOBUF_ARENA_MAX.
+ *
+ * \param gs Struktura sesji
+ */
+void gg_protobuf_arena_reset(struct gg_session *gs)
+{
+	struct gg_protobuf_arena *arena = gs->private_data->protobuf_arena;
+	gg_protobuf_arena_block_t *blk;
+
+	if (arena == NULL || arena->head == NULL)
+		return;
+
+	blk = arena->head;
+
+	while (blk->next != NULL) {
+		gg_protobuf_arena_block_t *next = blk->next->next;
+
+		free(blk->next);
+		blk->next = next;
+	}
+
+	if (blk->size > GG_PROTOBUF_ARENA_MAX) {
+		free(blk);
+		arena->head = NULL;
+		return;
+	}
+
+	blk->used = 0;
+}
+
+/**
+ * \internal Zwalnia arenę sesji.
+ *
+ * \param gs Struktura sesji
+ */
+void gg_protobuf_arena_destroy(struct gg_session *gs)
+{
+	struct gg_protobuf_arena *arena = gs->private_data->protobuf_arena;
+
+	if (arena == NULL)
+		return;
+
+	while (arena->head != NULL) {
+		gg_protobuf_arena_block_t *next = arena->head->next;
+
+		free(arena->head);
+		arena->head = next;
+	}
+
+	free(arena);
+	gs->private_data->protobuf_arena = NULL;
+}
+
+/**
+ * \internal Zwalnia wiadomość rozpakowaną z alokatorem \c gg_protobuf_arena().
+ *
+ * Wiadomości przydzielone z areny zostaną zwolnione po obsłudze pakietu.
+ * Wiadomości przydzielone domyślnym alokatorem (gdy nie udało się utworzyć
+ * areny) są zwalniane od razu.
+ *
+ * \param gs Struktura sesji
+ * \param msg Wiadomość (może być \c NULL)
+ */
+void gg_protobuf_free(struct gg_session *gs, ProtobufCMessage *msg)
+{
+	struct gg_protobuf_arena *arena = gs->private_data->protobuf_arena;
+	gg_protobuf_arena_block_t *blk;
+
+	if (msg == NULL)
+		return;
+
+	for (blk = (arena != NULL) ? arena->head : NULL; blk != NULL; blk = blk->next) {
+		const char *data = (const char*) blk + GG_PROTOBUF_ARENA_HEADER;
+
+		if ((const char*) msg >= data && (const char*) msg < data + blk->size)
+			return;
+	}
+
+	protobuf_c_message_free_unpacked(msg, NULL);
+}
+
 void gg_protobuf_set_uin(ProtobufCBinaryData *dst, uin_t uin, gg_protobuf_uin_buff_t *buff)
 {
 	char *uin_str;
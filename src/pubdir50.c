@@ -198,7 +198,7 @@ void gg_pubdir50_free(gg_pubdir50_t s)
  */
 uint32_t gg_pubdir50(struct gg_session *sess, gg_pubdir50_t req)
 {
-	int i, size = 5;
+	int i, len, size = 5;
 	uint32_t res;
 	char *buf, *p;
 	struct gg_pubdir50_request *r;
@@ -222,32 +222,8 @@ uint32_t gg_pubdir50(struct gg_session *sess, gg_pubdir50_t req)
 		if (req->entries[i].num)
 			continue;
 
-		if (sess->encoding == GG_ENCODING_CP1250) {
-			size += strlen(req->entries[i].field) + 1;
-			size += strlen(req->entries[i].value) + 1;
-		} else {
-			char *tmp;
-
-			/* XXX \todo zoptymalizować */
-			tmp = gg_encoding_convert(req->entries[i].field, sess->encoding, GG_ENCODING_CP1250, -1, -1);
-
-			if (tmp == NULL)
-				return -1;
-
-			size += strlen(tmp) + 1;
-
-			free(tmp);
-
-			/* XXX \todo zoptymalizować */
-			tmp = gg_encoding_convert(req->entries[i].value, sess->encoding, GG_ENCODING_CP1250, -1, -1);
-
-			if (tmp == NULL)
-				return -1;
-
-			size += strlen(tmp) + 1;
-
-			free(tmp);
-		}
+		size += gg_encoding_convert_max(sess->encoding, GG_ENCODING_CP1250, strlen(req->entries[i].field)) + 1;
+		size += gg_encoding_convert_max(sess->encoding, GG_ENCODING_CP1250, strlen(req->entries[i].value)) + 1;
 	}
 
 	if (!(buf = malloc(size))) {
@@ -268,42 +244,27 @@ uint32_t gg_pubdir50(struct gg_session *sess, gg_pubdir50_t req)
 		if (req->entries[i].num)
 			continue;
 
-		if (sess->encoding == GG_ENCODING_CP1250) {
-			strcpy(p, req->entries[i].field);
-			p += strlen(p) + 1;
+		len = gg_encoding_convert_buf(req->entries[i].field, sess->encoding, GG_ENCODING_CP1250, -1, p, buf + size - p);
 
-			strcpy(p, req->entries[i].value);
-			p += strlen(p) + 1;
-		} else {
-			char *tmp;
-
-			/* XXX \todo zoptymalizować */
-			tmp = gg_encoding_convert(req->entries[i].field, sess->encoding, GG_ENCODING_CP1250, -1, -1);
-
-			if (tmp == NULL) {
-				free(buf);
-				return -1;
-			}
-
-			strcpy(p, tmp);
-			p += strlen(tmp) + 1;
-			free(tmp);
-
-			/* XXX \todo zoptymalizować */
-			tmp = gg_encoding_convert(req->entries[i].value, sess->encoding, GG_ENCODING_CP1250, -1, -1);
+		if (len == -1) {
+			free(buf);
+			return -1;
+		}
 
+		p += len + 1;
 
-			if (tmp == NULL) {
-				free(buf);
-				return -1;
-			}
+		len = gg_encoding_convert_buf(req->entries[i].value, sess->encoding, GG_ENCODING_CP1250, -1, p, buf + size - p);
 
-			strcpy(p, tmp);
-			p += strlen(tmp) + 1;
-			free(tmp);
+		if (len == -1) {
+			free(buf);
+			return -1;
 		}
+
+		p += len + 1;
 	}
 
+	size = p - buf;
+
 	if (gg_send_packet(sess, GG_PUBDIR50_REQUEST, buf, size, NULL, 0) == -1)
 		res = 0;
 
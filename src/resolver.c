@@ -28,7 +28,9 @@
 
 #include "internal.h"
 
+#include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -36,6 +38,7 @@
 #include "network.h"
 #include "resolver.h"
 #include "session.h"
+#include "timer.h"
 
 #ifdef GG_CONFIG_HAVE_FORK
 #include <sys/wait.h>
@@ -268,6 +271,519 @@ int gg_gethostbyname_real(const char *hostname, struct in_addr **result, unsigne
 #endif /* GG_CONFIG_HAVE_GETHOSTBYNAME_R */
 }
 
+#ifdef GG_CONFIG_HAVE_PTHREAD
+
+/**
+ * \internal Liczba kubełków pamięci podręcznej nazw.
+ */
+#define GG_RESOLVER_CACHE_BUCKETS 64
+
+/**
+ * \internal Maksymalna liczba nazw w pamięci podręcznej.
+ */
+#define GG_RESOLVER_CACHE_MAX 256
+
+/**
+ * \internal Nazwa w pamięci podręcznej.
+ */
+struct gg_resolver_cache_entry {
+	char *hostname;		/*< Nazwa serwera zapisana małymi literami */
+	struct in_addr *addrs;	/*< Adresy zakończone INADDR_NONE lub NULL przed pierwszym wynikiem */
+	unsigned int count;	/*< Liczba adresów, 0 dla wyniku negatywnego */
+	uint64_t expires;	/*< Czas utraty ważności wyniku */
+	uint64_t resolved;	/*< Czas ostatniego udanego rozwiązania nazwy */
+	unsigned int generation;	/*< Numer kolejnego wyniku */
+	int resolving;		/*< Flaga trwającego rozwiązywania nazwy */
+	int waiters;		/*< Liczba wątków czekających na wynik */
+
+	struct gg_resolver_cache_entry *next;	/*< Następna nazwa w kubełku */
+};
+
+/**
+ * \internal Pamięć podręczna nazw wspólna dla wszystkich sesji.
+ */
+static struct {
+	struct gg_resolver_cache_entry *table[GG_RESOLVER_CACHE_BUCKETS];
+	unsigned int count;
+	int ttl;		/* czas ważności wyniku w sekundach, 0 wyłącza */
+	int negative_ttl;	/* czas ważności wyniku negatywnego */
+	int max_stale;		/* czas używania nieaktualnego wyniku */
+	struct gg_resolver_cache_stats stats;
+} gg_resolver_cache;
+
+static pthread_mutex_t gg_resolver_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gg_resolver_cache_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * \internal Wyznacza kubełek nazwy.
+ */
+static unsigned int gg_resolver_cache_slot(const char *hostname)
+{
+	uint32_t hash = 2166136261U;
+
+	for (; *hostname != '\0'; hostname++) {
+		hash ^= (unsigned char) tolower((unsigned char) *hostname);
+		hash *= 16777619U;
+	}
+
+	return hash % GG_RESOLVER_CACHE_BUCKETS;
+}
+
+/**
+ * \internal Szuka nazwy w pamięci podręcznej.
+ *
+ * \return Wskaźnik na wskaźnik nazwy w kubełku lub \c NULL
+ */
+static struct gg_resolver_cache_entry **gg_resolver_cache_lookup(const char *hostname)
+{
+	struct gg_resolver_cache_entry **it;
+
+	it = &gg_resolver_cache.table[gg_resolver_cache_slot(hostname)];
+
+	for (; *it != NULL; it = &(*it)->next) {
+		const char *a = (*it)->hostname, *b = hostname;
+
+		while (*a != '\0' && *a == tolower((unsigned char) *b)) {
+			a++;
+			b++;
+		}
+
+		if (*a == '\0' && *b == '\0')
+			return it;
+	}
+
+	return NULL;
+}
+
+/**
+ * \internal Usuwa nazwę z pamięci podręcznej.
+ */
+static void gg_resolver_cache_drop(struct gg_resolver_cache_entry **it)
+{
+	struct gg_resolver_cache_entry *e = *it;
+
+	*it = e->next;
+	gg_resolver_cache.count--;
+
+	free(e->hostname);
+	free(e->addrs);
+	free(e);
+}
+
+/**
+ * \internal Dodaje nazwę do pamięci podręcznej.
+ *
+ * Jeśli brakuje miejsca, usuwana jest nieużywana nazwa, której wynik
+ * najwcześniej traci ważność.
+ *
+ * \return Nowa nazwa lub \c NULL w przypadku błędu
+ */
+static struct gg_resolver_cache_entry *gg_resolver_cache_add(const char *hostname)
+{
+	struct gg_resolver_cache_entry *e, **it;
+	char *p;
+
+	if (gg_resolver_cache.count >= GG_RESOLVER_CACHE_MAX) {
+		struct gg_resolver_cache_entry **victim = NULL;
+		unsigned int i;
+
+		for (i = 0; i < GG_RESOLVER_CACHE_BUCKETS; i++) {
+			for (it = &gg_resolver_cache.table[i]; *it != NULL; it = &(*it)->next) {
+				if ((*it)->resolving || (*it)->waiters > 0)
+					continue;
+
+				if (victim == NULL || (*it)->expires < (*victim)->expires)
+					victim = it;
+			}
+		}
+
+		if (victim == NULL) {
+			errno = ENOBUFS;
+			return NULL;
+		}
+
+		gg_resolver_cache_drop(victim);
+	}
+
+	e = calloc(1, sizeof(struct gg_resolver_cache_entry));
+
+	if (e == NULL)
+		return NULL;
+
+	e->hostname = strdup(hostname);
+
+	if (e->hostname == NULL) {
+		free(e);
+		return NULL;
+	}
+
+	for (p = e->hostname; *p != '\0'; p++)
+		*p = tolower((unsigned char) *p);
+
+	it = &gg_resolver_cache.table[gg_resolver_cache_slot(hostname)];
+	e->next = *it;
+	*it = e;
+	gg_resolver_cache.count++;
+
+	return e;
+}
+
+/**
+ * \internal Kopiuje wynik z pamięci podręcznej.
+ *
+ * \return 0 jeśli się powiodło, -1 dla wyniku negatywnego lub w przypadku
+ *         błędu
+ */
+static int gg_resolver_cache_copy(const struct gg_resolver_cache_entry *e,
+	struct in_addr **result, unsigned int *count)
+{
+	if (e->count == 0)
+		return -1;
+
+	*result = malloc((e->count + 1) * sizeof(struct in_addr));
+
+	if (*result == NULL)
+		return -1;
+
+	memcpy(*result, e->addrs, (e->count + 1) * sizeof(struct in_addr));
+	*count = e->count;
+
+	return 0;
+}
+
+/**
+ * \internal Sprawdza, czy wynik w pamięci podręcznej jest ważny.
+ */
+static int gg_resolver_cache_valid(const struct gg_resolver_cache_entry *e,
+	uint64_t now)
+{
+	return (e->addrs != NULL && now < e->expires);
+}
+
+/**
+ * \internal Zwalnia nazwę po przerwaniu rozwiązywania przez
+ * \c pthread_cancel(), żeby czekające wątki mogły spróbować same.
+ */
+static void gg_resolver_cache_abort(void *arg)
+{
+	struct gg_resolver_cache_entry *e = arg;
+
+	pthread_mutex_lock(&gg_resolver_cache_mutex);
+	e->resolving = 0;
+	pthread_cond_broadcast(&gg_resolver_cache_cond);
+	pthread_mutex_unlock(&gg_resolver_cache_mutex);
+}
+
+/**
+ * \internal Kończy czekanie na wynik przerwane przez \c pthread_cancel().
+ *
+ * Przerwane \c pthread_cond_wait() zwraca blokadę przed wywołaniem tej
+ * funkcji.
+ */
+static void gg_resolver_cache_unwait(void *arg)
+{
+	struct gg_resolver_cache_entry *e = arg;
+
+	e->waiters--;
+	pthread_mutex_unlock(&gg_resolver_cache_mutex);
+}
+
+/**
+ * \internal Czeka na wynik rozwiązywania nazwy w innym wątku.
+ *
+ * Funkcja musi być wywołana z założoną blokadą.
+ */
+static void gg_resolver_cache_wait(struct gg_resolver_cache_entry *e)
+{
+	pthread_cleanup_push(gg_resolver_cache_unwait, e);
+
+	while (e->resolving)
+		pthread_cond_wait(&gg_resolver_cache_cond, &gg_resolver_cache_mutex);
+
+	pthread_cleanup_pop(0);
+}
+
+/**
+ * \internal Rozwiązuje nazwę na potrzeby pamięci podręcznej.
+ *
+ * Jeśli wątek zostanie unicestwiony, czekające wątki zostaną obudzone.
+ */
+static int gg_resolver_cache_query(struct gg_resolver_cache_entry *e,
+	const char *hostname, struct in_addr **result, unsigned int *count,
+	int pthread)
+{
+	int res;
+
+	pthread_cleanup_push(gg_resolver_cache_abort, e);
+
+	res = gg_gethostbyname_real(hostname, result, count, pthread);
+
+	pthread_cleanup_pop(0);
+
+	return res;
+}
+
+/**
+ * \internal Rozwiązuje nazwę z użyciem pamięci podręcznej.
+ *
+ * Ważny wynik jest zwracany bez pytania serwera nazw. Jeśli ta sama nazwa
+ * jest właśnie rozwiązywana w innym wątku, funkcja czeka na jego wynik.
+ * Gdy serwer nazw nie odpowiada, przez \c max_stale sekund po utracie
+ * ważności zwracany jest poprzedni wynik.
+ *
+ * \param hostname Nazwa serwera
+ * \param result Wskaźnik na wskaźnik z tablicą adresów zakończoną INADDR_NONE
+ * \param count Wskaźnik na zmienną, do ktorej zapisze się liczbę wyników
+ * \param pthread Flaga blokowania unicestwiania wątku podczas alokacji pamięci
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_resolver_cache_resolve(const char *hostname,
+	struct in_addr **result, unsigned int *count, int pthread)
+{
+	struct gg_resolver_cache_entry **it, *e = NULL;
+	struct in_addr *addrs = NULL;
+	unsigned int addrs_count = 0, generation = 0;
+	uint64_t now;
+	int res, old_state, waited = 0;
+
+	if (pthread)
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+
+	pthread_mutex_lock(&gg_resolver_cache_mutex);
+
+	if (gg_resolver_cache.ttl == 0) {
+		pthread_mutex_unlock(&gg_resolver_cache_mutex);
+
+		if (pthread)
+			pthread_setcancelstate(old_state, NULL);
+
+		return gg_gethostbyname_real(hostname, result, count, pthread);
+	}
+
+	for (;;) {
+		now = gg_timer_clock();
+		it = gg_resolver_cache_lookup(hostname);
+		e = (it != NULL) ? *it : NULL;
+
+		/* Wynik ważny albo ten, na który czekaliśmy */
+		if (e != NULL && (gg_resolver_cache_valid(e, now) ||
+			(waited && e->addrs != NULL && e->generation != generation)))
+		{
+			if (!waited) {
+				gg_resolver_cache.stats.hits++;
+				if (e->count == 0)
+					gg_resolver_cache.stats.negative++;
+			}
+
+			res = gg_resolver_cache_copy(e, result, count);
+
+			pthread_mutex_unlock(&gg_resolver_cache_mutex);
+
+			if (pthread)
+				pthread_setcancelstate(old_state, NULL);
+
+			return res;
+		}
+
+		if (e == NULL || !e->resolving)
+			break;
+
+		if (!waited)
+			gg_resolver_cache.stats.coalesced++;
+
+		waited = 1;
+		generation = e->generation;
+		e->waiters++;
+
+		if (pthread)
+			pthread_setcancelstate(old_state, NULL);
+
+		gg_resolver_cache_wait(e);
+
+		if (pthread)
+			pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+
+		e->waiters--;
+	}
+
+	if (e == NULL)
+		e = gg_resolver_cache_add(hostname);
+
+	if (e == NULL) {
+		/* Brak miejsca, rozwiąż nazwę bez pamięci podręcznej */
+		pthread_mutex_unlock(&gg_resolver_cache_mutex);
+
+		if (pthread)
+			pthread_setcancelstate(old_state, NULL);
+
+		return gg_gethostbyname_real(hostname, result, count, pthread);
+	}
+
+	e->resolving = 1;
+	gg_resolver_cache.stats.misses++;
+
+	pthread_mutex_unlock(&gg_resolver_cache_mutex);
+
+	if (pthread)
+		pthread_setcancelstate(old_state, NULL);
+
+	res = gg_resolver_cache_query(e, hostname, &addrs, &addrs_count, pthread);
+
+	if (pthread)
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+
+	pthread_mutex_lock(&gg_resolver_cache_mutex);
+
+	now = gg_timer_clock();
+
+	if (res == 0) {
+		free(e->addrs);
+		e->addrs = addrs;
+		e->count = addrs_count;
+		e->resolved = now;
+		e->expires = now + (uint64_t) gg_resolver_cache.ttl * 1000;
+	} else if (e->addrs != NULL && e->count > 0 && e->resolved != 0 &&
+		now < e->resolved + (uint64_t) (gg_resolver_cache.ttl +
+		gg_resolver_cache.max_stale) * 1000)
+	{
+		/* Serwer nazw nie odpowiada, zostaje poprzedni wynik */
+		gg_resolver_cache.stats.stale++;
+		e->expires = now + (uint64_t) gg_resolver_cache.negative_ttl * 1000;
+	} else {
+		addrs = malloc(sizeof(struct in_addr));
+
+		if (addrs != NULL) {
+			addrs[0].s_addr = INADDR_NONE;
+			free(e->addrs);
+			e->addrs = addrs;
+			e->count = 0;
+			e->expires = now + (uint64_t) gg_resolver_cache.negative_ttl * 1000;
+		}
+	}
+
+	res = (e->addrs != NULL) ? gg_resolver_cache_copy(e, result, count) : -1;
+
+	e->generation++;
+	e->resolving = 0;
+	pthread_cond_broadcast(&gg_resolver_cache_cond);
+
+	pthread_mutex_unlock(&gg_resolver_cache_mutex);
+
+	if (pthread)
+		pthread_setcancelstate(old_state, NULL);
+
+	return res;
+}
+
+/**
+ * \internal Usuwa z pamięci podręcznej wszystkie nieużywane nazwy.
+ *
+ * Wyniki nazw, które są właśnie rozwiązywane, tracą ważność.
+ */
+static void gg_resolver_cache_flush(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < GG_RESOLVER_CACHE_BUCKETS; i++) {
+		struct gg_resolver_cache_entry **it = &gg_resolver_cache.table[i];
+
+		while (*it != NULL) {
+			if ((*it)->resolving || (*it)->waiters > 0) {
+				(*it)->expires = 0;
+				(*it)->resolved = 0;
+				it = &(*it)->next;
+			} else {
+				gg_resolver_cache_drop(it);
+			}
+		}
+	}
+}
+
+#endif /* GG_CONFIG_HAVE_PTHREAD */
+
+/**
+ * \internal Zwraca wynik z pamięci podręcznej bez uruchamiania procesu
+ * ani wątku.
+ *
+ * Przy trafieniu deskryptor zawiera gotowy wynik, a prywatne dane są puste,
+ * więc funkcje zwalniające zasoby nie mają nic do zrobienia.
+ *
+ * \param fd Wskaźnik na zmienną, gdzie zostanie umieszczony deskryptor gniazda
+ * \param priv_data Wskaźnik na zmienną na prywatne dane
+ * \param hostname Nazwa serwera do rozwiązania
+ *
+ * \return 1 jeśli wynik pochodzi z pamięci podręcznej, 0 jeśli go nie ma
+ */
+static int gg_resolver_cache_start(int *fd, void **priv_data, const char *hostname)
+{
+#ifdef GG_CONFIG_HAVE_PTHREAD
+	struct gg_resolver_cache_entry **it;
+	struct in_addr none, *addrs = NULL;
+	unsigned int count = 0;
+	int pipes[2], hit = 0;
+	size_t len;
+
+	if (inet_addr(hostname) != INADDR_NONE)
+		return 0;
+
+	pthread_mutex_lock(&gg_resolver_cache_mutex);
+
+	if (gg_resolver_cache.ttl != 0) {
+		it = gg_resolver_cache_lookup(hostname);
+
+		if (it != NULL && gg_resolver_cache_valid(*it, gg_timer_clock()) &&
+			((*it)->count == 0 || gg_resolver_cache_copy(*it, &addrs, &count) == 0))
+		{
+			gg_resolver_cache.stats.hits++;
+			if ((*it)->count == 0)
+				gg_resolver_cache.stats.negative++;
+			hit = 1;
+		}
+	}
+
+	pthread_mutex_unlock(&gg_resolver_cache_mutex);
+
+	if (!hit)
+		return 0;
+
+	if (addrs == NULL) {
+		none.s_addr = INADDR_NONE;
+		addrs = &none;
+	}
+
+	len = (count + 1) * sizeof(struct in_addr);
+
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, pipes) == -1) {
+		if (addrs != &none)
+			free(addrs);
+		return 0;
+	}
+
+	hit = (send(pipes[1], (void *) addrs, len, 0) == (int) len);
+
+	close(pipes[1]);
+
+	if (addrs != &none)
+		free(addrs);
+
+	if (!hit) {
+		close(pipes[0]);
+		return 0;
+	}
+
+	gg_debug(GG_DEBUG_MISC, "// gg_resolver_cache_start() \"%s\" found in "
+		"cache\n", hostname);
+
+	*fd = pipes[0];
+	*priv_data = NULL;
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
 /**
  * \internal Rozwiązuje nazwę i zapisuje wynik do podanego gniazda.
  *
@@ -277,14 +793,16 @@ int gg_gethostbyname_real(const char *hostname, struct in_addr **result, unsigne
  * \param fd Deskryptor gniazda
  * \param hostname Nazwa serwera
  * \param pthread Flaga blokowania unicestwiania wątku podczas alokacji pamięci
+ * \param cache Flaga użycia pamięci podręcznej nazw (tylko w procesie
+ *              biblioteki, nie w procesie potomnym)
  *
  * \return 0 jeśli się powiodło, -1 w przypadku błędu
  */
-static int gg_resolver_run(int fd, const char *hostname, int pthread)
+static int gg_resolver_run(int fd, const char *hostname, int pthread, int cache)
 {
 	struct in_addr addr_ip[2], *addr_list = NULL;
 	unsigned int addr_count;
-	int res;
+	int res, found;
 #ifdef GG_CONFIG_HAVE_PTHREAD
 	int old_state;
 #endif
@@ -296,7 +814,14 @@ static int gg_resolver_run(int fd, const char *hostname, int pthread)
 	res = 0;
 
 	if ((addr_ip[0].s_addr = inet_addr(hostname)) == INADDR_NONE) {
-		if (gg_gethostbyname_real(hostname, &addr_list, &addr_count, pthread) == -1) {
+#ifdef GG_CONFIG_HAVE_PTHREAD
+		if (cache)
+			found = gg_resolver_cache_resolve(hostname, &addr_list, &addr_count, pthread);
+		else
+#endif
+			found = gg_gethostbyname_real(hostname, &addr_list, &addr_count, pthread);
+
+		if (found == -1) {
 #ifdef GG_CONFIG_HAVE_PTHREAD
 			if (pthread)
 				pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
@@ -404,6 +929,9 @@ static int gg_resolver_fork_start(int *fd, void **priv_data, const char *hostnam
 		return -1;
 	}
 
+	if (gg_resolver_cache_start(fd, priv_data, hostname))
+		return 0;
+
 	data = malloc(sizeof(struct gg_resolver_fork_data));
 
 	if (data == NULL) {
@@ -431,7 +959,7 @@ static int gg_resolver_fork_start(int *fd, void **priv_data, const char *hostnam
 
 		close(pipes[0]);
 
-		status = (gg_resolver_run(pipes[1], hostname, 0) == -1) ? 1 : 0;
+		status = (gg_resolver_run(pipes[1], hostname, 0, 0) == -1) ? 1 : 0;
 
 #ifdef HAVE__EXIT
 		_exit(status);
@@ -569,7 +1097,7 @@ static void *gg_resolver_pthread_thread(void *arg)
 	/* Powiadom wątek główny, że już odebraliśmy parametry. */
 	pthread_barrier_wait(params->init_barrier);
 
-	res = gg_resolver_run(params->wfd, params->hostname, 1);
+	res = gg_resolver_run(params->wfd, params->hostname, 1, 1);
 
 	pthread_cleanup_pop(1);
 
@@ -606,6 +1134,9 @@ static int gg_resolver_pthread_start(int *fd, void **priv_data, const char *host
 		return -1;
 	}
 
+	if (gg_resolver_cache_start(fd, priv_data, hostname))
+		return 0;
+
 	data = malloc(sizeof(struct gg_resolver_pthread_data));
 	if (data == NULL) {
 		gg_debug(GG_DEBUG_MISC, "// gg_resolver_pthread_start() "
@@ -708,7 +1239,7 @@ static DWORD WINAPI gg_resolver_win32_thread(void *arg)
 	struct gg_resolver_win32_data *data = arg;
 	int result, is_orphan;
 
-	result = gg_resolver_run(data->wfd, data->hostname, 0);
+	result = gg_resolver_run(data->wfd, data->hostname, 0, 1);
 
 	EnterCriticalSection(&data->mutex);
 	is_orphan = data->orphan;
@@ -755,6 +1286,9 @@ static int gg_resolver_win32_start(int *fd, void **priv_data, const char *hostna
 		return -1;
 	}
 
+	if (gg_resolver_cache_start(fd, priv_data, hostname))
+		return 0;
+
 	data = malloc(sizeof(struct gg_resolver_win32_data));
 
 	if (data == NULL) {
@@ -1172,6 +1706,96 @@ int gg_global_set_custom_resolver(
 	return 0;
 }
 
+/**
+ * Włącza pamięć podręczną nazw wspólną dla wszystkich sesji i połączeń HTTP.
+ *
+ * Wyniki rozwiązywania nazw są pamiętane przez \c ttl sekund, a wyniki
+ * negatywne przez \c negative_ttl sekund. Jednoczesne prośby o tę samą nazwę
+ * czekają na wynik jednego zapytania. Jeśli serwer nazw nie odpowiada,
+ * poprzedni wynik jest używany jeszcze przez \c max_stale sekund po utracie
+ * ważności. Pamięć podręczna nie obejmuje własnych sposobów rozwiązywania
+ * nazw, a wyniki procesów potomnych (\c GG_RESOLVER_FORK) nie są do niej
+ * zapisywane.
+ *
+ * \param ttl Czas ważności wyniku w sekundach lub 0, żeby wyłączyć pamięć
+ *            podręczną
+ * \param negative_ttl Czas ważności wyniku negatywnego w sekundach
+ * \param max_stale Czas używania nieaktualnego wyniku w sekundach
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ *
+ * \note Funkcja jest dostępna tylko, jeśli biblioteka została skompilowana
+ * z obsługą wątków pthread. W przeciwnym wypadku zwraca błąd \c ENOSYS.
+ */
+int gg_global_set_resolver_cache(int ttl, int negative_ttl, int max_stale)
+{
+	if (ttl < 0 || negative_ttl < 0 || max_stale < 0 ||
+		ttl > INT_MAX / 1000 - max_stale)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+#ifdef GG_CONFIG_HAVE_PTHREAD
+	pthread_mutex_lock(&gg_resolver_cache_mutex);
+
+	gg_resolver_cache.ttl = ttl;
+	gg_resolver_cache.negative_ttl = negative_ttl;
+	gg_resolver_cache.max_stale = max_stale;
+
+	if (ttl == 0)
+		gg_resolver_cache_flush();
+
+	pthread_mutex_unlock(&gg_resolver_cache_mutex);
+
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/**
+ * Usuwa wszystkie wyniki z pamięci podręcznej nazw.
+ *
+ * Przydaje się po zmianie sieci, gdy poprzednie wyniki mogą być
+ * nieaktualne.
+ */
+void gg_global_flush_resolver_cache(void)
+{
+#ifdef GG_CONFIG_HAVE_PTHREAD
+	pthread_mutex_lock(&gg_resolver_cache_mutex);
+	gg_resolver_cache_flush();
+	pthread_mutex_unlock(&gg_resolver_cache_mutex);
+#endif
+}
+
+/**
+ * Zwraca statystyki pamięci podręcznej nazw.
+ *
+ * \param stats Struktura statystyk
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+int gg_global_get_resolver_cache_stats(struct gg_resolver_cache_stats *stats)
+{
+	if (stats == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+#ifdef GG_CONFIG_HAVE_PTHREAD
+	pthread_mutex_lock(&gg_resolver_cache_mutex);
+	*stats = gg_resolver_cache.stats;
+	stats->entries = gg_resolver_cache.count;
+	pthread_mutex_unlock(&gg_resolver_cache_mutex);
+#else
+	memset(stats, 0, sizeof(struct gg_resolver_cache_stats));
+#endif
+
+	return 0;
+}
+
 /**
  * Odczytuje dane z procesu/wątku rozwiązywania nazw.
  *
@@ -0,0 +1,374 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/**
+ * \file roster.c
+ *
+ * \brief Lista statusów kontaktów prowadzona przez bibliotekę
+ *
+ * Kontakty są przechowywane w tablicy z adresowaniem otwartym i liniowym
+ * próbkowaniem, więc wyszukanie kontaktu zajmuje średnio stały czas.
+ * Usunięcie kontaktu przesuwa kolejne wpisy z tego samego ciągu, dzięki
+ * czemu tablica nie zawiera znaczników usuniętych pozycji.
+ */
+
+#include "internal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \internal Początkowa liczba pozycji tablicy.
+ */
+#define GG_ROSTER_INITIAL_SIZE 64
+
+/**
+ * \internal Wyznacza pozycję kontaktu w tablicy.
+ *
+ * \param roster Lista kontaktów
+ * \param uin    Numer kontaktu
+ *
+ * \return Pozycja, od której należy zacząć szukanie
+ */
+static inline unsigned int gg_roster_slot(const gg_roster_t *roster, uin_t uin)
+{
+	uint32_t hash = uin * (uint32_t) 2654435761U;
+
+	return (hash ^ (hash >> 16)) & (roster->size - 1);
+}
+
+/**
+ * \internal Szuka kontaktu w tablicy.
+ *
+ * \param roster Lista kontaktów
+ * \param uin    Numer kontaktu
+ *
+ * \return Wpis kontaktu lub \c NULL, jeśli go nie ma
+ */
+static struct gg_roster_contact *gg_roster_lookup(const gg_roster_t *roster,
+	uin_t uin)
+{
+	unsigned int mask, i;
+
+	if (roster->entries == NULL || uin == 0)
+		return NULL;
+
+	mask = roster->size - 1;
+
+	for (i = gg_roster_slot(roster, uin); roster->entries[i].uin != 0; i = (i + 1) & mask) {
+		if (roster->entries[i].uin == uin)
+			return &roster->entries[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * \internal Zwraca wolną pozycję dla kontaktu, którego nie ma w tablicy.
+ *
+ * \param roster Lista kontaktów
+ * \param uin    Numer kontaktu
+ *
+ * \return Wolna pozycja
+ */
+static struct gg_roster_contact *gg_roster_empty_slot(const gg_roster_t *roster,
+	uin_t uin)
+{
+	unsigned int mask, i;
+
+	mask = roster->size - 1;
+
+	for (i = gg_roster_slot(roster, uin); roster->entries[i].uin != 0; i = (i + 1) & mask);
+
+	return &roster->entries[i];
+}
+
+/**
+ * \internal Powiększa tablicę dwukrotnie.
+ *
+ * \param roster Lista kontaktów
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_roster_grow(gg_roster_t *roster)
+{
+	gg_roster_t tmp;
+	unsigned int i;
+
+	tmp.size = (roster->size != 0) ? roster->size * 2 : GG_ROSTER_INITIAL_SIZE;
+	tmp.count = roster->count;
+
+	if (tmp.size < roster->size) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	tmp.entries = calloc(tmp.size, sizeof(struct gg_roster_contact));
+
+	if (tmp.entries == NULL)
+		return -1;
+
+	for (i = 0; i < roster->size; i++) {
+		if (roster->entries[i].uin != 0)
+			*gg_roster_empty_slot(&tmp, roster->entries[i].uin) = roster->entries[i];
+	}
+
+	free(roster->entries);
+	*roster = tmp;
+
+	return 0;
+}
+
+/**
+ * \internal Porównuje opisy statusu.
+ */
+static int gg_roster_descr_equal(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+		return (a == b);
+
+	return (strcmp(a, b) == 0);
+}
+
+/**
+ * \internal Dopisuje zmianę kontaktu do zdarzenia \c GG_EVENT_ROSTER_CHANGE.
+ *
+ * Tablica zmian jest powiększana dwukrotnie, gdy liczba elementów osiąga
+ * potęgę dwójki, więc nie trzeba przechowywać jej pojemności.
+ *
+ * \param ge      Struktura zdarzenia
+ * \param uin     Numer kontaktu
+ * \param changed Zmienione pola
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+static int gg_roster_event_append(struct gg_event *ge, uin_t uin, int changed)
+{
+	struct gg_event_roster_change *rc = &ge->event.roster_change;
+
+	if (ge->type != GG_EVENT_ROSTER_CHANGE) {
+		ge->type = GG_EVENT_ROSTER_CHANGE;
+		rc->count = 0;
+		rc->changes = NULL;
+	}
+
+	if ((rc->count & (rc->count - 1)) == 0) {
+		struct gg_roster_change *tmp;
+		unsigned int size;
+
+		size = (rc->count != 0) ? rc->count * 2 : 1;
+
+		tmp = realloc(rc->changes, size * sizeof(struct gg_roster_change));
+
+		if (tmp == NULL)
+			return -1;
+
+		rc->changes = tmp;
+	}
+
+	rc->changes[rc->count].uin = uin;
+	rc->changes[rc->count].changed = changed;
+	rc->count++;
+
+	return 0;
+}
+
+/**
+ * \internal Aktualizuje stan kontaktu na podstawie odebranego pakietu.
+ *
+ * Jeśli stan kontaktu się zmienił, zmiana jest dopisywana do zdarzenia
+ * \c GG_EVENT_ROSTER_CHANGE. W przeciwnym wypadku zdarzenie pozostaje
+ * bez zmian.
+ *
+ * \param gs      Struktura sesji
+ * \param ge      Struktura zdarzenia
+ * \param contact Nowy stan kontaktu. Opis przechodzi na własność listy
+ *                i pole \c descr jest zerowane.
+ *
+ * \return 0 jeśli się powiodło, -1 w przypadku błędu
+ */
+int gg_roster_update(struct gg_session *gs, struct gg_event *ge,
+	struct gg_roster_contact *contact)
+{
+	gg_roster_t *roster = &gs->private_data->roster;
+	struct gg_roster_contact *entry;
+	int changed = 0;
+
+	if (contact->uin == 0) {
+		free(contact->descr);
+		contact->descr = NULL;
+		return 0;
+	}
+
+	entry = gg_roster_lookup(roster, contact->uin);
+
+	if (entry == NULL) {
+		if ((roster->count + 1) * 4 > roster->size * 3 &&
+			gg_roster_grow(roster) == -1)
+		{
+			gg_debug_session(gs, GG_DEBUG_MISC | GG_DEBUG_ERROR,
+				"// gg_roster_update() out of memory\n");
+			free(contact->descr);
+			contact->descr = NULL;
+			return -1;
+		}
+
+		entry = gg_roster_empty_slot(roster, contact->uin);
+		*entry = *contact;
+		roster->count++;
+
+		changed = GG_ROSTER_CHANGED_NEW;
+	} else {
+		if (entry->status != contact->status) {
+			entry->status = contact->status;
+			changed |= GG_ROSTER_CHANGED_STATUS;
+		}
+
+		if (!gg_roster_descr_equal(entry->descr, contact->descr)) {
+			free(entry->descr);
+			entry->descr = contact->descr;
+			changed |= GG_ROSTER_CHANGED_DESCR;
+		} else
+			free(contact->descr);
+
+		if (entry->image_size != contact->image_size) {
+			entry->image_size = contact->image_size;
+			changed |= GG_ROSTER_CHANGED_IMAGE_SIZE;
+		}
+
+		if (entry->flags != contact->flags) {
+			entry->flags = contact->flags;
+			changed |= GG_ROSTER_CHANGED_FLAGS;
+		}
+
+		if (entry->remote_ip != contact->remote_ip ||
+			entry->remote_port != contact->remote_port)
+		{
+			entry->remote_ip = contact->remote_ip;
+			entry->remote_port = contact->remote_port;
+			changed |= GG_ROSTER_CHANGED_ADDRESS;
+		}
+	}
+
+	contact->descr = NULL;
+
+	if (changed == 0)
+		return 0;
+
+	if (gg_roster_event_append(ge, contact->uin, changed) == -1) {
+		gg_debug_session(gs, GG_DEBUG_MISC | GG_DEBUG_ERROR,
+			"// gg_roster_update() out of memory\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * \internal Usuwa kontakt z listy.
+ *
+ * \param gs  Struktura sesji
+ * \param uin Numer kontaktu
+ */
+void gg_roster_remove(struct gg_session *gs, uin_t uin)
+{
+	gg_roster_t *roster = &gs->private_data->roster;
+	struct gg_roster_contact *entry;
+	unsigned int mask, i, j;
+
+	entry = gg_roster_lookup(roster, uin);
+
+	if (entry == NULL)
+		return;
+
+	free(entry->descr);
+
+	mask = roster->size - 1;
+	i = entry - roster->entries;
+
+	/* Przesuwa na zwolnioną pozycję kolejne wpisy z ciągu, których
+	 * pozycja początkowa nie leży między nią a ich obecną pozycją. */
+	for (j = (i + 1) & mask; roster->entries[j].uin != 0; j = (j + 1) & mask) {
+		unsigned int k = gg_roster_slot(roster, roster->entries[j].uin);
+
+		if ((i < j) ? (k <= i || k > j) : (k <= i && k > j)) {
+			roster->entries[i] = roster->entries[j];
+			i = j;
+		}
+	}
+
+	memset(&roster->entries[i], 0, sizeof(struct gg_roster_contact));
+	roster->count--;
+}
+
+/**
+ * \internal Zwalnia listę kontaktów.
+ *
+ * \param gs Struktura sesji
+ */
+void gg_roster_free(struct gg_session *gs)
+{
+	gg_roster_t *roster = &gs->private_data->roster;
+	unsigned int i;
+
+	for (i = 0; i < roster->size; i++)
+		free(roster->entries[i].descr);
+
+	free(roster->entries);
+
+	memset(roster, 0, sizeof(gg_roster_t));
+}
+
+/**
+ * Zwraca stan kontaktu z listy prowadzonej przez bibliotekę.
+ *
+ * Lista jest prowadzona, jeśli przy połączeniu ustawiono pole \c roster
+ * struktury \c gg_login_params. Zwrócona struktura jest ważna do
+ * następnego wywołania \c gg_watch_fd(), \c gg_remove_notify_ex()
+ * lub \c gg_free_session() dla tej sesji i nie należy jej modyfikować.
+ *
+ * \param sess Struktura sesji
+ * \param uin  Numer kontaktu
+ *
+ * \return Stan kontaktu lub \c NULL w przypadku błędu lub braku informacji
+ *         o kontakcie (\c errno równe \c ENOENT)
+ *
+ * \ingroup contacts
+ */
+const struct gg_roster_contact *gg_roster_find(struct gg_session *sess, uin_t uin)
+{
+	struct gg_roster_contact *entry;
+
+	if (sess == NULL || sess->private_data == NULL) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if (!sess->private_data->roster_enabled) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	entry = gg_roster_lookup(&sess->private_data->roster, uin);
+
+	if (entry == NULL)
+		errno = ENOENT;
+
+	return entry;
+}
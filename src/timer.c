@@ -0,0 +1,399 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/**
+ * \file timer.c
+ *
+ * \brief Hierarchiczne koło liczników czasu
+ *
+ * Liczniki wygasające w ciągu najbliższych \c GG_TIMER_SLOTS milisekund
+ * trafiają na najniższy poziom koła, na pozycję odpowiadającą dokładnemu
+ * czasowi upływu. Dalsze liczniki trafiają na wyższe poziomy, których
+ * pozycje obejmują coraz dłuższe przedziały czasu. Gdy najniższy poziom
+ * wykona pełny obrót, liczniki z bieżącej pozycji wyższego poziomu są
+ * rozdzielane na niższe poziomy.
+ */
+
+#include "internal.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "timer.h"
+
+/**
+ * \internal Maska pozycji na poziomie koła.
+ */
+#define GG_TIMER_MASK (GG_TIMER_SLOTS - 1)
+
+/**
+ * \internal Zakres czasu obejmowany przez całe koło.
+ */
+#define GG_TIMER_RANGE ((uint64_t) 1 << (GG_TIMER_BITS * GG_TIMER_LEVELS))
+
+/**
+ * \internal Zwraca numer najmłodszego ustawionego bitu.
+ *
+ * \param x Niezerowa liczba
+ *
+ * \return Numer bitu
+ */
+static inline unsigned int gg_timer_ctz(uint64_t x)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(x);
+#else
+	unsigned int res = 0;
+
+	while ((x & 1) == 0) {
+		x >>= 1;
+		res++;
+	}
+
+	return res;
+#endif
+}
+
+/**
+ * \internal Zwraca bieżący czas monotoniczny w milisekundach.
+ *
+ * \return Czas w milisekundach
+ */
+uint64_t gg_timer_clock(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	memset(&ts, 0, sizeof(ts));
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+	return (uint64_t) time(NULL) * 1000;
+#endif
+}
+
+/**
+ * \internal Inicjalizuje koło liczników.
+ *
+ * \param wheel Koło liczników
+ * \param now Bieżący czas w milisekundach
+ */
+void gg_timer_wheel_init(gg_timer_wheel_t *wheel, uint64_t now)
+{
+	int level, slot;
+
+	memset(wheel, 0, sizeof(gg_timer_wheel_t));
+
+	wheel->now = now;
+
+	for (level = 0; level < GG_TIMER_LEVELS; level++) {
+		for (slot = 0; slot < GG_TIMER_SLOTS; slot++) {
+			gg_timer_t *head = &wheel->slots[level][slot];
+
+			head->next = head;
+			head->prev = head;
+			head->level = -1;
+		}
+	}
+}
+
+/**
+ * \internal Inicjalizuje licznik.
+ *
+ * \param timer Licznik
+ * \param handler Funkcja obsługi
+ * \param data Dane funkcji obsługi
+ */
+void gg_timer_init(gg_timer_t *timer, gg_timer_handler_t handler, void *data)
+{
+	memset(timer, 0, sizeof(gg_timer_t));
+
+	timer->level = -1;
+	timer->handler = handler;
+	timer->data = data;
+}
+
+/**
+ * \internal Umieszcza licznik na właściwej pozycji koła.
+ *
+ * \param wheel Koło liczników
+ * \param timer Licznik
+ */
+static void gg_timer_insert(gg_timer_wheel_t *wheel, gg_timer_t *timer)
+{
+	uint64_t expires, delta;
+	gg_timer_t *head;
+	int level;
+
+	expires = timer->expires;
+
+	if (expires < wheel->now)
+		expires = wheel->now;
+
+	delta = expires - wheel->now;
+
+	/* Licznik wykraczający poza koło trafia na najwyższy poziom
+	 * i zostanie przeniesiony przy kolejnym obrocie. */
+	if (delta >= GG_TIMER_RANGE) {
+		delta = GG_TIMER_RANGE - 1;
+		expires = wheel->now + delta;
+	}
+
+	for (level = 0; level < GG_TIMER_LEVELS - 1; level++) {
+		if (delta < ((uint64_t) 1 << (GG_TIMER_BITS * (level + 1))))
+			break;
+	}
+
+	timer->level = level;
+	timer->slot = (expires >> (GG_TIMER_BITS * level)) & GG_TIMER_MASK;
+
+	head = &wheel->slots[level][timer->slot];
+
+	timer->next = head;
+	timer->prev = head->prev;
+	head->prev->next = timer;
+	head->prev = timer;
+
+	wheel->bitmap[level] |= (uint64_t) 1 << timer->slot;
+}
+
+/**
+ * \internal Usuwa licznik z pozycji koła.
+ *
+ * \param wheel Koło liczników
+ * \param timer Licznik
+ */
+static void gg_timer_unlink(gg_timer_wheel_t *wheel, gg_timer_t *timer)
+{
+	gg_timer_t *head = &wheel->slots[timer->level][timer->slot];
+
+	/* Jeśli licznik czeka na obsługę w gg_timer_run(), nie ma go już
+	 * na pozycji koła, więc sprawdzenie niżej najwyżej wyzeruje bit
+	 * pustej pozycji. */
+
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+
+	if (head->next == head)
+		wheel->bitmap[timer->level] &= ~((uint64_t) 1 << timer->slot);
+
+	timer->next = NULL;
+	timer->prev = NULL;
+	timer->level = -1;
+}
+
+/**
+ * \internal Ustawia licznik. Jeśli licznik był już ustawiony, jest
+ * przestawiany na nowy czas.
+ *
+ * \param wheel Koło liczników
+ * \param timer Licznik
+ * \param expires Czas upływu w milisekundach
+ */
+void gg_timer_arm(gg_timer_wheel_t *wheel, gg_timer_t *timer, uint64_t expires)
+{
+	if (timer->level != -1)
+		gg_timer_unlink(wheel, timer);
+	else
+		wheel->count++;
+
+	timer->expires = expires;
+
+	gg_timer_insert(wheel, timer);
+}
+
+/**
+ * \internal Odwołuje licznik. Odwołanie nieaktywnego licznika nic nie robi.
+ *
+ * \param wheel Koło liczników
+ * \param timer Licznik
+ */
+void gg_timer_cancel(gg_timer_wheel_t *wheel, gg_timer_t *timer)
+{
+	if (timer->level == -1)
+		return;
+
+	gg_timer_unlink(wheel, timer);
+	wheel->count--;
+}
+
+/**
+ * \internal Sprawdza, czy licznik jest ustawiony.
+ *
+ * \param timer Licznik
+ *
+ * \return 1 jeśli licznik jest ustawiony, 0 w przeciwnym wypadku
+ */
+int gg_timer_is_armed(const gg_timer_t *timer)
+{
+	return (timer->level != -1);
+}
+
+/**
+ * \internal Rozdziela liczniki z pozycji wyższego poziomu na niższe poziomy.
+ *
+ * \param wheel Koło liczników
+ * \param level Poziom koła
+ * \param slot Pozycja na poziomie koła
+ */
+static void gg_timer_cascade(gg_timer_wheel_t *wheel, int level, int slot)
+{
+	gg_timer_t *head = &wheel->slots[level][slot];
+	gg_timer_t *timer;
+
+	if (head->next == head)
+		return;
+
+	/* Odłączamy całą listę, bo liczniki najwyższego poziomu mogą
+	 * wrócić na ten sam poziom. */
+
+	timer = head->next;
+	head->prev->next = NULL;
+	head->next = head;
+	head->prev = head;
+	wheel->bitmap[level] &= ~((uint64_t) 1 << slot);
+
+	while (timer != NULL) {
+		gg_timer_t *next = timer->next;
+
+		gg_timer_insert(wheel, timer);
+		timer = next;
+	}
+}
+
+/**
+ * \internal Wyznacza czas najbliższego zdarzenia koła.
+ *
+ * Dla najniższego poziomu jest to dokładny czas upływu licznika, a dla
+ * wyższych czas rozdzielenia najbliższej niepustej pozycji, który nie jest
+ * późniejszy od czasu upływu znajdujących się na niej liczników.
+ *
+ * \param wheel Koło liczników
+ *
+ * \return Czas w milisekundach lub \c GG_TIMER_NEVER
+ */
+uint64_t gg_timer_next(const gg_timer_wheel_t *wheel)
+{
+	uint64_t result = GG_TIMER_NEVER;
+	int level;
+
+	if (wheel->count == 0)
+		return result;
+
+	for (level = 0; level < GG_TIMER_LEVELS; level++) {
+		unsigned int shift = GG_TIMER_BITS * level;
+		uint64_t bitmap = wheel->bitmap[level];
+		uint64_t base, when;
+		unsigned int index;
+
+		if (bitmap == 0)
+			continue;
+
+		/* Najbliższa pozycja tego poziomu, która nie została
+		 * jeszcze obsłużona. */
+		base = (wheel->now + ((uint64_t) 1 << shift) - 1) >> shift;
+		index = base & GG_TIMER_MASK;
+
+		if (index != 0)
+			bitmap = (bitmap >> index) | (bitmap << (GG_TIMER_SLOTS - index));
+
+		when = (base + gg_timer_ctz(bitmap)) << shift;
+
+		if (when < result)
+			result = when;
+	}
+
+	return result;
+}
+
+/**
+ * \internal Obsługuje liczniki, których czas upłynął.
+ *
+ * Funkcje obsługi mogą ustawiać i odwoływać dowolne liczniki. Licznik
+ * ustawiony na czas, który już minął, zostanie obsłużony w kolejnej
+ * milisekundzie.
+ *
+ * \param wheel Koło liczników
+ * \param now Bieżący czas w milisekundach
+ */
+void gg_timer_run(gg_timer_wheel_t *wheel, uint64_t now)
+{
+	while (wheel->now <= now) {
+		gg_timer_t pending, *head;
+		uint64_t next;
+		int index;
+
+		/* Puste pozycje są pomijane, więc po dłuższej przerwie
+		 * nie trzeba obracać kołem milisekunda po milisekundzie. */
+
+		next = gg_timer_next(wheel);
+
+		if (next > now) {
+			wheel->now = now + 1;
+			break;
+		}
+
+		if (next > wheel->now)
+			wheel->now = next;
+
+		index = wheel->now & GG_TIMER_MASK;
+
+		if (index == 0) {
+			int level;
+
+			for (level = 1; level < GG_TIMER_LEVELS; level++) {
+				int slot = (wheel->now >> (GG_TIMER_BITS * level)) & GG_TIMER_MASK;
+
+				gg_timer_cascade(wheel, level, slot);
+
+				if (slot != 0)
+					break;
+			}
+		}
+
+		wheel->now++;
+
+		head = &wheel->slots[0][index];
+
+		if (head->next == head)
+			continue;
+
+		/* Liczniki są przenoszone na osobną listę, bo licznik
+		 * ustawiony przez funkcję obsługi za GG_TIMER_SLOTS - 1
+		 * milisekund trafiłby na obsługiwaną właśnie pozycję.
+		 * Odwołanie licznika z tej listy nadal jest możliwe. */
+
+		pending.next = head->next;
+		pending.prev = head->prev;
+		pending.next->prev = &pending;
+		pending.prev->next = &pending;
+		head->next = head;
+		head->prev = head;
+		wheel->bitmap[0] &= ~((uint64_t) 1 << index);
+
+		while (pending.next != &pending) {
+			gg_timer_t *timer = pending.next;
+
+			gg_timer_unlink(wheel, timer);
+			wheel->count--;
+
+			timer->handler(timer, timer->data);
+		}
+	}
+}
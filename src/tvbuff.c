@@ -540,6 +540,179 @@ uin_t gg_tvbuff_read_uin(gg_tvbuff_t *tvb)
 	return uin;
 }
 
+/**
+ * \internal Zamienia kolejność bajtów w 32-bitowym słowie na maszynach
+ * big-endianowych. W przeciwieństwie do gg_fix32() jest rozwijana w miejscu
+ * wywołania, więc pętle po tablicach mogą zostać zwektoryzowane.
+ */
+#ifndef GG_CONFIG_BIGENDIAN
+#  define GG_TVBUFF_FIX32(x) (x)
+#else
+#  define GG_TVBUFF_FIX32(x) ((uint32_t) \
+	((((x) & (uint32_t) 0x000000ffU) << 24) | \
+	(((x) & (uint32_t) 0x0000ff00U) << 8) | \
+	(((x) & (uint32_t) 0x00ff0000U) >> 8) | \
+	(((x) & (uint32_t) 0xff000000U) >> 24)))
+#endif
+
+/**
+ * \internal Sprawdza, czy w buforze pozostała tablica o podanej liczbie
+ * elementów. Jeżeli nie została - oznacza bufor jako nieprawidłowy.
+ *
+ * \param tvb   Bufor
+ * \param count Liczba elementów
+ * \param size  Rozmiar elementu
+ *
+ * \return Wartość różna od 0, jeżeli można odczytać całą tablicę.
+ */
+static int gg_tvbuff_have_array(gg_tvbuff_t *tvb, size_t count, size_t size)
+{
+	if (!gg_tvbuff_is_valid(tvb))
+		return 0;
+
+	if (size != 0 && count > (size_t) -1 / size) {
+		gg_debug(GG_DEBUG_WARNING, "// gg_tvbuff_have_array() "
+			"array too big (%" GG_SIZE_FMT " * %" GG_SIZE_FMT ")\n",
+			count, size);
+		tvb->valid = 0;
+		return 0;
+	}
+
+	return gg_tvbuff_have_remaining(tvb, count * size);
+}
+
+/**
+ * \internal Odczytuje z bufora tablicę liczb 32-bitowych.
+ *
+ * Zakres bufora jest sprawdzany jednokrotnie dla całej tablicy.
+ *
+ * \param tvb   Bufor
+ * \param dst   Tablica docelowa
+ * \param count Liczba elementów
+ */
+void gg_tvbuff_read_uint32_array(gg_tvbuff_t *tvb, uint32_t *dst, size_t count)
+{
+#ifdef GG_CONFIG_BIGENDIAN
+	size_t i;
+#endif
+
+	if (!gg_tvbuff_is_valid(tvb))
+		return;
+
+	if (!gg_tvbuff_have_array(tvb, count, 4)) {
+		gg_debug(GG_DEBUG_WARNING, "// gg_tvbuff_read_uint32_array() "
+			"failed at %" GG_SIZE_FMT ":%" GG_SIZE_FMT "\n",
+			tvb->offset, count);
+		return;
+	}
+
+	if (count == 0)
+		return;
+
+	memcpy(dst, tvb->buffer + tvb->offset, count * 4);
+	tvb->offset += count * 4;
+
+#ifdef GG_CONFIG_BIGENDIAN
+	for (i = 0; i < count; i++)
+		dst[i] = GG_TVBUFF_FIX32(dst[i]);
+#endif
+}
+
+/**
+ * \internal Odczytuje z bufora tablicę rekordów o stałym rozmiarze,
+ * zapisując liczbę 32-bitową z początku każdego z nich.
+ *
+ * Zakres bufora jest sprawdzany jednokrotnie dla całej tablicy, a pozostałe
+ * pola rekordów są pomijane.
+ *
+ * \param tvb    Bufor
+ * \param dst    Tablica docelowa
+ * \param count  Liczba rekordów
+ * \param stride Rozmiar rekordu (co najmniej 4 bajty)
+ */
+void gg_tvbuff_read_uint32_strided(gg_tvbuff_t *tvb, uint32_t *dst,
+	size_t count, size_t stride)
+{
+	const char *src;
+	size_t i;
+
+	if (!gg_tvbuff_is_valid(tvb))
+		return;
+
+	if (stride < 4) {
+		gg_debug(GG_DEBUG_ERROR, "// gg_tvbuff_read_uint32_strided() "
+			"invalid arguments\n");
+		tvb->valid = 0;
+		return;
+	}
+
+	if (!gg_tvbuff_have_array(tvb, count, stride)) {
+		gg_debug(GG_DEBUG_WARNING, "// gg_tvbuff_read_uint32_strided() "
+			"failed at %" GG_SIZE_FMT ":%" GG_SIZE_FMT "\n",
+			tvb->offset, count);
+		return;
+	}
+
+	src = tvb->buffer + tvb->offset;
+
+	for (i = 0; i < count; i++) {
+		uint32_t val;
+
+		memcpy(&val, src + i * stride, 4);
+		dst[i] = GG_TVBUFF_FIX32(val);
+	}
+
+	tvb->offset += count * stride;
+}
+
+/**
+ * \internal Odczytuje z bufora tablicę identyfikatorów użytkowników,
+ * zapisanych tak jak dla gg_tvbuff_read_uin().
+ *
+ * Typowe identyfikatory (krótkie, złożone z samych cyfr) są dekodowane
+ * bezpośrednio z bufora, a pozostałe przez gg_tvbuff_read_uin().
+ *
+ * \param tvb   Bufor
+ * \param dst   Tablica docelowa
+ * \param count Liczba identyfikatorów
+ */
+void gg_tvbuff_read_uin_array(gg_tvbuff_t *tvb, uin_t *dst, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count && gg_tvbuff_is_valid(tvb); i++) {
+		const unsigned char *p;
+		uint8_t uin_len;
+		uint64_t uin = 0;
+		int j;
+
+		p = (const unsigned char*) tvb->buffer + tvb->offset;
+
+		/* długość całości, typ i długość numeru */
+		if (tvb->length - tvb->offset < 3 || p[1] != 0 ||
+			p[2] == 0 || p[2] > 10 || p[0] != p[2] + 2 ||
+			tvb->length - tvb->offset < 3 + (size_t) p[2])
+		{
+			dst[i] = gg_tvbuff_read_uin(tvb);
+			continue;
+		}
+
+		uin_len = p[2];
+		p += 3;
+
+		for (j = 0; j < uin_len && p[j] >= '0' && p[j] <= '9'; j++)
+			uin = uin * 10 + (p[j] - '0');
+
+		if (j != uin_len || uin == 0 || uin > 0xffffffffU) {
+			dst[i] = gg_tvbuff_read_uin(tvb);
+			continue;
+		}
+
+		dst[i] = uin;
+		tvb->offset += 3 + uin_len;
+	}
+}
+
 /**
  * \internal Odczytuje z bufora liczbę 8-bitową i porównuje z podaną. Jeżeli te
  * się różnią, zostaje wygenerowane ostrzeżenie.
@@ -33,6 +33,12 @@
 
 #include <errno.h>
 
+/** \internal Miejsce na nagłówek pakietu przed treścią bufora */
+#define GG_TVBUILDER_HEADROOM sizeof(struct gg_header)
+
+/** \internal Maksymalna liczba zwolnionych buforów zachowanych w sesji */
+#define GG_TVBUILDER_POOL_SIZE 4
+
 struct gg_tvbuilder
 {
 	char *buffer;
@@ -40,8 +46,14 @@ struct gg_tvbuilder
 	size_t alloc_length;
 	int valid;
 
+	/* Fragment kolejki danych do wysłania, w którym budowany jest pakiet.
+	 * Bufor zaczyna się za miejscem na nagłówek. */
+	gg_send_chunk_t *chunk;
+
 	struct gg_session *gs;
 	struct gg_event *ge;
+
+	gg_tvbuilder_t *next;
 };
 
 static char *gg_tvbuilder_extend(gg_tvbuilder_t *tvb, size_t length);
@@ -49,6 +61,8 @@ static char *gg_tvbuilder_extend(gg_tvbuilder_t *tvb, size_t length);
 /**
  * \internal Tworzy nową instancję bufora.
  *
+ * Struktura bufora jest w miarę możliwości brana z puli sesji.
+ *
  * \param gs Struktura sesji
  * \param ge Struktura zdarzenia
  *
@@ -59,9 +73,15 @@ gg_tvbuilder_t *gg_tvbuilder_new(struct gg_session *gs, struct gg_event *ge)
 {
 	gg_tvbuilder_t *tvb;
 
-	tvb = malloc(sizeof(gg_tvbuilder_t));
-	if (tvb == NULL)
-		return NULL;
+	if (gs != NULL && gs->private_data->tvbuilder_pool != NULL) {
+		tvb = gs->private_data->tvbuilder_pool;
+		gs->private_data->tvbuilder_pool = tvb->next;
+		gs->private_data->tvbuilder_pool_count--;
+	} else {
+		tvb = malloc(sizeof(gg_tvbuilder_t));
+		if (tvb == NULL)
+			return NULL;
+	}
 	memset(tvb, 0, sizeof(gg_tvbuilder_t));
 
 	if (gs == NULL) {
@@ -85,17 +105,59 @@ gg_tvbuilder_t *gg_tvbuilder_new(struct gg_session *gs, struct gg_event *ge)
 /**
  * \internal Zwalnia bufor.
  *
+ * Struktura bufora wraca do puli sesji, a pamięć na dane do puli
+ * fragmentów kolejki danych do wysłania.
+ *
  * \param tvb Bufor
  */
 void gg_tvbuilder_free(gg_tvbuilder_t *tvb)
 {
+	struct gg_session_private *p;
+
 	if (tvb == NULL)
 		return;
 
-	free(tvb->buffer);
+	/* Bufor bez sesji nigdy nie przydzielił pamięci na dane */
+	if (tvb->gs == NULL) {
+		free(tvb);
+		return;
+	}
+
+	p = tvb->gs->private_data;
+
+	gg_send_chunk_free(tvb->gs, tvb->chunk);
+	tvb->chunk = NULL;
+	tvb->buffer = NULL;
+
+	if (p->tvbuilder_pool_count < GG_TVBUILDER_POOL_SIZE) {
+		tvb->next = p->tvbuilder_pool;
+		p->tvbuilder_pool = tvb;
+		p->tvbuilder_pool_count++;
+		return;
+	}
+
 	free(tvb);
 }
 
+/**
+ * \internal Zwalnia pulę buforów sesji.
+ *
+ * \param gs Struktura sesji
+ */
+void gg_tvbuilder_pool_free(struct gg_session *gs)
+{
+	struct gg_session_private *p = gs->private_data;
+
+	while (p->tvbuilder_pool != NULL) {
+		gg_tvbuilder_t *next = p->tvbuilder_pool->next;
+
+		free(p->tvbuilder_pool);
+		p->tvbuilder_pool = next;
+	}
+
+	p->tvbuilder_pool_count = 0;
+}
+
 /**
  * \internal Zwalnia bufor i generuje błąd połączenia.
  *
@@ -129,6 +191,9 @@ void gg_tvbuilder_fail(gg_tvbuilder_t *tvb, enum gg_failure_t failure)
 /**
  * \internal Próbuje wysłać zawartość bufora i go zwalnia.
  *
+ * Pamięć z zawartością bufora jest dołączana do kolejki danych do wysłania
+ * bez kopiowania, bo przed treścią pakietu zostało miejsce na nagłówek.
+ *
  * \param tvb  Bufor
  * \param type Typ pakietu
  *
@@ -145,14 +210,25 @@ int gg_tvbuilder_send(gg_tvbuilder_t *tvb, int type)
 		return 0;
 	}
 
+	/* Pusty pakiet też potrzebuje miejsca na nagłówek */
+	if (gg_tvbuilder_is_valid(tvb) && tvb->chunk == NULL) {
+		tvb->chunk = gg_send_chunk_new(tvb->gs, GG_TVBUILDER_HEADROOM);
+		if (tvb->chunk == NULL)
+			tvb->valid = 0;
+	}
+
 	if (!gg_tvbuilder_is_valid(tvb)) {
 		gg_debug_session(tvb->gs, GG_DEBUG_ERROR, "// gg_tvbuilder_send() "
 			"invalid buffer\n");
 		ret = -1;
 		failure = GG_FAILURE_INTERNAL;
 	} else {
-		const char *buffer = (tvb->length > 0) ? tvb->buffer : "";
-		ret = gg_send_packet(tvb->gs, type, buffer, tvb->length, NULL);
+		gg_send_chunk_t *chunk = tvb->chunk;
+
+		/* Fragment przechodzi na własność kolejki */
+		tvb->chunk = NULL;
+
+		ret = gg_send_packet_chunk(tvb->gs, type, chunk, tvb->length);
 		if (ret == -1) {
 			failure = GG_FAILURE_WRITING;
 			gg_debug_session(tvb->gs, GG_DEBUG_ERROR,
@@ -213,7 +289,7 @@ size_t gg_tvbuilder_get_size(const gg_tvbuilder_t *tvb)
 void gg_tvbuilder_expected_size(gg_tvbuilder_t *tvb, size_t length)
 {
 	size_t length_new;
-	char *buff_new;
+	gg_send_chunk_t *chunk_new;
 
 	if (!gg_tvbuilder_is_valid(tvb) || length == 0)
 		return;
@@ -230,17 +306,26 @@ void gg_tvbuilder_expected_size(gg_tvbuilder_t *tvb, size_t length)
 			tvb, length, tvb->alloc_length, length_new);
 	}
 
-	buff_new = realloc(tvb->buffer, length_new);
-	if (buff_new != NULL) {
-		tvb->buffer = buff_new;
-		tvb->alloc_length = length_new;
+	if (tvb->chunk == NULL) {
+		chunk_new = gg_send_chunk_new(tvb->gs,
+			GG_TVBUILDER_HEADROOM + length_new);
+	} else {
+		chunk_new = gg_send_chunk_resize(tvb->chunk,
+			GG_TVBUILDER_HEADROOM + length_new);
+	}
+
+	if (chunk_new != NULL) {
+		tvb->chunk = chunk_new;
+		tvb->buffer = chunk_new->buf + GG_TVBUILDER_HEADROOM;
+		tvb->alloc_length = chunk_new->size - GG_TVBUILDER_HEADROOM;
 		return;
 	}
 
 	gg_debug(GG_DEBUG_ERROR, "// gg_tvbuilder_expected_size(%p, %"
 		GG_SIZE_FMT ") out of memory (new length: %" GG_SIZE_FMT
 		")\n", tvb, length, length_new);
-	free(tvb->buffer);
+	gg_send_chunk_free(tvb->gs, tvb->chunk);
+	tvb->chunk = NULL;
 	tvb->buffer = NULL;
 	tvb->length = 0;
 	tvb->alloc_length = 0;
@@ -0,0 +1,188 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test śledzenia wiadomości oczekujących na potwierdzenie. Sesja wysyła
+ * więcej wiadomości, niż biblioteka pamięta, a potem dostaje potwierdzenia
+ * w losowej kolejności. Zapamiętane wiadomości muszą dać zdarzenie
+ * GG_EVENT_ACK110 z czasem doręczenia i, w trybie zgodności, zdarzenie
+ * GG_EVENT_ACK z odbiorcą. Zapomniane i powtórzone potwierdzenia nie
+ * mogą mieć czasu doręczenia.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define MESSAGES (GG_SENT_MESSAGES_MAX + 1000)
+
+static int order[MESSAGES];
+
+static uin_t message_recipient(int seq)
+{
+	return 1000 + seq;
+}
+
+static void send_ack(int fd, int seq)
+{
+	char buf[32];
+	size_t len = 0;
+
+	buf[len++] = 0x08;
+	buf[len++] = 0x01;
+	buf[len++] = 0x10;
+	len += put_varint(buf + len, seq);
+	buf[len++] = 0x1d;
+	memset(buf + len, 0, 4);
+	len += 4;
+	buf[len++] = 0x38;
+	buf[len++] = 0x00;
+
+	send_packet(fd, GG_SEND_MSG_ACK110, buf, len);
+}
+
+static void check_ack(struct gg_session *gs, int fd, int seq, int known,
+	int compat)
+{
+	struct gg_event *ge;
+
+	send_ack(fd, seq);
+
+	ge = watch(gs, GG_EVENT_ACK110);
+
+	if (ge->event.ack110.seq != (uint32_t) seq ||
+		(known && ge->event.ack110.latency < 0) ||
+		(!known && ge->event.ack110.latency != -1))
+	{
+		fprintf(stderr, "Invalid ack for %d (latency %d)\n", seq,
+			ge->event.ack110.latency);
+		exit(1);
+	}
+
+	gg_event_recycle(gs, ge);
+
+	if (!known || !compat)
+		return;
+
+	ge = watch(gs, GG_EVENT_ACK);
+
+	if (ge->event.ack.seq != seq ||
+		ge->event.ack.recipient != message_recipient(seq) ||
+		ge->event.ack.status != GG_ACK_DELIVERED)
+	{
+		fprintf(stderr, "Invalid compat ack for %d\n", seq);
+		exit(1);
+	}
+
+	gg_event_recycle(gs, ge);
+}
+
+static void test_ack(gg_compat_t compatibility)
+{
+	struct gg_session *gs;
+	int compat, fds[2], i;
+
+	gs = session_new(fds);
+	gs->private_data->compatibility = compatibility;
+
+	compat = (compatibility < GG_COMPAT_1_12_0);
+
+	for (i = 1; i <= MESSAGES; i++) {
+		int seq;
+
+		seq = gg_send_message(gs, GG_CLASS_CHAT, message_recipient(i),
+			(const unsigned char *) "test");
+
+		if (seq != i) {
+			fprintf(stderr, "Unexpected seq %d, expected %d\n", seq, i);
+			exit(1);
+		}
+
+		drain(fds[1]);
+	}
+
+	if (gs->private_data->sent_count != GG_SENT_MESSAGES_MAX) {
+		fprintf(stderr, "Retained %u messages\n",
+			gs->private_data->sent_count);
+		exit(1);
+	}
+
+	/* Potwierdzenia w losowej kolejności */
+	for (i = 0; i < MESSAGES; i++)
+		order[i] = i + 1;
+
+	for (i = MESSAGES - 1; i > 0; i--) {
+		int j = rand() % (i + 1);
+		int tmp = order[i];
+
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (i = 0; i < MESSAGES; i++) {
+		int seq = order[i];
+
+		check_ack(gs, fds[1], seq, seq > MESSAGES - GG_SENT_MESSAGES_MAX,
+			compat);
+
+		/* Powtórzone potwierdzenie */
+		if (rand() % 100 == 0)
+			check_ack(gs, fds[1], seq, 0, compat);
+
+		drain(fds[1]);
+	}
+
+	if (gs->private_data->sent_count != 0 ||
+		gs->private_data->sent_oldest != NULL ||
+		gs->private_data->sent_newest != NULL ||
+		gs->private_data->sent_pool_count != GG_SENT_MESSAGES_POOL_SIZE)
+	{
+		fprintf(stderr, "Messages left after all acks\n");
+		exit(1);
+	}
+
+	gg_free_session(gs);
+
+	close(fds[1]);
+}
+
+int main(void)
+{
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	srand(time(NULL));
+
+	test_ack(GG_COMPAT_LEGACY);
+	test_ack(GG_COMPAT_1_12_0);
+
+	printf("okay\n");
+
+	return 0;
+}
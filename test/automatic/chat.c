@@ -0,0 +1,291 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test listy konferencji. Sesja dostaje pakiety GG_CHAT_INFO dla wielu
+ * konferencji, a potem losowe pakiety GG_CHAT_INFO_UPDATE. Pola zdarzeń
+ * GG_EVENT_CHAT_INFO_UPDATE i lista odbiorców wiadomości konferencyjnych
+ * są porównywane z prostym modelem.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define CHATS 1000
+#define UINS 300
+#define ROUNDS 20000
+
+static char model[CHATS][UINS];
+static uin_t participants[UINS * 2];
+
+static uint64_t chat_id(int i)
+{
+	/* Identyfikatory różniące się głównie starszymi bitami */
+	return ((uint64_t) (i + 1) << 40) | 0x1234;
+}
+
+static uin_t participant_uin(int i)
+{
+	return 1000 + i;
+}
+
+static size_t put_uint64(char *buf, uint64_t value)
+{
+	value = gg_fix64(value);
+	memcpy(buf, &value, 8);
+	return 8;
+}
+
+static size_t put_uin(char *buf, uin_t uin)
+{
+	/* Numery uczestników mają zawsze cztery cyfry */
+	buf[0] = 6;
+	buf[1] = 0x00;
+	buf[2] = 4;
+	snprintf(buf + 3, 5, "%u", uin);
+	return 7;
+}
+
+static int model_count(int chat)
+{
+	int i, count = 0;
+
+	for (i = 0; i < UINS; i++)
+		count += model[chat][i];
+
+	return count;
+}
+
+static void send_chat_info(struct gg_session *gs, int fd, int chat)
+{
+	static char buf[UINS * 16 + 64];
+	struct gg_event *ge;
+	size_t len = 0;
+	int count = 0, i;
+
+	for (i = 0; i < UINS; i++) {
+		model[chat][i] = (rand() % 4 == 0);
+
+		if (model[chat][i]) {
+			participants[count++] = participant_uin(i);
+
+			/* Powtórzony uczestnik */
+			if (rand() % 20 == 0)
+				participants[count++] = participant_uin(i);
+		}
+	}
+
+	/* Przemieszanie kolejności */
+	for (i = count - 1; i > 0; i--) {
+		int j = rand() % (i + 1);
+		uin_t tmp = participants[i];
+
+		participants[i] = participants[j];
+		participants[j] = tmp;
+	}
+
+	len += put_uint64(buf + len, chat_id(chat));
+	len += put_uint32(buf + len, 0);
+	len += put_uint32(buf + len, 1);
+	len += put_uint32(buf + len, 0);
+	len += put_uint32(buf + len, count);
+
+	for (i = 0; i < count; i++) {
+		len += put_uint32(buf + len, participants[i]);
+		len += put_uint32(buf + len, 0x1e);
+	}
+
+	send_packet(fd, GG_CHAT_INFO, buf, len);
+
+	ge = watch(gs, GG_EVENT_CHAT_INFO);
+
+	if (ge->event.chat_info.id != chat_id(chat) ||
+		ge->event.chat_info.participants_count != (uint32_t) count ||
+		memcmp(ge->event.chat_info.participants, participants,
+		count * sizeof(uin_t)) != 0)
+	{
+		fprintf(stderr, "Invalid chat info for %d\n", chat);
+		exit(1);
+	}
+
+	gg_event_recycle(gs, ge);
+}
+
+static void send_chat_update(struct gg_session *gs, int fd, int chat,
+	int known, uint32_t update_type, int participant, uint32_t version)
+{
+	char buf[128];
+	struct gg_event *ge;
+	struct gg_event_chat_info_update *u;
+	size_t len = 0;
+	int changed = 0;
+
+	buf[len++] = 0x0a;
+	len += put_uin(buf + len, participant_uin(participant));
+	buf[len++] = 0x12;
+	len += put_uin(buf + len, participant_uin(participant));
+	buf[len++] = 0x1d;
+	len += put_uint32(buf + len, update_type);
+	buf[len++] = 0x25;
+	len += put_uint32(buf + len, 0);
+	buf[len++] = 0x2d;
+	len += put_uint32(buf + len, 0);
+	buf[len++] = 0x30;
+	buf[len++] = version & 0x7f;
+	buf[len++] = 0x38;
+	buf[len++] = 0;
+	buf[len++] = 0x49;
+	len += put_uint64(buf + len, 0);
+	buf[len++] = 0x51;
+	len += put_uint64(buf + len, known ? chat_id(chat) : chat_id(chat) + 1);
+	buf[len++] = 0x59;
+	len += put_uint64(buf + len, 0);
+
+	send_packet(fd, GG_CHAT_INFO_UPDATE, buf, len);
+
+	if (known) {
+		if (update_type == GG_CHAT_INFO_UPDATE_ENTERED) {
+			changed = !model[chat][participant];
+			model[chat][participant] = 1;
+		} else if (update_type == GG_CHAT_INFO_UPDATE_EXITED) {
+			changed = model[chat][participant];
+			model[chat][participant] = 0;
+		}
+	}
+
+	ge = watch(gs, GG_EVENT_CHAT_INFO_UPDATE);
+	u = &ge->event.chat_info_update;
+
+	if (u->type != update_type ||
+		u->participant != participant_uin(participant) ||
+		u->version != (version & 0x7f) ||
+		u->changed != changed ||
+		u->participants_count != (uint32_t) (known ? model_count(chat) : 0))
+	{
+		fprintf(stderr, "Invalid update for %d: changed %d, count %u\n",
+			chat, u->changed, u->participants_count);
+		exit(1);
+	}
+
+	gg_event_recycle(gs, ge);
+}
+
+static void check_recipients(struct gg_session *gs, int fd, int chat)
+{
+	char buf[128];
+	struct gg_event *ge;
+	size_t len = 0;
+	int count = 0, i;
+
+	buf[len++] = 0x0a;
+	len += put_uin(buf + len, participant_uin(0));
+	buf[len++] = 0x10;
+	buf[len++] = 0x08;
+	buf[len++] = 0x18;
+	buf[len++] = 0x01;
+	buf[len++] = 0x25;
+	len += put_uint32(buf + len, 0);
+	buf[len++] = 0x2a;
+	buf[len++] = 2;
+	buf[len++] = 'o';
+	buf[len++] = 'k';
+	buf[len++] = 0x51;
+	len += put_uint64(buf + len, chat_id(chat));
+
+	send_packet(fd, GG_CHAT_RECV_MSG, buf, len);
+
+	ge = watch(gs, GG_EVENT_MSG);
+
+	/* Odbiorcy są posortowani według numerów */
+	for (i = 0; i < UINS; i++) {
+		if (model[chat][i])
+			participants[count++] = participant_uin(i);
+	}
+
+	if (ge->event.msg.recipients_count != count ||
+		memcmp(ge->event.msg.recipients, participants,
+		count * sizeof(uin_t)) != 0)
+	{
+		fprintf(stderr, "Invalid recipients for %d\n", chat);
+		exit(1);
+	}
+
+	gg_event_recycle(gs, ge);
+
+	drain(fd);
+}
+
+int main(void)
+{
+	struct gg_session *gs;
+	int fds[2], i, round;
+
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	srand(time(NULL));
+
+	gs = session_new(fds);
+
+	for (i = 0; i < CHATS; i++)
+		send_chat_info(gs, fds[1], i);
+
+	/* Ponowna informacja o konferencji zastępuje listę uczestników */
+	for (i = 0; i < CHATS; i += 7)
+		send_chat_info(gs, fds[1], i);
+
+	for (i = 0; i < CHATS; i += 10)
+		check_recipients(gs, fds[1], i);
+
+	for (round = 0; round < ROUNDS; round++) {
+		static const uint32_t update_types[] = {
+			GG_CHAT_INFO_UPDATE_ENTERED,
+			GG_CHAT_INFO_UPDATE_EXITED,
+			0x02
+		};
+
+		send_chat_update(gs, fds[1], rand() % CHATS, rand() % 50 != 0,
+			update_types[rand() % 3], rand() % UINS, round);
+
+		if (round % 1000 == 0)
+			check_recipients(gs, fds[1], rand() % CHATS);
+	}
+
+	for (i = 0; i < CHATS; i++)
+		check_recipients(gs, fds[1], i);
+
+	gg_free_session(gs);
+
+	close(fds[1]);
+
+	printf("okay\n");
+
+	return 0;
+}
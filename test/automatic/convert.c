@@ -134,11 +134,29 @@ static const struct test_data utf8_to_cp1250[] =
 
 	TEST("\xef\xbb\xbf", ""),
 	TEST("\xef\xbb\xbftest", "test"),
+
+	TEST("0123456789abcdef0123456789abcdefżółć0123456789abcdef\xc0",
+		"0123456789abcdef0123456789abcdef\xbf\xf3\xb3\xe6" "0123456789abcdef?"),
+	TEST("0123456789abcdef\xc4\x85" "0123456789abcdef\xc4", "0123456789abcdef\xb9" "0123456789abcdef?"),
+	TEST("\xc4" "0123456789abcdef0123456789abcdef", "?0123456789abcdef0123456789abcdef"),
+
+	TEST_SIZE("zażółć", "za\xbf", -1, 3),
+	TEST_SIZE("zażółć", "za", 3, -1),
+	TEST_SIZE("0123456789abcdef0123456789abcdef", "0123456789abcdef0", -1, 17),
 };
 
 static const struct test_data cp1250_to_utf8[] =
 {
 	TEST("za\xbf\xf3\xb3\xe6 g\xea\x9cl\xb9 ja\x9f\xf1", "zażółć gęślą jaźń"),
+
+	TEST("0123456789abcdef0123456789abcdef\xbf\xf3\xb3\xe6" "0123456789abcdef\x80",
+		"0123456789abcdef0123456789abcdefżółć0123456789abcdef€"),
+	TEST("\x99" "0123456789abcdef\x81", "™0123456789abcdef?"),
+
+	TEST_SIZE("za\xbf\xf3", "za", -1, 3),
+	TEST_SIZE("za\xbf\xf3", "zaż", -1, 4),
+	TEST_SIZE("0123456789abcdef0123456789abcdef", "0123456789abcdef0", -1, 17),
+	TEST_SIZE("0123456789abcdef0123456789abcdef", "0123456789abcdef012", 19, -1),
 };
 
 static void test_utf8_to_cp1250(const struct test_data *t)
@@ -0,0 +1,181 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Porównanie wszystkich implementacji CRC32 z prostą pętlą bajtową dla
+ * losowych danych, długości, przesunięć i wartości początkowych, a na koniec
+ * pomiar ich szybkości.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BUF_SIZE 65536
+#define ROUNDS 20000
+#define BENCH_ROUNDS 2000
+
+static uint32_t table[256];
+
+static void reference_init(void)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < 256; i++) {
+		uint32_t crc = i;
+
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xedb88320) : (crc >> 1);
+
+		table[i] = crc;
+	}
+}
+
+static uint32_t reference(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	crc ^= 0xffffffff;
+
+	while (len--)
+		crc = (crc >> 8) ^ table[(crc ^ *buf++) & 0xff];
+
+	return crc ^ 0xffffffff;
+}
+
+static void check(const char *name, uint32_t expected, uint32_t result,
+	size_t ofs, size_t len, uint32_t init)
+{
+	if (expected == result)
+		return;
+
+	fprintf(stderr, "%s mismatch (ofs=%d, len=%d, init=0x%08x): "
+		"expected 0x%08x, got 0x%08x\n", name, (int) ofs, (int) len,
+		init, expected, result);
+	exit(1);
+}
+
+static void bench(const char *name, uint32_t (*func)(uint32_t, const unsigned char *, size_t),
+	const unsigned char *buf)
+{
+	clock_t start, elapsed;
+	uint32_t crc = 0;
+	int i;
+
+	start = clock();
+
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		crc = func(crc, buf, BUF_SIZE);
+
+	elapsed = clock() - start;
+
+	if (elapsed == 0)
+		elapsed = 1;
+
+	printf("%-10s %8.1f MB/s (0x%08x)\n", name,
+		(double) BUF_SIZE * BENCH_ROUNDS / 1048576.0 * CLOCKS_PER_SEC / elapsed,
+		crc);
+}
+
+static uint32_t bench_public(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	return gg_crc32(crc, buf, len);
+}
+
+int main(void)
+{
+	unsigned char *buf;
+	unsigned int seed;
+	const char *env;
+	int hw, i;
+
+	reference_init();
+
+	buf = malloc(BUF_SIZE);
+
+	if (buf == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	/* Ziarno można podać, żeby powtórzyć nieudany przebieg */
+	env = getenv("GG_CRC32_SEED");
+	seed = (env != NULL) ? strtoul(env, NULL, 0) : (unsigned int) time(NULL);
+
+	printf("seed: %u\n", seed);
+
+	srand(seed);
+
+	for (i = 0; i < BUF_SIZE; i++)
+		buf[i] = rand() & 255;
+
+	hw = gg_crc32_hw_available();
+
+	printf("hardware crc32: %s\n", hw ? "yes" : "no");
+
+	/* Znane wartości */
+
+	check("gg_crc32", 0xcbf43926, gg_crc32(0, (const unsigned char*) "123456789", 9), 0, 9, 0);
+	check("gg_crc32", 0x00000000, gg_crc32(0, (const unsigned char*) "", 0), 0, 0, 0);
+	check("gg_crc32", 0x12345678, gg_crc32(0x12345678, NULL, 10), 0, 10, 0x12345678);
+
+	for (i = 0; i < ROUNDS; i++) {
+		size_t len, ofs;
+		uint32_t init, expected;
+
+		/* Przeważnie krótkie bloki, czasem długie */
+		if (i % 10 == 0)
+			len = rand() % (BUF_SIZE - 16);
+		else
+			len = rand() % 300;
+
+		ofs = rand() % (BUF_SIZE - len);
+		init = (i & 1) ? ((uint32_t) rand() << 16) ^ rand() : 0;
+
+		expected = reference(init, buf + ofs, len);
+
+		check("gg_crc32", expected, gg_crc32(init, buf + ofs, len), ofs, len, init);
+		check("sliced", expected, gg_crc32_sliced(init, buf + ofs, len), ofs, len, init);
+
+		if (hw)
+			check("hw", expected, gg_crc32_hw(init, buf + ofs, len), ofs, len, init);
+
+		/* Suma kontrolna liczona w dwóch częściach */
+		if (len > 0) {
+			size_t split = rand() % len;
+			uint32_t tmp;
+
+			tmp = gg_crc32(init, buf + ofs, split);
+			tmp = gg_crc32(tmp, buf + ofs + split, len - split);
+			check("gg_crc32 split", expected, tmp, ofs, len, init);
+		}
+	}
+
+	bench("reference", reference, buf);
+	bench("sliced", gg_crc32_sliced, buf);
+
+	if (hw)
+		bench("hw", gg_crc32_hw, buf);
+
+	bench("gg_crc32", bench_public, buf);
+
+	free(buf);
+
+	return 0;
+}
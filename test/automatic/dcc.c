@@ -0,0 +1,259 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libgadu.h"
+#include "network.h"
+
+/* Trzy kawałki protokołu: dwa pełne po 4096 bajtów i jeden niepełny */
+#define FILE_SIZE (4096 * 2 + 1000)
+#define HEADER_SIZE 12
+
+static unsigned char data[FILE_SIZE];
+static unsigned char result[FILE_SIZE + 3 * HEADER_SIZE];
+
+static void failed(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	exit(1);
+}
+
+static int temp_file(void)
+{
+	char name[] = "/tmp/libgadu-dcc-XXXXXX";
+	int fd;
+
+	fd = mkstemp(name);
+
+	if (fd == -1) {
+		perror("mkstemp");
+		exit(1);
+	}
+
+	unlink(name);
+
+	return fd;
+}
+
+static void make_socketpair(int *fds)
+{
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	if (!gg_fd_set_nonblocking(fds[0]) || !gg_fd_set_nonblocking(fds[1])) {
+		perror("gg_fd_set_nonblocking");
+		exit(1);
+	}
+}
+
+static size_t put_header(unsigned char *buf, uint32_t type, uint32_t size)
+{
+	memset(buf, 0, HEADER_SIZE);
+	buf[0] = type & 255;
+	buf[4] = size & 255;
+	buf[5] = (size >> 8) & 255;
+
+	return HEADER_SIZE;
+}
+
+static size_t put_chunk(unsigned char *buf, size_t offset)
+{
+	size_t size = FILE_SIZE - offset;
+
+	if (size > 4096)
+		size = 4096;
+
+	put_header(buf, (size == 4096) ? 0x0003 : 0x0002, size);
+	memcpy(buf + HEADER_SIZE, data + offset, size);
+
+	return HEADER_SIZE + size;
+}
+
+static struct gg_dcc *dcc_new(int type, int fd, int file_fd)
+{
+	struct gg_dcc *d;
+
+	d = calloc(1, sizeof(struct gg_dcc));
+
+	if (d == NULL)
+		failed("out of memory");
+
+	d->type = type;
+	d->fd = fd;
+	d->file_fd = file_fd;
+	d->file_info.size = FILE_SIZE;
+
+	return d;
+}
+
+static int watch(struct gg_dcc *d)
+{
+	struct gg_event *e;
+	int type;
+
+	e = gg_dcc_watch_fd(d);
+
+	if (e == NULL)
+		failed("gg_dcc_watch_fd failed");
+
+	type = e->type;
+
+	if (type == GG_EVENT_DCC_ERROR) {
+		fprintf(stderr, "dcc error %d\n", e->event.dcc_error);
+		exit(1);
+	}
+
+	gg_event_free(e);
+
+	return type;
+}
+
+static void check_counters(struct gg_dcc *d)
+{
+	if (d->transfer_start == 0)
+		failed("transfer_start not set");
+
+	if (d->transfer_bytes != FILE_SIZE)
+		failed("invalid transfer_bytes");
+
+	if (d->transfer_rate == 0 || d->transfer_rate > FILE_SIZE)
+		failed("invalid transfer_rate");
+}
+
+static void test_send(void)
+{
+	unsigned char expect[sizeof(result)];
+	struct gg_dcc *d;
+	size_t len, offset;
+	int fd, fds[2];
+	ssize_t res;
+
+	printf("send\n");
+
+	fd = temp_file();
+
+	if (write(fd, data, sizeof(data)) != sizeof(data))
+		failed("write failed");
+
+	make_socketpair(fds);
+
+	d = dcc_new(GG_SESSION_DCC_SEND, fds[0], fd);
+	d->state = GG_STATE_SENDING_FILE_HEADER;
+
+	if (watch(d) != GG_EVENT_NONE || d->state != GG_STATE_SENDING_FILE)
+		failed("header not sent");
+
+	/* Cały plik wraz z nagłówkami w jednym wywołaniu */
+	if (watch(d) != GG_EVENT_DCC_DONE)
+		failed("expected done");
+
+	check_counters(d);
+
+	for (len = 0, offset = 0; offset < FILE_SIZE; offset += 4096)
+		len += put_chunk(expect + len, offset);
+
+	res = recv(fds[1], result, sizeof(result), 0);
+
+	if (res != (ssize_t) len || memcmp(result, expect, len) != 0)
+		failed("data mismatch");
+
+	gg_dcc_free(d);
+	close(fds[1]);
+}
+
+static void test_get(size_t split)
+{
+	unsigned char stream[sizeof(result)];
+	struct gg_dcc *d;
+	size_t len, offset;
+	int fd, fds[2], type;
+
+	printf("get (split=%d)\n", (int) split);
+
+	for (len = 0, offset = 0; offset < FILE_SIZE; offset += 4096)
+		len += put_chunk(stream + len, offset);
+
+	fd = temp_file();
+
+	make_socketpair(fds);
+
+	d = dcc_new(GG_SESSION_DCC_GET, fds[0], fd);
+	d->state = GG_STATE_READING_FILE_HEADER;
+	d->chunk_size = HEADER_SIZE;
+	d->chunk_buf = malloc(HEADER_SIZE);
+
+	if (d->chunk_buf == NULL)
+		failed("out of memory");
+
+	if (send(fds[1], stream, split, 0) != (ssize_t) split)
+		failed("send failed");
+
+	if (watch(d) != GG_EVENT_NONE || d->state != GG_STATE_GETTING_FILE)
+		failed("header not received");
+
+	type = watch(d);
+
+	if (split < len) {
+		/* Brak danych przerywa odbieranie do kolejnego wywołania */
+		if (type != GG_EVENT_NONE)
+			failed("unexpected event");
+
+		if (send(fds[1], stream + split, len - split, 0) != (ssize_t) (len - split))
+			failed("send failed");
+
+		while (type == GG_EVENT_NONE)
+			type = watch(d);
+	}
+
+	if (type != GG_EVENT_DCC_DONE)
+		failed("expected done");
+
+	check_counters(d);
+
+	if (lseek(fd, 0, SEEK_SET) != 0 || read(fd, result, FILE_SIZE) != FILE_SIZE)
+		failed("read failed");
+
+	if (memcmp(data, result, FILE_SIZE) != 0)
+		failed("data mismatch");
+
+	gg_dcc_free(d);
+	close(fds[1]);
+}
+
+int main(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (i * 7 + i / 251) & 255;
+
+	test_send();
+	test_get(sizeof(result));
+	test_get(HEADER_SIZE + 4096 + 6);
+	test_get(HEADER_SIZE + 100);
+
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Mikrobenchmark wyszukiwania funkcji obsługi pakietów. Sesja w stanie
+ * GG_STATE_DISCONNECTING dostaje pakiety wszystkich typów z zakresu
+ * 0x00-0xff (poza GG_DISCONNECT_ACK), więc każdy pakiet przechodzi przez
+ * tablicę stanów gg_watch_fd() i tablicę pakietów, ale żadna funkcja
+ * obsługi nie jest wywoływana.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "network.h"
+#include "protocol.h"
+
+#define ROUNDS 2000
+
+static void resolver_cleanup(void **priv_data, int force)
+{
+}
+
+int main(void)
+{
+	struct gg_session gs;
+	struct gg_session_private gsp;
+	char buf[256 * sizeof(struct gg_header)];
+	unsigned int count = 0, i, round;
+	size_t len = 0;
+	clock_t start, elapsed;
+	int fds[2];
+
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	if (!gg_fd_set_nonblocking(fds[0])) {
+		perror("gg_fd_set_nonblocking");
+		exit(1);
+	}
+
+	memset(&gsp, 0, sizeof(gsp));
+	memset(&gs, 0, sizeof(gs));
+	gs.private_data = &gsp;
+	gs.fd = fds[0];
+	gs.state = GG_STATE_DISCONNECTING;
+	gs.timeout = -1;
+	gs.resolver_cleanup = resolver_cleanup;
+	gs.async = 1;
+
+	for (i = 0; i < 256; i++) {
+		struct gg_header h;
+
+		if (i == GG_DISCONNECT_ACK)
+			continue;
+
+		h.type = gg_fix32(i);
+		h.length = gg_fix32(0);
+		memcpy(buf + len, &h, sizeof(h));
+		len += sizeof(h);
+	}
+
+	start = clock();
+
+	for (round = 0; round < ROUNDS; round++) {
+		if (send(fds[1], buf, len, 0) != (ssize_t) len) {
+			perror("send");
+			exit(1);
+		}
+
+		for (i = 0; i < len / sizeof(struct gg_header); i++) {
+			struct gg_event *ge;
+
+			ge = gg_watch_fd(&gs);
+
+			if (ge == NULL) {
+				perror("gg_watch_fd");
+				exit(1);
+			}
+
+			if (ge->type != GG_EVENT_NONE || gs.state != GG_STATE_DISCONNECTING) {
+				fprintf(stderr, "Unexpected event %s in state %s\n",
+					gg_debug_event(ge->type),
+					gg_debug_state(gs.state));
+				exit(1);
+			}
+
+			gg_event_recycle(&gs, ge);
+			count++;
+		}
+
+		if (gsp.recv_ring.len != 0) {
+			fprintf(stderr, "Packets left in buffer\n");
+			exit(1);
+		}
+	}
+
+	elapsed = clock() - start;
+
+	printf("%u packets, %.1f ns per packet\n", count,
+		(double) elapsed * 1000000000.0 / CLOCKS_PER_SEC / count);
+
+	while (gsp.event_pool_count > 0)
+		free(gsp.event_pool[--gsp.event_pool_count]);
+
+	free(gsp.recv_ring.buf);
+	free(gsp.recv_ring.frame);
+
+	if (gsp.dummyfds_created) {
+		close(gsp.dummyfds[0]);
+		close(gsp.dummyfds[1]);
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+
+	return 0;
+}
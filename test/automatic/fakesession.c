@@ -0,0 +1,131 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Sesja połączona gniazdem z testem zamiast z serwerem. Test wysyła pakiety
+ * na fds[1] i odbiera to, co wysłała sesja. Funkcje kończą test w przypadku
+ * błędu.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+size_t put_varint(char *buf, uint32_t value)
+{
+	size_t len = 0;
+
+	while (value >= 0x80) {
+		buf[len++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+
+	buf[len++] = value;
+
+	return len;
+}
+
+size_t put_uint32(char *buf, uint32_t value)
+{
+	value = gg_fix32(value);
+	memcpy(buf, &value, 4);
+	return 4;
+}
+
+void send_packet(int fd, uint32_t type, const char *buf, size_t len)
+{
+	struct gg_header h;
+
+	h.type = gg_fix32(type);
+	h.length = gg_fix32(len);
+
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h) ||
+		send(fd, buf, len, 0) != (ssize_t) len)
+	{
+		perror("send");
+		exit(1);
+	}
+}
+
+void drain(int fd)
+{
+	char buf[4096];
+
+	while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0);
+}
+
+struct gg_session *session_new(int fds[2])
+{
+	struct gg_session *gs;
+
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	if (!gg_fd_set_nonblocking(fds[0])) {
+		perror("gg_fd_set_nonblocking");
+		exit(1);
+	}
+
+	gs = calloc(1, sizeof(struct gg_session));
+
+	if (gs != NULL)
+		gs->private_data = calloc(1, sizeof(struct gg_session_private));
+
+	if (gs == NULL || gs->private_data == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	gs->fd = fds[0];
+	gs->state = GG_STATE_CONNECTED;
+	gs->check = GG_CHECK_READ;
+	gs->timeout = -1;
+	gs->async = 1;
+	gs->protocol_version = GG_PROTOCOL_VERSION_110;
+	gs->encoding = GG_ENCODING_UTF8;
+
+	return gs;
+}
+
+struct gg_event *watch(struct gg_session *gs, int type)
+{
+	struct gg_event *ge;
+
+	ge = gg_watch_fd(gs);
+
+	if (ge == NULL) {
+		perror("gg_watch_fd");
+		exit(1);
+	}
+
+	if (ge->type != type) {
+		fprintf(stderr, "Expected %s, got %s\n", gg_debug_event(type),
+			gg_debug_event(ge->type));
+		exit(1);
+	}
+
+	return ge;
+}
@@ -0,0 +1,31 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+#ifndef FAKESESSION_H
+#define FAKESESSION_H
+
+#include "libgadu.h"
+
+size_t put_varint(char *buf, uint32_t value);
+size_t put_uint32(char *buf, uint32_t value);
+void send_packet(int fd, uint32_t type, const char *buf, size_t len);
+void drain(int fd);
+struct gg_session *session_new(int fds[2]);
+struct gg_event *watch(struct gg_session *gs, int type);
+
+#endif /* FAKESESSION_H */
@@ -0,0 +1,223 @@
+/*
+ *  (C) Copyright 2001-2010 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fileio.h"
+#include "network.h"
+
+#define FILE_SIZE 200000
+
+static unsigned char data[FILE_SIZE];
+static unsigned char result[FILE_SIZE];
+
+static void failed(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	exit(1);
+}
+
+static int temp_file(void)
+{
+	char name[] = "/tmp/libgadu-fileio-XXXXXX";
+	int fd;
+
+	fd = mkstemp(name);
+
+	if (fd == -1) {
+		perror("mkstemp");
+		exit(1);
+	}
+
+	unlink(name);
+
+	return fd;
+}
+
+static void make_socketpair(int *fds)
+{
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	if (!gg_fd_set_nonblocking(fds[0]) || !gg_fd_set_nonblocking(fds[1])) {
+		perror("gg_fd_set_nonblocking");
+		exit(1);
+	}
+}
+
+static void test_send(int seek, size_t chunk)
+{
+	size_t offset = 0, received = 0;
+	int fd, fds[2];
+
+	printf("send (seek=%d, chunk=%d)\n", seek, (int) chunk);
+
+	fd = temp_file();
+
+	if (write(fd, data, sizeof(data)) != sizeof(data))
+		failed("write failed");
+
+	if (!seek && lseek(fd, 0, SEEK_SET) != 0)
+		failed("lseek failed");
+
+	make_socketpair(fds);
+
+	while (received < sizeof(data)) {
+		gg_file_transfer_t res;
+		size_t done;
+		int len;
+
+		res = gg_file_send(fds[0], fd, seek, offset,
+			sizeof(data) - offset, chunk, &done);
+
+		if (res != GG_FILE_TRANSFER_OK)
+			failed("gg_file_send failed");
+
+		offset += done;
+
+		while ((len = recv(fds[1], result + received, sizeof(result) - received, 0)) > 0)
+			received += len;
+
+		if (len == -1 && errno != EAGAIN)
+			failed("recv failed");
+	}
+
+	if (offset != sizeof(data) || memcmp(data, result, sizeof(data)) != 0)
+		failed("data mismatch");
+
+	close(fds[0]);
+	close(fds[1]);
+	close(fd);
+}
+
+static void test_send_eof(void)
+{
+	gg_file_transfer_t res;
+	size_t done;
+	int fd, fds[2];
+
+	printf("send eof\n");
+
+	fd = temp_file();
+
+	if (write(fd, data, 100) != 100)
+		failed("write failed");
+
+	make_socketpair(fds);
+
+	res = gg_file_send(fds[0], fd, 1, 0, 200, 0, &done);
+
+	if (res != GG_FILE_TRANSFER_EOF || done != 100)
+		failed("expected eof");
+
+	close(fds[0]);
+	close(fds[1]);
+	close(fd);
+}
+
+static void test_recv(size_t chunk, int use_pipe)
+{
+	size_t offset = 0, sent = 0;
+	gg_file_pipe_t *fp = NULL, **pipe_ptr;
+	gg_file_transfer_t res;
+	size_t done;
+	int fd, fds[2];
+
+	printf("recv (chunk=%d, pipe=%d)\n", (int) chunk, use_pipe);
+
+	pipe_ptr = use_pipe ? &fp : NULL;
+
+	fd = temp_file();
+
+	make_socketpair(fds);
+
+	while (offset < sizeof(data)) {
+		int len;
+
+		len = send(fds[1], data + sent, sizeof(data) - sent, 0);
+
+		if (len == -1 && errno != EAGAIN)
+			failed("send failed");
+
+		if (len > 0)
+			sent += len;
+
+		res = gg_file_recv(fds[0], fd, sizeof(data) - offset, chunk, &done,
+			pipe_ptr);
+
+		if (res != GG_FILE_TRANSFER_OK)
+			failed("gg_file_recv failed");
+
+		offset += done;
+	}
+
+	if (!use_pipe && fp != NULL)
+		failed("unexpected pipe");
+
+	if (offset != sizeof(data))
+		failed("too much data");
+
+	if (lseek(fd, 0, SEEK_SET) != 0 || read(fd, result, sizeof(result)) != sizeof(result))
+		failed("read failed");
+
+	if (memcmp(data, result, sizeof(data)) != 0)
+		failed("data mismatch");
+
+	/* Koniec połączenia przed odebraniem całości */
+
+	if (send(fds[1], data, 10, 0) != 10)
+		failed("send failed");
+
+	close(fds[1]);
+
+	res = gg_file_recv(fds[0], fd, 20, chunk, &done, pipe_ptr);
+
+	if (res != GG_FILE_TRANSFER_EOF || done != 10)
+		failed("expected eof");
+
+	gg_file_pipe_free(fp);
+	close(fds[0]);
+	close(fd);
+}
+
+int main(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (i * 7 + i / 251) & 255;
+
+	test_send(0, 0);
+	test_send(1, 0);
+	test_send(0, 1000);
+	test_send(1, 1000);
+	test_send_eof();
+	test_recv(0, 0);
+	test_recv(0, 1);
+	test_recv(1000, 0);
+	test_recv(1000, 1);
+
+	return 0;
+}
@@ -0,0 +1,355 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test pamięci podręcznej wysyłanych obrazków. Do pamięci podręcznej
+ * z małym limitem trafia więcej obrazków, niż się w nim mieści, więc część
+ * jest zapisywana do katalogu wymiany. Sesja dostaje prośby o obrazki
+ * w pakietach GG_RECV_MSG110, GG_RECV_MSG i GG_RECV_MSG80 i musi
+ * odpowiedzieć sama, także obrazkami wczytanymi z katalogu wymiany.
+ * O nieznane obrazki pyta aplikację.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define IMAGES 10
+#define IMAGE_SIZE 1500
+#define LIMIT (3 * IMAGE_SIZE + 100)
+#define SENDER 1000
+
+static uint32_t crcs[IMAGES];
+static int destroyed;
+
+static char image_byte(int k, uint32_t offset)
+{
+	return (k * 13 + offset * 7) & 0xff;
+}
+
+static void image_destroy(char *data)
+{
+	struct gg_image_cache_stats stats;
+
+	/* Bufor nie może być zwalniany pod blokadą pamięci podręcznej */
+	if (gg_image_cache_get_stats(&stats) == -1) {
+		perror("gg_image_cache_get_stats");
+		exit(1);
+	}
+
+	destroyed++;
+	free(data);
+}
+
+static void add_images(void)
+{
+	int k;
+
+	for (k = 0; k < IMAGES; k++) {
+		struct gg_image_buffer *buf;
+		char *data, name[16];
+		uint32_t i;
+
+		data = malloc(IMAGE_SIZE);
+
+		if (data == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+
+		for (i = 0; i < IMAGE_SIZE; i++)
+			data[i] = image_byte(k, i);
+
+		buf = gg_image_buffer_new(data, IMAGE_SIZE, image_destroy);
+
+		if (buf == NULL) {
+			perror("gg_image_buffer_new");
+			exit(1);
+		}
+
+		crcs[k] = buf->crc32;
+
+		snprintf(name, sizeof(name), "%d.png", k);
+
+		if (gg_image_cache_add(name, buf) == -1) {
+			perror("gg_image_cache_add");
+			exit(1);
+		}
+
+		gg_image_buffer_unref(buf);
+	}
+}
+
+static void send_request(int fd, uint32_t type, uint32_t crc32)
+{
+	char buf[64];
+	size_t len = 0;
+
+	switch (type) {
+		case GG_RECV_MSG:
+			/* gg_recv_msg i pusta treść */
+			len += put_uint32(buf + len, SENDER);
+			len += put_uint32(buf + len, 1);
+			len += put_uint32(buf + len, 0);
+			len += put_uint32(buf + len, GG_CLASS_CHAT);
+			buf[len++] = 0x00;
+			break;
+
+		case GG_RECV_MSG80:
+			/* gg_recv_msg80, pusta treść HTML i tekstowa */
+			len += put_uint32(buf + len, SENDER);
+			len += put_uint32(buf + len, 1);
+			len += put_uint32(buf + len, 0);
+			len += put_uint32(buf + len, GG_CLASS_CHAT);
+			len += put_uint32(buf + len, sizeof(struct gg_recv_msg80) + 1);
+			len += put_uint32(buf + len, sizeof(struct gg_recv_msg80) + 2);
+			buf[len++] = 0x00;
+			buf[len++] = 0x00;
+			break;
+
+		default:
+			buf[len++] = 0x0a;
+			buf[len++] = 6;
+			buf[len++] = 0x00;
+			buf[len++] = 4;
+			snprintf(buf + len, 5, "%d", SENDER);
+			len += 4;
+			buf[len++] = 0x10;
+			buf[len++] = 0x08;
+			buf[len++] = 0x18;
+			buf[len++] = 0x01;
+			buf[len++] = 0x25;
+			len += put_uint32(buf + len, 0);
+			buf[len++] = 0x2a;
+			buf[len++] = 0x00;
+			buf[len++] = 0x3a;
+			len += put_varint(buf + len, 9);
+			break;
+	}
+
+	buf[len++] = GG_MSG_OPTION_IMAGE_REQUEST;
+	len += put_uint32(buf + len, IMAGE_SIZE);
+	len += put_uint32(buf + len, crc32);
+
+	send_packet(fd, type, buf, len);
+}
+
+/* Sprawdza wysłany obrazek i zwraca liczbę odebranych obrazków */
+static int receive_reply(int fd, int k)
+{
+	static char buf[4096];
+	struct gg_header h;
+	int count = 0;
+
+	while (recv(fd, &h, sizeof(h), MSG_DONTWAIT) == sizeof(h)) {
+		const struct gg_send_msg *s = (const void*) buf;
+		struct gg_msg_image_reply r;
+		uint32_t len = gg_fix32(h.length), i;
+		const char *data;
+		char name[16];
+
+		if (len > sizeof(buf) ||
+			recv(fd, buf, len, MSG_WAITALL) != (ssize_t) len)
+		{
+			fprintf(stderr, "Invalid packet\n");
+			exit(1);
+		}
+
+		if (gg_fix32(h.type) != GG_SEND_MSG)
+			continue;
+
+		snprintf(name, sizeof(name), "%d.png", k);
+		memcpy(&r, buf + sizeof(*s) + 1, sizeof(r));
+		data = buf + sizeof(*s) + 1 + sizeof(r) + strlen(name) + 1;
+
+		if (gg_fix32(s->recipient) != SENDER ||
+			r.flag != GG_MSG_OPTION_IMAGE_REPLY ||
+			gg_fix32(r.size) != IMAGE_SIZE ||
+			gg_fix32(r.crc32) != crcs[k] ||
+			strcmp(buf + sizeof(*s) + 1 + sizeof(r), name) != 0 ||
+			data + IMAGE_SIZE != buf + len)
+		{
+			fprintf(stderr, "Invalid reply for %d\n", k);
+			exit(1);
+		}
+
+		for (i = 0; i < IMAGE_SIZE; i++) {
+			if (data[i] != image_byte(k, i)) {
+				fprintf(stderr, "Invalid image data for %d\n", k);
+				exit(1);
+			}
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+static void request(struct gg_session *gs, int fd, uint32_t type, int k,
+	int cached)
+{
+	struct gg_event *ge;
+
+	send_request(fd, type, (k < IMAGES) ? crcs[k] : ~crcs[0]);
+
+	ge = gg_watch_fd(gs);
+
+	if (ge == NULL) {
+		perror("gg_watch_fd");
+		exit(1);
+	}
+
+	if (cached && (ge->type != GG_EVENT_NONE || receive_reply(fd, k) != 1)) {
+		fprintf(stderr, "Image %d not sent from cache\n", k);
+		exit(1);
+	}
+
+	if (!cached && (ge->type != GG_EVENT_IMAGE_REQUEST ||
+		ge->event.image_request.sender != SENDER ||
+		receive_reply(fd, k) != 0))
+	{
+		fprintf(stderr, "Image %d not requested\n", k);
+		exit(1);
+	}
+
+	gg_event_recycle(gs, ge);
+
+	/* Obrazek mieści się w jednym fragmencie */
+	gs->private_data->imgout_waiting_ack = 0;
+}
+
+static void check_stats(unsigned int count, unsigned int spilled,
+	unsigned int hits, unsigned int misses)
+{
+	struct gg_image_cache_stats stats;
+
+	if (gg_image_cache_get_stats(&stats) == -1) {
+		perror("gg_image_cache_get_stats");
+		exit(1);
+	}
+
+	if (stats.count != count || stats.spilled != spilled ||
+		stats.hits != hits || stats.misses != misses ||
+		stats.memory > LIMIT || stats.limit != LIMIT)
+	{
+		fprintf(stderr, "Invalid stats: count %u, spilled %u, hits %u, "
+			"misses %u, memory %u\n", stats.count, stats.spilled,
+			stats.hits, stats.misses, (unsigned int) stats.memory);
+		exit(1);
+	}
+}
+
+int main(void)
+{
+	struct gg_session *gs;
+	char dir[] = "imgcache-XXXXXX";
+	int fds[2], k;
+
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		exit(1);
+	}
+
+	if (gg_image_cache_setup(LIMIT, dir) == -1) {
+		perror("gg_image_cache_setup");
+		exit(1);
+	}
+
+	add_images();
+
+	/* Najstarsze obrazki trafiły do katalogu wymiany */
+	check_stats(IMAGES, IMAGES - 3, 0, 0);
+
+	if (destroyed != IMAGES - 3) {
+		fprintf(stderr, "Spilled images not released\n");
+		exit(1);
+	}
+
+	gs = session_new(fds);
+
+	for (k = 0; k < IMAGES; k++)
+		request(gs, fds[1], GG_RECV_MSG110, k, 1);
+
+	request(gs, fds[1], GG_RECV_MSG110, IMAGES, 0);
+
+	check_stats(IMAGES, IMAGES, IMAGES, 1);
+
+	/* Bez katalogu wymiany zostają tylko obrazki w pamięci */
+	if (gg_image_cache_setup(LIMIT, NULL) == -1) {
+		perror("gg_image_cache_setup");
+		exit(1);
+	}
+
+	check_stats(3, 0, IMAGES, 1);
+
+	request(gs, fds[1], GG_RECV_MSG110, 0, 0);
+	request(gs, fds[1], GG_RECV_MSG110, IMAGES - 1, 1);
+
+	/* Starsze pakiety wiadomości nie mogą zgłosić pustej wiadomości */
+	request(gs, fds[1], GG_RECV_MSG, IMAGES - 1, 1);
+	request(gs, fds[1], GG_RECV_MSG80, IMAGES - 1, 1);
+	request(gs, fds[1], GG_RECV_MSG, IMAGES, 0);
+	request(gs, fds[1], GG_RECV_MSG80, IMAGES, 0);
+
+	if (gg_image_cache_remove(IMAGE_SIZE, crcs[IMAGES - 1]) == -1 ||
+		gg_image_cache_remove(IMAGE_SIZE, crcs[IMAGES - 1]) != -1)
+	{
+		fprintf(stderr, "Invalid removal\n");
+		exit(1);
+	}
+
+	gg_image_cache_clear();
+
+	/* Prośba do pustej pamięci podręcznej też jest chybieniem */
+	request(gs, fds[1], GG_RECV_MSG110, 0, 0);
+
+	check_stats(0, 0, IMAGES + 3, 5);
+
+	/* Wszystkie pliki zostały usunięte */
+	if (rmdir(dir) == -1) {
+		perror("rmdir");
+		exit(1);
+	}
+
+	/* Obrazki wczytane z katalogu wymiany są zwalniane przez free() */
+	if (destroyed != IMAGES) {
+		fprintf(stderr, "Images not released (%d)\n", destroyed);
+		exit(1);
+	}
+
+	gg_free_session(gs);
+	close(fds[1]);
+
+	printf("okay\n");
+
+	return 0;
+}
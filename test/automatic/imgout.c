@@ -0,0 +1,309 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test wysyłania obrazków. Jeden bufor obrazka jest wysyłany do kilku
+ * odbiorców, a druga strona potwierdza każdy odebrany fragment. Obrazki
+ * złożone z fragmentów muszą się zgadzać z oryginałem, liczba fragmentów
+ * wysłanych bez potwierdzenia musi wzrosnąć ponad początkowe okno, a dane
+ * obrazka muszą zostać zwolnione dopiero po wysłaniu ostatniego fragmentu.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define IMAGE_SIZE (300 * 1024)
+#define RECIPIENTS 3
+
+struct recipient {
+	uin_t uin;
+	char *data;
+	uint32_t received;
+	int first;
+};
+
+static struct recipient recipients[RECIPIENTS];
+static uint32_t image_crc32;
+static int destroyed;
+
+static void image_destroy(char *data)
+{
+	destroyed++;
+	free(data);
+}
+
+static char image_byte(uint32_t offset)
+{
+	return (offset * 7 + (offset >> 8)) & 0xff;
+}
+
+static struct gg_image_buffer *image_new(void)
+{
+	struct gg_image_buffer *buf;
+	char *data;
+	uint32_t i;
+
+	data = malloc(IMAGE_SIZE);
+
+	if (data == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (i = 0; i < IMAGE_SIZE; i++)
+		data[i] = image_byte(i);
+
+	image_crc32 = gg_crc32(0, (const unsigned char*) data, IMAGE_SIZE);
+
+	buf = gg_image_buffer_new(data, IMAGE_SIZE, image_destroy);
+
+	if (buf == NULL) {
+		perror("gg_image_buffer_new");
+		exit(1);
+	}
+
+	return buf;
+}
+
+static void check_chunk(const char *buf, size_t len)
+{
+	const struct gg_send_msg *s = (const struct gg_send_msg*) buf;
+	struct gg_msg_image_reply r;
+	struct recipient *rcpt = NULL;
+	size_t ofs;
+	int i;
+
+	if (len < sizeof(*s) + 1 + sizeof(r)) {
+		fprintf(stderr, "Packet too short\n");
+		exit(1);
+	}
+
+	for (i = 0; i < RECIPIENTS; i++) {
+		if (recipients[i].uin == gg_fix32(s->recipient))
+			rcpt = &recipients[i];
+	}
+
+	memcpy(&r, buf + sizeof(*s) + 1, sizeof(r));
+	ofs = sizeof(*s) + 1 + sizeof(r);
+
+	if (rcpt == NULL || gg_fix32(r.size) != IMAGE_SIZE ||
+		gg_fix32(r.crc32) != image_crc32)
+	{
+		fprintf(stderr, "Invalid chunk header\n");
+		exit(1);
+	}
+
+	if (r.flag == GG_MSG_OPTION_IMAGE_REPLY) {
+		if (rcpt->first || len < ofs + 10 ||
+			memcmp(buf + ofs, "image.png", 10) != 0)
+		{
+			fprintf(stderr, "Invalid first chunk\n");
+			exit(1);
+		}
+
+		rcpt->first = 1;
+		ofs += 10;
+	} else if (r.flag != GG_MSG_OPTION_IMAGE_REPLY_MORE || !rcpt->first) {
+		fprintf(stderr, "Invalid chunk flag\n");
+		exit(1);
+	}
+
+	if (rcpt->received + (len - ofs) > IMAGE_SIZE) {
+		fprintf(stderr, "Image too long\n");
+		exit(1);
+	}
+
+	memcpy(rcpt->data + rcpt->received, buf + ofs, len - ofs);
+	rcpt->received += len - ofs;
+}
+
+/* Odbiera wszystkie wysłane pakiety i zwraca ich liczbę */
+static int receive_chunks(int fd)
+{
+	static char buf[4096];
+	struct gg_header h;
+	int count = 0;
+
+	while (recv(fd, &h, sizeof(h), MSG_DONTWAIT) == sizeof(h)) {
+		uint32_t len = gg_fix32(h.length);
+
+		if (gg_fix32(h.type) != GG_SEND_MSG || len > sizeof(buf) ||
+			recv(fd, buf, len, MSG_WAITALL) != (ssize_t) len)
+		{
+			fprintf(stderr, "Invalid packet\n");
+			exit(1);
+		}
+
+		check_chunk(buf, len);
+		count++;
+	}
+
+	return count;
+}
+
+static void send_ack(struct gg_session *gs, int fd)
+{
+	struct gg_send_msg_ack a;
+
+	a.status = gg_fix32(GG_ACK_DELIVERED);
+	a.recipient = gg_fix32(0);
+	a.seq = gg_fix32(0);
+
+	send_packet(fd, GG_SEND_MSG_ACK, (const char*) &a, sizeof(a));
+
+	gg_event_recycle(gs, watch(gs, GG_EVENT_ACK));
+}
+
+static void test_transfer(void)
+{
+	struct gg_image_buffer *buf;
+	struct gg_session *gs;
+	int fds[2], i, count, max_count = 0;
+
+	gs = session_new(fds);
+	buf = image_new();
+	destroyed = 0;
+
+	for (i = 0; i < RECIPIENTS; i++) {
+		recipients[i].uin = 1000 + i;
+		recipients[i].data = malloc(IMAGE_SIZE);
+		recipients[i].received = 0;
+		recipients[i].first = 0;
+
+		if (recipients[i].data == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+
+		/* Ścieżka musi zostać obcięta do nazwy pliku */
+		if (gg_image_reply_buffer(gs, recipients[i].uin,
+			"/tmp/image.png", buf) == -1)
+		{
+			perror("gg_image_reply_buffer");
+			exit(1);
+		}
+	}
+
+	gg_image_buffer_unref(buf);
+
+	while ((count = receive_chunks(fds[1])) > 0) {
+		if (count > max_count)
+			max_count = count;
+
+		if (destroyed != 0 && gs->private_data->imgout_queue != NULL) {
+			fprintf(stderr, "Image destroyed too early\n");
+			exit(1);
+		}
+
+		for (i = 0; i < count; i++)
+			send_ack(gs, fds[1]);
+	}
+
+	if (destroyed != 1 || gs->private_data->imgout_queue != NULL ||
+		gs->private_data->imgout_waiting_ack != 0)
+	{
+		fprintf(stderr, "Image not released (destroyed %d)\n", destroyed);
+		exit(1);
+	}
+
+	if (max_count <= GG_IMGOUT_WAITING_MAX ||
+		max_count > GG_IMGOUT_WINDOW_MAX)
+	{
+		fprintf(stderr, "Invalid window %d\n", max_count);
+		exit(1);
+	}
+
+	for (i = 0; i < RECIPIENTS; i++) {
+		uint32_t j;
+
+		if (recipients[i].received != IMAGE_SIZE) {
+			fprintf(stderr, "Image for %u incomplete\n",
+				recipients[i].uin);
+			exit(1);
+		}
+
+		for (j = 0; j < IMAGE_SIZE; j++) {
+			if (recipients[i].data[j] != image_byte(j)) {
+				fprintf(stderr, "Invalid image data for %u\n",
+					recipients[i].uin);
+				exit(1);
+			}
+		}
+
+		free(recipients[i].data);
+	}
+
+	gg_free_session(gs);
+	close(fds[1]);
+}
+
+static void test_close(void)
+{
+	struct gg_image_buffer *buf;
+	struct gg_session *gs;
+	int fds[2];
+
+	gs = session_new(fds);
+	buf = image_new();
+	destroyed = 0;
+
+	if (gg_image_reply_buffer(gs, 1000, "image.png", buf) == -1) {
+		perror("gg_image_reply_buffer");
+		exit(1);
+	}
+
+	gg_image_buffer_unref(buf);
+
+	/* Zamknięcie sesji zwalnia niewysłany obrazek */
+	if (destroyed != 0) {
+		fprintf(stderr, "Image destroyed too early\n");
+		exit(1);
+	}
+
+	gg_free_session(gs);
+	close(fds[1]);
+
+	if (destroyed != 1) {
+		fprintf(stderr, "Image not released on close\n");
+		exit(1);
+	}
+}
+
+int main(void)
+{
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	test_transfer();
+	test_close();
+
+	printf("okay\n");
+
+	return 0;
+}
@@ -0,0 +1,344 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test kolejki odbieranych obrazków. Sesja zamawia wiele obrazków, a potem
+ * dostaje ich fragmenty w losowej kolejności w pakietach GG_RECV_MSG110.
+ * Bez limitu pamięci wszystkie obrazki muszą dotrzeć w całości, a z małym
+ * limitem zajęta pamięć nie może go przekroczyć, a liczniki muszą się
+ * zgadzać. Sprawdzane jest też usuwanie obrazków, których transfer stanął.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define IMAGES 200
+#define PART_SIZE 1800
+#define SMALL_LIMIT (32 * 1024)
+
+struct image {
+	uin_t sender;
+	uint32_t size;
+	uint32_t crc32;
+	uint32_t sent;
+	int received;
+};
+
+static struct image images[IMAGES];
+
+static char image_byte(int k, uint32_t offset)
+{
+	return (k * 31 + offset) & 0xff;
+}
+
+static void send_part(int fd, int k)
+{
+	static char data[PART_SIZE + 64], buf[PART_SIZE + 128];
+	struct image *img = &images[k];
+	size_t data_len = 0, len = 0;
+	uint32_t part, i;
+	char sender[16];
+
+	if (img->sent == 0) {
+		data[data_len++] = GG_MSG_OPTION_IMAGE_REPLY;
+		data_len += put_uint32(data + data_len, img->size);
+		data_len += put_uint32(data + data_len, img->crc32);
+		memcpy(data + data_len, "image.png", 10);
+		data_len += 10;
+	} else {
+		data[data_len++] = GG_MSG_OPTION_IMAGE_REPLY_MORE;
+		data_len += put_uint32(data + data_len, img->size);
+		data_len += put_uint32(data + data_len, img->crc32);
+	}
+
+	part = img->size - img->sent;
+	if (part > PART_SIZE)
+		part = PART_SIZE;
+
+	for (i = 0; i < part; i++)
+		data[data_len++] = image_byte(k, img->sent + i);
+
+	img->sent += part;
+
+	snprintf(sender, sizeof(sender), "%u", img->sender);
+
+	buf[len++] = 0x0a;
+	buf[len++] = strlen(sender) + 2;
+	buf[len++] = 0x00;
+	buf[len++] = strlen(sender);
+	memcpy(buf + len, sender, strlen(sender));
+	len += strlen(sender);
+	buf[len++] = 0x10;
+	buf[len++] = 0x08;
+	buf[len++] = 0x18;
+	buf[len++] = 0x01;
+	buf[len++] = 0x25;
+	len += put_uint32(buf + len, 0);
+	buf[len++] = 0x2a;
+	buf[len++] = 0x00;
+	buf[len++] = 0x3a;
+	len += put_varint(buf + len, data_len);
+	memcpy(buf + len, data, data_len);
+	len += data_len;
+
+	send_packet(fd, GG_RECV_MSG110, buf, len);
+}
+
+static void check_event(struct gg_session *gs, int k)
+{
+	struct gg_event *ge;
+	uint32_t i;
+
+	ge = gg_watch_fd(gs);
+
+	if (ge == NULL) {
+		perror("gg_watch_fd");
+		exit(1);
+	}
+
+	if (ge->type == GG_EVENT_IMAGE_REPLY) {
+		struct gg_event_image_reply *r = &ge->event.image_reply;
+
+		if (r->sender != images[k].sender || r->size != images[k].size ||
+			r->crc32 != images[k].crc32 ||
+			images[k].sent != images[k].size ||
+			strcmp(r->filename, "image.png") != 0)
+		{
+			fprintf(stderr, "Invalid image reply for %d\n", k);
+			exit(1);
+		}
+
+		for (i = 0; i < r->size; i++) {
+			if (r->image[i] != image_byte(k, i)) {
+				fprintf(stderr, "Invalid image data for %d\n", k);
+				exit(1);
+			}
+		}
+
+		images[k].received = 1;
+	} else if (ge->type != GG_EVENT_NONE) {
+		fprintf(stderr, "Unexpected event %s\n", gg_debug_event(ge->type));
+		exit(1);
+	}
+
+	gg_event_recycle(gs, ge);
+}
+
+static void test_transfer(size_t limit)
+{
+	struct gg_image_queue_stats stats;
+	struct gg_session *gs;
+	int fds[2], k, left, received = 0;
+
+	gs = session_new(fds);
+	gs->private_data->image_index.limit = limit;
+
+	for (k = 0; k < IMAGES; k++) {
+		images[k].sender = 2000 + k;
+		images[k].size = 1000 + (k % 5) * 3000;
+		images[k].crc32 = k % 7;
+		images[k].sent = 0;
+		images[k].received = 0;
+
+		if (gg_image_request(gs, images[k].sender, images[k].size,
+			images[k].crc32) == -1)
+		{
+			perror("gg_image_request");
+			exit(1);
+		}
+	}
+
+	drain(fds[1]);
+
+	/* Fragmenty obrazków przeplatane w losowej kolejności */
+	for (left = IMAGES; left > 0; ) {
+		k = rand() % IMAGES;
+
+		if (images[k].sent == images[k].size)
+			continue;
+
+		send_part(fds[1], k);
+		check_event(gs, k);
+		drain(fds[1]);
+
+		if (images[k].sent == images[k].size)
+			left--;
+
+		if (gs->private_data->image_index.memory >
+			(limit != 0 ? limit : GG_IMAGE_QUEUE_LIMIT))
+		{
+			fprintf(stderr, "Image memory %d over limit\n",
+				(int) gs->private_data->image_index.memory);
+			exit(1);
+		}
+	}
+
+	for (k = 0; k < IMAGES; k++)
+		received += images[k].received;
+
+	if (gg_image_queue_get_stats(gs, &stats) == -1) {
+		perror("gg_image_queue_get_stats");
+		exit(1);
+	}
+
+	if (stats.completed != (unsigned int) received ||
+		stats.pending != 0 || stats.memory != 0 || stats.expired != 0 ||
+		stats.completed + stats.evicted != IMAGES ||
+		(limit == 0 && stats.completed != IMAGES) ||
+		(limit != 0 && stats.evicted == 0) ||
+		gs->images != NULL)
+	{
+		fprintf(stderr, "Invalid stats: completed %u, evicted %u, "
+			"pending %u\n", stats.completed, stats.evicted,
+			stats.pending);
+		exit(1);
+	}
+
+	gg_free_session(gs);
+	close(fds[1]);
+}
+
+static void test_timeout(void)
+{
+	struct gg_image_queue_stats stats;
+	struct gg_session *gs;
+	int fds[2];
+
+	gs = session_new(fds);
+	gs->private_data->image_index.limit = SMALL_LIMIT;
+
+	if (gg_image_request(gs, 1000, SMALL_LIMIT + 1, 0) != -1 ||
+		errno != ENOBUFS)
+	{
+		fprintf(stderr, "Image over limit requested\n");
+		exit(1);
+	}
+
+	if (gg_image_request(gs, 1000, 100, 1) == -1 ||
+		gg_image_request(gs, 1001, 100, 1) == -1 ||
+		gg_image_request(gs, 1000, 100, 1) == -1)
+	{
+		perror("gg_image_request");
+		exit(1);
+	}
+
+	drain(fds[1]);
+
+	/* Ponownie zamówiony obrazek jest najnowszy */
+	if (gs->images == NULL || gs->images->sender != 1001 ||
+		gs->images->next == NULL || gs->images->next->sender != 1000 ||
+		gs->images->next->next != NULL)
+	{
+		fprintf(stderr, "Invalid image list\n");
+		exit(1);
+	}
+
+	((gg_image_entry_t *) gs->images)->activity -= GG_IMAGE_QUEUE_TIMEOUT + 1;
+
+	if (gg_image_queue_get_stats(gs, &stats) == -1 ||
+		stats.pending != 1 || stats.expired != 1)
+	{
+		fprintf(stderr, "Stalled image not expired\n");
+		exit(1);
+	}
+
+	gg_free_session(gs);
+	close(fds[1]);
+}
+
+static void test_pending(void)
+{
+	struct gg_image_queue_stats stats;
+	struct gg_session *gs;
+	int fds[2], k;
+
+	gs = session_new(fds);
+	gs->private_data->image_index.limit = SMALL_LIMIT;
+
+	/* Najstarszy obrazek jest zamówiony, ale nie ma jeszcze danych */
+	for (k = 0; k < 3; k++) {
+		images[k].sender = 3000 + k;
+		images[k].size = (k == 0) ? 1000 : 20000;
+		images[k].crc32 = k;
+		images[k].sent = 0;
+		images[k].received = 0;
+
+		if (gg_image_request(gs, images[k].sender, images[k].size,
+			images[k].crc32) == -1)
+		{
+			perror("gg_image_request");
+			exit(1);
+		}
+	}
+
+	drain(fds[1]);
+
+	while (images[1].sent + PART_SIZE < images[1].size) {
+		send_part(fds[1], 1);
+		check_event(gs, 1);
+	}
+
+	while (images[2].sent < images[2].size) {
+		send_part(fds[1], 2);
+		check_event(gs, 2);
+	}
+
+	drain(fds[1]);
+
+	/* Usunięty został tylko obrazek zajmujący pamięć */
+	if (gg_image_queue_get_stats(gs, &stats) == -1 ||
+		!images[2].received || stats.evicted != 1 ||
+		stats.pending != 1 || gs->images == NULL ||
+		gs->images->sender != images[0].sender)
+	{
+		fprintf(stderr, "Pending image evicted\n");
+		exit(1);
+	}
+
+	gg_free_session(gs);
+	close(fds[1]);
+}
+
+int main(void)
+{
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	srand(time(NULL));
+
+	test_transfer(0);
+	test_transfer(SMALL_LIMIT);
+	test_timeout();
+	test_pending();
+
+	printf("okay\n");
+
+	return 0;
+}
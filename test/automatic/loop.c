@@ -0,0 +1,343 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test pętli zdarzeń gg_loop. Sesja w stanie GG_STATE_CONNECTED dostaje
+ * przez socketpair() pakiety GG_PONG, które pętla powinna przekazać do
+ * funkcji zwrotnej. Następnie sprawdzane jest przekroczenie czasu operacji
+ * i zerwanie połączenia, a na końcu przejście do kolejnego adresu serwera
+ * przez gniazdo z tym samym numerem deskryptora.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "network.h"
+#include "protocol.h"
+
+#define PONG_COUNT 5
+
+static int event_count;
+static int timeout_count;
+static int error_count;
+static int priv;
+
+static void resolver_cleanup(void **priv_data, int force)
+{
+}
+
+static void callback(struct gg_loop *loop, void *object, gg_loop_status_t status, struct gg_event *ge, void *priv_data)
+{
+	if (priv_data != &priv) {
+		fprintf(stderr, "Invalid private data\n");
+		exit(1);
+	}
+
+	switch (status) {
+		case GG_LOOP_EVENT:
+			if (ge == NULL) {
+				fprintf(stderr, "Missing event\n");
+				exit(1);
+			}
+
+			if (ge->type == GG_EVENT_PONG) {
+				event_count++;
+				break;
+			}
+
+			if (ge->type == GG_EVENT_DISCONNECT) {
+				error_count++;
+				gg_loop_remove(loop, object);
+				break;
+			}
+
+			fprintf(stderr, "Unexpected event %s\n", gg_debug_event(ge->type));
+			exit(1);
+
+		case GG_LOOP_TIMEOUT:
+			timeout_count++;
+			break;
+
+		case GG_LOOP_ERROR:
+			error_count++;
+			break;
+
+		default:
+			fprintf(stderr, "Unexpected status %d\n", status);
+			exit(1);
+	}
+}
+
+static int tcp_socket(struct sockaddr_in *sin, int do_listen)
+{
+	socklen_t sin_len = sizeof(*sin);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (fd == -1 || bind(fd, (struct sockaddr*) sin, sizeof(*sin)) == -1 ||
+		getsockname(fd, (struct sockaddr*) sin, &sin_len) == -1 ||
+		(do_listen && listen(fd, 1) == -1))
+	{
+		perror("socket");
+		exit(1);
+	}
+
+	return fd;
+}
+
+static void test_failover(struct gg_loop *loop)
+{
+	struct gg_session gs;
+	struct gg_session_private gsp;
+	struct sockaddr_in good, bad;
+	int listen_fd, fd, i;
+
+	/* Pierwszy port jest zamknięty, drugi przyjmuje połączenia */
+
+	listen_fd = tcp_socket(&good, 1);
+	fd = tcp_socket(&bad, 0);
+	close(fd);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (fd == -1 || !gg_fd_set_nonblocking(fd)) {
+		perror("socket");
+		exit(1);
+	}
+
+	if (connect(fd, (struct sockaddr*) &bad, sizeof(bad)) != -1 || errno != EINPROGRESS) {
+		printf("Asynchronous connection failure not supported\n");
+		close(fd);
+		close(listen_fd);
+		return;
+	}
+
+	memset(&gsp, 0, sizeof(gsp));
+	memset(&gs, 0, sizeof(gs));
+	gs.private_data = &gsp;
+	gs.fd = fd;
+	gs.check = GG_CHECK_WRITE;
+	gs.state = GG_STATE_CONNECTING_GG;
+	gs.timeout = GG_DEFAULT_TIMEOUT;
+	gs.resolver_cleanup = resolver_cleanup;
+	gs.async = 1;
+	gs.resolver_result = malloc(sizeof(struct in_addr));
+	gs.resolver_count = 1;
+	gs.resolver_result[0] = good.sin_addr;
+	gs.connect_port[0] = ntohs(bad.sin_port);
+	gs.connect_port[1] = ntohs(good.sin_port);
+
+	if (gg_loop_add_session(loop, &gs, callback, &priv) == -1) {
+		perror("gg_loop_add_session");
+		exit(1);
+	}
+
+	for (i = 0; i < 5 && gs.state != GG_STATE_READING_KEY; i++) {
+		if (gg_loop_run_once(loop, 1000) == -1) {
+			perror("gg_loop_run_once");
+			exit(1);
+		}
+	}
+
+	if (gs.connect_index != 1 || gs.fd != fd) {
+		fprintf(stderr, "Descriptor not reused (index %d, fd %d)\n", gs.connect_index, gs.fd);
+		exit(1);
+	}
+
+	if (gs.state != GG_STATE_READING_KEY) {
+		fprintf(stderr, "Connection to second port not noticed\n");
+		exit(1);
+	}
+
+	gg_loop_remove(loop, &gs);
+
+	while (gsp.event_pool_count > 0)
+		free(gsp.event_pool[--gsp.event_pool_count]);
+
+	free(gs.resolver_result);
+	free(gsp.recv_ring.buf);
+	free(gsp.recv_ring.frame);
+	close(gs.fd);
+	close(listen_fd);
+}
+
+int main(void)
+{
+	struct gg_session gs;
+	struct gg_session_private gsp;
+	struct gg_loop *loop;
+	char buf[PONG_COUNT * sizeof(struct gg_header)];
+	unsigned int i;
+	int fds[2];
+
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	loop = gg_loop_new();
+
+	if (loop == NULL && errno == ENOSYS) {
+		printf("Event loop not supported\n");
+		return 77;
+	}
+
+	if (loop == NULL) {
+		perror("gg_loop_new");
+		exit(1);
+	}
+
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	if (!gg_fd_set_nonblocking(fds[0])) {
+		perror("gg_fd_set_nonblocking");
+		exit(1);
+	}
+
+	memset(&gsp, 0, sizeof(gsp));
+	memset(&gs, 0, sizeof(gs));
+	gs.private_data = &gsp;
+	gs.fd = fds[0];
+	gs.check = GG_CHECK_READ;
+	gs.state = GG_STATE_CONNECTED;
+	gs.timeout = -1;
+	gs.resolver_cleanup = resolver_cleanup;
+	gs.async = 1;
+
+	/* Odbieranie zdarzeń */
+
+	if (gg_loop_add_session(loop, &gs, callback, &priv) == -1) {
+		perror("gg_loop_add_session");
+		exit(1);
+	}
+
+	if (gg_loop_add_session(loop, &gs, callback, &priv) != -1 || errno != EBUSY) {
+		fprintf(stderr, "Session added twice\n");
+		exit(1);
+	}
+
+	for (i = 0; i < PONG_COUNT; i++) {
+		struct gg_header h;
+
+		h.type = gg_fix32(GG_PONG);
+		h.length = gg_fix32(0);
+		memcpy(buf + i * sizeof(h), &h, sizeof(h));
+	}
+
+	if (send(fds[1], buf, sizeof(buf), 0) != (ssize_t) sizeof(buf)) {
+		perror("send");
+		exit(1);
+	}
+
+	for (i = 0; i < 100 && event_count < PONG_COUNT; i++) {
+		if (gg_loop_run_once(loop, 1000) == -1) {
+			perror("gg_loop_run_once");
+			exit(1);
+		}
+	}
+
+	if (event_count != PONG_COUNT || timeout_count != 0 || error_count != 0) {
+		fprintf(stderr, "Received %d events, %d timeouts, %d errors\n", event_count, timeout_count, error_count);
+		exit(1);
+	}
+
+	if (gg_loop_remove(loop, &gs) != 0 || gsp.loop_item != NULL) {
+		fprintf(stderr, "Session not removed\n");
+		exit(1);
+	}
+
+	if (gg_loop_remove(loop, &gs) != -1 || errno != ENOENT) {
+		fprintf(stderr, "Session removed twice\n");
+		exit(1);
+	}
+
+	/* Przekroczenie czasu */
+
+	gs.timeout = 1;
+
+	if (gg_loop_add_session(loop, &gs, callback, &priv) == -1) {
+		perror("gg_loop_add_session");
+		exit(1);
+	}
+
+	if (gg_loop_run(loop) == -1) {
+		perror("gg_loop_run");
+		exit(1);
+	}
+
+	if (timeout_count != 1 || gsp.loop_item != NULL) {
+		fprintf(stderr, "Timeout not reported\n");
+		exit(1);
+	}
+
+	/* Zerwanie połączenia */
+
+	gs.timeout = -1;
+
+	if (gg_loop_add_session(loop, &gs, callback, &priv) == -1) {
+		perror("gg_loop_add_session");
+		exit(1);
+	}
+
+	close(fds[1]);
+
+	if (gg_loop_run(loop) == -1) {
+		perror("gg_loop_run");
+		exit(1);
+	}
+
+	if (error_count != 1 || gsp.loop_item != NULL) {
+		fprintf(stderr, "Disconnection not reported\n");
+		exit(1);
+	}
+
+	test_failover(loop);
+
+	gg_loop_free(loop);
+
+	while (gsp.event_pool_count > 0)
+		free(gsp.event_pool[--gsp.event_pool_count]);
+
+	free(gsp.recv_ring.buf);
+	free(gsp.recv_ring.frame);
+
+	if (gsp.dummyfds_created) {
+		close(gsp.dummyfds[0]);
+		close(gsp.dummyfds[1]);
+	}
+
+	if (gs.fd != -1)
+		close(gs.fd);
+
+	printf("okay\n");
+
+	return 0;
+}
@@ -0,0 +1,413 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test synchronizacji listy kontaktów. Sesja dostaje losowe listy
+ * kontaktów przez gg_notify_sync(), przeplatane pojedynczymi zmianami.
+ * Odebrane pakiety są stosowane do modelu listy po stronie serwera, który
+ * po każdym wywołaniu musi odpowiadać ostatniej liście, a liczba pakietów
+ * musi być najmniejsza możliwa. Zmiana rodzaju kontaktu powinna dotyczyć
+ * wyłącznie zmienionych bitów.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define CONTACTS 2000
+#define ROUNDS 200
+
+static const char user_types[] = { GG_USER_OFFLINE, GG_USER_NORMAL, GG_USER_BLOCKED };
+
+static char server[CONTACTS];
+static char wanted[CONTACTS];
+
+static uin_t userlist[CONTACTS * 2];
+static char types[CONTACTS * 2];
+
+static int full_lists;
+static int single_packets;
+static char added_types;
+static char removed_types;
+
+static uin_t contact_uin(int i)
+{
+	return 1000 + i * 37;
+}
+
+static int contact_index(uin_t uin)
+{
+	if (uin < 1000 || (uin - 1000) % 37 != 0 || (uin - 1000) / 37 >= CONTACTS) {
+		fprintf(stderr, "Invalid uin %u\n", uin);
+		exit(1);
+	}
+
+	return (uin - 1000) / 37;
+}
+
+static const char *read_uin(const char *ptr, const char *end, uin_t *uin)
+{
+	char tmp[16];
+	uint8_t uin_len;
+
+	if (end - ptr < 2 || ptr[0] != 0x00 || (uin_len = ptr[1]) > 10 ||
+		end - ptr < 2 + uin_len)
+	{
+		fprintf(stderr, "Invalid uin format\n");
+		exit(1);
+	}
+
+	memcpy(tmp, ptr + 2, uin_len);
+	tmp[uin_len] = 0;
+	*uin = strtoul(tmp, NULL, 10);
+
+	return ptr + 2 + uin_len;
+}
+
+static void handle_packet(uint32_t type, const char *ptr, uint32_t len)
+{
+	const char *end = ptr + len;
+	static int in_list;
+
+	switch (type) {
+		case GG_NOTIFY105_FIRST:
+		case GG_NOTIFY105_LAST:
+		case GG_NOTIFY105_LIST_EMPTY:
+		case GG_NOTIFY_FIRST:
+		case GG_NOTIFY_LAST:
+		case GG_LIST_EMPTY:
+			if (!in_list)
+				memset(server, 0, sizeof(server));
+
+			in_list = (type == GG_NOTIFY105_FIRST || type == GG_NOTIFY_FIRST);
+
+			if (type == GG_NOTIFY_FIRST || type == GG_NOTIFY_LAST) {
+				while (end - ptr >= (int) sizeof(struct gg_notify)) {
+					struct gg_notify n;
+
+					memcpy(&n, ptr, sizeof(n));
+					server[contact_index(gg_fix32(n.uin))] |= n.dunno1;
+					ptr += sizeof(n);
+				}
+			} else {
+				while (ptr < end) {
+					uin_t uin;
+
+					ptr = read_uin(ptr, end, &uin);
+					server[contact_index(uin)] |= *ptr++;
+				}
+			}
+
+			if (!in_list)
+				full_lists++;
+
+			break;
+
+		case GG_ADD_NOTIFY105:
+		case GG_REMOVE_NOTIFY105:
+		case GG_ADD_NOTIFY:
+		case GG_REMOVE_NOTIFY:
+		{
+			uin_t uin;
+			char user_type;
+			int i;
+
+			if (type == GG_ADD_NOTIFY || type == GG_REMOVE_NOTIFY) {
+				struct gg_add_remove a;
+
+				memcpy(&a, ptr, sizeof(a));
+				uin = gg_fix32(a.uin);
+				user_type = a.dunno1;
+			} else {
+				ptr = read_uin(ptr, end, &uin);
+				user_type = *ptr;
+			}
+
+			i = contact_index(uin);
+
+			if (type == GG_ADD_NOTIFY105 || type == GG_ADD_NOTIFY) {
+				server[i] |= user_type;
+				added_types |= user_type;
+			} else {
+				server[i] &= ~user_type;
+				removed_types |= user_type;
+			}
+
+			single_packets++;
+			break;
+		}
+
+		default:
+			fprintf(stderr, "Unexpected packet 0x%x\n", type);
+			exit(1);
+	}
+}
+
+static void receive(struct gg_session *gs, int fd)
+{
+	static char buf[1024 * 1024];
+	size_t len = 0, offset = 0;
+	ssize_t res;
+
+	if (gs->send_left != 0) {
+		fprintf(stderr, "Data left in queue\n");
+		exit(1);
+	}
+
+	while ((res = recv(fd, buf + len, sizeof(buf) - len, MSG_DONTWAIT)) > 0)
+		len += res;
+
+	while (offset < len) {
+		struct gg_header h;
+
+		memcpy(&h, buf + offset, sizeof(h));
+		offset += sizeof(h);
+		handle_packet(gg_fix32(h.type), buf + offset, gg_fix32(h.length));
+		offset += gg_fix32(h.length);
+	}
+
+	if (offset != len) {
+		fprintf(stderr, "Truncated packet\n");
+		exit(1);
+	}
+}
+
+static void check_server(void)
+{
+	int i;
+
+	for (i = 0; i < CONTACTS; i++) {
+		if (server[i] != wanted[i]) {
+			fprintf(stderr, "Contact %d: server 0x%x, wanted 0x%x\n",
+				i, server[i], wanted[i]);
+			exit(1);
+		}
+	}
+}
+
+static void test_sync(int protocol_version)
+{
+	struct gg_session *gs;
+	int fds[2], round;
+
+	gs = session_new(fds);
+	gs->protocol_version = protocol_version;
+
+	memset(server, 0x7f, sizeof(server));
+	full_lists = 0;
+
+	for (round = 0; round < ROUNDS; round++) {
+		int count = 0, expected = 0, i, density;
+
+		/* Od pustej listy do wszystkich kontaktów, z powtórzeniami */
+		density = rand() % 5;
+
+		for (i = 0; i < CONTACTS; i++) {
+			char old = wanted[i];
+
+			wanted[i] = 0;
+
+			if (density != 0 && rand() % 4 < density) {
+				wanted[i] = user_types[rand() % 3];
+				userlist[count] = contact_uin(i);
+				types[count++] = wanted[i];
+
+				if (rand() % 50 == 0) {
+					char dup = user_types[rand() % 3];
+
+					wanted[i] |= dup;
+					userlist[count] = contact_uin(i);
+					types[count++] = dup;
+				}
+			}
+
+			/* Osobno usunięte i dodane bity rodzaju */
+			if (round != 0) {
+				expected += (old & ~wanted[i]) ? 1 : 0;
+				expected += (wanted[i] & ~old) ? 1 : 0;
+			}
+		}
+
+		/* Przemieszanie kolejności */
+		for (i = count - 1; i > 0; i--) {
+			int j = rand() % (i + 1);
+			uin_t tmp_uin = userlist[i];
+			char tmp_type = types[i];
+
+			userlist[i] = userlist[j];
+			types[i] = types[j];
+			userlist[j] = tmp_uin;
+			types[j] = tmp_type;
+		}
+
+		single_packets = 0;
+
+		if (gg_notify_sync(gs, userlist, types, count) == -1) {
+			perror("gg_notify_sync");
+			exit(1);
+		}
+
+		receive(gs, fds[1]);
+		check_server();
+
+		if (full_lists != 1 || single_packets != expected) {
+			fprintf(stderr, "Round %d: %d full lists, %d packets, "
+				"expected %d\n", round, full_lists,
+				single_packets, expected);
+			exit(1);
+		}
+
+		/* Pojedyncze zmiany poza gg_notify_sync() */
+		for (i = 0; i < 10; i++) {
+			int j = rand() % CONTACTS;
+			char user_type = user_types[rand() % 3];
+
+			if (wanted[j] != 0) {
+				if (gg_remove_notify_ex(gs, contact_uin(j), wanted[j]) == -1) {
+					perror("gg_remove_notify_ex");
+					exit(1);
+				}
+				wanted[j] = 0;
+			} else {
+				if (gg_add_notify_ex(gs, contact_uin(j), user_type) == -1) {
+					perror("gg_add_notify_ex");
+					exit(1);
+				}
+				wanted[j] = user_type;
+			}
+		}
+
+		receive(gs, fds[1]);
+		check_server();
+	}
+
+	/* Pełna lista wysłana z pominięciem gg_notify_sync() */
+	if (gg_notify_ex(gs, userlist, NULL, 0) == -1 ||
+		gg_notify_sync(gs, userlist, NULL, 1) == -1)
+	{
+		perror("gg_notify_ex");
+		exit(1);
+	}
+
+	memset(wanted, 0, sizeof(wanted));
+	wanted[contact_index(userlist[0])] = GG_USER_NORMAL;
+
+	receive(gs, fds[1]);
+	check_server();
+
+	if (full_lists != 3) {
+		fprintf(stderr, "List not resent after gg_notify_ex()\n");
+		exit(1);
+	}
+
+	gg_free_session(gs);
+
+	close(fds[1]);
+}
+
+static void test_type_change(int protocol_version)
+{
+	static const struct {
+		char from;
+		char to;
+		char removed;
+		char added;
+	} changes[] = {
+		{ GG_USER_NORMAL, GG_USER_OFFLINE, GG_USER_NORMAL & ~GG_USER_OFFLINE, 0 },
+		{ GG_USER_OFFLINE, GG_USER_NORMAL, 0, GG_USER_NORMAL & ~GG_USER_OFFLINE },
+		{ GG_USER_NORMAL, GG_USER_BLOCKED, GG_USER_NORMAL, GG_USER_BLOCKED },
+		{ GG_USER_BLOCKED, GG_USER_NORMAL | GG_USER_BLOCKED, 0, GG_USER_NORMAL },
+	};
+	struct gg_session *gs;
+	unsigned int i;
+	int fds[2];
+
+	gs = session_new(fds);
+	gs->protocol_version = protocol_version;
+
+	userlist[0] = contact_uin(0);
+
+	for (i = 0; i < sizeof(changes) / sizeof(changes[0]); i++) {
+		/* Pierwsza lista jest wysyłana w całości */
+		types[0] = changes[i].from;
+
+		if (gg_notify_ex(gs, userlist, NULL, 0) == -1 ||
+			gg_notify_sync(gs, userlist, types, 1) == -1)
+		{
+			perror("gg_notify_sync");
+			exit(1);
+		}
+
+		receive(gs, fds[1]);
+
+		types[0] = changes[i].to;
+		single_packets = 0;
+		added_types = 0;
+		removed_types = 0;
+
+		if (gg_notify_sync(gs, userlist, types, 1) == -1) {
+			perror("gg_notify_sync");
+			exit(1);
+		}
+
+		receive(gs, fds[1]);
+
+		if (server[0] != changes[i].to ||
+			removed_types != changes[i].removed ||
+			added_types != changes[i].added ||
+			single_packets != (changes[i].removed != 0) + (changes[i].added != 0))
+		{
+			fprintf(stderr, "Change 0x%x -> 0x%x: removed 0x%x, added 0x%x in %d packets\n",
+				changes[i].from, changes[i].to, removed_types,
+				added_types, single_packets);
+			exit(1);
+		}
+	}
+
+	gg_free_session(gs);
+
+	close(fds[1]);
+}
+
+int main(void)
+{
+	srand(time(NULL));
+
+	gg_debug_level = 0;
+
+	test_sync(GG_PROTOCOL_VERSION_110);
+
+	memset(wanted, 0, sizeof(wanted));
+
+	test_sync(0x2e);
+
+	test_type_change(GG_PROTOCOL_VERSION_110);
+	test_type_change(0x2e);
+
+	printf("okay\n");
+
+	return 0;
+}
@@ -37,6 +37,12 @@ int expected_packet;
 static int recv_called = 0;
 static int send_called = 0;
 
+static const char *stream_data = NULL;
+static size_t stream_len;
+static size_t stream_offset;
+static size_t stream_chunk;
+static int stream_eof;
+
 struct {
 	const char *data;
 	int result;
@@ -113,6 +119,29 @@ ssize_t recv(int fd, void *buf, size_t len, int flags)
 
 	recv_called = 1;
 
+	if (stream_data != NULL) {
+		size_t chunk;
+
+		if (stream_offset == stream_len) {
+			if (stream_eof)
+				return 0;
+			errno = EAGAIN;
+			return -1;
+		}
+
+		/* Różne porcje danych, żeby pakiety zawijały się w buforze */
+		chunk = stream_chunk++ % 7 * 1000 + 1;
+		if (chunk > len)
+			chunk = len;
+		if (chunk > stream_len - stream_offset)
+			chunk = stream_len - stream_offset;
+
+		memcpy(buf, stream_data + stream_offset, chunk);
+		stream_offset += chunk;
+
+		return chunk;
+	}
+
 	if (fd != 123) {
 		fprintf(stderr, "recv: Invalid descriptor\n");
 		errno = EINVAL;
@@ -162,6 +191,43 @@ static void gs_init(struct gg_session *gs, struct gg_session_private *gsp, int a
 	gs->async = async;
 }
 
+static void gs_free_send_queue(struct gg_session *gs)
+{
+	struct gg_session_private *gsp = gs->private_data;
+
+	while (gsp->send_head != NULL) {
+		gg_send_chunk_t *next = gsp->send_head->next;
+
+		free(gsp->send_head);
+		gsp->send_head = next;
+	}
+
+	gsp->send_tail = NULL;
+	gs->send_buf = NULL;
+	gs->send_left = 0;
+}
+
+static int gs_send_queue_equals(struct gg_session *gs, const char *buf, size_t len)
+{
+	struct gg_session_private *gsp = gs->private_data;
+	gg_send_chunk_t *chunk;
+	size_t offset = 0;
+
+	if ((size_t) gs->send_left != len)
+		return 0;
+
+	for (chunk = gsp->send_head; chunk != NULL; chunk = chunk->next) {
+		size_t n = chunk->end - chunk->start;
+
+		if (offset + n > len || memcmp(chunk->buf + chunk->start, buf + offset, n) != 0)
+			return 0;
+
+		offset += n;
+	}
+
+	return (offset == len);
+}
+
 /* TODO: napisać test na r1324 */
 static void test_recv_packet(void)
 {
@@ -238,6 +304,98 @@ static void test_recv_packet(void)
 	fprintf(stderr, "Test succeeded.\n");
 }
 
+static void test_recv_stream(void)
+{
+	struct gg_session gs;
+	struct gg_session_private gsp;
+	char *data;
+	size_t i, len = 0, count;
+	uint32_t length;
+
+	gg_debug_level = 0;
+
+	gs_init(&gs, &gsp, 1);
+
+	data = malloc(2 * 1024 * 1024);
+
+	if (data == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	/* Pakiety różnej długości, również większe niż bufor cykliczny */
+
+	for (i = 0, length = 0; len + 8 + length < 2 * 1024 * 1024; i++) {
+		struct gg_header gh;
+
+		gh.type = gg_fix32(i);
+		gh.length = gg_fix32(length);
+		memcpy(data + len, &gh, sizeof(gh));
+		memset(data + len + sizeof(gh), 'A' + i % 26, length);
+		len += sizeof(gh) + length;
+
+		length = (length * 7 + 1234) % 40000;
+	}
+
+	count = i;
+
+	stream_data = data;
+	stream_len = len;
+	stream_offset = 0;
+	stream_eof = 0;
+
+	for (i = 0; i < count; ) {
+		struct gg_header *gh;
+		size_t j;
+
+		gh = gg_recv_packet(&gs);
+
+		if (gh == NULL) {
+			if (errno != EAGAIN) {
+				fprintf(stderr, "Unexpected error: %s\n", strerror(errno));
+				exit(1);
+			}
+			continue;
+		}
+
+		if (gh->type != i) {
+			fprintf(stderr, "Expected type %d, received %d\n", (int) i, gh->type);
+			exit(1);
+		}
+
+		for (j = 0; j <= gh->length; j++) {
+			char expected = (j < gh->length) ? ('A' + i % 26) : 0;
+
+			if (((char*) gh)[sizeof(*gh) + j] != expected) {
+				fprintf(stderr, "Invalid packet payload\n");
+				exit(1);
+			}
+		}
+
+		free(gh);
+		i++;
+	}
+
+	if (stream_offset != stream_len) {
+		fprintf(stderr, "Stream not consumed\n");
+		exit(1);
+	}
+
+	/* Zamknięcie połączenia zwalnia bufory */
+
+	stream_eof = 1;
+
+	if (gg_recv_packet(&gs) != NULL || errno != ECONNRESET) {
+		fprintf(stderr, "Expected connection reset\n");
+		exit(1);
+	}
+
+	stream_data = NULL;
+	free(data);
+
+	fprintf(stderr, "Test succeeded (%d packets).\n", (int) count);
+}
+
 static unsigned int send_state = 0;
 
 struct {
@@ -251,6 +409,9 @@ struct {
 	{ "\x56\x34\x00\x00\x06\x00\x00\x00""JKLMNO", 14, -1, EINTR },
 	{ "\x56\x34\x00\x00\x06\x00\x00\x00""JKLMNO", 14, 8, 0 },
 	{ "\x67\x45\x00\x00\x06\x00\x00\x00""PQRSTU", 14, -1, EAGAIN },
+	{ "\x89\x67\x00\x00\x06\x00\x00\x00""ABCDEF", 14, 9, 0 },
+	{ "\x9a\x78\x00\x00\x11\x00\x00\x00""abcdefghijklmnopq", 25, 25, 0 },
+	{ "\x11\x11\x00\x00\x06\x00\x00\x00""ABCDEF", 14, -1, EAGAIN },
 };
 
 #undef send
@@ -288,6 +449,36 @@ ssize_t send(int fd, const void *buf, size_t len, int flags)
 	return res;
 }
 
+#ifndef _WIN32
+ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+	char *buf;
+	size_t len = 0, i;
+	ssize_t res;
+
+	for (i = 0; i < (size_t) msg->msg_iovlen; i++)
+		len += msg->msg_iov[i].iov_len;
+
+	buf = malloc(len);
+
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0, len = 0; i < (size_t) msg->msg_iovlen; i++) {
+		memcpy(buf + len, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+		len += msg->msg_iov[i].iov_len;
+	}
+
+	res = send(fd, buf, len, flags);
+
+	free(buf);
+
+	return res;
+}
+#endif
+
 static void test_send_packet(void)
 {
 	struct gg_session gs;
@@ -334,7 +525,7 @@ static void test_send_packet(void)
 		exit(1);
 	}
 
-	free(gs.send_buf);
+	gs_free_send_queue(&gs);
 
 	/* EAGAIN na początek */
 
@@ -367,7 +558,105 @@ static void test_send_packet(void)
 		exit(1);
 	}
 
-	free(gs.send_buf);
+	gs_free_send_queue(&gs);
+
+	/* Niekompletna transmisja w środku fragmentu */
+
+	gs_init(&gs, &gsp, 1);
+
+	if (gg_send_packet(&gs, 0x6789, "AB", 2, "CD", 2, "EF", 2, NULL) != 0) {
+		fprintf(stderr, "Expected success\n");
+		exit(1);
+	}
+
+	if (gs.send_buf == NULL || gs.send_left != 5 || memcmp(gs.send_buf, "BCDEF", 5) != 0) {
+		fprintf(stderr, "Not queued properly\n");
+		exit(1);
+	}
+
+	gs_free_send_queue(&gs);
+
+	/* Więcej fragmentów niż mieści tablica */
+
+	gs_init(&gs, &gsp, 1);
+
+	if (gg_send_packet(&gs, 0x789a, "a", 1, "b", 1, "c", 1, "d", 1,
+		"e", 1, "f", 1, "g", 1, "h", 1, "i", 1, "j", 1, "k", 1, "l", 1,
+		"m", 1, "n", 1, "o", 1, "p", 1, "q", 1, NULL) != 0)
+	{
+		fprintf(stderr, "Expected success\n");
+		exit(1);
+	}
+
+	if (gs.send_buf != NULL || gs.send_left != 0) {
+		fprintf(stderr, "Unexpected queue\n");
+		exit(1);
+	}
+
+	/* Przekroczenie limitu kolejki */
+
+	gs_init(&gs, &gsp, 1);
+	gsp.send_queue_limit = 20;
+
+	if (gg_send_packet(&gs, 0x1111, "ABCDEF", 6, NULL) != 0) {
+		fprintf(stderr, "Expected success\n");
+		exit(1);
+	}
+
+	if (gg_send_packet(&gs, 0x2222, "GHI", 3, NULL) != -1 || errno != ENOBUFS) {
+		fprintf(stderr, "Expected ENOBUFS\n");
+		exit(1);
+	}
+
+	if (!gs_send_queue_equals(&gs, "\x11\x11\x00\x00\x06\x00\x00\x00""ABCDEF", 14)) {
+		fprintf(stderr, "Not queued properly\n");
+		exit(1);
+	}
+
+	/* Dopisanie do kolejki więcej niż mieści jeden fragment */
+
+	gsp.send_queue_limit = 0;
+
+	{
+		char *big, *expect;
+		size_t i;
+
+		big = malloc(GG_SEND_CHUNK_SIZE + 1000);
+		expect = malloc(14 + 8 + GG_SEND_CHUNK_SIZE + 1000);
+
+		if (big == NULL || expect == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+
+		for (i = 0; i < GG_SEND_CHUNK_SIZE + 1000; i++)
+			big[i] = i * 7;
+
+		if (gg_send_packet(&gs, 0x3333, big, GG_SEND_CHUNK_SIZE + 1000, NULL) != 0) {
+			fprintf(stderr, "Expected success\n");
+			exit(1);
+		}
+
+		memcpy(expect, "\x11\x11\x00\x00\x06\x00\x00\x00""ABCDEF", 14);
+		memcpy(expect + 14, "\x33\x33\x00\x00", 4);
+		expect[18] = (GG_SEND_CHUNK_SIZE + 1000) & 255;
+		expect[19] = (GG_SEND_CHUNK_SIZE + 1000) >> 8;
+		expect[20] = 0;
+		expect[21] = 0;
+		memcpy(expect + 22, big, GG_SEND_CHUNK_SIZE + 1000);
+
+		if (!gs_send_queue_equals(&gs, expect, 22 + GG_SEND_CHUNK_SIZE + 1000) ||
+			gsp.send_head == gsp.send_tail)
+		{
+			fprintf(stderr, "Not queued properly\n");
+			exit(1);
+		}
+
+		free(expect);
+		free(big);
+	}
+
+	gs_free_send_queue(&gs);
 
 	/* Sprawdź, czy wszystko już sprawdzone */
 
@@ -397,6 +686,7 @@ int main(void)
 #endif
 
 	test_recv_packet();
+	test_recv_stream();
 	test_send_packet();
 
 	return 0;
@@ -0,0 +1,196 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test rozpakowywania wiadomości protokołu 11.0. Sesja w stanie
+ * GG_STATE_CONNECTED wielokrotnie dostaje pakiet GG_RECV_MSG110, który jest
+ * rozpakowywany do areny sesji, a pola typu bytes wskazują na bufor pakietu.
+ * Zawartość zdarzeń musi być poprawna również po ponownym użyciu areny,
+ * a potwierdzenie, pakowane bezpośrednio do kolejki danych do wysłania,
+ * musi dotrzeć w całości.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define ROUNDS 1000
+
+static const char formats[] = { 0x00, 0x00, 0x08, 0x00, 0x00, 0x00 };
+
+static size_t build_packet(char *buf, uint32_t seq, const char *text)
+{
+	struct gg_header h;
+	size_t len = sizeof(h), text_len = strlen(text);
+
+	/* sender = "\x00\x05" "12345" */
+	buf[len++] = 0x0a;
+	buf[len++] = 7;
+	buf[len++] = 0x00;
+	buf[len++] = 5;
+	memcpy(buf + len, "12345", 5);
+	len += 5;
+
+	/* flags = 8 */
+	buf[len++] = 0x10;
+	buf[len++] = 0x08;
+
+	/* seq */
+	buf[len++] = 0x18;
+	buf[len++] = seq & 0x7f;
+
+	/* time */
+	buf[len++] = 0x25;
+	memset(buf + len, 0, 4);
+	len += 4;
+
+	/* msg_plain */
+	buf[len++] = 0x2a;
+	buf[len++] = text_len;
+	memcpy(buf + len, text, text_len);
+	len += text_len;
+
+	/* data */
+	buf[len++] = 0x3a;
+	buf[len++] = sizeof(formats);
+	memcpy(buf + len, formats, sizeof(formats));
+	len += sizeof(formats);
+
+	h.type = gg_fix32(GG_RECV_MSG110);
+	h.length = gg_fix32(len - sizeof(h));
+	memcpy(buf, &h, sizeof(h));
+
+	return len;
+}
+
+static void check_ack(int fd, uint32_t seq)
+{
+	/* type = MSG, seq, dummy1 = 1 */
+	const char payload[] = { 0x08, 0x01, 0x10, seq & 0x7f, 0x18, 0x01 };
+	struct gg_header h;
+	char buf[256];
+	ssize_t res;
+
+	res = recv(fd, buf, sizeof(buf), 0);
+
+	if (res != (ssize_t) (sizeof(h) + sizeof(payload))) {
+		fprintf(stderr, "Invalid ack length %d\n", (int) res);
+		exit(1);
+	}
+
+	memcpy(&h, buf, sizeof(h));
+
+	if (gg_fix32(h.type) != GG_ACK110 ||
+		gg_fix32(h.length) != sizeof(payload) ||
+		memcmp(buf + sizeof(h), payload, sizeof(payload)) != 0)
+	{
+		fprintf(stderr, "Invalid ack for %u\n", seq);
+		exit(1);
+	}
+}
+
+int main(void)
+{
+	struct gg_session *gs;
+	char buf[256], text[64];
+	unsigned int round;
+	int fds[2];
+
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	gs = session_new(fds);
+
+	if (!gg_fd_set_nonblocking(fds[1])) {
+		perror("gg_fd_set_nonblocking");
+		exit(1);
+	}
+
+	for (round = 0; round < ROUNDS; round++) {
+		struct gg_event *ge;
+		size_t len;
+
+		/* Kolejne wiadomości mają różną długość, żeby poprzednia
+		 * zawartość areny nie mogła przypadkiem dać dobrego wyniku. */
+		snprintf(text, sizeof(text), "Message %u %.*s", round,
+			(int) (round % 32), "................................");
+
+		len = build_packet(buf, round, text);
+
+		if (send(fds[1], buf, len, 0) != (ssize_t) len) {
+			perror("send");
+			exit(1);
+		}
+
+		ge = gg_watch_fd(gs);
+
+		if (ge == NULL) {
+			perror("gg_watch_fd");
+			exit(1);
+		}
+
+		if (ge->type != GG_EVENT_MSG) {
+			fprintf(stderr, "Unexpected event %s\n", gg_debug_event(ge->type));
+			exit(1);
+		}
+
+		if (ge->event.msg.sender != 12345 ||
+			ge->event.msg.seq != (round & 0x7f) ||
+			strcmp((char*) ge->event.msg.message, text) != 0)
+		{
+			fprintf(stderr, "Invalid message %u from %u: \"%s\"\n",
+				ge->event.msg.seq, ge->event.msg.sender,
+				ge->event.msg.message);
+			exit(1);
+		}
+
+		if (ge->event.msg.formats_length != sizeof(formats) ||
+			memcmp(ge->event.msg.formats, formats, sizeof(formats)) != 0)
+		{
+			fprintf(stderr, "Invalid formats\n");
+			exit(1);
+		}
+
+		gg_event_free(ge);
+
+		check_ack(fds[1], round & 0x7f);
+	}
+
+	if (gs->private_data->protobuf_arena == NULL) {
+		fprintf(stderr, "Arena not used\n");
+		exit(1);
+	}
+
+	gg_free_session(gs);
+
+	close(fds[1]);
+
+	printf("okay\n");
+
+	return 0;
+}
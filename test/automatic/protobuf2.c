@@ -0,0 +1,442 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test porównujący wyspecjalizowane kodowanie wiadomości protokołu 11.0
+ * z ogólnym kodowaniem protobuf-c. Losowe wiadomości oraz ich uszkodzone
+ * wersje muszą zostać rozpakowane tak samo przez obie implementacje,
+ * z alokatorem systemowym i z alokatorem, który nie zwalnia pamięci.
+ * Na koniec mierzony jest czas rozpakowywania obiema metodami.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "protobuf-fast.h"
+
+#define ROUNDS 20000
+#define BENCH_ROUNDS 200000
+
+#define POOL_SIZE 65536
+
+static char pool[POOL_SIZE];
+static size_t pool_used;
+
+static void *pool_alloc(void *allocator_data, size_t size)
+{
+	void *res;
+
+	size = (size + 15) & ~(size_t) 15;
+
+	if (pool_used + size > sizeof(pool))
+		return NULL;
+
+	res = pool + pool_used;
+	pool_used += size;
+
+	return res;
+}
+
+/* Alokator bez funkcji zwalniającej, tak jak arena sesji */
+static ProtobufCAllocator pool_allocator = { pool_alloc, NULL, NULL };
+
+static uint32_t random32(void)
+{
+	uint32_t r = rand() & 0xffff;
+
+	r |= (uint32_t) (rand() & 0xffff) << 16;
+
+	/* Krótkie liczby są częstsze w prawdziwych pakietach */
+	switch (rand() % 4) {
+		case 0:
+			return r & 0x7f;
+		case 1:
+			return r & 0x3fff;
+		default:
+			return r;
+	}
+}
+
+static uint64_t random64(void)
+{
+	return ((uint64_t) random32() << 32) | random32();
+}
+
+static void random_bytes(ProtobufCBinaryData *bd, uint8_t *buf, size_t size)
+{
+	size_t i;
+
+	bd->len = rand() % size;
+	bd->data = buf;
+
+	for (i = 0; i < bd->len; i++)
+		buf[i] = rand();
+}
+
+static char *random_string(char *buf, size_t size)
+{
+	size_t i, len = rand() % size;
+
+	for (i = 0; i < len; i++)
+		buf[i] = 'a' + rand() % 26;
+
+	buf[len] = 0;
+
+	return buf;
+}
+
+static int bytes_equal(const ProtobufCBinaryData *a, const ProtobufCBinaryData *b)
+{
+	if (a->len != b->len)
+		return 0;
+
+	return (a->len == 0 || memcmp(a->data, b->data, a->len) == 0);
+}
+
+static int string_equal(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+		return (a == b);
+
+	return (strcmp(a, b) == 0);
+}
+
+static int recv_message_equal(const GG110RecvMessage *a, const GG110RecvMessage *b)
+{
+	if (a == NULL || b == NULL)
+		return (a == b);
+
+	return (a->base.n_unknown_fields == b->base.n_unknown_fields &&
+		a->has_sender == b->has_sender &&
+		bytes_equal(&a->sender, &b->sender) &&
+		a->flags == b->flags &&
+		a->seq == b->seq &&
+		a->time == b->time &&
+		string_equal(a->msg_plain, b->msg_plain) &&
+		string_equal(a->msg_xhtml, b->msg_xhtml) &&
+		a->has_data == b->has_data &&
+		bytes_equal(&a->data, &b->data) &&
+		a->has_msg_id == b->has_msg_id &&
+		a->msg_id == b->msg_id &&
+		a->has_chat_id == b->has_chat_id &&
+		a->chat_id == b->chat_id &&
+		a->has_conv_id == b->has_conv_id &&
+		a->conv_id == b->conv_id);
+}
+
+static int message_ack_equal(const GG110MessageAck *a, const GG110MessageAck *b)
+{
+	size_t i;
+
+	if (a == NULL || b == NULL)
+		return (a == b);
+
+	if (a->base.n_unknown_fields != b->base.n_unknown_fields ||
+		a->msg_type != b->msg_type ||
+		a->seq != b->seq ||
+		a->time != b->time ||
+		a->has_msg_id != b->has_msg_id ||
+		a->msg_id != b->msg_id ||
+		a->has_conv_id != b->has_conv_id ||
+		a->conv_id != b->conv_id ||
+		a->dummy1 != b->dummy1 ||
+		a->n_links != b->n_links)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < a->n_links; i++) {
+		if (a->links[i]->id != b->links[i]->id ||
+			!string_equal(a->links[i]->url, b->links[i]->url))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int pong_equal(const GG110Pong *a, const GG110Pong *b)
+{
+	if (a == NULL || b == NULL)
+		return (a == b);
+
+	return (a->base.n_unknown_fields == b->base.n_unknown_fields &&
+		a->server_time == b->server_time);
+}
+
+/* Losowo uszkadza zakodowaną wiadomość: zmienia bajty, skraca ją albo
+ * dopisuje nieznane pole. */
+static size_t mutate(uint8_t *buf, size_t len, size_t size)
+{
+	switch (rand() % 4) {
+		case 0:
+			if (len > 0)
+				buf[rand() % len] = rand();
+			break;
+		case 1:
+			if (len > 0)
+				len = rand() % len;
+			break;
+		case 2:
+			if (len + 2 <= size) {
+				buf[len++] = (1 + rand() % 20) << 3;
+				buf[len++] = rand() & 0x7f;
+			}
+			break;
+	}
+
+	return len;
+}
+
+static void check_recv_message(ProtobufCAllocator *allocator, const uint8_t *buf, size_t len)
+{
+	GG110RecvMessage *a, *b;
+
+	pool_used = 0;
+
+	a = gg110_recv_message__unpack(allocator, len, buf);
+	b = gg_protobuf_unpack_recv_message(allocator, len, buf);
+
+	if (!recv_message_equal(a, b)) {
+		fprintf(stderr, "GG110RecvMessage mismatch (%s, %s)\n",
+			(a != NULL) ? "valid" : "invalid",
+			(b != NULL) ? "valid" : "invalid");
+		exit(1);
+	}
+
+	protobuf_c_message_free_unpacked((ProtobufCMessage*) a, allocator);
+	protobuf_c_message_free_unpacked((ProtobufCMessage*) b, allocator);
+}
+
+static void check_message_ack(ProtobufCAllocator *allocator, const uint8_t *buf, size_t len)
+{
+	GG110MessageAck *a, *b;
+
+	pool_used = 0;
+
+	a = gg110_message_ack__unpack(allocator, len, buf);
+	b = gg_protobuf_unpack_message_ack(allocator, len, buf);
+
+	if (!message_ack_equal(a, b)) {
+		fprintf(stderr, "GG110MessageAck mismatch (%s, %s)\n",
+			(a != NULL) ? "valid" : "invalid",
+			(b != NULL) ? "valid" : "invalid");
+		exit(1);
+	}
+
+	protobuf_c_message_free_unpacked((ProtobufCMessage*) a, allocator);
+	protobuf_c_message_free_unpacked((ProtobufCMessage*) b, allocator);
+}
+
+static void check_pong(ProtobufCAllocator *allocator, const uint8_t *buf, size_t len)
+{
+	GG110Pong *a, *b;
+
+	pool_used = 0;
+
+	a = gg110_pong__unpack(allocator, len, buf);
+	b = gg_protobuf_unpack_pong(allocator, len, buf);
+
+	if (!pong_equal(a, b)) {
+		fprintf(stderr, "GG110Pong mismatch\n");
+		exit(1);
+	}
+
+	protobuf_c_message_free_unpacked((ProtobufCMessage*) a, allocator);
+	protobuf_c_message_free_unpacked((ProtobufCMessage*) b, allocator);
+}
+
+static size_t build_recv_message(uint8_t *buf)
+{
+	GG110RecvMessage msg = GG110_RECV_MESSAGE__INIT;
+	uint8_t sender[16], data[64];
+	char plain[128], xhtml[128];
+
+	if ((msg.has_sender = rand() % 2))
+		random_bytes(&msg.sender, sender, sizeof(sender));
+	msg.flags = random32();
+	msg.seq = random32();
+	msg.time = random32();
+	if (rand() % 4 != 0)
+		msg.msg_plain = random_string(plain, sizeof(plain));
+	if (rand() % 2)
+		msg.msg_xhtml = random_string(xhtml, sizeof(xhtml));
+	if ((msg.has_data = rand() % 2))
+		random_bytes(&msg.data, data, sizeof(data));
+	if ((msg.has_msg_id = rand() % 2))
+		msg.msg_id = random64();
+	if ((msg.has_chat_id = rand() % 2))
+		msg.chat_id = random64();
+	if ((msg.has_conv_id = rand() % 2))
+		msg.conv_id = random64();
+
+	return gg110_recv_message__pack(&msg, buf);
+}
+
+static size_t build_message_ack(uint8_t *buf)
+{
+	GG110MessageAck msg = GG110_MESSAGE_ACK__INIT;
+	GG110MessageAckLink links[3], *link_ptrs[3];
+	char urls[3][32];
+	size_t i;
+
+	msg.msg_type = random32();
+	msg.seq = random32();
+	msg.time = random32();
+	if ((msg.has_msg_id = rand() % 2))
+		msg.msg_id = random64();
+	if ((msg.has_conv_id = rand() % 2))
+		msg.conv_id = random64();
+	msg.dummy1 = random32();
+	msg.n_links = rand() % 4;
+	msg.links = link_ptrs;
+
+	for (i = 0; i < msg.n_links; i++) {
+		GG110MessageAckLink link = GG110_MESSAGE_ACK_LINK__INIT;
+
+		links[i] = link;
+		links[i].id = random64();
+		links[i].url = random_string(urls[i], sizeof(urls[i]));
+		link_ptrs[i] = &links[i];
+	}
+
+	return gg110_message_ack__pack(&msg, buf);
+}
+
+static size_t build_pong(uint8_t *buf)
+{
+	GG110Pong msg = GG110_PONG__INIT;
+
+	msg.server_time = random32();
+
+	return gg110_pong__pack(&msg, buf);
+}
+
+static void test_unpack(void)
+{
+	ProtobufCAllocator *allocators[2] = { NULL, &pool_allocator };
+	unsigned int round;
+
+	for (round = 0; round < ROUNDS; round++) {
+		ProtobufCAllocator *allocator = allocators[round % 2];
+		uint8_t buf[512];
+		size_t len;
+
+		len = build_recv_message(buf);
+		check_recv_message(allocator, buf, len);
+		len = mutate(buf, len, sizeof(buf));
+		check_recv_message(allocator, buf, len);
+
+		len = build_message_ack(buf);
+		check_message_ack(allocator, buf, len);
+		len = mutate(buf, len, sizeof(buf));
+		check_message_ack(allocator, buf, len);
+
+		len = build_pong(buf);
+		check_pong(allocator, buf, len);
+		len = mutate(buf, len, sizeof(buf));
+		check_pong(allocator, buf, len);
+	}
+}
+
+static void test_pack(void)
+{
+	unsigned int round;
+
+	for (round = 0; round < ROUNDS; round++) {
+		GG110Ack msg = GG110_ACK__INIT;
+		uint8_t a[64], b[64];
+		size_t a_len, b_len;
+
+		msg.type = (rand() % 8 == 0) ? -(int) random32() : (int) random32();
+		msg.seq = random32();
+		msg.dummy1 = random32();
+
+		a_len = gg110_ack__pack(&msg, a);
+		b_len = gg_protobuf_ack_pack(&msg, b);
+
+		if (gg110_ack__get_packed_size(&msg) != gg_protobuf_ack_size(&msg) ||
+			a_len != b_len || memcmp(a, b, a_len) != 0)
+		{
+			fprintf(stderr, "GG110Ack mismatch\n");
+			exit(1);
+		}
+	}
+}
+
+static void test_bench(void)
+{
+	GG110RecvMessage msg = GG110_RECV_MESSAGE__INIT;
+	uint8_t buf[256];
+	clock_t start, generic, fast;
+	unsigned int round;
+	size_t len;
+
+	msg.has_sender = 1;
+	msg.sender.data = (uint8_t*) "\x00\x07" "1234567";
+	msg.sender.len = 9;
+	msg.flags = 8;
+	msg.seq = 12345;
+	msg.time = 1400000000;
+	msg.msg_plain = "Ala ma kota, a kot ma Alę.";
+	msg.has_msg_id = 1;
+	msg.msg_id = 0x123456789abcdefULL;
+	msg.has_conv_id = 1;
+	msg.conv_id = 0xfedcba987654321ULL;
+
+	len = gg110_recv_message__pack(&msg, buf);
+
+	start = clock();
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		pool_used = 0;
+		if (gg110_recv_message__unpack(&pool_allocator, len, buf) == NULL)
+			exit(1);
+	}
+
+	generic = clock() - start;
+	start = clock();
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		pool_used = 0;
+		if (gg_protobuf_unpack_recv_message(&pool_allocator, len, buf) == NULL)
+			exit(1);
+	}
+
+	fast = clock() - start;
+
+	printf("GG110RecvMessage: generic %.1f ns, specialized %.1f ns\n",
+		(double) generic * 1000000000.0 / CLOCKS_PER_SEC / BENCH_ROUNDS,
+		(double) fast * 1000000000.0 / CLOCKS_PER_SEC / BENCH_ROUNDS);
+}
+
+int main(void)
+{
+	srand(time(NULL));
+
+	test_unpack();
+	test_pack();
+	test_bench();
+
+	return 0;
+}
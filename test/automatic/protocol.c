@@ -431,7 +431,7 @@ int main(int argc, char **argv)
 				continue;
 			}
 
-			gg_event_free(ge);
+			gg_event_recycle(gs, ge);
 		}
 	}
 
@@ -0,0 +1,293 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test pamięci podręcznej nazw. Funkcje gethostbyname() i gethostbyname_r()
+ * są podmienione, żeby liczyć zapytania do serwera nazw. Wiele jednoczesnych
+ * próśb o tę samą nazwę musi dać jedno zapytanie, a kolejne prośby muszą
+ * dostać wynik bez zapytania, również negatywny. Sprawdzane jest też użycie
+ * nieaktualnego wyniku, gdy serwer nazw nie odpowiada.
+ */
+
+#include "internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "network.h"
+
+#ifdef GG_CONFIG_HAVE_PTHREAD
+
+#include <pthread.h>
+
+#define HOST "hub.example"
+#define FAIL_HOST "fail.example"
+#define FLAKY_HOST "flaky.example"
+#define ADDRESS "127.0.0.2"
+#define REQUESTS 20
+
+static pthread_mutex_t lookups_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int lookups;
+static int delay_flag;
+static int flaky_flag;
+
+#undef gethostbyname
+struct hostent *gethostbyname(const char *name)
+{
+	static struct hostent he;
+	static struct in_addr addr;
+	static char *addr_list[2];
+
+	pthread_mutex_lock(&lookups_mutex);
+	lookups++;
+	pthread_mutex_unlock(&lookups_mutex);
+
+	if (delay_flag)
+		usleep(300000);
+
+	if (strcmp(name, FAIL_HOST) == 0 ||
+		(strcmp(name, FLAKY_HOST) == 0 && flaky_flag))
+	{
+		return NULL;
+	}
+
+	addr_list[0] = (char*) &addr;
+	addr_list[1] = NULL;
+	addr.s_addr = inet_addr(ADDRESS);
+
+	memset(&he, 0, sizeof(he));
+	he.h_addrtype = AF_INET;
+	he.h_length = sizeof(struct in_addr);
+	he.h_addr_list = addr_list;
+
+	return &he;
+}
+
+#ifdef GG_CONFIG_HAVE_GETHOSTBYNAME_R
+int gethostbyname_r(const char *name, struct hostent *ret, char *buf,
+	size_t buflen, struct hostent **result, int *h_errnop)
+{
+	struct hostent *tmp;
+
+	tmp = gethostbyname(name);
+
+	if (tmp != NULL) {
+		*h_errnop = 0;
+		memcpy(ret, tmp, sizeof(struct hostent));
+		*result = ret;
+	} else {
+		*h_errnop = HOST_NOT_FOUND;
+		*result = NULL;
+	}
+
+	return 0;
+}
+#endif
+
+/* Rozwiązuje nazwę jednocześnie kilka razy i zwraca liczbę zapytań */
+static int resolve(struct gg_session *gs, const char *hostname, int count,
+	int success, int *cached)
+{
+	int fds[REQUESTS], before, i;
+	void *priv[REQUESTS];
+
+	before = lookups;
+
+	for (i = 0; i < count; i++) {
+		if (gs->resolver_start(&fds[i], &priv[i], hostname) == -1) {
+			perror("resolver_start");
+			exit(1);
+		}
+
+		if (cached != NULL)
+			*cached = (priv[i] == NULL);
+	}
+
+	for (i = 0; i < count; i++) {
+		struct in_addr addr[2];
+		size_t done = 0;
+		int res;
+
+		while (done < sizeof(addr)) {
+			res = read(fds[i], (char*) addr + done,
+				sizeof(addr) - done);
+
+			if (res <= 0)
+				break;
+
+			done += res;
+		}
+
+		if ((success && (done != sizeof(addr) ||
+			addr[0].s_addr != inet_addr(ADDRESS) ||
+			addr[1].s_addr != INADDR_NONE)) ||
+			(!success && (done != sizeof(struct in_addr) ||
+			addr[0].s_addr != INADDR_NONE)))
+		{
+			fprintf(stderr, "Invalid result for %s\n", hostname);
+			exit(1);
+		}
+
+		gs->resolver_cleanup(&priv[i], 0);
+		close(fds[i]);
+	}
+
+	return lookups - before;
+}
+
+static void get_stats(struct gg_resolver_cache_stats *stats)
+{
+	if (gg_global_get_resolver_cache_stats(stats) == -1) {
+		perror("gg_global_get_resolver_cache_stats");
+		exit(1);
+	}
+}
+
+static void expect(int cond, const char *msg)
+{
+	struct gg_resolver_cache_stats stats;
+
+	if (cond)
+		return;
+
+	get_stats(&stats);
+
+	fprintf(stderr, "%s (entries %u, hits %u, negative %u, misses %u, "
+		"coalesced %u, stale %u)\n", msg, stats.entries, stats.hits,
+		stats.negative, stats.misses, stats.coalesced, stats.stale);
+	exit(1);
+}
+
+int main(void)
+{
+	struct gg_resolver_cache_stats stats;
+	struct gg_session *gs;
+	int cached;
+
+	gg_debug_level = 0;
+
+	gs = calloc(1, sizeof(struct gg_session));
+
+	if (gs == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	if (gg_session_set_resolver(gs, GG_RESOLVER_PTHREAD) == -1) {
+		perror("gg_session_set_resolver");
+		exit(1);
+	}
+
+	if (gg_global_set_resolver_cache(-1, 0, 0) != -1 || errno != EINVAL) {
+		fprintf(stderr, "Invalid TTL accepted\n");
+		exit(1);
+	}
+
+	/* Bez pamięci podręcznej każda prośba to zapytanie */
+	expect(resolve(gs, HOST, 2, 1, NULL) == 2, "Lookups without cache");
+
+	if (gg_global_set_resolver_cache(60, 60, 0) == -1) {
+		perror("gg_global_set_resolver_cache");
+		exit(1);
+	}
+
+	/* Jednoczesne prośby czekają na jedno zapytanie */
+	delay_flag = 1;
+	expect(resolve(gs, HOST, REQUESTS, 1, NULL) == 1, "Lookups not coalesced");
+	delay_flag = 0;
+
+	get_stats(&stats);
+	expect(stats.misses == 1 && stats.hits + stats.coalesced == REQUESTS - 1 &&
+		stats.entries == 1, "Invalid stats after coalescing");
+
+	/* Wynik z pamięci podręcznej bez uruchamiania wątku */
+	expect(resolve(gs, "Hub.Example", 1, 1, &cached) == 0 && cached,
+		"Cached result not used");
+
+	/* Wynik negatywny */
+	expect(resolve(gs, FAIL_HOST, 1, 0, NULL) == 1, "Failed lookup");
+	expect(resolve(gs, FAIL_HOST, 1, 0, &cached) == 0 && cached,
+		"Negative result not cached");
+	get_stats(&stats);
+	expect(stats.negative == 1, "Negative hit not counted");
+
+#ifdef GG_CONFIG_HAVE_FORK
+	/* Proces potomny nie jest potrzebny, gdy wynik jest znany */
+	if (gg_session_set_resolver(gs, GG_RESOLVER_FORK) == -1) {
+		perror("gg_session_set_resolver");
+		exit(1);
+	}
+
+	expect(resolve(gs, HOST, 1, 1, &cached) == 0 && cached,
+		"Cached result not used by fork resolver");
+
+	if (gg_session_set_resolver(gs, GG_RESOLVER_PTHREAD) == -1) {
+		perror("gg_session_set_resolver");
+		exit(1);
+	}
+#endif
+
+	gg_global_flush_resolver_cache();
+	get_stats(&stats);
+	expect(stats.entries == 0, "Cache not flushed");
+	expect(resolve(gs, HOST, 1, 1, NULL) == 1, "Flushed result used");
+
+	/* Nieaktualny wynik, gdy serwer nazw nie odpowiada */
+	if (gg_global_set_resolver_cache(1, 1, 60) == -1) {
+		perror("gg_global_set_resolver_cache");
+		exit(1);
+	}
+
+	expect(resolve(gs, FLAKY_HOST, 1, 1, NULL) == 1, "Flaky lookup");
+	flaky_flag = 1;
+	usleep(1100000);
+	expect(resolve(gs, FLAKY_HOST, 1, 1, NULL) == 1, "Stale lookup");
+	get_stats(&stats);
+	expect(stats.stale == 1, "Stale result not used");
+	expect(resolve(gs, FLAKY_HOST, 1, 1, NULL) == 0,
+		"Stale result not kept for negative TTL");
+
+	/* Wyłączenie pamięci podręcznej */
+	if (gg_global_set_resolver_cache(0, 0, 0) == -1) {
+		perror("gg_global_set_resolver_cache");
+		exit(1);
+	}
+
+	get_stats(&stats);
+	expect(stats.entries == 0, "Cache not cleared");
+	expect(resolve(gs, HOST, 1, 1, &cached) == 1 && !cached,
+		"Cache not disabled");
+
+	free(gs);
+
+	printf("okay\n");
+
+	return 0;
+}
+
+#else
+
+int main(void)
+{
+	return 77;
+}
+
+#endif /* GG_CONFIG_HAVE_PTHREAD */
@@ -0,0 +1,269 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test listy statusów kontaktów prowadzonej przez bibliotekę. Sesja dostaje
+ * pakiety GG_NOTIFY_REPLY80 i GG_STATUS80 z losowymi zmianami, a kontakty
+ * są losowo usuwane. Zdarzenia GG_EVENT_ROSTER_CHANGE i wynik
+ * gg_roster_find() są porównywane z prostym modelem.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define CONTACTS 3000
+#define ROUNDS 20000
+#define PACKET_CONTACTS 500
+
+static const char *descrs[] = { NULL, "Zaraz wracam", "Zażółć gęślą jaźń" };
+
+struct contact {
+	int present;
+	int status;
+	int descr;
+	int image_size;
+	uint32_t flags;
+	uint16_t remote_port;
+};
+
+static struct contact model[CONTACTS];
+static int expected[CONTACTS];
+
+static uin_t contact_uin(int i)
+{
+	/* Numery o wspólnych młodszych bitach, żeby ciągi w tablicy się
+	 * nakładały */
+	return 1000 + i * 4096;
+}
+
+static size_t put_status(char *buf, int i)
+{
+	struct gg_notify_reply80 n;
+	const char *descr = descrs[model[i].descr];
+	size_t descr_len = (descr != NULL) ? strlen(descr) : 0;
+
+	memset(&n, 0, sizeof(n));
+	n.uin = gg_fix32(contact_uin(i));
+	n.status = gg_fix32(model[i].status);
+	n.image_size = model[i].image_size;
+	n.flags = gg_fix32(model[i].flags);
+	n.remote_port = gg_fix16(model[i].remote_port);
+	n.descr_len = gg_fix32(descr_len);
+
+	memcpy(buf, &n, sizeof(n));
+	if (descr_len > 0)
+		memcpy(buf + sizeof(n), descr, descr_len);
+
+	return sizeof(n) + descr_len;
+}
+
+static void change_contact(int i)
+{
+	struct contact old = model[i];
+	int changed = 0;
+
+	if (rand() % 2)
+		model[i].status = (rand() % 2) ? GG_STATUS_AVAIL : GG_STATUS_BUSY;
+	if (rand() % 2)
+		model[i].descr = rand() % 3;
+	if (rand() % 4 == 0)
+		model[i].image_size = rand() % 256;
+	if (rand() % 4 == 0)
+		model[i].flags = rand() % 4;
+	if (rand() % 4 == 0)
+		model[i].remote_port = rand() % 4;
+
+	if (!old.present)
+		changed = GG_ROSTER_CHANGED_NEW;
+	else {
+		const char *a = descrs[old.descr];
+		const char *b = descrs[model[i].descr];
+
+		if (old.status != model[i].status)
+			changed |= GG_ROSTER_CHANGED_STATUS;
+		if ((a == NULL || b == NULL) ? (a != b) : (strcmp(a, b) != 0))
+			changed |= GG_ROSTER_CHANGED_DESCR;
+		if (old.image_size != model[i].image_size)
+			changed |= GG_ROSTER_CHANGED_IMAGE_SIZE;
+		if (old.flags != model[i].flags)
+			changed |= GG_ROSTER_CHANGED_FLAGS;
+		if (old.remote_port != model[i].remote_port)
+			changed |= GG_ROSTER_CHANGED_ADDRESS;
+	}
+
+	model[i].present = 1;
+	expected[i] = changed;
+}
+
+static void check_event(struct gg_session *gs)
+{
+	struct gg_event *ge;
+	unsigned int count = 0, i;
+	int j;
+
+	ge = gg_watch_fd(gs);
+
+	if (ge == NULL) {
+		perror("gg_watch_fd");
+		exit(1);
+	}
+
+	for (j = 0; j < CONTACTS; j++) {
+		if (expected[j] != 0)
+			count++;
+	}
+
+	if (count == 0) {
+		if (ge->type != GG_EVENT_NONE) {
+			fprintf(stderr, "Unexpected event %s\n", gg_debug_event(ge->type));
+			exit(1);
+		}
+		gg_event_recycle(gs, ge);
+		return;
+	}
+
+	if (ge->type != GG_EVENT_ROSTER_CHANGE || ge->event.roster_change.count != count) {
+		fprintf(stderr, "Expected %u changes, got %s\n", count, gg_debug_event(ge->type));
+		exit(1);
+	}
+
+	for (i = 0; i < count; i++) {
+		struct gg_roster_change *c = &ge->event.roster_change.changes[i];
+
+		j = (c->uin - 1000) / 4096;
+
+		if (c->uin != contact_uin(j) || expected[j] != c->changed) {
+			fprintf(stderr, "Invalid change %u 0x%x\n", c->uin, c->changed);
+			exit(1);
+		}
+
+		expected[j] = 0;
+	}
+
+	gg_event_recycle(gs, ge);
+}
+
+static void check_roster(struct gg_session *gs)
+{
+	int i;
+
+	for (i = 0; i < CONTACTS; i++) {
+		const struct gg_roster_contact *c;
+		const char *descr = descrs[model[i].descr];
+
+		c = gg_roster_find(gs, contact_uin(i));
+
+		if (!model[i].present) {
+			if (c != NULL || errno != ENOENT) {
+				fprintf(stderr, "Contact %d not removed\n", i);
+				exit(1);
+			}
+			continue;
+		}
+
+		if (c == NULL || c->uin != contact_uin(i) ||
+			c->status != model[i].status ||
+			c->image_size != model[i].image_size ||
+			c->flags != model[i].flags ||
+			c->remote_port != model[i].remote_port ||
+			((descr == NULL) ? (c->descr != NULL) :
+			(c->descr == NULL || strcmp(c->descr, descr) != 0)))
+		{
+			fprintf(stderr, "Contact %d mismatch\n", i);
+			exit(1);
+		}
+	}
+}
+
+int main(void)
+{
+	struct gg_session *gs;
+	static char buf[PACKET_CONTACTS * 64];
+	size_t len = 0;
+	int fds[2], i, round;
+
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	srand(time(NULL));
+
+	gs = session_new(fds);
+	gs->private_data->roster_enabled = 1;
+
+	/* Pierwsza lista kontaktów, po kilkaset w pakiecie */
+	for (i = 0; i < CONTACTS; i++) {
+		change_contact(i);
+		len += put_status(buf + len, i);
+
+		if ((i + 1) % PACKET_CONTACTS == 0 || i == CONTACTS - 1) {
+			send_packet(fds[1], GG_NOTIFY_REPLY80, buf, len);
+			check_event(gs);
+
+			/* Powtórzony pakiet nie zmienia niczego */
+			send_packet(fds[1], GG_NOTIFY_REPLY80, buf, len);
+			check_event(gs);
+
+			len = 0;
+		}
+	}
+
+	check_roster(gs);
+
+	for (round = 0; round < ROUNDS; round++) {
+		i = rand() % CONTACTS;
+
+		if (rand() % 4 == 0) {
+			if (gg_remove_notify(gs, contact_uin(i)) == -1) {
+				perror("gg_remove_notify");
+				exit(1);
+			}
+			memset(&model[i], 0, sizeof(model[i]));
+			drain(fds[1]);
+		} else {
+			change_contact(i);
+			len = put_status(buf, i);
+			send_packet(fds[1], GG_STATUS80, buf, len);
+			check_event(gs);
+		}
+
+		if (round % 1000 == 0)
+			check_roster(gs);
+	}
+
+	check_roster(gs);
+
+	gg_free_session(gs);
+
+	close(fds[1]);
+
+	printf("okay\n");
+
+	return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test koła liczników czasu. Losowo ustawiane, przestawiane i odwoływane
+ * liczniki z zakresów obejmujących wszystkie poziomy koła (i wykraczających
+ * poza nie) muszą zostać obsłużone dokładnie raz, w milisekundzie upływu,
+ * a czas najbliższego zdarzenia nie może być późniejszy od najbliższego
+ * licznika. Na koniec mierzony jest czas ustawiania i odwoływania.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timer.h"
+
+#define COUNT 100000
+#define BENCH_ROUNDS 20
+
+typedef struct {
+	gg_timer_t timer;
+	int cancelled;
+	int fired;
+	int rearm;
+} test_timer_t;
+
+static gg_timer_wheel_t wheel;
+static test_timer_t timers[COUNT];
+static unsigned int fired_count;
+
+static uint64_t random_delay(void)
+{
+	static const unsigned int bits[] = { 6, 12, 18, 24, 30, 33 };
+	uint64_t r;
+
+	r = ((uint64_t) rand() << 31) ^ rand();
+
+	return r & (((uint64_t) 1 << bits[rand() % 6]) - 1);
+}
+
+static void handler(gg_timer_t *timer, void *data)
+{
+	test_timer_t *t = data;
+	uint64_t tick = wheel.now - 1;
+
+	if (t->cancelled || t->fired) {
+		fprintf(stderr, "Timer %d fired unexpectedly\n", (int) (t - timers));
+		exit(1);
+	}
+
+	if (tick != timer->expires) {
+		fprintf(stderr, "Timer %d expired at %llu, fired at %llu\n",
+			(int) (t - timers),
+			(unsigned long long) timer->expires,
+			(unsigned long long) tick);
+		exit(1);
+	}
+
+	if (t->rearm) {
+		t->rearm = 0;
+		gg_timer_arm(&wheel, timer, wheel.now + random_delay());
+		return;
+	}
+
+	t->fired = 1;
+	fired_count++;
+}
+
+static uint64_t earliest(void)
+{
+	uint64_t result = GG_TIMER_NEVER;
+	unsigned int i;
+
+	for (i = 0; i < COUNT; i++) {
+		if (gg_timer_is_armed(&timers[i].timer) && timers[i].timer.expires < result)
+			result = timers[i].timer.expires;
+	}
+
+	return result;
+}
+
+static void test_random(void)
+{
+	unsigned int expected = 0, steps = 0, i;
+	uint64_t now = 1234567;
+
+	gg_timer_wheel_init(&wheel, now);
+
+	for (i = 0; i < COUNT; i++) {
+		gg_timer_init(&timers[i].timer, handler, &timers[i]);
+		gg_timer_arm(&wheel, &timers[i].timer, now + random_delay());
+	}
+
+	for (i = 0; i < COUNT; i++) {
+		switch (rand() % 8) {
+			case 0:
+				gg_timer_cancel(&wheel, &timers[i].timer);
+				timers[i].cancelled = 1;
+				break;
+			case 1:
+				gg_timer_arm(&wheel, &timers[i].timer, now + random_delay());
+				break;
+			case 2:
+				timers[i].rearm = 1;
+				break;
+		}
+
+		if (!timers[i].cancelled)
+			expected++;
+	}
+
+	if (wheel.count != expected) {
+		fprintf(stderr, "Invalid timer count %u, expected %u\n", wheel.count, expected);
+		exit(1);
+	}
+
+	while (fired_count < expected) {
+		static const unsigned int bits[] = { 1, 7, 17, 27 };
+		uint64_t next;
+
+		if (steps++ % 256 == 0) {
+			next = gg_timer_next(&wheel);
+
+			if (next > earliest()) {
+				fprintf(stderr, "Next event %llu after earliest timer %llu\n",
+					(unsigned long long) next,
+					(unsigned long long) earliest());
+				exit(1);
+			}
+		}
+
+		now += 1 + (rand() & ((1 << bits[rand() % 4]) - 1));
+
+		gg_timer_run(&wheel, now);
+	}
+
+	if (wheel.count != 0 || gg_timer_next(&wheel) != GG_TIMER_NEVER) {
+		fprintf(stderr, "Timers left in wheel\n");
+		exit(1);
+	}
+
+	printf("%u timers fired in %u steps\n", fired_count, steps);
+}
+
+static void handler_nop(gg_timer_t *timer, void *data)
+{
+}
+
+static void test_bench(void)
+{
+	clock_t start, elapsed;
+	unsigned int i, round;
+
+	gg_timer_wheel_init(&wheel, 0);
+
+	for (i = 0; i < COUNT; i++)
+		gg_timer_init(&timers[i].timer, handler_nop, NULL);
+
+	start = clock();
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		for (i = 0; i < COUNT; i++)
+			gg_timer_arm(&wheel, &timers[i].timer, (i * 7919) % 1800000);
+
+		for (i = 0; i < COUNT; i++)
+			gg_timer_cancel(&wheel, &timers[i].timer);
+	}
+
+	elapsed = clock() - start;
+
+	printf("arm + cancel: %.1f ns\n", (double) elapsed * 1000000000.0 / CLOCKS_PER_SEC / COUNT / BENCH_ROUNDS);
+}
+
+int main(void)
+{
+	srand(time(NULL));
+
+	test_random();
+	test_bench();
+
+	return 0;
+}
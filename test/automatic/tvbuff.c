@@ -0,0 +1,359 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test porównujący odczyt tablic z gg_tvbuff z odczytem pole po polu.
+ * Obie metody muszą zwrócić te same wartości, zostawić bufor w tym samym
+ * miejscu i tak samo reagować na uszkodzone lub zbyt krótkie dane.
+ * Na koniec mierzony jest czas odczytu obiema metodami.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "tvbuff.h"
+
+#define COUNT 1000
+#define ROUNDS 1000
+#define BENCH_ROUNDS 2000
+
+static char buf[COUNT * 16];
+static uint32_t res1[COUNT], res2[COUNT];
+
+/* Kopia z common.c, który wymaga niemal całej biblioteki */
+uin_t gg_str_to_uin(const char *str, int len)
+{
+	char buff[11];
+	char *endptr;
+	uin_t uin;
+
+	if (len < 0)
+		len = strlen(str);
+	if (len > 10)
+		return 0;
+	memcpy(buff, str, len);
+	buff[len] = '\0';
+
+	errno = 0;
+	uin = strtoul(buff, &endptr, 10);
+	if (errno == ERANGE || endptr[0] != '\0')
+		return 0;
+
+	return uin;
+}
+
+static void fill_random(char *ptr, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		ptr[i] = rand();
+}
+
+static void check_same(const char *name, gg_tvbuff_t *tvb1, gg_tvbuff_t *tvb2,
+	size_t count)
+{
+	int valid1, valid2;
+
+	valid1 = gg_tvbuff_is_valid(tvb1);
+	valid2 = gg_tvbuff_is_valid(tvb2);
+
+	if (valid1 != valid2 ||
+		gg_tvbuff_get_remaining(tvb1) != gg_tvbuff_get_remaining(tvb2) ||
+		(valid1 && memcmp(res1, res2, count * sizeof(uint32_t)) != 0))
+	{
+		fprintf(stderr, "%s mismatch (count %d)\n", name, (int) count);
+		exit(1);
+	}
+
+	gg_tvbuff_close(tvb1);
+	gg_tvbuff_close(tvb2);
+}
+
+static void test_uint32_array(void)
+{
+	unsigned int round;
+
+	for (round = 0; round < ROUNDS; round++) {
+		gg_tvbuff_t *tvb1, *tvb2;
+		size_t len, count, i;
+
+		len = rand() % (COUNT * 4);
+		count = rand() % (COUNT + 1);
+		fill_random(buf, len);
+
+		tvb1 = gg_tvbuff_new(buf, len);
+		tvb2 = gg_tvbuff_new(buf, len);
+
+		for (i = 0; i < count && gg_tvbuff_is_valid(tvb1); i++)
+			res1[i] = gg_tvbuff_read_uint32(tvb1);
+
+		gg_tvbuff_read_uint32_array(tvb2, res2, count);
+
+		/* Odczyt pole po polu zatrzymuje się na końcu bufora */
+		if (count * 4 > len) {
+			if (gg_tvbuff_is_valid(tvb2)) {
+				fprintf(stderr, "uint32 array past end of buffer\n");
+				exit(1);
+			}
+			gg_tvbuff_close(tvb1);
+			gg_tvbuff_close(tvb2);
+			continue;
+		}
+
+		check_same("uint32 array", tvb1, tvb2, count);
+	}
+}
+
+static void test_uint32_strided(void)
+{
+	unsigned int round;
+
+	for (round = 0; round < ROUNDS; round++) {
+		gg_tvbuff_t *tvb1, *tvb2;
+		size_t len, count, stride, i;
+
+		stride = 4 + rand() % 13;
+		len = rand() % (COUNT * 16);
+		count = rand() % (COUNT + 1);
+		fill_random(buf, len);
+
+		tvb1 = gg_tvbuff_new(buf, len);
+		tvb2 = gg_tvbuff_new(buf, len);
+
+		for (i = 0; i < count && gg_tvbuff_is_valid(tvb1); i++) {
+			res1[i] = gg_tvbuff_read_uint32(tvb1);
+			gg_tvbuff_skip(tvb1, stride - 4);
+		}
+
+		gg_tvbuff_read_uint32_strided(tvb2, res2, count, stride);
+
+		if (count * stride > len) {
+			if (gg_tvbuff_is_valid(tvb2)) {
+				fprintf(stderr, "uint32 strided past end of buffer\n");
+				exit(1);
+			}
+			gg_tvbuff_close(tvb1);
+			gg_tvbuff_close(tvb2);
+			continue;
+		}
+
+		check_same("uint32 strided", tvb1, tvb2, count);
+	}
+}
+
+static size_t put_uin(char *ptr, const char *uin)
+{
+	size_t len = strlen(uin);
+
+	ptr[0] = len + 2;
+	ptr[1] = 0;
+	ptr[2] = len;
+	memcpy(ptr + 3, uin, len);
+
+	return len + 3;
+}
+
+static const char *random_uin(char *tmp, size_t size)
+{
+	static const char *odd[] = { "0", "007", "+12", "-1", " 5", "12a",
+		"4294967295", "4294967296", "99999999999", "" };
+
+	if (rand() % 8 != 0) {
+		snprintf(tmp, size, "%u", (unsigned int) (1 + rand() % 100000000));
+		return tmp;
+	}
+
+	return odd[rand() % (sizeof(odd) / sizeof(odd[0]))];
+}
+
+static void test_uin_array(void)
+{
+	unsigned int round;
+
+	for (round = 0; round < ROUNDS; round++) {
+		gg_tvbuff_t *tvb1, *tvb2;
+		size_t len = 0, count, i;
+		char tmp[16];
+
+		count = rand() % 100;
+
+		for (i = 0; i < count; i++)
+			len += put_uin(buf + len, random_uin(tmp, sizeof(tmp)));
+
+		/* Uszkodzone nagłówki i ucięte dane */
+		if (len > 0 && rand() % 4 == 0)
+			buf[rand() % len] = rand();
+		if (len > 0 && rand() % 4 == 0)
+			len -= rand() % len;
+
+		tvb1 = gg_tvbuff_new(buf, len);
+		tvb2 = gg_tvbuff_new(buf, len);
+
+		for (i = 0; i < count && gg_tvbuff_is_valid(tvb1); i++)
+			res1[i] = gg_tvbuff_read_uin(tvb1);
+
+		gg_tvbuff_read_uin_array(tvb2, res2, count);
+
+		check_same("uin array", tvb1, tvb2, count);
+	}
+}
+
+static void test_invalid(void)
+{
+	gg_tvbuff_t *tvb;
+
+	memset(buf, 0, 16);
+
+	tvb = gg_tvbuff_new(buf, 16);
+	gg_tvbuff_read_uint32_array(tvb, res1, (size_t) -1 / 2);
+	if (gg_tvbuff_close(tvb)) {
+		fprintf(stderr, "uint32 array overflow not detected\n");
+		exit(1);
+	}
+
+	tvb = gg_tvbuff_new(buf, 16);
+	gg_tvbuff_read_uint32_strided(tvb, res1, (size_t) -1 / 4, 8);
+	if (gg_tvbuff_close(tvb)) {
+		fprintf(stderr, "uint32 strided overflow not detected\n");
+		exit(1);
+	}
+
+	tvb = gg_tvbuff_new(buf, 16);
+	gg_tvbuff_read_uint32_strided(tvb, res1, 2, 2);
+	if (gg_tvbuff_close(tvb)) {
+		fprintf(stderr, "uint32 strided invalid stride not detected\n");
+		exit(1);
+	}
+
+	tvb = gg_tvbuff_new(buf, 16);
+	gg_tvbuff_read_uint32_array(tvb, res1, 0);
+	gg_tvbuff_read_uin_array(tvb, res1, 0);
+	if (gg_tvbuff_get_remaining(tvb) != 16 || !gg_tvbuff_close(tvb)) {
+		fprintf(stderr, "empty array read failed\n");
+		exit(1);
+	}
+}
+
+static double bench_ns(clock_t ticks)
+{
+	return (double) ticks * 1000000000.0 / CLOCKS_PER_SEC /
+		BENCH_ROUNDS / COUNT;
+}
+
+static void test_bench(void)
+{
+	clock_t start, loop_uint32, bulk_uint32, loop_strided, bulk_strided;
+	clock_t loop_uin, bulk_uin;
+	unsigned int round;
+	size_t uin_len = 0, i;
+
+	fill_random(buf, COUNT * 8);
+
+	start = clock();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		gg_tvbuff_t *tvb = gg_tvbuff_new(buf, COUNT * 4);
+		for (i = 0; i < COUNT && gg_tvbuff_is_valid(tvb); i++)
+			res1[i] = gg_tvbuff_read_uint32(tvb);
+		gg_tvbuff_close(tvb);
+	}
+	loop_uint32 = clock() - start;
+
+	start = clock();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		gg_tvbuff_t *tvb = gg_tvbuff_new(buf, COUNT * 4);
+		gg_tvbuff_read_uint32_array(tvb, res2, COUNT);
+		gg_tvbuff_close(tvb);
+	}
+	bulk_uint32 = clock() - start;
+
+	start = clock();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		gg_tvbuff_t *tvb = gg_tvbuff_new(buf, COUNT * 8);
+		for (i = 0; i < COUNT && gg_tvbuff_is_valid(tvb); i++) {
+			res1[i] = gg_tvbuff_read_uint32(tvb);
+			gg_tvbuff_read_uint32(tvb);
+		}
+		gg_tvbuff_close(tvb);
+	}
+	loop_strided = clock() - start;
+
+	start = clock();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		gg_tvbuff_t *tvb = gg_tvbuff_new(buf, COUNT * 8);
+		gg_tvbuff_read_uint32_strided(tvb, res2, COUNT, 8);
+		gg_tvbuff_close(tvb);
+	}
+	bulk_strided = clock() - start;
+
+	for (i = 0; i < COUNT; i++) {
+		char tmp[16];
+
+		snprintf(tmp, sizeof(tmp), "%u", (unsigned int) (1000000 + i * 7919));
+		uin_len += put_uin(buf + uin_len, tmp);
+	}
+
+	start = clock();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		gg_tvbuff_t *tvb = gg_tvbuff_new(buf, uin_len);
+		for (i = 0; i < COUNT && gg_tvbuff_is_valid(tvb); i++)
+			res1[i] = gg_tvbuff_read_uin(tvb);
+		gg_tvbuff_close(tvb);
+	}
+	loop_uin = clock() - start;
+
+	start = clock();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		gg_tvbuff_t *tvb = gg_tvbuff_new(buf, uin_len);
+		gg_tvbuff_read_uin_array(tvb, res2, COUNT);
+		gg_tvbuff_close(tvb);
+	}
+	bulk_uin = clock() - start;
+
+	if (memcmp(res1, res2, sizeof(res1)) != 0) {
+		fprintf(stderr, "uin array benchmark mismatch\n");
+		exit(1);
+	}
+
+	printf("uint32: loop %.2f ns, array %.2f ns per element\n",
+		bench_ns(loop_uint32), bench_ns(bulk_uint32));
+	printf("uint32 (stride 8): loop %.2f ns, strided %.2f ns per element\n",
+		bench_ns(loop_strided), bench_ns(bulk_strided));
+	printf("uin: loop %.2f ns, array %.2f ns per element\n",
+		bench_ns(loop_uin), bench_ns(bulk_uin));
+}
+
+int main(void)
+{
+	srand(time(NULL));
+
+	gg_debug_level = 0;
+
+	test_uint32_array();
+	test_uint32_strided();
+	test_uin_array();
+	test_invalid();
+	test_bench();
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ *  (C) Copyright 2001-2006 Wojtek Kaniewski <wojtekka@irc.pl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License Version
+ *  2.1 as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307,
+ *  USA.
+ */
+
+/*
+ * Test wysyłania listy kontaktów protokołu 11.0. Pakiety budowane są
+ * w buforach z miejscem na nagłówek, dołączanych do kolejki danych do
+ * wysłania bez kopiowania. Odebrane pakiety muszą zawierać wszystkie
+ * kontakty w kolejności, a bufory muszą wrócić do puli sesji.
+ */
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "network.h"
+#include "protocol.h"
+#include "fakesession.h"
+
+#define COUNT 2000
+#define ROUNDS 3
+
+static uin_t userlist[COUNT];
+static char types[COUNT];
+
+static void read_exact(int fd, char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t res = recv(fd, buf, len, 0);
+
+		if (res <= 0) {
+			fprintf(stderr, "Unexpected end of data\n");
+			exit(1);
+		}
+
+		buf += res;
+		len -= res;
+	}
+}
+
+static void check_packets(int fd)
+{
+	char buf[4096];
+	int i = 0, last = 0;
+
+	while (!last) {
+		struct gg_header h;
+		uint32_t type, length, offset = 0;
+
+		read_exact(fd, (char*) &h, sizeof(h));
+
+		type = gg_fix32(h.type);
+		length = gg_fix32(h.length);
+
+		if ((type != GG_NOTIFY105_FIRST && type != GG_NOTIFY105_LAST) ||
+			length > 2048)
+		{
+			fprintf(stderr, "Invalid packet 0x%x, length %u\n", type, length);
+			exit(1);
+		}
+
+		last = (type == GG_NOTIFY105_LAST);
+
+		read_exact(fd, buf, length);
+
+		while (offset < length) {
+			char uin[16];
+			uint8_t uin_len;
+
+			if (i >= COUNT) {
+				fprintf(stderr, "Too many contacts\n");
+				exit(1);
+			}
+
+			snprintf(uin, sizeof(uin), "%u", userlist[i]);
+			uin_len = buf[offset + 1];
+
+			if (buf[offset] != 0x00 || uin_len != strlen(uin) ||
+				memcmp(buf + offset + 2, uin, uin_len) != 0 ||
+				buf[offset + 2 + uin_len] != types[i])
+			{
+				fprintf(stderr, "Invalid contact %d\n", i);
+				exit(1);
+			}
+
+			offset += 3 + uin_len;
+			i++;
+		}
+	}
+
+	if (i != COUNT) {
+		fprintf(stderr, "Received %d contacts, expected %d\n", i, COUNT);
+		exit(1);
+	}
+}
+
+int main(void)
+{
+	struct gg_session *gs;
+	int fds[2], i, round;
+
+#ifdef _WIN32
+	gg_win32_init_network();
+#endif
+
+	gg_debug_level = 0;
+
+	for (i = 0; i < COUNT; i++) {
+		userlist[i] = 1000 + i * 7919;
+		types[i] = (i % 3 == 0) ? GG_USER_OFFLINE : GG_USER_NORMAL;
+	}
+
+	gs = session_new(fds);
+
+	for (round = 0; round < ROUNDS; round++) {
+		if (gg_notify_ex(gs, userlist, types, COUNT) == -1) {
+			perror("gg_notify_ex");
+			exit(1);
+		}
+
+		check_packets(fds[1]);
+
+		if (gs->send_left != 0) {
+			fprintf(stderr, "Data left in queue\n");
+			exit(1);
+		}
+
+		if (gs->private_data->tvbuilder_pool_count != 1 ||
+			gs->private_data->send_spare_count == 0)
+		{
+			fprintf(stderr, "Buffers not returned to pool\n");
+			exit(1);
+		}
+	}
+
+	gg_free_session(gs);
+
+	close(fds[1]);
+
+	printf("okay\n");
+
+	return 0;
+}